@@ -0,0 +1,66 @@
+#include "test_support.h"
+#include "benchmark.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * benchmark_run() on the host core, so a change can be measured without a device:
+ *
+ *   host_benchmark [--days D] [--interval-ms MS] [--queries Q] [--soak-queries N]
+ *   host_benchmark --concurrent S [--rate-hz HZ] [--batch N]
+ *
+ * The second form runs benchmark_concurrent() instead. Defaults are the
+ * CONFIG_BENCHMARK_* and CONFIG_HIGH_RATE_* values; the result is the same
+ * "BENCHMARK {...}" line the firmware prints. Host timings only compare
+ * builds with each other, not with the ESP32.
+ */
+#define USAGE "usage: %s [--days D] [--interval-ms MS] [--queries Q] [--soak-queries N]\n" \
+              "       %s --concurrent S [--rate-hz HZ] [--batch N]\n"
+int main(int argc, char **argv) {
+    uint32_t days = CONFIG_BENCHMARK_DAYS;
+    uint32_t interval_ms = CONFIG_BENCHMARK_INTERVAL_MS;
+    uint32_t queries = CONFIG_BENCHMARK_QUERIES;
+    uint32_t soak_queries = CONFIG_BENCHMARK_SOAK_QUERIES;
+    uint32_t concurrent_s = 0;
+    uint32_t rate_hz = CONFIG_HIGH_RATE_SAMPLE_HZ;
+    uint32_t batch = CONFIG_HIGH_RATE_BATCH_SIZE;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--days") == 0) {
+            days = value;
+        } else if (strcmp(argv[i], "--interval-ms") == 0) {
+            interval_ms = value;
+        } else if (strcmp(argv[i], "--queries") == 0) {
+            queries = value;
+        } else if (strcmp(argv[i], "--soak-queries") == 0) {
+            soak_queries = value;
+        } else if (strcmp(argv[i], "--concurrent") == 0) {
+            concurrent_s = value;
+        } else if (strcmp(argv[i], "--rate-hz") == 0) {
+            rate_hz = value;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = value;
+        } else {
+            fprintf(stderr, USAGE, argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (argc % 2 == 0 || interval_ms == 0) {
+        fprintf(stderr, USAGE, argv[0], argv[0]);
+        return 2;
+    }
+    if (getenv("HOST_FLASH_FILE") == NULL) {
+        unlink("host_benchmark.flash");
+        setenv("HOST_FLASH_FILE", "host_benchmark.flash", 1);
+    }
+
+    test_boot();
+    if (concurrent_s > 0) {
+        benchmark_concurrent(concurrent_s, rate_hz, batch);
+    } else {
+        benchmark_run(days, interval_ms, queries, soak_queries);
+    }
+    return 0;
+}
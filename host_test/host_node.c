@@ -0,0 +1,95 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "compaction.h"
+#include "query_handler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * The firmware core as a process, for mqtt_redis_app/query_load.py --host-core.
+ * Stands in for the device broker over stdin/stdout: every input line is
+ * "<topic>\t<payload>" and every publish is written back the same way.
+ *
+ *   host_node [--hours H] [--interval-ms MS]
+ *
+ * Before printing "ready" it ingests H hours of both series up to the wall
+ * clock, flushing and compacting like the collection and compaction tasks,
+ * so the store holds what fits in NVS just as a device would.
+ */
+#define QUERY_TOPIC "esp32/query"
+#define MAX_LINE 4096
+
+static int write_publish(const char *topic, const char *payload) {
+    static int msg_id;
+    printf("%s\t%s\n", topic, payload);
+    fflush(stdout);
+    return ++msg_id;
+}
+
+static uint64_t wall_clock_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void ingest_history(double hours, uint32_t interval_ms) {
+    uint64_t now = wall_clock_ms();
+    uint64_t span = (uint64_t)(hours * 3600 * 1000);
+    uint64_t first = now - span + interval_ms - (now - span) % interval_ms;
+    for (uint64_t ts = first; ts <= now; ts += interval_ms) {
+        for (uint8_t series_id = 0; series_id < SERIES_COUNT; series_id++) {
+            Measurement m = test_sample(series_id, ts, 20.0f + (float)((ts / interval_ms) % 100) / 10);
+            buffer_add_measurement(&m);
+            if (buffer_is_threshold_full()) {
+                buffer_push_to_flash();
+                compact_storage(ts);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    double hours = 24;
+    uint32_t interval_ms = 20000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--hours") == 0) {
+            hours = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--interval-ms") == 0) {
+            interval_ms = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hours H] [--interval-ms MS]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (interval_ms == 0) {
+        interval_ms = 20000;
+    }
+    // NVS lives in this process; the raw partition file only matters to a backend switch
+    if (getenv("HOST_FLASH_FILE") == NULL) {
+        unlink("host_node.flash");
+        setenv("HOST_FLASH_FILE", "host_node.flash", 1);
+    }
+
+    test_boot();
+    query_handler_set_response_sink(write_publish);
+    ingest_history(hours, interval_ms);
+    printf("ready\n");
+    fflush(stdout);
+
+    static char line[MAX_LINE];
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char *payload = strchr(line, '\t');
+        if (payload == NULL) {
+            continue;
+        }
+        *payload++ = '\0';
+        // The device only subscribes to esp32/query
+        if (strcmp(line, QUERY_TOPIC) == 0) {
+            process_query_message(payload);
+        }
+    }
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,482 @@
+#include "cJSON.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Small recursive-descent cJSON replacement: enough to parse the query
+ * messages and to print responses the way cJSON_PrintUnformatted() does.
+ */
+static void *(*json_malloc)(size_t) = malloc;
+static void (*json_free)(void *) = free;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks) {
+    json_malloc = (hooks && hooks->malloc_fn) ? hooks->malloc_fn : malloc;
+    json_free = (hooks && hooks->free_fn) ? hooks->free_fn : free;
+}
+
+void *cJSON_malloc(size_t size) {
+    return json_malloc(size);
+}
+
+void cJSON_free(void *object) {
+    if (object) {
+        json_free(object);
+    }
+}
+
+static char *json_strdup(const char *s) {
+    size_t n = strlen(s) + 1;
+    char *copy = json_malloc(n);
+    if (copy) {
+        memcpy(copy, s, n);
+    }
+    return copy;
+}
+
+static cJSON *new_item(int type) {
+    cJSON *item = json_malloc(sizeof(cJSON));
+    if (item) {
+        memset(item, 0, sizeof(*item));
+        item->type = type;
+    }
+    return item;
+}
+
+void cJSON_Delete(cJSON *item) {
+    while (item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        cJSON_free(item->valuestring);
+        cJSON_free(item->string);
+        json_free(item);
+        item = next;
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    const char *p;
+    const char *end;
+} Parser;
+
+static void skip_space(Parser *ps) {
+    while (ps->p < ps->end && isspace((unsigned char)*ps->p)) {
+        ps->p++;
+    }
+}
+
+static bool take_word(Parser *ps, const char *word) {
+    size_t n = strlen(word);
+    if ((size_t)(ps->end - ps->p) >= n && strncmp(ps->p, word, n) == 0) {
+        ps->p += n;
+        return true;
+    }
+    return false;
+}
+
+// Only \uXXXX escapes below 0x80 are decoded; the firmware never sends others
+static char *parse_string(Parser *ps) {
+    if (ps->p >= ps->end || *ps->p != '"') {
+        return NULL;
+    }
+    ps->p++;
+    const char *start = ps->p;
+    while (ps->p < ps->end && *ps->p != '"') {
+        ps->p += (*ps->p == '\\') ? 2 : 1;
+    }
+    if (ps->p >= ps->end) {
+        return NULL;
+    }
+    char *out = json_malloc((size_t)(ps->p - start) + 1);
+    if (out == NULL) {
+        return NULL;
+    }
+    size_t n = 0;
+    for (const char *s = start; s < ps->p; s++) {
+        if (*s != '\\') {
+            out[n++] = *s;
+            continue;
+        }
+        s++;
+        switch (*s) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'u': {
+                char hex[5] = { 0 };
+                strncpy(hex, s + 1, 4);
+                long code = strtol(hex, NULL, 16);
+                out[n++] = code < 0x80 ? (char)code : '?';
+                s += 4;
+                break;
+            }
+            default: out[n++] = *s; break;
+        }
+    }
+    out[n] = '\0';
+    ps->p++;
+    return out;
+}
+
+static cJSON *parse_value(Parser *ps, int depth);
+
+static cJSON *parse_container(Parser *ps, int depth, bool object) {
+    cJSON *item = new_item(object ? cJSON_Object : cJSON_Array);
+    if (item == NULL) {
+        return NULL;
+    }
+    char close = object ? '}' : ']';
+    ps->p++;
+    skip_space(ps);
+    if (ps->p < ps->end && *ps->p == close) {
+        ps->p++;
+        return item;
+    }
+    cJSON *last = NULL;
+    for (;;) {
+        char *key = NULL;
+        skip_space(ps);
+        if (object) {
+            key = parse_string(ps);
+            skip_space(ps);
+            if (key == NULL || ps->p >= ps->end || *ps->p != ':') {
+                cJSON_free(key);
+                break;
+            }
+            ps->p++;
+        }
+        cJSON *child = parse_value(ps, depth + 1);
+        if (child == NULL) {
+            cJSON_free(key);
+            break;
+        }
+        child->string = key;
+        if (last) {
+            last->next = child;
+            child->prev = last;
+        } else {
+            item->child = child;
+        }
+        last = child;
+        skip_space(ps);
+        if (ps->p < ps->end && *ps->p == ',') {
+            ps->p++;
+            continue;
+        }
+        if (ps->p < ps->end && *ps->p == close) {
+            ps->p++;
+            return item;
+        }
+        break;
+    }
+    cJSON_Delete(item);
+    return NULL;
+}
+
+static cJSON *parse_value(Parser *ps, int depth) {
+    skip_space(ps);
+    if (ps->p >= ps->end || depth > 32) {
+        return NULL;
+    }
+    if (*ps->p == '{' || *ps->p == '[') {
+        return parse_container(ps, depth, *ps->p == '{');
+    }
+    if (*ps->p == '"') {
+        char *s = parse_string(ps);
+        cJSON *item = s ? new_item(cJSON_String) : NULL;
+        if (item == NULL) {
+            cJSON_free(s);
+            return NULL;
+        }
+        item->valuestring = s;
+        return item;
+    }
+    if (take_word(ps, "true")) {
+        cJSON *item = new_item(cJSON_True);
+        if (item) {
+            item->valueint = 1;
+        }
+        return item;
+    }
+    if (take_word(ps, "false")) {
+        return new_item(cJSON_False);
+    }
+    if (take_word(ps, "null")) {
+        return new_item(cJSON_NULL);
+    }
+    char *end = NULL;
+    double number = strtod(ps->p, &end);
+    if (end == ps->p || end > ps->end) {
+        return NULL;
+    }
+    ps->p = end;
+    return cJSON_CreateNumber(number);
+}
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length) {
+    if (value == NULL) {
+        return NULL;
+    }
+    Parser ps = { value, value + buffer_length };
+    cJSON *item = parse_value(&ps, 0);
+    skip_space(&ps);
+    if (item && ps.p < ps.end && *ps.p != '\0') {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_Parse(const char *value) {
+    return value ? cJSON_ParseWithLength(value, strlen(value)) : NULL;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+} Printer;
+
+static void put(Printer *pr, const char *text, size_t n) {
+    if (pr->failed) {
+        return;
+    }
+    if (pr->len + n + 1 > pr->cap) {
+        size_t cap = (pr->cap + n + 1) * 2;
+        char *grown = json_malloc(cap);
+        if (grown == NULL) {
+            pr->failed = true;
+            return;
+        }
+        if (pr->buf) {
+            memcpy(grown, pr->buf, pr->len);
+            json_free(pr->buf);
+        }
+        pr->buf = grown;
+        pr->cap = cap;
+    }
+    memcpy(pr->buf + pr->len, text, n);
+    pr->len += n;
+    pr->buf[pr->len] = '\0';
+}
+
+static void put_string(Printer *pr, const char *s) {
+    put(pr, "\"", 1);
+    for (; *s; s++) {
+        char esc[8];
+        switch (*s) {
+            case '"': put(pr, "\\\"", 2); break;
+            case '\\': put(pr, "\\\\", 2); break;
+            case '\n': put(pr, "\\n", 2); break;
+            case '\t': put(pr, "\\t", 2); break;
+            case '\r': put(pr, "\\r", 2); break;
+            default:
+                if ((unsigned char)*s < 0x20) {
+                    snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*s);
+                    put(pr, esc, 6);
+                } else {
+                    put(pr, s, 1);
+                }
+                break;
+        }
+    }
+    put(pr, "\"", 1);
+}
+
+// Same number format as cJSON: integers exactly, everything else round-tripping
+static void put_number(Printer *pr, double d) {
+    char text[32];
+    if (isnan(d) || isinf(d)) {
+        snprintf(text, sizeof(text), "null");
+    } else if (d == (double)(long long)d && fabs(d) < 1e15) {
+        snprintf(text, sizeof(text), "%lld", (long long)d);
+    } else {
+        snprintf(text, sizeof(text), "%1.15g", d);
+        if (strtod(text, NULL) != d) {
+            snprintf(text, sizeof(text), "%1.17g", d);
+        }
+    }
+    put(pr, text, strlen(text));
+}
+
+static void print_item(Printer *pr, const cJSON *item) {
+    switch (item->type & 0xFF) {
+        case cJSON_False: put(pr, "false", 5); break;
+        case cJSON_True: put(pr, "true", 4); break;
+        case cJSON_NULL: put(pr, "null", 4); break;
+        case cJSON_Number: put_number(pr, item->valuedouble); break;
+        case cJSON_String: put_string(pr, item->valuestring ? item->valuestring : ""); break;
+        case cJSON_Array:
+        case cJSON_Object: {
+            bool object = (item->type & 0xFF) == cJSON_Object;
+            put(pr, object ? "{" : "[", 1);
+            for (const cJSON *child = item->child; child; child = child->next) {
+                if (object) {
+                    put_string(pr, child->string ? child->string : "");
+                    put(pr, ":", 1);
+                }
+                print_item(pr, child);
+                if (child->next) {
+                    put(pr, ",", 1);
+                }
+            }
+            put(pr, object ? "}" : "]", 1);
+            break;
+        }
+        default: pr->failed = true; break;
+    }
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item) {
+    if (item == NULL) {
+        return NULL;
+    }
+    Printer pr = { 0 };
+    print_item(&pr, item);
+    if (pr.failed) {
+        cJSON_free(pr.buf);
+        return NULL;
+    }
+    return pr.buf;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int cJSON_GetArraySize(const cJSON *array) {
+    int n = 0;
+    for (const cJSON *c = array ? array->child : NULL; c; c = c->next) {
+        n++;
+    }
+    return n;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index) {
+    cJSON *c = array ? array->child : NULL;
+    while (c && index-- > 0) {
+        c = c->next;
+    }
+    return c;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+    for (cJSON *c = object ? object->child : NULL; c && string; c = c->next) {
+        if (c->string && strcasecmp(c->string, string) == 0) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string) {
+    for (cJSON *c = object ? object->child : NULL; c && string; c = c->next) {
+        if (c->string && strcmp(c->string, string) == 0) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+cJSON_bool cJSON_IsFalse(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_False; }
+cJSON_bool cJSON_IsTrue(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_True; }
+cJSON_bool cJSON_IsBool(const cJSON *item) { return item && (item->type & (cJSON_True | cJSON_False)); }
+cJSON_bool cJSON_IsNull(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_NULL; }
+cJSON_bool cJSON_IsNumber(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_Number; }
+cJSON_bool cJSON_IsString(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_String; }
+cJSON_bool cJSON_IsArray(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_Array; }
+cJSON_bool cJSON_IsObject(const cJSON *item) { return item && (item->type & 0xFF) == cJSON_Object; }
+// ─────────────────────────────────────────────────────────────────────────────
+cJSON *cJSON_CreateBool(cJSON_bool boolean) {
+    return new_item(boolean ? cJSON_True : cJSON_False);
+}
+
+cJSON *cJSON_CreateNumber(double num) {
+    cJSON *item = new_item(cJSON_Number);
+    if (item) {
+        item->valuedouble = num;
+        item->valueint = num >= 2147483647.0 ? 2147483647 : num <= -2147483648.0 ? (-2147483647 - 1) : (int)num;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string) {
+    cJSON *item = new_item(cJSON_String);
+    if (item) {
+        item->valuestring = json_strdup(string);
+        if (item->valuestring == NULL) {
+            cJSON_Delete(item);
+            return NULL;
+        }
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateArray(void) {
+    return new_item(cJSON_Array);
+}
+
+cJSON *cJSON_CreateObject(void) {
+    return new_item(cJSON_Object);
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item) {
+    if (array == NULL || item == NULL) {
+        return 0;
+    }
+    if (array->child == NULL) {
+        array->child = item;
+        return 1;
+    }
+    cJSON *last = array->child;
+    while (last->next) {
+        last = last->next;
+    }
+    last->next = item;
+    item->prev = last;
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item) {
+    if (object == NULL || item == NULL || string == NULL) {
+        return 0;
+    }
+    char *key = json_strdup(string);
+    if (key == NULL) {
+        return 0;
+    }
+    cJSON_free(item->string);
+    item->string = key;
+    return cJSON_AddItemToArray(object, item);
+}
+
+static cJSON *add_or_delete(cJSON *object, const char *name, cJSON *item) {
+    if (cJSON_AddItemToObject(object, name, item)) {
+        return item;
+    }
+    cJSON_Delete(item);
+    return NULL;
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name, cJSON_bool boolean) {
+    return add_or_delete(object, name, cJSON_CreateBool(boolean));
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number) {
+    return add_or_delete(object, name, cJSON_CreateNumber(number));
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name, const char *string) {
+    return add_or_delete(object, name, cJSON_CreateString(string));
+}
+
+cJSON *cJSON_AddObjectToObject(cJSON *object, const char *name) {
+    return add_or_delete(object, name, cJSON_CreateObject());
+}
+
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name) {
+    return add_or_delete(object, name, cJSON_CreateArray());
+}
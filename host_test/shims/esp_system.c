@@ -0,0 +1,104 @@
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include <stdlib.h>
+#include <time.h>
+#if defined(__SANITIZE_ADDRESS__)
+#define HOST_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define HOST_ASAN 1
+#endif
+#endif
+#if HOST_ASAN
+size_t __sanitizer_get_current_allocated_bytes(void);  // ASan's replacement of the malloc stats
+#else
+#include <malloc.h>
+#endif
+// ─────────────────────────────────────────────────────────────────────────────
+int host_log_enabled;
+
+__attribute__((constructor)) static void host_log_from_env(void) {
+    host_log_enabled = getenv("HOST_LOG") != NULL;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+const char *esp_err_to_name(esp_err_t err) {
+    switch (err) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_NOT_ENOUGH_SPACE: return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        default: return "ESP_ERR_UNKNOWN";
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Deterministic, so a failing test fails the same way every run
+uint32_t esp_random(void) {
+    static uint32_t state = 0x12345678;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// The process heap seen as a device heap of HOST_HEAP_SIZE, so allocations that are not
+// given back show as a drop in free memory (the benchmark soak checks it stays level)
+#define HOST_HEAP_SIZE (8 * 1024 * 1024)
+
+static size_t heap_in_use(void) {
+#if HOST_ASAN
+    return __sanitizer_get_current_allocated_bytes();
+#else
+    return mallinfo2().uordblks;
+#endif
+}
+
+static size_t heap_free(void) {
+    size_t used = heap_in_use();
+    return used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return (uint32_t)heap_free();
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return (uint32_t)heap_free();
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return heap_free();
+}
+
+// The host allocator cannot report fragmentation, so this only follows the free size
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return heap_free();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return heap_free();
+}
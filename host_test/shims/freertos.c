@@ -0,0 +1,139 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+// ─────────────────────────────────────────────────────────────────────────────
+struct HostSemaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool available;
+};
+
+static SemaphoreHandle_t create_semaphore(bool available) {
+    SemaphoreHandle_t sem = calloc(1, sizeof(*sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->available = available;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return create_semaphore(true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return create_semaphore(false);
+}
+
+static struct timespec deadline_after(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    struct timespec deadline = deadline_after(ticks == portMAX_DELAY ? 0 : ticks);
+    pthread_mutex_lock(&sem->lock);
+    while (!sem->available) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&sem->cond, &sem->lock);
+        } else if (pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool taken = sem->available;
+    sem->available = false;
+    pthread_mutex_unlock(&sem->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    sem->available = true;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    free(sem);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+} TaskStart;
+
+static void *task_entry(void *p) {
+    TaskStart start = *(TaskStart *)p;
+    free(p);
+    start.fn(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    TaskStart *start = malloc(sizeof(*start));
+    pthread_t thread;
+    if (start == NULL) {
+        return pdFAIL;
+    }
+    start->fn = fn;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, task_entry, start) != 0) {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = (TaskHandle_t)thread;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    if (handle == NULL) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t)ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment) {
+    TickType_t target = *previous_wake + increment;
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(target - now) > 0) {
+        vTaskDelay(target - now);
+    }
+    *previous_wake = target;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return (TaskHandle_t)pthread_self();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+    return 1024;
+}
@@ -0,0 +1,113 @@
+#include "esp_http_server.h"
+#include "host_shims.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+#define HOST_HTTPD_MAX_HANDLERS 8
+
+struct HostHttpRequest {
+    const char *query;
+    HostHttpResponse *response;
+    bool finished;
+};
+
+static httpd_uri_t handlers[HOST_HTTPD_MAX_HANDLERS];
+static size_t handler_count;
+static int fail_after_chunks = -1;
+
+void host_httpd_fail_after(int chunks) {
+    fail_after_chunks = chunks;
+}
+
+bool host_httpd_get(const char *uri, const char *query, HostHttpResponse *response) {
+    memset(response, 0, sizeof(*response));
+    for (size_t i = 0; i < handler_count; i++) {
+        if (strcmp(handlers[i].uri, uri) == 0 && handlers[i].method == HTTP_GET) {
+            struct HostHttpRequest req = { query, response, false };
+            handlers[i].handler(&req);
+            return true;
+        }
+    }
+    return false;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    handler_count = 0;
+    *handle = (httpd_handle_t)handlers;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    if (handler_count == HOST_HTTPD_MAX_HANDLERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    handlers[handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len) {
+    if (req->query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (strlen(req->query) >= buf_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    strcpy(buf, req->query);
+    return ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *query, const char *key, char *val, size_t val_size) {
+    size_t key_len = strlen(key);
+    for (const char *p = query; p != NULL && *p != '\0'; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+        if (strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            const char *value = p + key_len + 1;
+            size_t n = strcspn(value, "&");
+            if (n >= val_size) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            memcpy(val, value, n);
+            val[n] = '\0';
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+    HostHttpResponse *resp = req->response;
+    if (fail_after_chunks >= 0 && resp->chunks >= (size_t)fail_after_chunks) {
+        return ESP_FAIL;
+    }
+    if (buf == NULL || buf_len == 0) {
+        resp->status = 200;
+        req->finished = true;
+        return ESP_OK;
+    }
+    char *grown = realloc(resp->body, resp->length + (size_t)buf_len + 1);
+    if (grown == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(grown + resp->length, buf, (size_t)buf_len);
+    resp->body = grown;
+    resp->length += (size_t)buf_len;
+    resp->body[resp->length] = '\0';
+    resp->chunks++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *message) {
+    req->response->status = (int)error;
+    free(req->response->body);
+    req->response->body = strdup(message);
+    req->response->length = strlen(message);
+    return ESP_OK;
+}
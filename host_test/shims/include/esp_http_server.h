@@ -0,0 +1,49 @@
+#ifndef HOST_ESP_HTTP_SERVER_H
+#define HOST_ESP_HTTP_SERVER_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * esp_http_server without sockets: registered handlers are kept so a test can
+ * run a request through host_httpd_get() (see host_shims.h), which collects
+ * the chunks the handler sends.
+ */
+typedef void *httpd_handle_t;
+typedef struct HostHttpRequest httpd_req_t;
+
+typedef enum {
+    HTTP_GET = 1,
+} httpd_method_t;
+
+typedef enum {
+    HTTPD_400_BAD_REQUEST = 400,
+    HTTPD_500_INTERNAL_SERVER_ERROR = 500,
+} httpd_err_code_t;
+
+typedef struct {
+    uint16_t server_port;
+    size_t stack_size;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() ((httpd_config_t){ .server_port = 80, .stack_size = 4096 })
+
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+} httpd_uri_t;
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *query, const char *key, char *val, size_t val_size);
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *message);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_ESP_HTTP_SERVER_H
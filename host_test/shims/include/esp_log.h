@@ -0,0 +1,26 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "esp_err.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/* Logs go to stderr when HOST_LOG is set in the environment, and nowhere otherwise */
+extern int host_log_enabled;
+
+#define HOST_LOG(letter, tag, fmt, ...) do {                                      \
+        if (host_log_enabled) {                                                   \
+            fprintf(stderr, letter " (%s) " fmt "\n", tag, ##__VA_ARGS__);        \
+        }                                                                         \
+    } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) HOST_LOG("D", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) HOST_LOG("V", tag, fmt, ##__VA_ARGS__)
+
+uint32_t esp_log_timestamp(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_ESP_LOG_H
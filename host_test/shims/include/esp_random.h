@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_RANDOM_H
+#define HOST_ESP_RANDOM_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+// ─────────────────────────────────────────────────────────────────────────────
+uint32_t esp_random(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_ESP_RANDOM_H
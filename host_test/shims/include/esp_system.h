@@ -0,0 +1,22 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_random.h"
+// ─────────────────────────────────────────────────────────────────────────────
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_TASK_WDT,
+    ESP_RST_BROWNOUT,
+} esp_reset_reason_t;
+
+/* Heap figures follow the process's allocations (see esp_system.c) */
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+esp_reset_reason_t esp_reset_reason(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_ESP_SYSTEM_H
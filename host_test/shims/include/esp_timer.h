@@ -0,0 +1,10 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include "esp_err.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/* Microseconds on the host's monotonic clock */
+int64_t esp_timer_get_time(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_ESP_TIMER_H
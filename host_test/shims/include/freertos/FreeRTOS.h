@@ -0,0 +1,29 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Host stand-in for the parts of FreeRTOS the firmware uses: tasks are
+ * pthreads, semaphores are a mutex plus condition variable, and one tick is
+ * one millisecond.
+ */
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define BIT0 0x01
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_FREERTOS_H
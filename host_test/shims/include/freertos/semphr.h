@@ -0,0 +1,14 @@
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include "freertos/FreeRTOS.h"
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct HostSemaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_SEMPHR_H
@@ -0,0 +1,16 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include "freertos/FreeRTOS.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/* Stack size and priority are ignored; every task is a detached pthread */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_TASK_H
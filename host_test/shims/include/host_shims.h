@@ -0,0 +1,44 @@
+#ifndef HOST_SHIMS_H
+#define HOST_SHIMS_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Test-side controls of the host shims. Nothing in main/ includes this file;
+ * the firmware only sees the ESP-IDF APIs the shims implement.
+ */
+/* Entries of the default 24 KB partition: 6 pages of 126, one kept free by NVS */
+#define HOST_NVS_DEFAULT_ENTRIES 630
+
+/* Drops every key, as after nvs_flash_erase() */
+void host_nvs_reset(void);
+/* Partition size in 32-byte entries; writes that would not fit fail with NOT_ENOUGH_SPACE */
+void host_nvs_set_capacity(size_t entries);
+/* Keys in the namespace starting with `prefix` ("" counts all) */
+size_t host_nvs_count_keys(const char *name_space, const char *prefix);
+/* Makes the next `count` sets (or erases) of keys starting with `prefix` fail */
+void host_nvs_fail_sets(const char *prefix, int count);
+void host_nvs_fail_erases(const char *prefix, int count);
+/* Writes every key to `path` / replaces the contents with such an image, so a later process can boot over it */
+bool host_nvs_save(const char *path);
+bool host_nvs_load(const char *path);
+// ─────────────────────────────────────────────────────────────────────────────
+/* Receives every esp_mqtt_client_publish(); returns the message id or -1 */
+typedef int (*host_publish_hook_t)(const char *topic, const char *payload, size_t len);
+void host_mqtt_set_publish_hook(host_publish_hook_t hook);
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    int status;         // 200, or the code passed to httpd_resp_send_err()
+    char *body;         // NUL terminated; free()
+    size_t length;
+    size_t chunks;
+} HostHttpResponse;
+
+/* Runs the handler registered for `uri` with `query` (NULL for none) */
+bool host_httpd_get(const char *uri, const char *query, HostHttpResponse *response);
+/* Fails every chunk after the first `chunks`, like a client that went away (-1 = never) */
+void host_httpd_fail_after(int chunks);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_SHIMS_H
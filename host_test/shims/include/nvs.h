@@ -0,0 +1,59 @@
+#ifndef HOST_NVS_H
+#define HOST_NVS_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * In-memory NVS: keys live until erased or host_nvs_reset(), so a test can
+ * "reboot" by re-running init_nvs() over the same contents. Space is
+ * accounted in 32-byte entries like the real partition (see host_shims.h).
+ */
+#define NVS_DEFAULT_PART_NAME "nvs"
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+typedef enum {
+    NVS_TYPE_U32 = 0x04,
+    NVS_TYPE_BLOB = 0x42,
+    NVS_TYPE_ANY = 0xff,
+} nvs_type_t;
+
+typedef struct {
+    size_t used_entries;
+    size_t free_entries;
+    size_t available_entries;
+    size_t total_entries;
+    size_t namespace_count;
+} nvs_stats_t;
+
+typedef struct {
+    char namespace_name[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_type_t type;
+} nvs_entry_info_t;
+
+typedef struct HostNvsIterator *nvs_iterator_t;
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t mode, nvs_handle_t *handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_erase_all(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_get_stats(const char *part_name, nvs_stats_t *stats);
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t nvs_entry_find(const char *part_name, const char *name_space, nvs_type_t type, nvs_iterator_t *it);
+esp_err_t nvs_entry_next(nvs_iterator_t *it);
+esp_err_t nvs_entry_info(const nvs_iterator_t it, nvs_entry_info_t *info);
+void nvs_release_iterator(nvs_iterator_t it);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HOST_NVS_H
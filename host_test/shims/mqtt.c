@@ -0,0 +1,44 @@
+#include "mqtt_client.h"
+#include "host_shims.h"
+#include <stdlib.h>
+// ─────────────────────────────────────────────────────────────────────────────
+struct HostMqttClient {
+    int next_msg_id;
+};
+
+static host_publish_hook_t publish_hook;
+
+void host_mqtt_set_publish_hook(host_publish_hook_t hook) {
+    publish_hook = hook;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    return calloc(1, sizeof(struct HostMqttClient));
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_arg) {
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    return ESP_OK;
+}
+
+/* Without a hook every publish succeeds, as if the outbox took it */
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain) {
+    size_t length = len > 0 ? (size_t)len : strlen(data);
+    if (publish_hook != NULL) {
+        return publish_hook(topic, data, length);
+    }
+    return client ? ++client->next_msg_id : 1;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos) {
+    return 1;
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) {
+    return 0;
+}
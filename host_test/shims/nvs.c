@@ -0,0 +1,371 @@
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_shims.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+#define HOST_NVS_MAX_KEYS 8192
+#define HOST_NVS_MAX_HANDLES 64
+#define HOST_NVS_ENTRY_SIZE 32
+
+typedef struct {
+    bool used;
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t *value;
+    size_t length;
+} HostNvsItem;
+
+typedef struct {
+    bool open;
+    bool writable;
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+} HostNvsHandle;
+
+struct HostNvsIterator {
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+    size_t pos;
+};
+
+typedef struct {
+    char prefix[NVS_KEY_NAME_MAX_SIZE];
+    int remaining;
+} HostNvsFault;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static HostNvsItem items[HOST_NVS_MAX_KEYS];
+static HostNvsHandle handles[HOST_NVS_MAX_HANDLES];
+static size_t capacity_entries = HOST_NVS_DEFAULT_ENTRIES;
+static HostNvsFault set_fault, erase_fault;
+// ─────────────────────────────────────────────────────────────────────────────
+// Item header, blob index and data entries, as nvs_utils.c accounts them
+static size_t entries_for(size_t length) {
+    return 2 + (length + HOST_NVS_ENTRY_SIZE - 1) / HOST_NVS_ENTRY_SIZE;
+}
+
+static size_t used_entries_locked(void) {
+    size_t used = 0;
+    for (size_t i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        if (items[i].used) {
+            used += entries_for(items[i].length);
+        }
+    }
+    return used;
+}
+
+static HostNvsItem *find_locked(const char *name_space, const char *key) {
+    for (size_t i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        if (items[i].used && strcmp(items[i].name_space, name_space) == 0 && strcmp(items[i].key, key) == 0) {
+            return &items[i];
+        }
+    }
+    return NULL;
+}
+
+static bool fault_hits_locked(HostNvsFault *fault, const char *key) {
+    if (fault->remaining <= 0 || strncmp(key, fault->prefix, strlen(fault->prefix)) != 0) {
+        return false;
+    }
+    fault->remaining--;
+    return true;
+}
+
+static HostNvsHandle *handle_get(nvs_handle_t handle) {
+    return (handle < HOST_NVS_MAX_HANDLES && handles[handle].open) ? &handles[handle] : NULL;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    host_nvs_reset();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    if (strlen(name_space) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    for (nvs_handle_t h = 1; h < HOST_NVS_MAX_HANDLES; h++) {
+        if (!handles[h].open) {
+            handles[h].open = true;
+            handles[h].writable = mode == NVS_READWRITE;
+            strcpy(handles[h].name_space, name_space);
+            *handle = h;
+            pthread_mutex_unlock(&nvs_lock);
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    if (handle < HOST_NVS_MAX_HANDLES) {
+        handles[handle].open = false;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length) {
+    pthread_mutex_lock(&nvs_lock);
+    HostNvsHandle *h = handle_get(handle);
+    HostNvsItem *item = h ? find_locked(h->name_space, key) : NULL;
+    esp_err_t err = ESP_OK;
+    if (h == NULL) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (item == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out != NULL && *length < item->length) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        if (out != NULL) {
+            memcpy(out, item->value, item->length);
+        }
+        *length = item->length;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    HostNvsHandle *h = handle_get(handle);
+    HostNvsItem *item = h ? find_locked(h->name_space, key) : NULL;
+    if (h == NULL || !h->writable) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (fault_hits_locked(&set_fault, key)) {
+        err = ESP_FAIL;
+    } else if (used_entries_locked() - (item ? entries_for(item->length) : 0) + entries_for(length) >
+               capacity_entries) {
+        err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    } else {
+        for (size_t i = 0; item == NULL && i < HOST_NVS_MAX_KEYS; i++) {
+            if (!items[i].used) {
+                item = &items[i];
+                item->used = true;
+                strcpy(item->name_space, h->name_space);
+                strcpy(item->key, key);
+                item->value = NULL;
+                item->length = 0;
+            }
+        }
+        uint8_t *copy = malloc(length ? length : 1);
+        if (item == NULL || copy == NULL) {
+            free(copy);
+            err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        } else {
+            memcpy(copy, value, length);
+            free(item->value);
+            item->value = copy;
+            item->length = length;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_OK;
+    HostNvsHandle *h = handle_get(handle);
+    HostNvsItem *item = h ? find_locked(h->name_space, key) : NULL;
+    if (h == NULL || !h->writable) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (item == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (fault_hits_locked(&erase_fault, key)) {
+        err = ESP_FAIL;
+    } else {
+        free(item->value);
+        memset(item, 0, sizeof(*item));
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    HostNvsHandle *h = handle_get(handle);
+    for (size_t i = 0; h != NULL && i < HOST_NVS_MAX_KEYS; i++) {
+        if (items[i].used && strcmp(items[i].name_space, h->name_space) == 0) {
+            free(items[i].value);
+            memset(&items[i], 0, sizeof(items[i]));
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return h ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_stats(const char *part_name, nvs_stats_t *stats) {
+    pthread_mutex_lock(&nvs_lock);
+    size_t used = used_entries_locked();
+    pthread_mutex_unlock(&nvs_lock);
+    stats->total_entries = capacity_entries;
+    stats->used_entries = used;
+    stats->free_entries = capacity_entries > used ? capacity_entries - used : 0;
+    stats->available_entries = stats->free_entries;
+    stats->namespace_count = 1;
+    return ESP_OK;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Advances to the next item of the namespace at or after it->pos. Caller holds the lock.
+static bool seek_locked(struct HostNvsIterator *it) {
+    for (; it->pos < HOST_NVS_MAX_KEYS; it->pos++) {
+        if (items[it->pos].used && strcmp(items[it->pos].name_space, it->name_space) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *name_space, nvs_type_t type, nvs_iterator_t *it) {
+    struct HostNvsIterator *iter = calloc(1, sizeof(*iter));
+    *it = NULL;
+    if (iter == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(iter->name_space, name_space, NVS_KEY_NAME_MAX_SIZE - 1);
+    pthread_mutex_lock(&nvs_lock);
+    bool found = seek_locked(iter);
+    pthread_mutex_unlock(&nvs_lock);
+    if (!found) {
+        free(iter);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *it = iter;
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *it) {
+    (*it)->pos++;
+    pthread_mutex_lock(&nvs_lock);
+    bool found = seek_locked(*it);
+    pthread_mutex_unlock(&nvs_lock);
+    if (!found) {
+        free(*it);
+        *it = NULL;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t it, nvs_entry_info_t *info) {
+    pthread_mutex_lock(&nvs_lock);
+    strcpy(info->namespace_name, it->name_space);
+    strcpy(info->key, items[it->pos].key);
+    info->type = NVS_TYPE_BLOB;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t it) {
+    free(it);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void host_nvs_reset(void) {
+    pthread_mutex_lock(&nvs_lock);
+    for (size_t i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        free(items[i].value);
+        memset(&items[i], 0, sizeof(items[i]));
+    }
+    memset(&set_fault, 0, sizeof(set_fault));
+    memset(&erase_fault, 0, sizeof(erase_fault));
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void host_nvs_set_capacity(size_t entries) {
+    pthread_mutex_lock(&nvs_lock);
+    capacity_entries = entries;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+size_t host_nvs_count_keys(const char *name_space, const char *prefix) {
+    size_t n = 0;
+    pthread_mutex_lock(&nvs_lock);
+    for (size_t i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        if (items[i].used && strcmp(items[i].name_space, name_space) == 0 &&
+            strncmp(items[i].key, prefix, strlen(prefix)) == 0) {
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return n;
+}
+
+static void arm_fault(HostNvsFault *fault, const char *prefix, int count) {
+    pthread_mutex_lock(&nvs_lock);
+    strncpy(fault->prefix, prefix, NVS_KEY_NAME_MAX_SIZE - 1);
+    fault->remaining = count;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+void host_nvs_fail_sets(const char *prefix, int count) {
+    arm_fault(&set_fault, prefix, count);
+}
+
+void host_nvs_fail_erases(const char *prefix, int count) {
+    arm_fault(&erase_fault, prefix, count);
+}
+
+// Image layout: per key, namespace and key (NVS_KEY_NAME_MAX_SIZE bytes each), uint32 length, value
+bool host_nvs_save(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = true;
+    pthread_mutex_lock(&nvs_lock);
+    for (size_t i = 0; i < HOST_NVS_MAX_KEYS && ok; i++) {
+        if (!items[i].used) {
+            continue;
+        }
+        uint32_t length = (uint32_t)items[i].length;
+        ok = fwrite(items[i].name_space, NVS_KEY_NAME_MAX_SIZE, 1, f) == 1 &&
+             fwrite(items[i].key, NVS_KEY_NAME_MAX_SIZE, 1, f) == 1 &&
+             fwrite(&length, sizeof(length), 1, f) == 1 &&
+             (length == 0 || fwrite(items[i].value, length, 1, f) == 1);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return fclose(f) == 0 && ok;
+}
+
+bool host_nvs_load(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    host_nvs_reset();
+    bool ok = true;
+    pthread_mutex_lock(&nvs_lock);
+    for (size_t i = 0; i < HOST_NVS_MAX_KEYS && ok; i++) {
+        HostNvsItem *item = &items[i];
+        uint32_t length;
+        if (fread(item->name_space, NVS_KEY_NAME_MAX_SIZE, 1, f) != 1) {
+            memset(item, 0, sizeof(*item));
+            break;
+        }
+        ok = fread(item->key, NVS_KEY_NAME_MAX_SIZE, 1, f) == 1 && fread(&length, sizeof(length), 1, f) == 1;
+        item->value = ok ? malloc(length ? length : 1) : NULL;
+        ok = item->value != NULL && (length == 0 || fread(item->value, length, 1, f) == 1);
+        item->length = length;
+        item->used = ok;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,104 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "mem_pool.h"
+#include "nvs_utils.h"
+#include "segment_list.h"
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Switching CONFIG_STORAGE_RAW_PARTITION over existing data. Built once per
+ * backend: "write" leaves an NVS image behind, and the other build boots
+ * over it in "switch" (ctest fixtures order the two).
+ */
+#define FLUSH_AT (BUFFER_CAPACITY_MACRO * BUFFER_THRESHOLD_PERCENT / 100)
+#define SAMPLES (5 * FLUSH_AT)
+
+#if CONFIG_STORAGE_RAW_PARTITION
+#define THIS_BUILD "test_backend_raw"
+#define OTHER_BUILD "test_backend_nvs"
+#else
+#define THIS_BUILD "test_backend_nvs"
+#define OTHER_BUILD "test_backend_raw"
+#endif
+
+static Measurement readback[2 * SAMPLES];
+
+static void write_history(void) {
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, SAMPLES);
+    test_ingest_series(SERIES_HUMIDITY, TEST_BASE_TS + 10 * SAMPLES * 1000, 1000, SAMPLES);
+}
+
+static void check_history(void) {
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, SAMPLES), SAMPLES);
+    CHECK_EQ(test_read_flash(SERIES_HUMIDITY, 0, UINT64_MAX, readback, SAMPLES), SAMPLES);
+}
+
+// Boots over the NVS the other build left; the raw build's partition file comes with it
+static void load_other_build(void) {
+    CHECK(host_nvs_load(OTHER_BUILD ".nvs"));
+#if !CONFIG_STORAGE_RAW_PARTITION
+    FILE *in = fopen(OTHER_BUILD ".write.flash", "rb");
+    FILE *out = fopen(getenv("HOST_FLASH_FILE"), "wb");
+    CHECK(in != NULL && out != NULL);
+    char chunk[4096];
+    size_t n;
+    while (in != NULL && out != NULL && (n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        fwrite(chunk, 1, n, out);
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+#endif
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_write_image(void) {
+    test_boot();
+    write_history();
+    check_history();
+    CHECK(host_nvs_save(THIS_BUILD ".nvs"));
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_switch_moves_segments(void) {
+    load_other_build();
+    test_boot();
+    size_t segments = test_segment_count(SERIES_TEMPERATURE);
+    CHECK_EQ(segments, SAMPLES / FLUSH_AT);
+    check_history();
+    // Only the lists, manifest and WAL keep their keys; the blobs left NVS or came into it
+    size_t blob_keys = host_nvs_count_keys("storage", "seg_0");
+    CHECK_EQ(blob_keys, CONFIG_STORAGE_RAW_PARTITION ? 0 : segments + test_segment_count(SERIES_HUMIDITY));
+
+    // The next boot finds the manifest on this backend and moves nothing
+    test_reboot();
+    check_history();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS + SAMPLES * 1000, 1000, SAMPLES);
+    test_reboot();
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 2 * SAMPLES), 2 * SAMPLES);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+#if !CONFIG_STORAGE_RAW_PARTITION
+static void test_unreachable_partition_refuses_mount(void) {
+    CHECK(host_nvs_load(OTHER_BUILD ".nvs"));
+    setenv("HOST_FLASH_FILE", "missing-dir/tsdata.flash", 1);
+    mem_pool_init();
+    CHECK_EQ(init_nvs(), ESP_ERR_INVALID_STATE);
+    // Nothing is dropped, so the right build can still mount it
+    segment_list_init();
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), SAMPLES / FLUSH_AT);
+}
+#endif
+// ─────────────────────────────────────────────────────────────────────────────
+int main(int argc, char **argv) {
+    static const TestCase cases[] = {
+        { "write", test_write_image },
+        { "switch", test_switch_moves_segments },
+#if !CONFIG_STORAGE_RAW_PARTITION
+        { "refused", test_unreachable_partition_refuses_mount },
+#endif
+    };
+    return run_test_cases(argc, argv, cases, sizeof(cases) / sizeof(cases[0]));
+}
@@ -0,0 +1,162 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "nvs_utils.h"
+#include "offload.h"
+#include "segment_list.h"
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/* Offload of stored segments to the edge broker, and resuming a partial run */
+#define SAMPLES 100
+#define FLUSH_AT (BUFFER_CAPACITY_MACRO * BUFFER_THRESHOLD_PERCENT / 100)
+
+static uint64_t published[4 * SAMPLES];
+static size_t published_count;
+static size_t publish_budget = SIZE_MAX;
+static Measurement readback[SAMPLES];
+
+static void (*on_first_publish)(void);
+
+static bool publish_to_edge(Measurement *m) {
+    if (on_first_publish != NULL) {
+        void (*hook)(void) = on_first_publish;
+        on_first_publish = NULL;
+        hook();
+    }
+    if (publish_budget == 0) {
+        return false;
+    }
+    publish_budget--;
+    published[published_count++] = m->timestamp;
+    return true;
+}
+
+static size_t times_published(uint64_t ts) {
+    size_t n = 0;
+    for (size_t i = 0; i < published_count; i++) {
+        n += published[i] == ts;
+    }
+    return n;
+}
+
+static void load_history(void) {
+    test_boot();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, SAMPLES);
+    // Disjoint timestamps, so a timestamp names one sample
+    test_ingest_series(SERIES_HUMIDITY, TEST_BASE_TS + 10 * SAMPLES * 1000, 1000, SAMPLES / 4);
+    published_count = 0;
+    publish_budget = SIZE_MAX;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_offload_sends_and_erases(void) {
+    load_history();
+    size_t segments = test_segment_count(SERIES_TEMPERATURE);
+    size_t humidity_segments = test_segment_count(SERIES_HUMIDITY);
+    CHECK(segments > 4);
+    SegmentInfo oldest[4];
+    size_t got = 0;
+    get_segments_from_list(SERIES_TEMPERATURE, 4, oldest, &got);
+    CHECK_EQ(got, 4);
+
+    // One run takes the four oldest segments of every series
+    offload_flash_to_edge(publish_to_edge);
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), segments - 4);
+    CHECK_EQ(test_segment_count(SERIES_HUMIDITY), 0);
+    size_t expected = 0;
+    for (size_t i = 0; i < got; i++) {
+        CHECK(!segment_exists_in_flash(oldest[i].segment_id));
+        expected += oldest[i].count;
+    }
+    CHECK(humidity_segments > 0);
+    CHECK_EQ(test_read_flash(SERIES_HUMIDITY, 0, UINT64_MAX, readback, SAMPLES), 0);
+
+    // Every stored sample goes out exactly once over repeated runs
+    for (int run = 0; run < 10 && test_segment_count(SERIES_TEMPERATURE) > 0; run++) {
+        offload_flash_to_edge(publish_to_edge);
+    }
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), 0);
+    CHECK(published_count >= expected);
+    for (size_t i = 0; i < published_count; i++) {
+        CHECK_EQ(times_published(published[i]), 1);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_partial_offload_resumes(void) {
+    load_history();
+    size_t segments = test_segment_count(SERIES_TEMPERATURE);
+    SegmentInfo first;
+    size_t got = 0;
+    get_segments_from_list(SERIES_TEMPERATURE, 1, &first, &got);
+
+    // The link drops part way through the second segment
+    publish_budget = first.count + 3;
+    offload_flash_to_edge(publish_to_edge);
+    CHECK_EQ(published_count, first.count + 3);
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), segments - 1);
+    CHECK(!segment_exists_in_flash(first.segment_id));
+
+    // The next run skips the three records already marked sent
+    publish_budget = SIZE_MAX;
+    offload_flash_to_edge(publish_to_edge);
+    for (size_t i = 0; i < published_count; i++) {
+        CHECK_EQ(times_published(published[i]), 1);
+    }
+
+    // The sent bitmap also survives a reboot
+    publish_budget = 2;
+    offload_flash_to_edge(publish_to_edge);
+    size_t before = published_count;
+    test_reboot();
+    publish_budget = SIZE_MAX;
+    offload_flash_to_edge(publish_to_edge);
+    CHECK(published_count > before);
+    for (size_t i = before; i < published_count; i++) {
+        CHECK_EQ(times_published(published[i]), 1);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+#define LATE_TS (TEST_BASE_TS + 500)
+
+// A late sample lands in the oldest segment while offload is sending it
+static void merge_late_sample(void) {
+    uint64_t ts = LATE_TS;
+    float value = -1;
+    CHECK(merge_late_measurements(SERIES_TEMPERATURE, &ts, &value, 1));
+}
+
+static void test_offload_leaves_replaced_segments(void) {
+    load_history();
+    SegmentInfo oldest;
+    size_t got = 0;
+    get_segments_from_list(SERIES_TEMPERATURE, 1, &oldest, &got);
+
+    // The link drops part way through the segment the merge replaced: its progress is not
+    // written back under the old id, which would bring back the blob the merge erased
+    publish_budget = 3;
+    on_first_publish = merge_late_sample;
+    offload_flash_to_edge(publish_to_edge);
+    CHECK(!segment_exists_in_flash(oldest.segment_id));
+    publish_budget = SIZE_MAX;
+    offload_flash_to_edge(publish_to_edge);
+
+    // The segments sent were replaced under offload, so it must not drop what is listed now
+    Measurement found;
+    CHECK(times_published(LATE_TS) == 1 || find_measurement_in_flash(SERIES_TEMPERATURE, LATE_TS, &found));
+    for (int run = 0; run < 10 && test_segment_count(SERIES_TEMPERATURE) > 0; run++) {
+        offload_flash_to_edge(publish_to_edge);
+    }
+    CHECK_EQ(times_published(LATE_TS), 1);
+    int stored = FLUSH_AT * (SAMPLES / FLUSH_AT);
+    for (int i = 0; i < stored; i++) {
+        CHECK(times_published(TEST_BASE_TS + (uint64_t)i * 1000) >= 1);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int main(int argc, char **argv) {
+    static const TestCase cases[] = {
+        { "send_and_erase", test_offload_sends_and_erases },
+        { "partial_resume", test_partial_offload_resumes },
+        { "replaced_under_offload", test_offload_leaves_replaced_segments },
+    };
+    return run_test_cases(argc, argv, cases, sizeof(cases) / sizeof(cases[0]));
+}
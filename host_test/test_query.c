@@ -0,0 +1,335 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "http_server.h"
+#include "mem_pool.h"
+#include "nvs_utils.h"
+#include "query_handler.h"
+#include "cJSON.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/* Range queries across flash and the ring, over MQTT messages and GET /range */
+#define SAMPLES 300
+#define INTERVAL_MS 20000
+
+static char *last_payload;
+static char last_topic[64];
+static int responses;
+
+static int capture_response(const char *topic, const char *payload) {
+    free(last_payload);
+    last_payload = strdup(payload);
+    snprintf(last_topic, sizeof(last_topic), "%s", topic);
+    return ++responses;
+}
+
+// Even samples are temperature, odd ones humidity; value = index % 100
+static void load_history(void) {
+    test_boot();
+    query_handler_set_response_sink(capture_response);
+    for (int i = 0; i < SAMPLES; i++) {
+        Measurement m = test_sample(i & 1, TEST_BASE_TS + (uint64_t)i * INTERVAL_MS, (float)(i % 100));
+        buffer_add_measurement(&m);
+        if (buffer_is_threshold_full()) {
+            buffer_push_to_flash();
+        }
+    }
+}
+
+static uint64_t ts_of(int i) {
+    return TEST_BASE_TS + (uint64_t)i * INTERVAL_MS;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    Measurement out[SAMPLES];
+    size_t count;
+} Collected;
+
+static bool collect(const Measurement *measurements, size_t count, void *ctx) {
+    Collected *c = ctx;
+    for (size_t i = 0; i < count && c->count < SAMPLES; i++) {
+        c->out[c->count++] = measurements[i];
+    }
+    return true;
+}
+
+static void test_range_spans_flash_and_buffer(void) {
+    load_history();
+    uint64_t earliest = 0, latest = 0;
+    CHECK(buffer_get_time_bounds(SERIES_HUMIDITY, &earliest, &latest));
+    CHECK(earliest > ts_of(1));
+
+    static Collected c;
+    c.count = 0;
+    int found = query_range_stream(SERIES_HUMIDITY, 0, UINT64_MAX, NULL, collect, &c);
+    CHECK_EQ(found, SAMPLES / 2);
+    CHECK_EQ(c.count, SAMPLES / 2);
+    for (size_t k = 0; k < c.count; k++) {
+        CHECK_EQ(c.out[k].timestamp, ts_of(2 * (int)k + 1));
+        CHECK(c.out[k].value == (float)((2 * k + 1) % 100));
+    }
+
+    // Both ends are inclusive
+    c.count = 0;
+    CHECK_EQ(query_range_stream(SERIES_HUMIDITY, ts_of(11), ts_of(21), NULL, collect, &c), 6);
+    CHECK_EQ(c.out[0].timestamp, ts_of(11));
+    CHECK_EQ(c.out[5].timestamp, ts_of(21));
+
+    // A predicate skips what cannot match
+    ValuePredicate where = { .has_lo = true, .lo_inclusive = true, .lo = 95 };
+    c.count = 0;
+    CHECK_EQ(query_range_stream(SERIES_TEMPERATURE, 0, UINT64_MAX, &where, collect, &c), 6);
+    for (size_t k = 0; k < c.count; k++) {
+        CHECK(c.out[k].value >= 95);
+    }
+    CHECK_EQ(query_range_stream(SERIES_TEMPERATURE, 5, 4, NULL, collect, &c), -1);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_mqtt_range_pages_with_cursor(void) {
+    load_history();
+    char query[256];
+    snprintf(query, sizeof(query),
+             "{\"action\":\"get_data_range\",\"series\":\"temperature\",\"start_timestamp\":%" PRIu64
+             ",\"end_timestamp\":%" PRIu64 ",\"response_topic\":\"test/range\"}", ts_of(0), ts_of(SAMPLES));
+
+    // Pages follow each other through the cursor until "more" is gone
+    size_t total = 0;
+    uint64_t previous = 0;
+    for (int page = 0; page < 20; page++) {
+        process_query_message(query);
+        CHECK_EQ(strcmp(last_topic, "test/range"), 0);
+        cJSON *json = cJSON_Parse(last_payload);
+        CHECK(json != NULL);
+        if (json == NULL) {
+            return;
+        }
+        cJSON *timestamps = cJSON_GetObjectItem(json, "timestamps");
+        int n = cJSON_GetArraySize(timestamps);
+        for (int i = 0; i < n; i++) {
+            uint64_t ts = (uint64_t)cJSON_GetArrayItem(timestamps, i)->valuedouble;
+            CHECK(ts > previous);
+            previous = ts;
+        }
+        total += n;
+        bool more = cJSON_IsTrue(cJSON_GetObjectItem(json, "more"));
+        const cJSON *cursor = cJSON_GetObjectItem(json, "cursor");
+        CHECK(cJSON_IsString(cursor));
+        snprintf(query, sizeof(query),
+                 "{\"action\":\"get_data_range\",\"since_cursor\":\"%s\",\"response_topic\":\"test/range\"}",
+                 cJSON_IsString(cursor) ? cursor->valuestring : "");
+        cJSON_Delete(json);
+        if (!more) {
+            break;
+        }
+    }
+    CHECK_EQ(total, SAMPLES / 2);
+
+    // Nothing new: an empty page that hands the same cursor back
+    process_query_message(query);
+    cJSON *json = cJSON_Parse(last_payload);
+    CHECK_EQ(cJSON_GetArraySize(cJSON_GetObjectItem(json, "timestamps")), 0);
+    cJSON_Delete(json);
+
+    // An empty window is reported as an error
+    process_query_message("{\"action\":\"get_data_range\",\"start_timestamp\":1,\"end_timestamp\":2}");
+    CHECK(strstr(last_payload, "error") != NULL);
+
+    // So are bounds that are no timestamp at all
+    static const char *bad[] = {
+        "{\"action\":\"get_data_range\",\"start_timestamp\":-1,\"end_timestamp\":2}",
+        "{\"action\":\"get_data_range\",\"start_timestamp\":1,\"end_timestamp\":1e30}",
+        "{\"action\":\"get_data_where\",\"start_timestamp\":-5e20,\"where\":{\"gt\":1}}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        free(last_payload);
+        last_payload = NULL;
+        process_query_message(bad[i]);
+        CHECK(last_payload != NULL && strstr(last_payload, "\"error\"") != NULL);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Sends a refresh of the temperature series and returns the parsed response
+static cJSON *refresh(const char *cursor) {
+    char query[160];
+    snprintf(query, sizeof(query),
+             "{\"action\":\"get_data_range\",\"series\":\"temperature\",\"since_cursor\":\"%s\"}", cursor);
+    process_query_message(query);
+    return cJSON_Parse(last_payload);
+}
+
+// Follows the pages from `cursor` to the end and leaves the final cursor in it
+static size_t drain(char cursor[QUERY_CURSOR_LEN]) {
+    size_t total = 0;
+    for (int page = 0; page < 40; page++) {
+        cJSON *json = refresh(cursor);
+        CHECK(json != NULL);
+        if (json == NULL) {
+            break;
+        }
+        total += cJSON_GetArraySize(cJSON_GetObjectItem(json, "timestamps"));
+        snprintf(cursor, QUERY_CURSOR_LEN, "%s", cJSON_GetObjectItem(json, "cursor")->valuestring);
+        bool more = cJSON_IsTrue(cJSON_GetObjectItem(json, "more"));
+        cJSON_Delete(json);
+        if (!more) {
+            break;
+        }
+    }
+    return total;
+}
+
+static void add(uint64_t ts, float value) {
+    Measurement m = test_sample(SERIES_TEMPERATURE, ts, value);
+    buffer_add_measurement(&m);
+}
+
+static void test_cursor_follows_rewrites(void) {
+    load_history();
+    char cursor[QUERY_CURSOR_LEN];
+    QueryCursor start = { 0 };
+    query_cursor_format(&start, cursor);
+    CHECK_EQ(drain(cursor), SAMPLES / 2);  // Epoch 0: resyncs to the whole series
+
+    // Behind the cursor: a late sample before the flushed range, one the ring reorders and
+    // a new value for a stored timestamp; ahead of it, one new sample
+    add(ts_of(2) + 1, 1.5f);
+    add(ts_of(SAMPLES - 4) + 1, 2.5f);
+    add(ts_of(SAMPLES - 10), 55);
+    add(ts_of(SAMPLES), 3.5f);
+    cJSON *json = refresh(cursor);
+    cJSON *timestamps = cJSON_GetObjectItem(json, "timestamps");
+    CHECK_EQ(cJSON_GetArraySize(timestamps), 4);
+    CHECK(cJSON_GetObjectItem(json, "resync") == NULL);
+    uint64_t expected[] = { ts_of(2) + 1, ts_of(SAMPLES - 4) + 1, ts_of(SAMPLES - 10), ts_of(SAMPLES) };
+    for (int i = 0; i < 4 && i < cJSON_GetArraySize(timestamps); i++) {
+        CHECK_EQ((uint64_t)cJSON_GetArrayItem(timestamps, i)->valuedouble, expected[i]);
+    }
+    const cJSON *value = cJSON_GetArrayItem(cJSON_GetObjectItem(json, "values"), 2);
+    CHECK(value != NULL && value->valuedouble == 55);
+    snprintf(cursor, QUERY_CURSOR_LEN, "%s", cJSON_GetObjectItem(json, "cursor")->valuestring);
+    cJSON_Delete(json);
+    CHECK_EQ(drain(cursor), 0);
+
+    // GET /range follows the same cursor
+    CHECK(http_server_start());
+    add(ts_of(4) + 1, 4.5f);
+    char query[64];
+    snprintf(query, sizeof(query), "since=%s", cursor);
+    HostHttpResponse resp;
+    CHECK(host_httpd_get("/range", query, &resp));
+    json = cJSON_Parse(resp.body);
+    CHECK_EQ(cJSON_GetObjectItem(json, "count")->valueint, 1);
+    CHECK_EQ(strlen(cJSON_GetObjectItem(json, "cursor")->valuestring), QUERY_CURSOR_LEN - 1);
+    snprintf(cursor, QUERY_CURSOR_LEN, "%s", cJSON_GetObjectItem(json, "cursor")->valuestring);
+    cJSON_Delete(json);
+    free(resp.body);
+    CHECK_EQ(drain(cursor), 0);
+
+    // More rewrites than the log keeps: the cursor can no longer be followed
+    for (int i = 0; i <= BUFFER_REWRITE_LOG; i++) {
+        add(ts_of(SAMPLES - 2), (float)i);
+    }
+    json = refresh(cursor);
+    CHECK(cJSON_IsTrue(cJSON_GetObjectItem(json, "resync")));
+    CHECK(cJSON_IsTrue(cJSON_GetObjectItem(json, "more")));
+    snprintf(cursor, QUERY_CURSOR_LEN, "%s", cJSON_GetObjectItem(json, "cursor")->valuestring);
+    cJSON_Delete(json);
+    drain(cursor);
+    CHECK_EQ(drain(cursor), 0);
+
+    // Nor can one from before a reboot
+    test_reboot();
+    query_handler_set_response_sink(capture_response);
+    json = refresh(cursor);
+    CHECK(cJSON_IsTrue(cJSON_GetObjectItem(json, "resync")));
+    cJSON_Delete(json);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_http_range(void) {
+    load_history();
+    CHECK(http_server_start());
+    // A failed reading stays valid JSON
+    Measurement failed = test_sample(SERIES_HUMIDITY, ts_of(SAMPLES + 1), NAN);
+    buffer_add_measurement(&failed);
+
+    char query[128];
+    HostHttpResponse resp;
+    snprintf(query, sizeof(query), "start=%" PRIu64 "&end=%" PRIu64 "&series=humidity", ts_of(0), ts_of(SAMPLES + 1));
+    CHECK(host_httpd_get("/range", query, &resp));
+    CHECK_EQ(resp.status, 200);
+    cJSON *json = cJSON_Parse(resp.body);
+    CHECK(json != NULL);
+    cJSON *points = cJSON_GetObjectItem(json, "points");
+    CHECK_EQ(cJSON_GetArraySize(points), SAMPLES / 2 + 1);
+    CHECK_EQ(cJSON_GetObjectItem(json, "count")->valueint, SAMPLES / 2 + 1);
+    cJSON *last = cJSON_GetArrayItem(points, SAMPLES / 2);
+    CHECK(last != NULL && cJSON_IsNull(cJSON_GetArrayItem(last, 1)));
+    cJSON_Delete(json);
+    free(resp.body);
+
+    // 12-byte little-endian records
+    snprintf(query, sizeof(query), "start=%" PRIu64 "&end=%" PRIu64 "&format=bin", ts_of(0), ts_of(9));
+    CHECK(host_httpd_get("/range", query, &resp));
+    CHECK_EQ(resp.length, 5 * 12);
+    for (size_t k = 0; k * 12 < resp.length; k++) {
+        uint64_t ts;
+        memcpy(&ts, resp.body + k * 12, sizeof(ts));
+        CHECK_EQ(ts, ts_of(2 * (int)k));
+    }
+    free(resp.body);
+
+    CHECK(host_httpd_get("/range", "start=5&end=1", &resp));
+    CHECK_EQ(resp.status, 400);
+    free(resp.body);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_only_the_response_uses_the_arena(void) {
+    load_history();
+    // cJSON built inside an arena is heap memory and outlives it
+    CHECK(mem_arena_begin());
+    cJSON *kept = cJSON_CreateObject();
+    cJSON_AddNumberToObject(kept, "value", 0.1f);
+    mem_arena_end();
+    MemPoolStats stats;
+    mem_pool_get_stats(&stats);
+    CHECK_EQ(stats.arena_peak, 0);
+    CHECK(mem_arena_begin());
+    memset(mem_scratch_alloc(MEM_ARENA_SIZE / 2), 0xA5, MEM_ARENA_SIZE / 2);
+    mem_arena_end();
+    char *expected_value = cJSON_PrintUnformatted(cJSON_GetObjectItem(kept, "value"));
+
+    // The measurement response is written into the query's arena, numbers printed as cJSON does
+    Measurement m = test_sample(SERIES_TEMPERATURE, ts_of(SAMPLES) - 1, 0.1f);
+    buffer_add_measurement(&m);
+    char query[160];
+    snprintf(query, sizeof(query), "{\"action\":\"get_data_range\",\"series\":\"temperature\","
+             "\"start_timestamp\":%" PRIu64 ",\"end_timestamp\":%" PRIu64 "}", ts_of(SAMPLES) - 1, ts_of(SAMPLES));
+    process_query_message(query);
+    mem_pool_get_stats(&stats);
+    CHECK(stats.arena_peak > 0);
+    CHECK(strstr(last_payload, expected_value) != NULL);
+
+    // A full page fits the size the builder reserves
+    snprintf(query, sizeof(query), "{\"action\":\"get_data_range\",\"series\":\"temperature\","
+             "\"start_timestamp\":0,\"end_timestamp\":%" PRIu64 "}", ts_of(SAMPLES));
+    process_query_message(query);
+    cJSON *json = cJSON_Parse(last_payload);
+    CHECK(json != NULL);
+    CHECK_EQ(cJSON_GetArraySize(cJSON_GetObjectItem(json, "timestamps")), BUFFER_CAPACITY_MACRO * 3);
+    CHECK_EQ(cJSON_GetArraySize(cJSON_GetObjectItem(json, "values")), BUFFER_CAPACITY_MACRO * 3);
+    CHECK(cJSON_IsTrue(cJSON_GetObjectItem(json, "more")));
+    cJSON_Delete(json);
+    cJSON_free(expected_value);
+    cJSON_Delete(kept);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int main(int argc, char **argv) {
+    static const TestCase cases[] = {
+        { "range_stream", test_range_spans_flash_and_buffer },
+        { "mqtt_paging", test_mqtt_range_pages_with_cursor },
+        { "http_range", test_http_range },
+        { "cursor_rewrites", test_cursor_follows_rewrites },
+        { "response_arena", test_only_the_response_uses_the_arena },
+    };
+    return run_test_cases(argc, argv, cases, sizeof(cases) / sizeof(cases[0]));
+}
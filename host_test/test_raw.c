@@ -0,0 +1,170 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "compaction.h"
+#include "nvs_utils.h"
+#include "raw_store.h"
+#include "segment_list.h"
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/* Raw partition log: an append torn by a reset, and the log wrapping around */
+#define FLUSH_AT (BUFFER_CAPACITY_MACRO * BUFFER_THRESHOLD_PERCENT / 100)
+
+// On-flash layout of raw_store.c, read straight from the partition file
+#define SECTOR_MAGIC 0x31445354
+#define RECORD_MAGIC 0x5247
+#define SECTOR_HEADER_SIZE 8
+#define RECORD_HEADER_SIZE 12
+
+static Measurement readback[8192];
+
+static uint8_t *read_partition(size_t *size) {
+    FILE *f = fopen(getenv("HOST_FLASH_FILE"), "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *image = malloc(*size);
+    if (image != NULL && fread(image, 1, *size, f) != *size) {
+        free(image);
+        image = NULL;
+    }
+    fclose(f);
+    return image;
+}
+
+static void write_partition_byte(long offset, uint8_t value) {
+    FILE *f = fopen(getenv("HOST_FLASH_FILE"), "r+b");
+    CHECK(f != NULL);
+    if (f != NULL) {
+        fseek(f, offset, SEEK_SET);
+        fputc(value, f);
+        fclose(f);
+    }
+}
+
+// Offset of the last record appended: the last one in the sector with the highest sequence
+static long newest_record(uint16_t *length) {
+    size_t size = 0;
+    uint8_t *image = read_partition(&size);
+    long found = -1;
+    uint32_t best_seq = 0;
+    for (size_t base = 0; image != NULL && base + RAW_SECTOR_SIZE <= size; base += RAW_SECTOR_SIZE) {
+        uint32_t magic, seq;
+        memcpy(&magic, image + base, 4);
+        memcpy(&seq, image + base + 4, 4);
+        if (magic != SECTOR_MAGIC || seq == UINT32_MAX || seq < best_seq) {
+            continue;
+        }
+        best_seq = seq;
+        for (size_t off = SECTOR_HEADER_SIZE; off + RECORD_HEADER_SIZE <= RAW_SECTOR_SIZE;) {
+            uint16_t rmagic, rlen;
+            memcpy(&rmagic, image + base + off, 2);
+            memcpy(&rlen, image + base + off + 2, 2);
+            if (rmagic != RECORD_MAGIC) {
+                break;
+            }
+            found = (long)(base + off);
+            *length = rlen;
+            off += raw_store_record_size(rlen);
+        }
+    }
+    free(image);
+    return found;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_torn_append_keeps_previous_version(void) {
+    test_boot();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, 3 * FLUSH_AT);
+    SegmentInfo first;
+    size_t got = 0;
+    get_segments_from_list(SERIES_TEMPERATURE, 1, &first, &got);
+    CHECK_EQ(got, 1);
+
+    // Marking a record sent appends a new version of the segment
+    Segment seg;
+    CHECK(load_segment_from_flash(first.segment_id, &seg));
+    segment_mark_sent(&seg, 0);
+    CHECK(update_segment_in_flash(&seg));
+
+    // The reset hits while the tail of that record is still being programmed
+    uint16_t length = 0;
+    long record = newest_record(&length);
+    CHECK(record >= 0);
+    write_partition_byte(record + RECORD_HEADER_SIZE + length - 1, 0xFF);
+
+    test_reboot();
+    CHECK(load_segment_from_flash(first.segment_id, &seg));
+    CHECK(!segment_is_sent(&seg, 0));
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 8192), 3 * FLUSH_AT);
+
+    // The closed record is skipped and the log goes on after it
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS + 3 * FLUSH_AT * 1000, 1000, 2 * FLUSH_AT);
+    test_reboot();
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 8192), 5 * FLUSH_AT);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Partition bytes the newest segment of the series took when it was appended
+static size_t newest_record_bytes(uint8_t series_id) {
+    size_t count = 0;
+    SegmentInfo *list = load_segment_list(series_id, &count);
+    Segment seg;
+    size_t bytes = 0;
+    if (list != NULL && load_segment_from_flash(list[count - 1].segment_id, &seg)) {
+        bytes = raw_store_record_size(segment_encoded_size(&seg));
+    }
+    free(list);
+    return bytes;
+}
+
+static void test_log_wraps_under_retention(void) {
+    host_nvs_set_capacity(4 * HOST_NVS_DEFAULT_ENTRIES);
+    test_boot();
+    size_t failed_flushes = 0, appended = 0;
+    uint64_t ts = TEST_BASE_TS;
+    for (int i = 0; i < 2000 * FLUSH_AT; i++, ts += 1000) {
+        Measurement m = test_sample(SERIES_TEMPERATURE, ts, (float)(i % 100));
+        buffer_add_measurement(&m);
+        if (buffer_is_threshold_full()) {
+            size_t before = test_segment_count(SERIES_TEMPERATURE);
+            buffer_push_to_flash();
+            if (test_segment_count(SERIES_TEMPERATURE) == before) {
+                failed_flushes++;
+            } else {
+                appended += newest_record_bytes(SERIES_TEMPERATURE);
+            }
+            compact_storage(ts);
+        }
+    }
+    CHECK_EQ(failed_flushes, 0);
+    CHECK(raw_store_usage_percent() < 100);
+
+    // More was appended than the partition holds, so the log went round
+    CHECK(appended > 2 * raw_store_capacity());
+    size_t segments = test_segment_count(SERIES_TEMPERATURE);
+    CHECK(segments > 0);
+
+    // After a reboot every listed segment is still readable, the newest included
+    test_reboot();
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), segments);
+    SegmentInfo *list = load_segment_list(SERIES_TEMPERATURE, &segments);
+    size_t listed = 0;
+    for (size_t i = 0; list != NULL && i < segments; i++) {
+        CHECK(segment_exists_in_flash(list[i].segment_id));
+        listed += list[i].count;
+    }
+    free(list);
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 8192), listed);
+    Measurement found;
+    CHECK(find_measurement_in_flash(SERIES_TEMPERATURE, ts - 1000, &found));
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int main(int argc, char **argv) {
+    static const TestCase cases[] = {
+        { "torn_record", test_torn_append_keeps_previous_version },
+        { "wrap", test_log_wraps_under_retention },
+    };
+    return run_test_cases(argc, argv, cases, sizeof(cases) / sizeof(cases[0]));
+}
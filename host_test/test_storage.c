@@ -0,0 +1,472 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "metrics.h"
+#include "nvs_utils.h"
+#include "segment_list.h"
+#include "subscription.h"
+#include "wal.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/* Ingest into the ring, flushes to segments, eviction and what survives a reboot */
+#define FLUSH_AT (BUFFER_CAPACITY_MACRO * BUFFER_THRESHOLD_PERCENT / 100)
+
+static Measurement readback[4096];
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_ingest_keeps_ring_sorted(void) {
+    test_boot();
+    uint64_t t0 = TEST_BASE_TS;
+    uint64_t order[] = { 0, 2000, 1000, 3000, 2000, 3000 };
+    float values[] = { 1, 3, 2, 4, 30, 40 };
+    for (size_t i = 0; i < 6; i++) {
+        Measurement m = test_sample(SERIES_TEMPERATURE, t0 + order[i], values[i]);
+        buffer_add_measurement(&m);
+    }
+    Measurement other = test_sample(SERIES_HUMIDITY, t0, 55);
+    Measurement invalid = test_sample(7, t0, 99);
+    buffer_add_measurements(&other, 1);
+    buffer_add_measurements(&invalid, 1);
+
+    // The out-of-order sample is put in place and a repeated timestamp, the newest one included,
+    // takes the newer value
+    int n = get_measurements_from_buffer(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 16);
+    CHECK_EQ(n, 4);
+    for (int i = 0; i < n; i++) {
+        CHECK_EQ(readback[i].timestamp, t0 + (uint64_t)i * 1000);
+    }
+    CHECK(readback[2].value == 30);
+    CHECK(readback[3].value == 40);
+
+    uint64_t earliest = 0, latest = 0;
+    CHECK(buffer_get_time_bounds(SERIES_TEMPERATURE, &earliest, &latest));
+    CHECK_EQ(earliest, t0);
+    CHECK_EQ(latest, t0 + 3000);
+
+    Measurement found;
+    CHECK(find_measurement_in_buffer(SERIES_HUMIDITY, t0, &found));
+    CHECK(found.value == 55);
+    CHECK(!find_measurement_in_buffer(SERIES_HUMIDITY, t0 + 1000, &found));
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), 0);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_flush_writes_one_segment(void) {
+    test_boot();
+    uint64_t t0 = TEST_BASE_TS;
+    for (int i = 0; i < FLUSH_AT; i++) {
+        CHECK(!buffer_is_threshold_full());
+        Measurement m = test_sample(SERIES_TEMPERATURE, t0 + (uint64_t)i * 1000, (float)i);
+        buffer_add_measurement(&m);
+    }
+    CHECK(buffer_is_threshold_full());
+    buffer_push_to_flash();
+    CHECK(!buffer_is_threshold_full());
+
+    size_t count = 0;
+    SegmentInfo *list = load_segment_list(SERIES_TEMPERATURE, &count);
+    CHECK_EQ(count, 1);
+    if (list) {
+        CHECK_EQ(list[0].count, FLUSH_AT);
+        CHECK_EQ(list[0].min_ts, t0);
+        CHECK_EQ(list[0].max_ts, t0 + (FLUSH_AT - 1) * 1000);
+        CHECK(segment_exists_in_flash(list[0].segment_id));
+    }
+    free(list);
+
+    int n = test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 64);
+    CHECK_EQ(n, FLUSH_AT);
+    for (int i = 0; i < n; i++) {
+        CHECK_EQ(readback[i].timestamp, t0 + (uint64_t)i * 1000);
+        CHECK(readback[i].value == (float)i);
+    }
+
+    // Flushed entries stay in the ring for queries but are never written again
+    buffer_push_to_flash();
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), 1);
+    CHECK_EQ(get_measurements_from_buffer(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 64), FLUSH_AT);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_eviction_persists_oldest(void) {
+    test_boot();
+    uint64_t t0 = TEST_BASE_TS;
+    // Nobody flushes: the ring fills and the next sample evicts the oldest one
+    for (int i = 0; i < BUFFER_CAPACITY_MACRO + 1; i++) {
+        Measurement m = test_sample(SERIES_HUMIDITY, t0 + (uint64_t)i * 1000, (float)i);
+        buffer_add_measurement(&m);
+    }
+    int n = get_measurements_from_buffer(SERIES_HUMIDITY, 0, UINT64_MAX, readback, 64);
+    CHECK_EQ(n, BUFFER_CAPACITY_MACRO);
+    CHECK_EQ(readback[0].timestamp, t0 + 1000);
+
+    // The evicted sample was flushed along with every other unsaved one first
+    Measurement found;
+    CHECK(!find_measurement_in_buffer(SERIES_HUMIDITY, t0, &found));
+    CHECK(find_measurement_in_flash(SERIES_HUMIDITY, t0, &found));
+    CHECK(found.value == 0);
+    CHECK_EQ(test_segment_count(SERIES_HUMIDITY), 1);
+    CHECK_EQ(test_read_flash(SERIES_HUMIDITY, 0, UINT64_MAX, readback, 64), BUFFER_CAPACITY_MACRO);
+
+    // A sample for a timestamp the full ring holds replaces its value and evicts nothing
+    Measurement again = test_sample(SERIES_HUMIDITY, t0 + BUFFER_CAPACITY_MACRO * 1000, 99);
+    buffer_add_measurement(&again);
+    n = get_measurements_from_buffer(SERIES_HUMIDITY, 0, UINT64_MAX, readback, 64);
+    CHECK_EQ(n, BUFFER_CAPACITY_MACRO);
+    CHECK_EQ(readback[0].timestamp, t0 + 1000);
+    CHECK(readback[n - 1].value == 99);
+
+    // A long run keeps every sample exactly once across ring and flash
+    test_ingest_series(SERIES_HUMIDITY, t0 + 100000, 1000, 500);
+    buffer_push_to_flash();
+    n = test_read_flash(SERIES_HUMIDITY, t0 + 100000, UINT64_MAX, readback, 4096);
+    CHECK_EQ(n, 500);
+    for (int i = 1; i < n; i++) {
+        CHECK(readback[i].timestamp > readback[i - 1].timestamp);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_reboot_keeps_flushed_and_journaled(void) {
+    test_boot();
+    uint64_t t0 = TEST_BASE_TS;
+    test_ingest_series(SERIES_TEMPERATURE, t0, 1000, 100);
+    size_t segments = test_segment_count(SERIES_TEMPERATURE);
+    CHECK(segments > 0);
+    // What the last flush did not cover only survives through the journal
+    CHECK(wal_commit());
+
+    test_reboot();
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), segments);
+    int stored = test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096);
+    int buffered = get_measurements_from_buffer(SERIES_TEMPERATURE, 0, UINT64_MAX, readback + stored, 64);
+    CHECK(buffered > 0);
+
+    Measurement found;
+    for (int i = 0; i < 100; i++) {
+        uint64_t ts = t0 + (uint64_t)i * 1000;
+        CHECK(find_measurement_in_buffer(SERIES_TEMPERATURE, ts, &found) ||
+              find_measurement_in_flash(SERIES_TEMPERATURE, ts, &found));
+    }
+
+    // Ingest carries on after the newest stored sample without overlapping it
+    test_ingest_series(SERIES_TEMPERATURE, t0 + 100000, 1000, 50);
+    buffer_push_to_flash();
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096), 150);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_full_partition_fails_flush(void) {
+    host_nvs_set_capacity(60);
+    test_boot();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, 400);
+    // Writes that do not fit fail cleanly; what was stored stays readable
+    size_t segments = test_segment_count(SERIES_TEMPERATURE);
+    CHECK(segments > 0);
+    CHECK(get_flash_usage_percent() >= 80);
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096),
+             (int)(segments * FLUSH_AT));
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_batch_ingest_keeps_every_sample(void) {
+    test_boot();
+    // A high-rate burst: larger than the ring, both series interleaved, one bad series id
+    static Measurement batch[65];
+    for (int i = 0; i < 64; i++) {
+        batch[i] = test_sample(i & 1, TEST_BASE_TS + (uint64_t)(i / 2) * 10, (float)i);
+    }
+    batch[64] = test_sample(SERIES_COUNT, TEST_BASE_TS, 0);
+    buffer_add_measurements(batch, 65);
+    buffer_push_to_flash();
+
+    for (uint8_t series = 0; series < 2; series++) {
+        int n = test_read_flash(series, 0, UINT64_MAX, readback, 64);
+        CHECK_EQ(n, 32);
+        for (int i = 0; i < n; i++) {
+            CHECK_EQ(readback[i].timestamp, TEST_BASE_TS + (uint64_t)i * 10);
+            CHECK(readback[i].value == (float)(2 * i + series));
+        }
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_overlapping_erases_survive_reset(void) {
+    test_boot();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, 3 * FLUSH_AT);
+    SegmentInfo listed[3];
+    size_t got = 0;
+    get_segments_from_list(SERIES_TEMPERATURE, 3, listed, &got);
+    CHECK_EQ(got, 3);
+
+    // One sequence drops the oldest segment from the list and resets before erasing it,
+    // while another one finishes in between
+    uint32_t dropped = listed[0].segment_id;
+    int slot = begin_segment_erase(&dropped, 1);
+    CHECK(slot >= 0);
+    CHECK(replace_segments_in_list(SERIES_TEMPERATURE, &dropped, 1, NULL, 0));
+    uint32_t other = listed[1].segment_id;
+    int other_slot = begin_segment_erase(&other, 1);
+    CHECK(other_slot >= 0 && other_slot != slot);
+    end_segment_erase(other_slot);
+
+    test_reboot();
+    CHECK(!segment_exists_in_flash(dropped));
+    CHECK(segment_exists_in_flash(listed[1].segment_id));
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), 2);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_legacy_records_migrate(void) {
+    // Baseline firmware: one 9-byte blob per temperature sample, keyed by its time in seconds
+    const uint32_t seconds[] = { 1700000000, 1700000060, 1700000120 };
+    nvs_handle_t handle;
+    CHECK(nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK);
+    for (size_t i = 0; i < 3; i++) {
+        uint8_t record[9];
+        float value = 20.0f + i;
+        memcpy(record, &seconds[i], 4);
+        memcpy(record + 4, &value, 4);
+        record[8] = DIRTY_BIT_IN_FLASH;
+        char key[16];
+        snprintf(key, sizeof(key), "%" PRIu32, seconds[i]);
+        CHECK(nvs_set_blob(handle, key, record, sizeof(record)) == ESP_OK);
+    }
+    CHECK(nvs_set_blob(handle, "timestamp_list", seconds, sizeof(seconds)) == ESP_OK);
+    nvs_close(handle);
+
+    test_boot();
+    CHECK_EQ(host_nvs_count_keys("storage", "timestamp_list"), 0);
+    CHECK_EQ(host_nvs_count_keys("storage", "17"), 0);
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 16), 3);
+    for (size_t i = 0; i < 3; i++) {
+        CHECK_EQ(readback[i].timestamp, (uint64_t)seconds[i] * 1000);
+        CHECK(readback[i].value == 20.0f + i);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static size_t pushed_points;
+
+static int count_pushed(const char *topic, const char *payload) {
+    cJSON *json = cJSON_Parse(payload);
+    pushed_points += cJSON_GetArraySize(cJSON_GetObjectItem(json, "timestamps"));
+    cJSON_Delete(json);
+    return 1;
+}
+
+static int counter_metric(const char *name) {
+    char *payload = metrics_to_json();
+    cJSON *json = cJSON_Parse(payload);
+    int value = cJSON_GetObjectItem(json, name)->valueint;
+    cJSON_Delete(json);
+    cJSON_free(payload);
+    return value;
+}
+
+static int ingested_metric(void) {
+    return counter_metric("ingest");
+}
+
+static void test_only_accepted_samples_are_announced(void) {
+    test_boot();
+    subscriptions_init(count_pushed);
+    SubscriptionFilter filter = {
+        .series_id = SERIES_TEMPERATURE, .batch_records = SUBSCRIPTION_BATCH_MAX, .lease_ms = 3600000,
+    };
+    CHECK(subscription_add("test/sub", &filter) >= 0);
+    int ingested = ingested_metric();
+    int fresh = 2 * FLUSH_AT + 3;
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, fresh);
+    subscriptions_flush();
+    CHECK_EQ(pushed_points, fresh);
+    CHECK_EQ(ingested_metric() - ingested, fresh);
+
+    // Late samples a full stage refuses are dropped and counted, so nobody hears about them;
+    // ingest never merges them itself, it leaves that to the flush it asks for
+    int stored = test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096);
+    Measurement late[BUFFER_LATE_CAPACITY + 4];
+    for (int i = 0; i < BUFFER_LATE_CAPACITY + 4; i++) {
+        late[i] = test_sample(SERIES_TEMPERATURE, TEST_BASE_TS + 50 + (uint64_t)i * 100, -1);
+    }
+    buffer_add_measurements(late, BUFFER_LATE_CAPACITY + 4);
+    subscriptions_flush();
+    CHECK_EQ(pushed_points, fresh + BUFFER_LATE_CAPACITY);
+    CHECK_EQ(ingested_metric() - ingested, fresh + BUFFER_LATE_CAPACITY);
+    CHECK_EQ(counter_metric("late_dropped"), 4);
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096), stored);
+    CHECK(buffer_is_threshold_full());
+
+    // Warm-up and journal replay put back samples that were announced before the reboot
+    CHECK(wal_commit());
+    test_reboot();
+    CHECK(get_measurements_from_buffer(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 64) > 0);
+    subscriptions_flush();
+    CHECK_EQ(pushed_points, fresh + BUFFER_LATE_CAPACITY);
+    CHECK_EQ(ingested_metric() - ingested, fresh + BUFFER_LATE_CAPACITY);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_late_merge_stops_on_unreadable_list(void) {
+    test_boot();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, 2 * FLUSH_AT);
+    buffer_push_to_flash();
+    for (int i = 0; i < BUFFER_LATE_FLUSH_AT; i++) {
+        Measurement m = test_sample(SERIES_TEMPERATURE, TEST_BASE_TS + 500 + (uint64_t)i * 1000, -1);
+        buffer_add_measurement(&m);
+    }
+    CHECK(buffer_is_threshold_full());
+
+    // A list that cannot be read is not an empty one: nothing is written and the stage is kept
+    nvs_handle_t handle;
+    CHECK(nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK);
+    uint8_t damaged[3] = { 0 };
+    CHECK(nvs_set_blob(handle, SEGMENT_LIST_HEADER_KEY "0", damaged, sizeof(damaged)) == ESP_OK);
+    FlashWearStats before, after;
+    get_flash_wear_stats(&before);
+    buffer_push_to_flash();
+    get_flash_wear_stats(&after);
+    CHECK_EQ(after.blob_writes, before.blob_writes);
+    CHECK_EQ(get_late_measurements(SERIES_TEMPERATURE, 0, UINT64_MAX, NULL, readback, 64), BUFFER_LATE_FLUSH_AT);
+
+    // Staging goes on meanwhile; queries see both sets, the newer value for a shared timestamp
+    Measurement again = test_sample(SERIES_TEMPERATURE, TEST_BASE_TS + 500, -2);
+    Measurement more = test_sample(SERIES_TEMPERATURE, TEST_BASE_TS + 600, -3);
+    buffer_add_measurement(&again);
+    buffer_add_measurement(&more);
+    CHECK_EQ(get_late_measurements(SERIES_TEMPERATURE, 0, UINT64_MAX, NULL, readback, 64), BUFFER_LATE_FLUSH_AT + 1);
+    CHECK(readback[0].value == -2);
+    CHECK_EQ(readback[1].timestamp, TEST_BASE_TS + 600);
+
+    // Once it reads again the failed set is merged first, then what was staged since
+    CHECK(nvs_erase_key(handle, SEGMENT_LIST_HEADER_KEY "0") == ESP_OK);
+    nvs_close(handle);
+    buffer_push_to_flash();
+    CHECK_EQ(get_late_measurements(SERIES_TEMPERATURE, 0, UINT64_MAX, NULL, readback, 64), 2);
+    buffer_push_to_flash();
+    CHECK_EQ(get_late_measurements(SERIES_TEMPERATURE, 0, UINT64_MAX, NULL, readback, 64), 0);
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096), 2 * FLUSH_AT + BUFFER_LATE_FLUSH_AT + 1);
+    Measurement found;
+    CHECK(find_measurement_in_flash(SERIES_TEMPERATURE, TEST_BASE_TS + 500, &found));
+    CHECK(found.value == -2);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_cold_ring_still_stages_late(void) {
+    CHECK_EQ(CONFIG_BOOT_RECOVERY_BUDGET_MS, 0);
+    test_boot();
+    test_ingest_series(SERIES_TEMPERATURE, TEST_BASE_TS, 1000, 2 * FLUSH_AT);
+    buffer_push_to_flash();
+    int stored = test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096);
+
+    // No budget, so no warm-up; the series still knows what it flushed and an old sample is late
+    test_reboot();
+    CHECK_EQ(get_measurements_from_buffer(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 64), 0);
+    Measurement old = test_sample(SERIES_TEMPERATURE, TEST_BASE_TS + 500, -1);
+    buffer_add_measurement(&old);
+    CHECK_EQ(get_measurements_from_buffer(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 64), 0);
+    CHECK_EQ(get_late_measurements(SERIES_TEMPERATURE, 0, UINT64_MAX, NULL, readback, 64), 1);
+
+    // Merged into the stored segments rather than flushed as one overlapping them
+    size_t before = test_segment_count(SERIES_TEMPERATURE);
+    buffer_push_to_flash();
+    CHECK_EQ(test_segment_count(SERIES_TEMPERATURE), before);
+    CHECK_EQ(test_read_flash(SERIES_TEMPERATURE, 0, UINT64_MAX, readback, 4096), stored + 1);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static SegmentInfo list_entry(uint32_t segment_id) {
+    return (SegmentInfo){
+        .segment_id = segment_id, .min_ts = segment_id, .max_ts = segment_id, .count = 1,
+        .series_id = SERIES_HUMIDITY, .min_value = 0, .max_value = 1,
+    };
+}
+
+static void check_listed(const uint32_t *ids, size_t count) {
+    size_t got = 0;
+    SegmentInfo *list = load_segment_list(SERIES_HUMIDITY, &got);
+    CHECK_EQ(got, count);
+    for (size_t i = 0; list != NULL && i < got && i < count; i++) {
+        CHECK_EQ(list[i].segment_id, ids[i]);
+    }
+    free(list);
+}
+
+static void test_list_appends_rewrite_one_chunk(void) {
+    test_boot();
+    enum { APPENDS = 12 * SEGMENT_LIST_CHUNK };
+    static uint32_t ids[APPENDS + 1];
+    FlashWearStats before, after;
+    uint64_t total = 0, largest = 0;
+    for (uint32_t i = 0; i < APPENDS; i++) {
+        ids[i] = 1000 + i;
+        SegmentInfo info = list_entry(ids[i]);
+        get_flash_wear_stats(&before);
+        CHECK(append_segment_to_list(&info));
+        get_flash_wear_stats(&after);
+        uint64_t written = after.bytes_written - before.bytes_written;
+        total += written;
+        largest = written > largest ? written : largest;
+    }
+    // At most a full chunk plus the header per append, a few entries on average, however long the list
+    CHECK(largest <= SEGMENT_LIST_CHUNK * sizeof(SegmentInfo) + 8 + 4 * (APPENDS / SEGMENT_LIST_CHUNK + 1));
+    CHECK(total / APPENDS <= (SEGMENT_LIST_CHUNK / 2 + 2) * sizeof(SegmentInfo));
+    check_listed(ids, APPENDS);
+
+    // A run across a chunk boundary becomes one entry; a run at the front goes
+    uint32_t run[] = { ids[SEGMENT_LIST_CHUNK - 2], ids[SEGMENT_LIST_CHUNK - 1], ids[SEGMENT_LIST_CHUNK] };
+    SegmentInfo merged = list_entry(5000);
+    CHECK(replace_segments_in_list(SERIES_HUMIDITY, run, 3, &merged, 1));
+    CHECK(replace_segments_in_list(SERIES_HUMIDITY, ids, 3, NULL, 0));
+    CHECK(!replace_segments_in_list(SERIES_HUMIDITY, run, 3, NULL, 0));
+    size_t n = 0;
+    static uint32_t expected[APPENDS];
+    for (uint32_t i = 3; i < APPENDS; i++) {
+        if (i == SEGMENT_LIST_CHUNK - 2) {
+            expected[n++] = 5000;
+        } else if (i < SEGMENT_LIST_CHUNK - 2 || i > SEGMENT_LIST_CHUNK) {
+            expected[n++] = ids[i];
+        }
+    }
+    check_listed(expected, n);
+    SegmentInfo info = list_entry(9000);
+    CHECK(append_segment_to_list(&info));
+    expected[n++] = 9000;
+    check_listed(expected, n);
+
+    // Replaced chunks are gone; what is left is the header and the live chunks
+    CHECK(host_nvs_count_keys("storage", SEGMENT_LIST_KEY "1") <= (n + SEGMENT_LIST_CHUNK - 1) / SEGMENT_LIST_CHUNK + 1);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_single_blob_list_loads_as_first_chunk(void) {
+    test_boot();
+    // Earlier firmware kept the whole list in one blob under the first chunk's key
+    enum { LISTED = 2 * SEGMENT_LIST_CHUNK + 3 };
+    uint32_t ids[LISTED + 1];
+    SegmentInfo list[LISTED];
+    for (uint32_t i = 0; i < LISTED; i++) {
+        ids[i] = 100 + i;
+        list[i] = list_entry(ids[i]);
+    }
+    nvs_handle_t handle;
+    CHECK(nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK);
+    CHECK(nvs_set_blob(handle, SEGMENT_LIST_KEY "1", list, sizeof(list)) == ESP_OK);
+    nvs_close(handle);
+    check_listed(ids, LISTED);
+
+    ids[LISTED] = 200;
+    SegmentInfo info = list_entry(ids[LISTED]);
+    CHECK(append_segment_to_list(&info));
+    check_listed(ids, LISTED + 1);
+    CHECK(replace_segments_in_list(SERIES_HUMIDITY, ids, 1, NULL, 0));
+    check_listed(ids + 1, LISTED);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int main(int argc, char **argv) {
+    static const TestCase cases[] = {
+        { "ingest", test_ingest_keeps_ring_sorted },
+        { "flush", test_flush_writes_one_segment },
+        { "eviction", test_eviction_persists_oldest },
+        { "reboot", test_reboot_keeps_flushed_and_journaled },
+        { "partition_full", test_full_partition_fails_flush },
+        { "batch_ingest", test_batch_ingest_keeps_every_sample },
+        { "overlapping_erases", test_overlapping_erases_survive_reset },
+        { "legacy_migration", test_legacy_records_migrate },
+        { "ingest_accounting", test_only_accepted_samples_are_announced },
+        { "late_list_error", test_late_merge_stops_on_unreadable_list },
+        { "list_chunks", test_list_appends_rewrite_one_chunk },
+        { "list_single_blob", test_single_blob_list_loads_as_first_chunk },
+        { "cold_reboot", test_cold_ring_still_stages_late },
+    };
+    return run_test_cases(argc, argv, cases, sizeof(cases) / sizeof(cases[0]));
+}
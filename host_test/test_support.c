@@ -0,0 +1,94 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "mem_pool.h"
+#include "mqtt_client.h"
+#include "nvs_utils.h"
+#include "read_cache.h"
+#include "recovery.h"
+#include "segment_list.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+// ─────────────────────────────────────────────────────────────────────────────
+int test_failures;
+
+// Defined by main.c on the target
+esp_mqtt_client_handle_t edge_mqtt_client;
+esp_mqtt_client_handle_t device_mqtt_client;
+// ─────────────────────────────────────────────────────────────────────────────
+// Gives every case its own raw partition file, erased, in the working directory
+static void use_fresh_flash_file(const char *program, const char *case_name) {
+    char path[256];
+    const char *base = strrchr(program, '/');
+    snprintf(path, sizeof(path), "%s.%s.flash", base ? base + 1 : program, case_name);
+    unlink(path);
+    setenv("HOST_FLASH_FILE", path, 1);
+}
+
+int run_test_cases(int argc, char **argv, const TestCase *cases, size_t count) {
+    int ran = 0, failed_cases = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (argc > 1 && strcmp(argv[1], cases[i].name) != 0) {
+            continue;
+        }
+        use_fresh_flash_file(argv[0], cases[i].name);
+        host_nvs_reset();
+        int before = test_failures;
+        cases[i].run();
+        bool passed = test_failures == before;
+        printf("%s %s\n", passed ? "PASS" : "FAIL", cases[i].name);
+        failed_cases += passed ? 0 : 1;
+        ran++;
+    }
+    if (ran == 0) {
+        fprintf(stderr, "No test case named \"%s\"\n", argc > 1 ? argv[1] : "");
+        return 2;
+    }
+    return failed_cases ? 1 : 0;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void test_boot(void) {
+    mem_pool_init();
+    if (init_nvs() != ESP_OK) {
+        fprintf(stderr, "init_nvs failed\n");
+        test_failures++;
+    }
+    buffer_init();
+    read_cache_init();
+    RecoveryReport report;
+    storage_recover(&report);
+}
+
+void test_reboot(void) {
+    test_boot();
+}
+
+Measurement test_sample(uint8_t series_id, uint64_t timestamp, float value) {
+    Measurement m = {
+        .timestamp = timestamp,
+        .value = value,
+        .dirty_bit = DIRTY_BIT_BUFFER_ONLY,
+        .series_id = series_id,
+    };
+    return m;
+}
+
+void test_ingest_series(uint8_t series_id, uint64_t first_ts, uint32_t interval_ms, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Measurement m = test_sample(series_id, first_ts + i * interval_ms, (float)(i % 100));
+        buffer_add_measurement(&m);
+        if (buffer_is_threshold_full()) {
+            buffer_push_to_flash();
+        }
+    }
+}
+
+size_t test_segment_count(uint8_t series_id) {
+    size_t count = 0;
+    free(load_segment_list(series_id, &count));
+    return count;
+}
+
+int test_read_flash(uint8_t series_id, uint64_t start, uint64_t end, Measurement *out, size_t max) {
+    return get_measurements_from_flash(series_id, start, end, out, max);
+}
@@ -0,0 +1,57 @@
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "measurement.h"
+#include "host_shims.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Each test executable lists its cases and hands them to run_test_cases();
+ * ctest runs every case in its own process (see CMakeLists.txt), so cases
+ * start from erased NVS and a fresh flash file.
+ */
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} TestCase;
+
+extern int test_failures;
+
+#define CHECK(cond) do {                                                          \
+        if (!(cond)) {                                                            \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                      \
+        }                                                                         \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do {                                           \
+        long long a_ = (long long)(actual), e_ = (long long)(expected);           \
+        if (a_ != e_) {                                                           \
+            fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n",                 \
+                    __FILE__, __LINE__, #actual, a_, e_);                         \
+            test_failures++;                                                      \
+        }                                                                         \
+    } while (0)
+
+/* Runs the case named by argv[1], or all of them; returns the process exit code */
+int run_test_cases(int argc, char **argv, const TestCase *cases, size_t count);
+// ─────────────────────────────────────────────────────────────────────────────
+#define TEST_BASE_TS 1760000000000ULL  // Synthetic samples start here (epoch ms)
+
+/* app_main's storage bring-up: pools, NVS, buffer, read cache, recovery */
+void test_boot(void);
+/* Loses everything in RAM and boots again over the same NVS and flash contents */
+void test_reboot(void);
+Measurement test_sample(uint8_t series_id, uint64_t timestamp, float value);
+/* Ingests `count` samples like the collection task, flushing whenever the buffer reaches its threshold */
+void test_ingest_series(uint8_t series_id, uint64_t first_ts, uint32_t interval_ms, size_t count);
+/* Listed segments of the series */
+size_t test_segment_count(uint8_t series_id);
+/* Every stored sample of the series in [start, end], read back through the flash scan */
+int test_read_flash(uint8_t series_id, uint64_t start, uint64_t end, Measurement *out, size_t max);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // TEST_SUPPORT_H
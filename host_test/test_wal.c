@@ -0,0 +1,74 @@
+#include "test_support.h"
+#include "buffer.h"
+#include "config.h"
+#include "nvs.h"
+#include "nvs_utils.h"
+#include "wal.h"
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/* Journal recovery and chunk retirement */
+#define CHUNKS (CONFIG_WAL_MAX_CHUNKS * 3)
+
+// Writes chunk `seq` holding one humidity sample, as wal_commit() lays it out
+static void write_chunk(uint32_t seq, uint64_t timestamp) {
+    uint8_t blob[sizeof(WalChunkHeader) + sizeof(Measurement)];
+    WalChunkHeader hdr = { .version = WAL_CHUNK_VERSION, .count = 1, .seq = seq };
+    Measurement m = test_sample(SERIES_HUMIDITY, timestamp, (float)seq);
+    memcpy(blob, &hdr, sizeof(hdr));
+    memcpy(blob + sizeof(hdr), &m, sizeof(m));
+    char key[16];
+    snprintf(key, sizeof(key), WAL_KEY_PREFIX "%08" PRIx32, seq);
+    nvs_handle_t handle;
+    CHECK(nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK);
+    CHECK(nvs_set_blob(handle, key, blob, sizeof(blob)) == ESP_OK);
+    nvs_close(handle);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_recovery_replays_every_chunk(void) {
+    // More chunks than the journal tracks, e.g. left behind by failed erases
+    for (uint32_t seq = 1; seq <= CHUNKS; seq++) {
+        write_chunk(seq, TEST_BASE_TS + seq * 1000);
+    }
+    test_boot();
+    buffer_push_to_flash();
+
+    Measurement found;
+    for (uint32_t seq = 1; seq <= CHUNKS; seq++) {
+        uint64_t ts = TEST_BASE_TS + seq * 1000;
+        CHECK(find_measurement_in_buffer(SERIES_HUMIDITY, ts, &found) ||
+              find_measurement_in_flash(SERIES_HUMIDITY, ts, &found));
+    }
+    // New chunks never reuse a sequence number seen on flash
+    Measurement m = test_sample(SERIES_HUMIDITY, TEST_BASE_TS + (CHUNKS + 1) * 1000, 1);
+    buffer_add_measurement(&m);
+    CHECK(wal_commit());
+    char key[16];
+    snprintf(key, sizeof(key), WAL_KEY_PREFIX "%08" PRIx32, (uint32_t)CHUNKS + 1);
+    CHECK_EQ(host_nvs_count_keys("storage", key), 1);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void test_failed_erase_keeps_chunk(void) {
+    test_boot();
+    Measurement m = test_sample(SERIES_TEMPERATURE, TEST_BASE_TS, 1);
+    buffer_add_measurement(&m);
+    CHECK(wal_commit());
+    CHECK_EQ(host_nvs_count_keys("storage", WAL_KEY_PREFIX), 1);
+
+    // The covering segment is stored but the chunk cannot be erased: it stays tracked
+    host_nvs_fail_erases(WAL_KEY_PREFIX, 1);
+    wal_checkpoint(SERIES_TEMPERATURE, TEST_BASE_TS);
+    CHECK_EQ(host_nvs_count_keys("storage", WAL_KEY_PREFIX), 1);
+
+    // ...and goes with the next checkpoint
+    wal_checkpoint(SERIES_TEMPERATURE, TEST_BASE_TS);
+    CHECK_EQ(host_nvs_count_keys("storage", WAL_KEY_PREFIX), 0);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int main(int argc, char **argv) {
+    static const TestCase cases[] = {
+        { "replay_all_chunks", test_recovery_replays_every_chunk },
+        { "failed_erase", test_failed_erase_keeps_chunk },
+    };
+    return run_test_cases(argc, argv, cases, sizeof(cases) / sizeof(cases[0]));
+}
@@ -151,10 +151,10 @@ function appendResponse(message) {
     responseArea.scrollTop = responseArea.scrollHeight;
 }
 
-// Function to query InfluxDB for a given timestamp range
+// Function to query InfluxDB for a given timestamp range (epoch milliseconds)
 async function fetchInfluxDBRange(startTimestamp, endTimestamp) {
-    const startRFC = new Date(startTimestamp * 1000).toISOString();
-    const endRFC = new Date(endTimestamp * 1000).toISOString();
+    const startRFC = new Date(startTimestamp).toISOString();
+    const endRFC = new Date(endTimestamp).toISOString();
 
     const url = `${INFLUXDB_URL}/api/v2/query?org=${INFLUXDB_ORG}`;
     const token = INFLUXDB_TOKEN;
@@ -232,7 +232,7 @@ function parseInfluxDBCSV(csvData) {
             const timeStr = cols[timeIndex];
             const valueStr = cols[valueIndex];
             if (timeStr && valueStr) {
-                const timestamp = Math.floor(new Date(timeStr).getTime() / 1000);
+                const timestamp = new Date(timeStr).getTime();
                 const temperature = parseFloat(valueStr);
                 measurements.push({ timestamp, temperature });
             }
@@ -0,0 +1,375 @@
+#include "benchmark.h"
+#include "buffer.h"
+#include "nvs_utils.h"
+#include "offload.h"
+#include "query_handler.h"
+#include "read_cache.h"
+#include "segment_list.h"
+#include "mem_pool.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "BENCHMARK";
+// ─────────────────────────────────────────────────────────────────────────────
+#define BENCHMARK_BASE_TS 1700000000000ULL // Synthetic history starts here (epoch ms)
+#define BENCHMARK_FLASH_LIMIT_PERCENT 80   // Drain to the null edge beyond this usage
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    const char *name;
+    uint32_t samples[BENCHMARK_MAX_SAMPLES]; // latencies in microseconds
+    uint32_t kept;
+    uint32_t ops;
+    uint64_t total_us;
+    uint32_t max_us;  // exact, unlike the sampled percentiles
+} BenchOp;
+
+enum { OP_INGEST, OP_FLUSH, OP_DRAIN, OP_LOOKUP, OP_RANGE_1M, OP_RANGE_1H, OP_RANGE_1D, OP_OFFLOAD, OP_COUNT };
+static const char *op_names[OP_COUNT] = {
+    "ingest", "flush", "drain", "point_lookup", "range_1m", "range_1h", "range_1d", "offload",
+};
+// ─────────────────────────────────────────────────────────────────────────────
+static void bench_record(BenchOp *op, int64_t elapsed_us) {
+    uint32_t us = elapsed_us < 0 ? 0 : (uint32_t)elapsed_us;
+    op->ops++;
+    op->total_us += us;
+    if (us > op->max_us) {
+        op->max_us = us;
+    }
+    if (op->kept < BENCHMARK_MAX_SAMPLES) {
+        op->samples[op->kept++] = us;
+    } else {
+        // Reservoir sampling keeps an unbiased subset for the percentiles
+        uint32_t slot = esp_random() % op->ops;
+        if (slot < BENCHMARK_MAX_SAMPLES) {
+            op->samples[slot] = us;
+        }
+    }
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_to_json(BenchOp *op, cJSON *parent) {
+    cJSON *obj = cJSON_AddObjectToObject(parent, op->name);
+    cJSON_AddNumberToObject(obj, "ops", op->ops);
+    if (op->kept == 0) {
+        return;
+    }
+    qsort(op->samples, op->kept, sizeof(uint32_t), compare_u32);
+    cJSON_AddNumberToObject(obj, "p50_us", op->samples[op->kept / 2]);
+    cJSON_AddNumberToObject(obj, "p99_us", op->samples[(op->kept * 99) / 100]);
+    cJSON_AddNumberToObject(obj, "max_us", op->max_us);
+    cJSON_AddNumberToObject(obj, "ops_per_sec",
+                            op->total_us ? (double)op->ops * 1000000.0 / (double)op->total_us : 0);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Stand-ins for the transports, so only the storage/query work is timed
+static bool null_publish(Measurement *m) {
+    return true;
+}
+
+static int null_response_sink(const char *topic, const char *payload) {
+    return 0;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void benchmark_run(uint32_t days, uint32_t interval_ms, uint32_t queries, uint32_t soak_queries) {
+    BenchOp *ops = calloc(OP_COUNT, sizeof(BenchOp));
+    if (!ops || interval_ms == 0) {
+        ESP_LOGE(TAG, "Cannot start benchmark");
+        free(ops);
+        return;
+    }
+    for (int i = 0; i < OP_COUNT; i++) {
+        ops[i].name = op_names[i];
+    }
+    static const uint64_t widths[] = BENCHMARK_RANGE_WIDTHS_MS;
+
+    clear_flash_storage();
+    reset_flash_wear_stats();
+    query_handler_set_response_sink(null_response_sink);
+
+    uint64_t samples_per_series = (uint64_t)days * 86400000ULL / interval_ms;
+    uint64_t ts = BENCHMARK_BASE_TS;
+    ESP_LOGI(TAG, "Loading %" PRIu64 " samples per series (%" PRIu32 " days)", samples_per_series, days);
+
+    /*--------------------------------------------------------
+     * 1) Ingest + flush, draining to a null edge when flash fills
+     *-------------------------------------------------------*/
+    for (uint64_t i = 0; i < samples_per_series; i++, ts += interval_ms) {
+        Measurement batch[SERIES_COUNT];
+        for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+            batch[s] = (Measurement){ .timestamp = ts, .value = 20.0f + (float)(i % 100) / 10.0f,
+                                      .dirty_bit = DIRTY_BIT_BUFFER_ONLY, .series_id = s };
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        buffer_add_measurements(batch, SERIES_COUNT);
+        bench_record(&ops[OP_INGEST], esp_timer_get_time() - t0);
+
+        if (buffer_is_threshold_full()) {
+            t0 = esp_timer_get_time();
+            buffer_push_to_flash();
+            bench_record(&ops[OP_FLUSH], esp_timer_get_time() - t0);
+
+            if (get_flash_usage_percent() >= BENCHMARK_FLASH_LIMIT_PERCENT) {
+                t0 = esp_timer_get_time();
+                offload_flash_to_edge(null_publish);
+                bench_record(&ops[OP_DRAIN], esp_timer_get_time() - t0);
+            }
+        }
+    }
+    uint64_t last_ts = ts - interval_ms;
+
+    FlashWearStats wear;
+    get_flash_wear_stats(&wear); // Ingest-phase write cost only
+
+    /*--------------------------------------------------------
+     * 2) Point lookups and range queries over what is retained
+     *-------------------------------------------------------*/
+    uint64_t oldest_ts = last_ts;
+    size_t segment_count = 0;
+    SegmentInfo *list = load_segment_list(SERIES_TEMPERATURE, &segment_count);
+    if (list) {
+        oldest_ts = list[0].min_ts;
+        free(list);
+    }
+    uint64_t span = last_ts - oldest_ts + 1;
+
+    for (uint32_t q = 0; q < queries; q++) {
+        uint64_t target = oldest_ts + ((((uint64_t)esp_random() << 32) | esp_random()) % span);
+        target -= (target - BENCHMARK_BASE_TS) % interval_ms; // Land on a sample
+        Measurement m;
+        int64_t t0 = esp_timer_get_time();
+        if (!find_measurement_in_buffer(SERIES_TEMPERATURE, target, &m)) {
+            find_measurement_in_flash(SERIES_TEMPERATURE, target, &m);
+        }
+        bench_record(&ops[OP_LOOKUP], esp_timer_get_time() - t0);
+
+        for (int w = 0; w < OP_RANGE_1D - OP_RANGE_1M + 1; w++) {
+            char query[160];
+            uint64_t end = target + widths[w];
+            snprintf(query, sizeof(query),
+                     "{\"action\":\"get_data_range\",\"start_timestamp\":%" PRIu64 ",\"end_timestamp\":%" PRIu64 "}",
+                     target, end);
+            t0 = esp_timer_get_time();
+            process_query_message(query);
+            bench_record(&ops[OP_RANGE_1M + w], esp_timer_get_time() - t0);
+        }
+    }
+
+    /*--------------------------------------------------------
+     * 2b) Soak: the query mix again, many times over; with the
+     *     request arenas the heap should end where it started
+     *-------------------------------------------------------*/
+    static const char *soak_kinds[] = { "get_data_range", "get_data_where", "get_stats" };
+    uint32_t heap_free_start = esp_get_free_heap_size();
+    uint32_t heap_blk_start = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    for (uint32_t q = 0; q < soak_queries; q++) {
+        uint64_t target = oldest_ts + ((((uint64_t)esp_random() << 32) | esp_random()) % span);
+        const char *kind = soak_kinds[q % 3];
+        char query[200];
+        snprintf(query, sizeof(query),
+                 "{\"action\":\"%s\",\"series\":\"%s\",\"start_timestamp\":%" PRIu64 ",\"end_timestamp\":%" PRIu64
+                 ",\"where\":{\"gt\":%u}}",
+                 kind, series_name((uint8_t)(q % SERIES_COUNT)), target, target + widths[q % 3],
+                 20 + (unsigned)(q % 10));
+        process_query_message(query);
+    }
+    uint32_t heap_free_end = esp_get_free_heap_size();
+    uint32_t heap_blk_end = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    /*--------------------------------------------------------
+     * 3) Offload everything that is left
+     *-------------------------------------------------------*/
+    // Until nothing is left, or a round removes nothing (a list that cannot be read)
+    size_t remaining = SIZE_MAX;
+    size_t before;
+    do {
+        before = remaining;
+        int64_t t0 = esp_timer_get_time();
+        offload_flash_to_edge(null_publish);
+        bench_record(&ops[OP_OFFLOAD], esp_timer_get_time() - t0);
+
+        remaining = 0;
+        for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+            size_t n = 0;
+            free(load_segment_list(s, &n));
+            remaining += n;
+        }
+    } while (remaining > 0 && remaining < before);
+    if (remaining > 0) {
+        ESP_LOGW(TAG, "Offload stopped making progress with %u segments left", (unsigned)remaining);
+    }
+
+    /*--------------------------------------------------------
+     * 4) Report
+     *-------------------------------------------------------*/
+    cJSON *report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "days", days);
+    cJSON_AddNumberToObject(report, "interval_ms", interval_ms);
+    cJSON_AddNumberToObject(report, "series", SERIES_COUNT);
+    cJSON_AddNumberToObject(report, "samples_per_series", (double)samples_per_series);
+    cJSON_AddNumberToObject(report, "retained_segments", (double)segment_count);
+    cJSON_AddNumberToObject(report, "offload_left", (double)remaining);
+    ReadCacheStats cache_stats;
+    read_cache_get_stats(&cache_stats);
+    cJSON *cache = cJSON_AddObjectToObject(report, "read_cache");
+    cJSON_AddNumberToObject(cache, "hits", cache_stats.hits);
+    cJSON_AddNumberToObject(cache, "misses", cache_stats.misses);
+    cJSON *flash = cJSON_AddObjectToObject(report, "flash_wear");
+    cJSON_AddNumberToObject(flash, "bytes_written", (double)wear.bytes_written);
+    cJSON_AddNumberToObject(flash, "entries_written", wear.entries_written);
+    cJSON_AddNumberToObject(flash, "commits", wear.commits);
+    cJSON_AddNumberToObject(flash, "erases", wear.erases);
+    cJSON_AddNumberToObject(flash, "entries_per_record",
+                            wear.logical_records ? (double)wear.entries_written / wear.logical_records : 0);
+    cJSON_AddNumberToObject(flash, "write_amplification", flash_write_amplification(&wear));
+    MemPoolStats pool;
+    mem_pool_get_stats(&pool);
+    cJSON *soak = cJSON_AddObjectToObject(report, "soak");
+    cJSON_AddNumberToObject(soak, "queries", soak_queries);
+    cJSON_AddNumberToObject(soak, "heap_free_start", heap_free_start);
+    cJSON_AddNumberToObject(soak, "heap_free_end", heap_free_end);
+    cJSON_AddNumberToObject(soak, "heap_blk_start", heap_blk_start);
+    cJSON_AddNumberToObject(soak, "heap_blk_end", heap_blk_end);
+    // What the soak did not give back, so a run can be checked without comparing fields
+    cJSON_AddNumberToObject(soak, "heap_free_lost", heap_free_end < heap_free_start ? heap_free_start - heap_free_end : 0);
+    cJSON_AddNumberToObject(soak, "heap_blk_lost", heap_blk_end < heap_blk_start ? heap_blk_start - heap_blk_end : 0);
+    cJSON_AddNumberToObject(soak, "arena_peak", pool.arena_peak);
+    cJSON_AddNumberToObject(soak, "arena_spill", pool.arena_fallbacks);
+    cJSON_AddNumberToObject(soak, "seg_spill", pool.pool_fallbacks[MEM_POOL_SEGMENT]);
+    cJSON *results = cJSON_AddObjectToObject(report, "results");
+    for (int i = 0; i < OP_COUNT; i++) {
+        bench_to_json(&ops[i], results);
+    }
+
+    char *json = cJSON_PrintUnformatted(report);
+    if (json) {
+        printf("BENCHMARK %s\n", json);
+        cJSON_free(json);
+    }
+    cJSON_Delete(report);
+    free(ops);
+
+    clear_flash_storage();
+    query_handler_set_response_sink(NULL);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/* Shared with the query task of benchmark_concurrent(); only it writes `queries` */
+typedef struct {
+    int64_t start_us;
+    BenchOp queries;
+    SemaphoreHandle_t stop;
+    SemaphoreHandle_t done;
+} ConcurrentRun;
+
+// Range queries of random width over what has been ingested so far, back to back
+static void concurrent_query_task(void *arg) {
+    ConcurrentRun *run = arg;
+    static const uint64_t widths[] = BENCHMARK_RANGE_WIDTHS_MS;
+    while (xSemaphoreTake(run->stop, 0) != pdTRUE) {
+        uint64_t span = (uint64_t)(esp_timer_get_time() - run->start_us) / 1000 + 1;
+        uint64_t start = BENCHMARK_BASE_TS + esp_random() % span;
+        char query[160];
+        snprintf(query, sizeof(query),
+                 "{\"action\":\"get_data_range\",\"start_timestamp\":%" PRIu64 ",\"end_timestamp\":%" PRIu64 "}",
+                 start, start + widths[esp_random() % 3]);
+        int64_t t0 = esp_timer_get_time();
+        process_query_message(query);
+        bench_record(&run->queries, esp_timer_get_time() - t0);
+        vTaskDelay(1);
+    }
+    xSemaphoreGive(run->done);
+    vTaskDelete(NULL);
+}
+
+void benchmark_concurrent(uint32_t seconds, uint32_t sample_hz, uint32_t batch_size) {
+    ConcurrentRun *run = calloc(1, sizeof(ConcurrentRun));
+    BenchOp *commits = calloc(1, sizeof(BenchOp));
+    Measurement *batch = calloc(batch_size ? batch_size : 1, sizeof(Measurement));
+    if (!run || !commits || !batch || sample_hz == 0 || sample_hz > 1000 || batch_size == 0) {
+        ESP_LOGE(TAG, "Cannot start concurrent benchmark");
+        free(run);
+        free(commits);
+        free(batch);
+        return;
+    }
+    run->queries.name = "query";
+    commits->name = "batch_commit";
+    run->stop = xSemaphoreCreateBinary();
+    run->done = xSemaphoreCreateBinary();
+
+    clear_flash_storage();
+    query_handler_set_response_sink(null_response_sink);
+    run->start_us = esp_timer_get_time();
+    xTaskCreate(concurrent_query_task, "bench_query", 6144, run, 4, NULL);
+
+    // Paced like high_rate_collection_task: a batch is due every batch_size samples; one
+    // that is not committed before the next is due is an overrun
+    const int64_t period_us = (int64_t)batch_size * 1000000 / sample_hz;
+    uint64_t total = (uint64_t)seconds * sample_hz / batch_size * batch_size;
+    uint32_t overruns = 0;
+    int64_t due_us = run->start_us;
+    for (uint64_t i = 0; i < total; i += batch_size) {
+        for (uint32_t k = 0; k < batch_size; k++) {
+            batch[k] = (Measurement){ .timestamp = BENCHMARK_BASE_TS + (i + k) * 1000 / sample_hz,
+                                      .value = 20.0f + (float)((i + k) % 100) / 10.0f,
+                                      .dirty_bit = DIRTY_BIT_BUFFER_ONLY, .series_id = SERIES_TEMPERATURE };
+        }
+        int64_t t0 = esp_timer_get_time();
+        buffer_add_measurements(batch, batch_size);
+        if (buffer_is_threshold_full()) {
+            buffer_push_to_flash();
+        }
+        int64_t t1 = esp_timer_get_time();
+        bench_record(commits, t1 - t0);
+
+        due_us += period_us;
+        if (t1 > due_us) {
+            overruns++;
+        } else {
+            vTaskDelay((TickType_t)((due_us - t1) / 1000 / portTICK_PERIOD_MS));
+        }
+    }
+    xSemaphoreGive(run->stop);
+    xSemaphoreTake(run->done, portMAX_DELAY);
+
+    cJSON *report = cJSON_CreateObject();
+    cJSON_AddStringToObject(report, "mode", "concurrent");
+    cJSON_AddNumberToObject(report, "seconds", seconds);
+    cJSON_AddNumberToObject(report, "sample_hz", sample_hz);
+    cJSON_AddNumberToObject(report, "batch_size", batch_size);
+    cJSON_AddNumberToObject(report, "samples", (double)total);
+    cJSON_AddNumberToObject(report, "batch_period_us", (double)period_us);
+    cJSON_AddNumberToObject(report, "overruns", overruns);
+    cJSON *results = cJSON_AddObjectToObject(report, "results");
+    bench_to_json(commits, results);
+    bench_to_json(&run->queries, results);
+    char *json = cJSON_PrintUnformatted(report);
+    if (json) {
+        printf("BENCHMARK %s\n", json);
+        cJSON_free(json);
+    }
+    cJSON_Delete(report);
+
+    vSemaphoreDelete(run->stop);
+    vSemaphoreDelete(run->done);
+    free(run);
+    free(commits);
+    free(batch);
+    clear_flash_storage();
+    query_handler_set_response_sink(NULL);
+}
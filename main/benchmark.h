@@ -0,0 +1,35 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stddef.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/* Latency samples kept per operation; longer runs are reservoir-sampled */
+#define BENCHMARK_MAX_SAMPLES 512
+/* Range query widths exercised, in milliseconds (1 min, 1 h, 1 day) */
+#define BENCHMARK_RANGE_WIDTHS_MS { 60000ULL, 3600000ULL, 86400000ULL }
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Loads `days` of synthetic samples (one per `interval_ms` for every series)
+ * through the normal ingest path, then times ingest, flush, point lookups,
+ * range queries of several widths and offload, plus the flash write cost of
+ * the ingest phase. A soak of `soak_queries` mixed queries follows, reporting
+ * free heap and largest free block before and after so fragmentation shows.
+ * Results are printed as one
+ * JSON line prefixed with "BENCHMARK " so runs can be diffed across commits.
+ *
+ * Destructive: the "storage" namespace is erased before and after the run.
+ */
+void benchmark_run(uint32_t days, uint32_t interval_ms, uint32_t queries, uint32_t soak_queries);
+/*
+ * Ingests one series at `sample_hz` for `seconds`, committing every
+ * `batch_size` samples with one buffer_add_measurements() call (and a flush
+ * when due) on the high-rate schedule, while another task runs range
+ * queries. Reports commit and query latency, including the worst batch
+ * commit, and how many commits missed the next batch's deadline.
+ *
+ * Destructive like benchmark_run().
+ */
+void benchmark_concurrent(uint32_t seconds, uint32_t sample_hz, uint32_t batch_size);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // BENCHMARK_H
\ No newline at end of file
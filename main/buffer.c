@@ -1,113 +1,525 @@
 #include "buffer.h"
 #include "nvs_utils.h"
+#include "segment_list.h"
+#include "segment.h"
+#include "metrics.h"
+#include "wal.h"
+#include "subscription.h"
+#define TRACE_LEVEL CONFIG_TRACE_LEVEL_BUFFER
+#include "trace.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 #include <string.h>
-#include "timestamp_list.h"
+#include <stdlib.h>
 // ─────────────────────────────────────────────────────────────────────────────
 static const char *TAG = "BUFFER";
 // ─────────────────────────────────────────────────────────────────────────────
 const int BUFFER_CAPACITY = BUFFER_CAPACITY_MACRO; // Match the macro value
 // ─────────────────────────────────────────────────────────────────────────────
-Measurement buffer[BUFFER_CAPACITY_MACRO];
-// ─────────────────────────────────────────────────────────────────────────────
-int buffer_head = 0;
-int buffer_tail = 0;
-int buffer_count = 0;
+SeriesBuffer buffer[SERIES_COUNT];
 SemaphoreHandle_t buffer_mutex;
+
+/* Late samples per series, sorted by timestamp; guarded by buffer_mutex */
+typedef struct {
+    uint64_t timestamps[BUFFER_LATE_CAPACITY];
+    float values[BUFFER_LATE_CAPACITY];
+    int count;
+} LateStage;
+static LateStage late_stage[SERIES_COUNT];
+/*
+ * What a flush took from the stage and merges without the mutex; kept until a
+ * merge succeeds. Only the flush holding `late_merging_busy` writes it.
+ */
+static LateStage late_merging[SERIES_COUNT];
+static bool late_merging_busy[SERIES_COUNT];
+
+/*
+ * Rewrites per series in a ring, by ingest sequence; guarded by buffer_mutex.
+ * `lost_seq` is the newest sequence pushed out, so a cursor at or before it
+ * can no longer be served incrementally.
+ */
+typedef struct {
+    uint64_t timestamps[BUFFER_REWRITE_LOG];
+    uint32_t seqs[BUFFER_REWRITE_LOG];
+    int next;
+    int count;
+    uint32_t lost_seq;
+} RewriteLog;
+static RewriteLog rewrite_log[SERIES_COUNT];
+static uint32_t ingest_seq[SERIES_COUNT];   // last sequence handed out per series
+static uint32_t ingest_epoch;
 // ─────────────────────────────────────────────────────────────────────────────
-/* track earliest & latest timestamps in buffer */
-uint32_t buffer_earliest_ts = 0;
-uint32_t buffer_latest_ts  = 0;
+static inline bool slot_persisted(const SeriesBuffer *sb, int idx) {
+    return (sb->persisted[idx / 32] >> (idx % 32)) & 1u;
+}
+
+static inline void set_slot_persisted(SeriesBuffer *sb, int idx, bool persisted) {
+    if (persisted) {
+        sb->persisted[idx / 32] |= (1u << (idx % 32));
+    } else {
+        sb->persisted[idx / 32] &= ~(1u << (idx % 32));
+    }
+}
+
+static void slot_to_measurement(const SeriesBuffer *sb, uint8_t series_id, int idx, Measurement *m) {
+    m->timestamp = sb->timestamps[idx];
+    m->value = sb->values[idx];
+    m->dirty_bit = slot_persisted(sb, idx) ? DIRTY_BIT_IN_FLASH : DIRTY_BIT_BUFFER_ONLY;
+    m->series_id = series_id;
+}
 // ─────────────────────────────────────────────────────────────────────────────
 void buffer_init() {
-    buffer_head = 0;
-    buffer_tail = 0;
-    buffer_count = 0;
-    buffer_mutex = xSemaphoreCreateMutex();
-
-    /* Initialize earliest & latest to some neutral values */
-    buffer_earliest_ts = 0;
-    buffer_latest_ts   = 0;
+    memset(buffer, 0, sizeof(buffer));
+    memset(late_stage, 0, sizeof(late_stage));
+    memset(late_merging, 0, sizeof(late_merging));
+    memset(late_merging_busy, 0, sizeof(late_merging_busy));
+    memset(rewrite_log, 0, sizeof(rewrite_log));
+    memset(ingest_seq, 0, sizeof(ingest_seq));
+    // Sequences restart at every boot; the epoch tells cursors from an earlier one apart
+    uint32_t previous = ingest_epoch;
+    do {
+        ingest_epoch = esp_random();
+    } while (ingest_epoch == 0 || ingest_epoch == previous);
+    if (buffer_mutex == NULL) {
+        buffer_mutex = xSemaphoreCreateMutex();
+    }
 }
 // ─────────────────────────────────────────────────────────────────────────────
-void update_buffer_earliest(void)
+void update_buffer_earliest(uint8_t series_id)
 {
-    // We'll find the minimum timestamp in the current buffer.
-    // This is O(buffer_count), typically small enough for embedded scenarios.
-    if (buffer_count == 0) {
-        buffer_earliest_ts = 0;
+    // We'll find the minimum timestamp in the current ring.
+    // This is O(count), typically small enough for embedded scenarios.
+    SeriesBuffer *sb = &buffer[series_id];
+    if (sb->count == 0) {
+        sb->earliest_ts = 0;
         return;
     }
 
-    uint32_t min_ts = UINT32_MAX;
-    for (int i = 0; i < buffer_count; i++) {
-        int idx = (buffer_tail + i) % BUFFER_CAPACITY_MACRO;
-        if (buffer[idx].timestamp < min_ts) {
-            min_ts = buffer[idx].timestamp;
+    uint64_t min_ts = UINT64_MAX;
+    sb->min_value = sb->max_value = sb->values[sb->tail];
+    for (int i = 0; i < sb->count; i++) {
+        int idx = (sb->tail + i) % BUFFER_CAPACITY_MACRO;
+        if (sb->timestamps[idx] < min_ts) {
+            min_ts = sb->timestamps[idx];
+        }
+        if (sb->values[idx] < sb->min_value) {
+            sb->min_value = sb->values[idx];
+        }
+        if (sb->values[idx] > sb->max_value) {
+            sb->max_value = sb->values[idx];
         }
     }
-    buffer_earliest_ts = min_ts;
+    sb->earliest_ts = min_ts;
 }
 // ─────────────────────────────────────────────────────────────────────────────
-void buffer_add_measurement(Measurement *m) {
-    if (buffer_mutex == NULL) {
-        ESP_LOGE(TAG, "Buffer mutex not initialized");
-        return;
+// Packs every not-yet-persisted entry of one ring into a single segment. Caller holds the mutex.
+static int flush_series_to_flash(uint8_t series_id) {
+    SeriesBuffer *sb = &buffer[series_id];
+    Segment seg;
+    int slots[BUFFER_CAPACITY_MACRO];
+
+    memset(&seg, 0, sizeof(seg));
+    seg.info.series_id = series_id;
+    for (int i = 0; i < sb->count && seg.info.count < SEGMENT_MAX_RECORDS; i++) {
+        int idx = (sb->tail + i) % BUFFER_CAPACITY_MACRO;
+        if (!slot_persisted(sb, idx)) {
+            seg.timestamps[seg.info.count] = sb->timestamps[idx];
+            seg.values[seg.info.count] = sb->values[idx];
+            slots[seg.info.count++] = idx;
+        }
+    }
+    if (seg.info.count == 0) {
+        return 0;
     }
 
+    int64_t start_us = esp_timer_get_time();
+    bool stored = store_segment_in_flash(&seg);
+    metrics_observe(METRIC_HIST_FLUSH_US, (uint32_t)(esp_timer_get_time() - start_us));
+    if (!stored) {
+        metrics_inc(METRIC_FLUSH_FAILURES, 1);
+        ESP_LOGE(TAG, "Failed to store %s segment in flash", series_name(series_id));
+        return -1;
+    }
+    metrics_inc(METRIC_FLUSHES, 1);
+    for (int i = 0; i < seg.info.count; i++) {
+        set_slot_persisted(sb, slots[i], true);
+    }
+    if (seg.info.max_ts > sb->flushed_ts) {
+        sb->flushed_ts = seg.info.max_ts;
+    }
+    // Slots are taken oldest first, so nothing up to max_ts still needs the journal
+    wal_checkpoint(series_id, seg.info.max_ts);
+    TRACE(TRACE_FLUSH, series_id, seg.info.segment_id);
+    TRACE_LOG("Pushed %u %s entries from buffer to flash as segment %" PRIu32,
+             seg.info.count, series_name(series_id), seg.info.segment_id);
+    return seg.info.count;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Merges the series' late samples into its stored segments. Rewriting segments is slow, so the
+// stage is taken under the mutex and merged without it; samples staged meanwhile wait for the
+// next flush. A merge that fails is retried as is before the stage is taken again.
+static int flush_late(uint8_t series_id) {
+    LateStage *merging = &late_merging[series_id];
     xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    if (late_merging_busy[series_id] || (merging->count == 0 && late_stage[series_id].count == 0)) {
+        xSemaphoreGive(buffer_mutex);
+        return 0;
+    }
+    if (merging->count == 0) {
+        *merging = late_stage[series_id];
+        late_stage[series_id].count = 0;
+    }
+    late_merging_busy[series_id] = true;
+    xSemaphoreGive(buffer_mutex);
+
+    bool ok = merge_late_measurements(series_id, merging->timestamps, merging->values, merging->count);
 
-    // Check if buffer is full
-    if (buffer_count >= BUFFER_CAPACITY_MACRO) {
-        // Buffer is full, need to make space
-        // Evict the oldest entry (buffer_tail)
-        Measurement *oldest = &buffer[buffer_tail];
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    late_merging_busy[series_id] = false;
+    int merged = merging->count;
+    if (ok) {
+        merging->count = 0;
+        // The journal drops late records per series, so only once none are left to merge
+        if (late_stage[series_id].count == 0) {
+            wal_checkpoint_late(series_id);
+        }
+    }
+    xSemaphoreGive(buffer_mutex);
 
-        ESP_LOGI(TAG, "Evicting oldest entry timestamp=%" PRIu32 " from buffer", oldest->timestamp);
+    if (!ok) {
+        metrics_inc(METRIC_FLUSH_FAILURES, 1);
+        ESP_LOGE(TAG, "Failed to merge %d late %s samples; kept for the next flush",
+                 merged, series_name(series_id));
+        return -1;
+    }
+    ESP_LOGI(TAG, "Merged %d late %s samples into stored segments", merged, series_name(series_id));
+    return merged;
+}
 
-        if (oldest->dirty_bit == DIRTY_BIT_BUFFER_ONLY) {
-            // Push to flash before eviction
-            if (store_measurement_in_flash(oldest)) {
-                append_timestamp_to_list(oldest->timestamp);
-                oldest->dirty_bit = DIRTY_BIT_IN_FLASH;
-                ESP_LOGI(TAG, "Evicted entry stored to flash, timestamp=%" PRIu32, oldest->timestamp);
-            } else {
-                ESP_LOGE(TAG, "Failed to store measurement in flash during eviction");
-                // Handle error if necessary
-            }
+// Adds a sample at or before flushed_ts to the late stage, in timestamp order. Caller holds the mutex.
+static bool stage_late_locked(const Measurement *m) {
+    LateStage *stage = &late_stage[m->series_id];
+    int pos = stage->count;
+    while (pos > 0 && stage->timestamps[pos - 1] > m->timestamp) {
+        pos--;
+    }
+    if (pos > 0 && stage->timestamps[pos - 1] == m->timestamp) {
+        // Back-fill of a sample already staged: the newer value wins
+        stage->values[pos - 1] = m->value;
+        return true;
+    }
+    if (stage->count == BUFFER_LATE_CAPACITY) {
+        // Merging rewrites stored segments, which is the flush path's job, not the ingest path's;
+        // it started at BUFFER_LATE_FLUSH_AT, so getting here means it is behind or failing
+        metrics_inc(METRIC_LATE_DROPPED, 1);
+        ESP_LOGW(TAG, "Late stage full; dropping %s sample timestamp=%" PRIu64,
+                 series_name(m->series_id), m->timestamp);
+        return false;
+    }
+    memmove(&stage->timestamps[pos + 1], &stage->timestamps[pos], (stage->count - pos) * sizeof(uint64_t));
+    memmove(&stage->values[pos + 1], &stage->values[pos], (stage->count - pos) * sizeof(float));
+    stage->timestamps[pos] = m->timestamp;
+    stage->values[pos] = m->value;
+    stage->count++;
+    metrics_inc(METRIC_LATE, 1);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Drops the oldest entry of a full ring, persisting it (with the rest of the unsaved ones) first
+static void evict_oldest_locked(uint8_t series_id) {
+    SeriesBuffer *sb = &buffer[series_id];
+    TRACE(TRACE_EVICT, series_id, sb->timestamps[sb->tail]);
+    TRACE_LOG("Evicting oldest %s entry timestamp=%" PRIu64 " from buffer",
+             series_name(series_id), sb->timestamps[sb->tail]);
+
+    if (!slot_persisted(sb, sb->tail)) {
+        // Push to flash before eviction, together with the rest of the unsaved entries
+        if (flush_series_to_flash(series_id) < 0) {
+            ESP_LOGE(TAG, "Failed to store measurement in flash during eviction");
+            // Handle error if necessary
+        }
+    }
+    // Move tail forward
+    sb->tail = (sb->tail + 1) % BUFFER_CAPACITY_MACRO;
+    sb->count--;
+
+    // We removed the oldest; re-scan to update earliest_ts
+    update_buffer_earliest(series_id);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// True if the ring already holds this timestamp, so a sample for it only replaces a value
+static bool ring_holds_locked(const SeriesBuffer *sb, uint64_t timestamp) {
+    if (sb->count == 0 || timestamp < sb->earliest_ts || timestamp > sb->latest_ts) {
+        return false;
+    }
+    for (int i = sb->count - 1; i >= 0; i--) {
+        uint64_t ts = sb->timestamps[(sb->tail + i) % BUFFER_CAPACITY_MACRO];
+        if (ts <= timestamp) {
+            return ts == timestamp;
+        }
+    }
+    return false;
+}
+
+// Puts a sample older than the ring's newest at its sorted position, overwriting one with the
+// same timestamp (returns false then). The ring must have room. Caller holds the mutex.
+static bool ring_insert_locked(SeriesBuffer *sb, const Measurement *m, bool persisted) {
+    int pos = sb->count;
+    while (pos > 0 && sb->timestamps[(sb->tail + pos - 1) % BUFFER_CAPACITY_MACRO] > m->timestamp) {
+        pos--;
+    }
+    int prev = (sb->tail + pos - 1 + BUFFER_CAPACITY_MACRO) % BUFFER_CAPACITY_MACRO;
+    if (pos > 0 && sb->timestamps[prev] == m->timestamp) {
+        sb->values[prev] = m->value;
+        return false;
+    }
+
+    // Shift the newer entries one slot toward the head
+    for (int i = sb->count; i > pos; i--) {
+        int to = (sb->tail + i) % BUFFER_CAPACITY_MACRO;
+        int from = (sb->tail + i - 1) % BUFFER_CAPACITY_MACRO;
+        sb->timestamps[to] = sb->timestamps[from];
+        sb->values[to] = sb->values[from];
+        set_slot_persisted(sb, to, slot_persisted(sb, from));
+    }
+    int idx = (sb->tail + pos) % BUFFER_CAPACITY_MACRO;
+    sb->timestamps[idx] = m->timestamp;
+    sb->values[idx] = m->value;
+    set_slot_persisted(sb, idx, persisted);
+    sb->head = (sb->head + 1) % BUFFER_CAPACITY_MACRO;
+    sb->count++;
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Adds one sample to its series' ring in timestamp order, evicting (and persisting) the oldest if
+// full. Returns false if the sample was dropped. Caller holds the mutex.
+static bool ring_append_locked(const Measurement *m) {
+    SeriesBuffer *sb = &buffer[m->series_id];
+    bool fresh = m->dirty_bit == DIRTY_BIT_BUFFER_ONLY;
+
+    // At or before the newest flushed sample it would overlap stored segments (clock stepped
+    // back, back-fill), so it is merged into them instead of flushed as a new one
+    bool late = fresh && sb->flushed_ts != 0 && m->timestamp <= sb->flushed_ts;
+    bool replaces = ring_holds_locked(sb, m->timestamp);
+    if (!late && !replaces && sb->count >= BUFFER_CAPACITY_MACRO) {
+        evict_oldest_locked(m->series_id);
+        // The eviction may have flushed entries newer than this sample
+        late = fresh && sb->flushed_ts != 0 && m->timestamp <= sb->flushed_ts;
+    }
+
+    bool added = true;
+    if (late) {
+        if (!stage_late_locked(m)) {
+            return false;
         }
-        // Move buffer_tail forward
-        buffer_tail = (buffer_tail + 1) % BUFFER_CAPACITY_MACRO;
-        buffer_count--;
+        wal_append_late(m);
+        TRACE_LOG("Staged late %s measurement timestamp=%" PRIu64 " (flushed up to %" PRIu64 ")",
+                 series_name(m->series_id), m->timestamp, sb->flushed_ts);
 
-        // We removed the oldest; re-scan to update buffer_earliest_ts
-        update_buffer_earliest();
+        // Also buffered when inside the ring's span, which the ring answers queries for;
+        // marked persisted since the stage, not a ring flush, writes it
+        if (!replaces && sb->count > 0 && m->timestamp >= sb->earliest_ts && sb->count >= BUFFER_CAPACITY_MACRO) {
+            evict_oldest_locked(m->series_id);
+        }
+        if (sb->count == 0 || m->timestamp < sb->earliest_ts) {
+            return true;
+        }
+        added = ring_insert_locked(sb, m, true);
+    } else if (sb->count > 0 && m->timestamp <= sb->latest_ts) {
+        // Out of order (or the newest timestamp again) but newer than anything flushed: the ring
+        // itself reorders it
+        added = ring_insert_locked(sb, m, !fresh);
+    } else {
+        sb->timestamps[sb->head] = m->timestamp;
+        sb->values[sb->head] = m->value;
+        set_slot_persisted(sb, sb->head, !fresh);
+        sb->head = (sb->head + 1) % BUFFER_CAPACITY_MACRO;
+        sb->count++;
+    }
+    TRACE(TRACE_INGEST, m->series_id, m->timestamp);
+    if (fresh && !late) {
+        wal_append(m);
     }
 
-    // Add new measurement
-    buffer[buffer_head] = *m;
-    buffer_head = (buffer_head + 1) % BUFFER_CAPACITY_MACRO;
-    buffer_count++;
+    if (!added) {
+        // An existing timestamp took the new value; only the value bounds can have changed
+        update_buffer_earliest(m->series_id);
+        return true;
+    }
 
     // If this is the only entry, set earliest_ts = latest_ts = current
-    if (buffer_count == 1) {
-        buffer_earliest_ts = m->timestamp;
-        buffer_latest_ts   = m->timestamp;
+    if (sb->count == 1) {
+        sb->earliest_ts = m->timestamp;
+        sb->latest_ts   = m->timestamp;
+        sb->min_value   = m->value;
+        sb->max_value   = m->value;
     } else {
+        if (m->value < sb->min_value) {
+            sb->min_value = m->value;
+        }
+        if (m->value > sb->max_value) {
+            sb->max_value = m->value;
+        }
         // update earliest & latest if needed
-        if (m->timestamp < buffer_earliest_ts) {
-            buffer_earliest_ts = m->timestamp;
+        if (m->timestamp < sb->earliest_ts) {
+            sb->earliest_ts = m->timestamp;
         }
-        if (m->timestamp > buffer_latest_ts) {
-            buffer_latest_ts   = m->timestamp;
+        if (m->timestamp > sb->latest_ts) {
+            sb->latest_ts   = m->timestamp;
+        }
+    }
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Numbers an accepted sample and logs it if it is fresh and lands at or before its series' newest
+// one. Caller holds the mutex.
+static bool buffer_append_locked(const Measurement *m) {
+    const SeriesBuffer *sb = &buffer[m->series_id];
+    bool rewrite = m->dirty_bit == DIRTY_BIT_BUFFER_ONLY && ((sb->count > 0 && m->timestamp <= sb->latest_ts) ||
+                   (sb->flushed_ts != 0 && m->timestamp <= sb->flushed_ts));
+    if (!ring_append_locked(m)) {
+        return false;
+    }
+    uint32_t seq = ++ingest_seq[m->series_id];
+    if (rewrite) {
+        RewriteLog *log = &rewrite_log[m->series_id];
+        if (log->count == BUFFER_REWRITE_LOG) {
+            log->lost_seq = log->seqs[log->next];
+        } else {
+            log->count++;
+        }
+        log->timestamps[log->next] = m->timestamp;
+        log->seqs[log->next] = seq;
+        log->next = (log->next + 1) % BUFFER_REWRITE_LOG;
+    }
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Appends up to BUFFER_INGEST_CHUNK samples under one lock acquisition and
+ * copies the ones taken into `accepted`; returns how many that is. Samples
+ * with an invalid series id, or dropped by a full late stage, are left out.
+ */
+static size_t append_chunk(const Measurement *batch, size_t n, Measurement *accepted) {
+    size_t taken = 0;
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < n; i++) {
+        if (batch[i].series_id < SERIES_COUNT && buffer_append_locked(&batch[i])) {
+            accepted[taken++] = batch[i];
         }
     }
+    xSemaphoreGive(buffer_mutex);
+    return taken;
+}
+
+void buffer_add_measurement(Measurement *m) {
+    if (buffer_mutex == NULL) {
+        ESP_LOGE(TAG, "Buffer mutex not initialized");
+        return;
+    }
+    if (m->series_id >= SERIES_COUNT) {
+        ESP_LOGE(TAG, "Invalid series id %u", m->series_id);
+        return;
+    }
 
+    Measurement accepted;
+    if (append_chunk(m, 1, &accepted) == 0) {
+        return;
+    }
+    metrics_inc(METRIC_INGESTED, 1);
+    subscriptions_on_ingest(&accepted, 1);
+    TRACE_LOG("Added %s measurement timestamp=%" PRIu64 ", dirty_bit=%u to buffer",
+             series_name(m->series_id), m->timestamp, m->dirty_bit);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Commits a batch of samples (any mix of series), taking the lock once per BUFFER_INGEST_CHUNK
+void buffer_add_measurements(const Measurement *batch, size_t n) {
+    if (buffer_mutex == NULL) {
+        ESP_LOGE(TAG, "Buffer mutex not initialized");
+        return;
+    }
+
+    size_t added = 0;
+    for (size_t i = 0; i < n; i += BUFFER_INGEST_CHUNK) {
+        Measurement accepted[BUFFER_INGEST_CHUNK];
+        size_t taken = append_chunk(&batch[i], n - i < BUFFER_INGEST_CHUNK ? n - i : BUFFER_INGEST_CHUNK, accepted);
+        // Subscribers and the ingest count only see what the buffer actually took
+        metrics_inc(METRIC_INGESTED, taken);
+        subscriptions_on_ingest(accepted, taken);
+        added += taken;
+    }
+
+    if (added < n) {
+        ESP_LOGE(TAG, "Dropped %u of %u samples (invalid series id or late stage full)",
+                 (unsigned)(n - added), (unsigned)n);
+    }
+    TRACE(TRACE_INGEST_BATCH, added, n);
+    TRACE_LOG("Added batch of %u measurements to buffer", (unsigned)added);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Re-adds samples that were ingested before a reboot: no ingest count, no subscriber pushes
+void buffer_restore_measurements(const Measurement *batch, size_t n) {
+    if (buffer_mutex == NULL) {
+        ESP_LOGE(TAG, "Buffer mutex not initialized");
+        return;
+    }
+    for (size_t i = 0; i < n; i += BUFFER_INGEST_CHUNK) {
+        Measurement accepted[BUFFER_INGEST_CHUNK];
+        append_chunk(&batch[i], n - i < BUFFER_INGEST_CHUNK ? n - i : BUFFER_INGEST_CHUNK, accepted);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Anything from before the newest stored timestamp is late, even if that segment cannot be read back
+bool buffer_seed_flushed_ts(uint8_t series_id, uint32_t *newest_segment) {
+    size_t count = 0;
+    SegmentInfo *segment_list = load_segment_list(series_id, &count);
+    if (segment_list == NULL) {
+        return false;
+    }
+    *newest_segment = segment_list[count - 1].segment_id;
+    uint64_t newest_ts = segment_list[count - 1].max_ts;
+    free(segment_list);
+
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    if (newest_ts > buffer[series_id].flushed_ts) {
+        buffer[series_id].flushed_ts = newest_ts;
+    }
     xSemaphoreGive(buffer_mutex);
-    ESP_LOGI(TAG, "Added measurement timestamp=%" PRIu32 ", dirty_bit=%u to buffer (count=%d)",
-             m->timestamp, m->dirty_bit, buffer_count);
+    return true;
 }
 // ─────────────────────────────────────────────────────────────────────────────
+// Refills one ring from the series' newest segment so recent queries stay in RAM after a reboot
+size_t buffer_warm_from_flash(uint8_t series_id, uint32_t newest) {
+    Segment *seg = malloc(sizeof(Segment));
+    if (seg == NULL) {
+        return 0;
+    }
+    if (!load_segment_from_flash(newest, seg)) {
+        // Left to validate_segment_lists_step(); the rest of the boot does not need it
+        ESP_LOGW(TAG, "Newest %s segment %" PRIu32 " unreadable; ring stays cold", series_name(series_id), newest);
+        free(seg);
+        return 0;
+    }
+
+    // Already persisted, so they are marked in flash and never journaled or flushed again
+    Measurement batch[BUFFER_CAPACITY_MACRO];
+    size_t first = seg->info.count > BUFFER_CAPACITY_MACRO ? seg->info.count - BUFFER_CAPACITY_MACRO : 0;
+    size_t n = 0;
+    for (size_t i = first; i < seg->info.count; i++) {
+        batch[n].timestamp = seg->timestamps[i];
+        batch[n].value = seg->values[i];
+        batch[n].dirty_bit = DIRTY_BIT_IN_FLASH;
+        batch[n].series_id = series_id;
+        n++;
+    }
+    free(seg);
+
+    buffer_restore_measurements(batch, n);
+    return n;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// True once any series holds enough unsaved entries to fill a worthwhile segment
 bool buffer_is_threshold_full() {
     if (buffer_mutex == NULL) {
         ESP_LOGE(TAG, "Buffer mutex not initialized");
@@ -115,12 +527,24 @@ bool buffer_is_threshold_full() {
     }
 
     xSemaphoreTake(buffer_mutex, portMAX_DELAY);
-    bool result = (buffer_count >= (BUFFER_CAPACITY_MACRO * BUFFER_THRESHOLD_PERCENT / 100));
+    bool result = false;
+    int unsaved = 0;
+    for (uint8_t s = 0; s < SERIES_COUNT && !result; s++) {
+        unsaved = 0;
+        for (int i = 0; i < buffer[s].count; i++) {
+            if (!slot_persisted(&buffer[s], (buffer[s].tail + i) % BUFFER_CAPACITY_MACRO)) {
+                unsaved++;
+            }
+        }
+        result = (unsaved >= (BUFFER_CAPACITY_MACRO * BUFFER_THRESHOLD_PERCENT / 100))
+                 || late_stage[s].count >= BUFFER_LATE_FLUSH_AT
+                 || (late_merging[s].count > 0 && !late_merging_busy[s]);
+    }
     xSemaphoreGive(buffer_mutex);
     // Before returning result checking the threshold
     if (result) {
-        ESP_LOGI(TAG, "Buffer threshold reached. Current count = %d, capacity = %d", 
-                 buffer_count, BUFFER_CAPACITY);
+        TRACE_LOG("Buffer threshold reached. Unsaved count = %d, capacity = %d",
+                 unsaved, BUFFER_CAPACITY);
     }
     return result;
 }
@@ -130,45 +554,33 @@ void buffer_push_to_flash() {
         ESP_LOGE(TAG, "Buffer mutex not initialized");
         return;
     }
-    ESP_LOGI(TAG, "Buffer threshold triggered. Pushing half of buffer entries to flash...");
-    int entries_to_push = BUFFER_CAPACITY_MACRO / 2; // Push half of the entries
-    int entries_pushed = 0;
+    TRACE_LOG("Buffer threshold triggered. Pushing unsaved entries to flash...");
 
     xSemaphoreTake(buffer_mutex, portMAX_DELAY);
-    for (int i = 0; i < buffer_count && entries_pushed < entries_to_push; i++) {
-        int index = (buffer_tail + i) % BUFFER_CAPACITY_MACRO;
-        Measurement *m = &buffer[index];
-
-        // Only process entries with dirty bit DIRTY_BIT_BUFFER_ONLY (0)
-        if (m->dirty_bit == DIRTY_BIT_BUFFER_ONLY) {
-            // Update dirty bit to DIRTY_BIT_IN_FLASH
-            m->dirty_bit = DIRTY_BIT_IN_FLASH;
-
-            // Store measurement in flash
-            if (store_measurement_in_flash(m)) {
-                // Append timestamp to FIFO list
-                append_timestamp_to_list(m->timestamp);
-                entries_pushed++;
-                ESP_LOGI(TAG, "Pushed timestamp=%" PRIu32 " from buffer to flash", m->timestamp);
-            } else {
-                ESP_LOGE(TAG, "Failed to store measurement in flash");
-            }
-        }
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        flush_series_to_flash(s);
     }
     xSemaphoreGive(buffer_mutex);
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        flush_late(s);
+    }
 }
 // ─────────────────────────────────────────────────────────────────────────────
-bool find_measurement_in_buffer(uint32_t timestamp, Measurement *result) {
+bool find_measurement_in_buffer(uint8_t series_id, uint64_t timestamp, Measurement *result) {
     if (buffer_mutex == NULL) {
         ESP_LOGE(TAG, "Buffer mutex not initialized");
         return false;
     }
+    if (series_id >= SERIES_COUNT) {
+        return false;
+    }
 
     xSemaphoreTake(buffer_mutex, portMAX_DELAY);
-    for (int i = 0; i < buffer_count; i++) {
-        int index = (buffer_tail + i) % BUFFER_CAPACITY_MACRO;
-        if (buffer[index].timestamp == timestamp) {
-            *result = buffer[index];
+    const SeriesBuffer *sb = &buffer[series_id];
+    for (int i = 0; i < sb->count; i++) {
+        int index = (sb->tail + i) % BUFFER_CAPACITY_MACRO;
+        if (sb->timestamps[index] == timestamp) {
+            slot_to_measurement(sb, series_id, index, result);
             xSemaphoreGive(buffer_mutex);
             return true;
         }
@@ -177,26 +589,55 @@ bool find_measurement_in_buffer(uint32_t timestamp, Measurement *result) {
     return false;
 }
 // ─────────────────────────────────────────────────────────────────────────────
+bool buffer_get_time_bounds(uint8_t series_id, uint64_t *earliest, uint64_t *latest) {
+    if (buffer_mutex == NULL || series_id >= SERIES_COUNT) {
+        return false;
+    }
+
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    bool has_data = buffer[series_id].count > 0;
+    *earliest = buffer[series_id].earliest_ts;
+    *latest = buffer[series_id].latest_ts;
+    xSemaphoreGive(buffer_mutex);
+    return has_data;
+}
+// ─────────────────────────────────────────────────────────────────────────────
 // Retrieves measurements within the specified timestamp range from the buffer
-int get_measurements_from_buffer(uint32_t start_timestamp, uint32_t end_timestamp,
+int get_measurements_from_buffer(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
                                  Measurement *measurements, size_t max_measurements) {
+    return get_measurements_from_buffer_where(series_id, start_timestamp, end_timestamp, NULL,
+                                              measurements, max_measurements);
+}
+
+int get_measurements_from_buffer_where(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                                       const ValuePredicate *where, Measurement *measurements,
+                                       size_t max_measurements) {
     if (buffer_mutex == NULL) {
         ESP_LOGE(TAG, "Buffer mutex not initialized");
         return -1;
     }
+    if (series_id >= SERIES_COUNT) {
+        return 0;
+    }
 
     xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    const SeriesBuffer *sb = &buffer[series_id];
     int count = 0;
-    for (int i = 0; i < buffer_count; i++) {
-        int index = (buffer_tail + i) % BUFFER_CAPACITY_MACRO;
-        Measurement *m = &buffer[index];
+    int scan = sb->count;
+    if (where && scan > 0 && !value_predicate_may_match(where, sb->min_value, sb->max_value)) {
+        scan = 0;
+    }
+    for (int i = 0; i < scan; i++) {
+        int index = (sb->tail + i) % BUFFER_CAPACITY_MACRO;
+        uint64_t ts = sb->timestamps[index];
 
-        if (m->timestamp >= start_timestamp && m->timestamp <= end_timestamp) {
+        if (ts >= start_timestamp && ts <= end_timestamp
+            && (where == NULL || value_predicate_match(where, sb->values[index]))) {
             if (count < (int)max_measurements) {
-                measurements[count++] = *m;
+                slot_to_measurement(sb, series_id, index, &measurements[count++]);
             } else {
-                // Exceeded the maximum measurements that can be stored in the provided array
-                ESP_LOGW(TAG, "get_measurements_from_buffer: reached max_measurements limit=%u", 
+                // Array full; streaming callers resume after the last timestamp copied
+                ESP_LOGD(TAG, "get_measurements_from_buffer: reached max_measurements limit=%u", 
                          (unsigned)max_measurements);
                 break;
             }
@@ -204,8 +645,75 @@ int get_measurements_from_buffer(uint32_t start_timestamp, uint32_t end_timestam
     }
     xSemaphoreGive(buffer_mutex);
 
+    TRACE(TRACE_BUFFER_LOOKUP, series_id, count);
     if (count > 0) {
-        ESP_LOGI(TAG, "get_measurements_from_buffer: found %d matching entries in buffer", count);
+        TRACE_LOG("get_measurements_from_buffer: found %d matching entries in buffer", count);
     }
     return count; // Return the number of measurements found
-}
\ No newline at end of file
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int get_late_measurements(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                          const ValuePredicate *where, Measurement *measurements, size_t max_measurements) {
+    if (buffer_mutex == NULL || series_id >= SERIES_COUNT) {
+        return 0;
+    }
+
+    // The samples being merged and those staged since, the staged value winning a shared timestamp
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    const LateStage *merging = &late_merging[series_id];
+    const LateStage *stage = &late_stage[series_id];
+    int count = 0;
+    int a = 0, b = 0;
+    while ((a < merging->count || b < stage->count) && count < (int)max_measurements) {
+        uint64_t ts;
+        float value;
+        if (b == stage->count || (a < merging->count && merging->timestamps[a] < stage->timestamps[b])) {
+            ts = merging->timestamps[a];
+            value = merging->values[a++];
+        } else {
+            if (a < merging->count && merging->timestamps[a] == stage->timestamps[b]) {
+                a++;
+            }
+            ts = stage->timestamps[b];
+            value = stage->values[b++];
+        }
+        if (ts >= start_timestamp && ts <= end_timestamp && (where == NULL || value_predicate_match(where, value))) {
+            measurements[count++] = (Measurement){ .timestamp = ts, .value = value,
+                                                   .dirty_bit = DIRTY_BIT_BUFFER_ONLY, .series_id = series_id };
+        }
+    }
+    xSemaphoreGive(buffer_mutex);
+    return count;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void buffer_ingest_position(uint8_t series_id, uint32_t *epoch, uint32_t *seq) {
+    *epoch = 0;
+    *seq = 0;
+    if (buffer_mutex == NULL || series_id >= SERIES_COUNT) {
+        return;
+    }
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    *epoch = ingest_epoch;
+    *seq = ingest_seq[series_id];
+    xSemaphoreGive(buffer_mutex);
+}
+
+int buffer_get_rewrites(uint8_t series_id, uint32_t after_seq, uint32_t up_to_seq,
+                        uint64_t *timestamps, uint32_t *seqs, size_t max) {
+    if (buffer_mutex == NULL || series_id >= SERIES_COUNT) {
+        return -1;
+    }
+    xSemaphoreTake(buffer_mutex, portMAX_DELAY);
+    const RewriteLog *log = &rewrite_log[series_id];
+    int count = log->lost_seq > after_seq ? -1 : 0;
+    for (int i = 0; count >= 0 && i < log->count && count < (int)max; i++) {
+        int idx = (log->next - log->count + i + BUFFER_REWRITE_LOG) % BUFFER_REWRITE_LOG;
+        if (log->seqs[idx] > after_seq && log->seqs[idx] <= up_to_seq) {
+            timestamps[count] = log->timestamps[idx];
+            seqs[count] = log->seqs[idx];
+            count++;
+        }
+    }
+    xSemaphoreGive(buffer_mutex);
+    return count;
+}
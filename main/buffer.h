@@ -5,32 +5,92 @@
 #include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "config.h"
 // ─────────────────────────────────────────────────────────────────────────────
-#define BUFFER_CAPACITY_MACRO 10
+#if CONFIG_HIGH_RATE_SAMPLING
+#define BUFFER_CAPACITY_MACRO 40 // 80% threshold = one full segment per flush
+#else
+#define BUFFER_CAPACITY_MACRO 10 // ~10 readings per series
+#endif
 #define BUFFER_THRESHOLD_PERCENT 80
+/* Samples older than what a series already flushed, held until the next flush merges them */
+#define BUFFER_LATE_CAPACITY 16
+/* Staged late samples that make buffer_is_threshold_full() ask for that flush */
+#define BUFFER_LATE_FLUSH_AT (BUFFER_LATE_CAPACITY / 2)
+/* Late samples not in flash yet: the stage plus what a flush is merging */
+#define BUFFER_LATE_HELD (2 * BUFFER_LATE_CAPACITY)
+#define BUFFER_BITMAP_WORDS ((BUFFER_CAPACITY_MACRO + 31) / 32)
+/* Samples of a batch appended per buffer_mutex acquisition */
+#define BUFFER_INGEST_CHUNK 16
+/* Rewrites remembered per series for cursors (see buffer_get_rewrites) */
+#define BUFFER_REWRITE_LOG 32
 // ─────────────────────────────────────────────────────────────────────────────
-extern Measurement buffer[];
-extern int buffer_head;
-extern int buffer_tail;
-extern int buffer_count;
+/*
+ * One ring per series, stored column-wise: range scans only touch the
+ * timestamp column, and the series id and dirty state are implied by the
+ * ring and the `persisted` bitmap instead of being repeated per record.
+ * The ring stays sorted by timestamp: a sample at or before the newest one is
+ * inserted in place (replacing one with its timestamp), and one at or before
+ * `flushed_ts` also goes to the late stage, which the next flush merges into
+ * the stored segments. A full stage drops it (counted as late_dropped).
+ */
+typedef struct {
+    uint64_t timestamps[BUFFER_CAPACITY_MACRO];
+    float values[BUFFER_CAPACITY_MACRO];
+    uint32_t persisted[BUFFER_BITMAP_WORDS]; // bit set once the slot is in flash
+    int head;
+    int tail;
+    int count;
+    uint64_t earliest_ts; // Track earliest & latest timestamps in the ring
+    uint64_t latest_ts;
+    float min_value;      // Value bounds: a predicate query skips the ring if they cannot match
+    float max_value;
+    uint64_t flushed_ts;  // newest timestamp in flash (0 = none)
+} SeriesBuffer;
+// ─────────────────────────────────────────────────────────────────────────────
+extern SeriesBuffer buffer[SERIES_COUNT];
 extern SemaphoreHandle_t buffer_mutex;
 extern const int BUFFER_CAPACITY;
 // ─────────────────────────────────────────────────────────────────────────────
-/* Track earliest & latest timestamps in the buffer */
-extern uint32_t buffer_earliest_ts;
-extern uint32_t buffer_latest_ts;
-// ─────────────────────────────────────────────────────────────────────────────
 void buffer_init(void);
 void buffer_add_measurement(Measurement *m);
+void buffer_add_measurements(const Measurement *batch, size_t n);
+/* Same, for samples already ingested once (warm-up, journal replay): not counted or pushed to subscribers */
+void buffer_restore_measurements(const Measurement *batch, size_t n);
+/* Marks everything up to the series' newest stored timestamp as flushed; false if it has no segments */
+bool buffer_seed_flushed_ts(uint8_t series_id, uint32_t *newest_segment);
+/* Loads the newest stored samples (segment `newest`) into the series' empty ring; returns how many */
+size_t buffer_warm_from_flash(uint8_t series_id, uint32_t newest);
 bool buffer_is_threshold_full(void);
 void buffer_push_to_flash(void);
-bool find_measurement_in_buffer(uint32_t timestamp, Measurement *result);
+bool find_measurement_in_buffer(uint8_t series_id, uint64_t timestamp, Measurement *result);
 // ─────────────────────────────────────────────────────────────────────────────
-/* Helper to re-scan the buffer and find a new earliest_ts if we evict oldest */
-void update_buffer_earliest(void);
+/* Helper to re-scan one ring for a new earliest_ts and value bounds if we evict oldest */
+void update_buffer_earliest(uint8_t series_id);
+/* Copies the ring's time bounds; returns false if the series has nothing buffered */
+bool buffer_get_time_bounds(uint8_t series_id, uint64_t *earliest, uint64_t *latest);
 // ─────────────────────────────────────────────────────────────────────────────
-/*  Retrieve all measurements in the range from the buffer into `measurements` array */
-int get_measurements_from_buffer(uint32_t start_timestamp, uint32_t end_timestamp,
+/*  Retrieve all measurements of one series in the range from the buffer into `measurements` array */
+int get_measurements_from_buffer(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
                                  Measurement *measurements, size_t max_measurements);
+/* Same, keeping only values that satisfy `where` (NULL matches everything) */
+int get_measurements_from_buffer_where(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                                       const ValuePredicate *where, Measurement *measurements,
+                                       size_t max_measurements);
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Every accepted sample takes the next ingest sequence number of its series.
+ * One at or before the newest sample the series already had (a late arrival,
+ * a back-fill, a new value for a buffered timestamp) is a rewrite: a cursor
+ * past its timestamp would miss it, so it is also kept in a small log.
+ * Sequences restart at every boot under a new epoch.
+ */
+void buffer_ingest_position(uint8_t series_id, uint32_t *epoch, uint32_t *seq);
+/* Rewrites with a sequence in (after_seq, up_to_seq], oldest first; -1 if the log no longer reaches back that far */
+int buffer_get_rewrites(uint8_t series_id, uint32_t after_seq, uint32_t up_to_seq,
+                        uint64_t *timestamps, uint32_t *seqs, size_t max);
+/* Late samples in the range not merged into flash yet, sorted (at most BUFFER_LATE_HELD) */
+int get_late_measurements(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                          const ValuePredicate *where, Measurement *measurements, size_t max_measurements);
 // ─────────────────────────────────────────────────────────────────────────────
 #endif // BUFFER_H
\ No newline at end of file
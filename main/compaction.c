@@ -0,0 +1,181 @@
+#include "compaction.h"
+#include "config.h"
+#include "nvs_utils.h"
+#include "segment_list.h"
+#include "metrics.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "COMPACTION";
+/* Anything earlier means the clock has not been set (SNTP not synced yet) */
+#define MIN_VALID_TIME_MS 1577836800000ULL  // 2020-01-01
+// ─────────────────────────────────────────────────────────────────────────────
+// Drops the first n entries of a series' list (its oldest data)
+static bool drop_segments(const SegmentInfo *list, size_t n) {
+    uint32_t ids[MANIFEST_MAX_PENDING];
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = list[i].segment_id;
+    }
+    if (!replace_segments_in_flash(list[0].series_id, ids, n, NULL, 0)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Dropped %u %s segments (ts %" PRIu64 "..%" PRIu64 ")",
+             (unsigned)n, series_name(list[0].series_id), list[0].min_ts, list[n - 1].max_ts);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Averages the records of `run` in groups of at least CONFIG_ROLLUP_FACTOR so the result fits one segment
+static bool rollup_run(const SegmentInfo *run, size_t n) {
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        total += run[i].count;
+    }
+    size_t group = (total + SEGMENT_MAX_RECORDS - 1) / SEGMENT_MAX_RECORDS;
+    if (group < CONFIG_ROLLUP_FACTOR) {
+        group = CONFIG_ROLLUP_FACTOR;
+    }
+
+    Segment *src = malloc(sizeof(Segment));
+    Segment *dst = calloc(1, sizeof(Segment));
+    if (src == NULL || dst == NULL) {
+        free(src);
+        free(dst);
+        return false;
+    }
+    dst->info.series_id = run[0].series_id;
+    dst->info.flags = SEGMENT_FLAG_ROLLUP;
+
+    size_t in_group = 0;
+    double sum = 0;
+    bool all_sent = true;
+    bool ok = true;
+    for (size_t i = 0; i < n && ok; i++) {
+        // Straight from flash: old data should not displace the read cache
+        ok = load_segment_from_flash(run[i].segment_id, src);
+        for (int r = 0; ok && r < src->info.count; r++) {
+            if (in_group == 0) {
+                dst->timestamps[dst->info.count] = src->timestamps[r];
+            }
+            sum += src->values[r];
+            all_sent = all_sent && segment_is_sent(src, r);
+            if (++in_group == group) {
+                dst->values[dst->info.count] = (float)(sum / in_group);
+                if (all_sent) {
+                    segment_mark_sent(dst, dst->info.count);
+                }
+                dst->info.count++;
+                in_group = 0;
+                sum = 0;
+                all_sent = true;
+            }
+        }
+    }
+    if (ok && in_group > 0) {
+        dst->values[dst->info.count] = (float)(sum / in_group);
+        if (all_sent) {
+            segment_mark_sent(dst, dst->info.count);
+        }
+        dst->info.count++;
+    }
+    free(src);
+
+    uint32_t ids[CONFIG_ROLLUP_SEGMENTS];
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = run[i].segment_id;
+    }
+    ok = ok && dst->info.count > 0 && replace_segments_in_flash(run[0].series_id, ids, n, dst, 1);
+    if (ok) {
+        ESP_LOGI(TAG, "Rolled up %u %s segments (%u records) into segment %" PRIu32 " (%u records)",
+                 (unsigned)n, series_name(run[0].series_id), (unsigned)total,
+                 dst->info.segment_id, dst->info.count);
+    }
+    free(dst);
+    return ok;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Applies the first rule that has work; returns segments reclaimed (0 = nothing to do).
+// Under space pressure a rollup is preferred to a drop since it keeps a coarse copy.
+static size_t compact_one(uint64_t now_ms) {
+    bool clock_valid = now_ms >= MIN_VALID_TIME_MS;
+    SegmentInfo *oldest_list = NULL;    // list of the series holding the oldest data
+    size_t oldest_count = 0;
+
+    for (uint8_t series_id = 0; series_id < SERIES_COUNT; series_id++) {
+        size_t count = 0;
+        SegmentInfo *list = load_segment_list(series_id, &count);
+        if (list == NULL) {
+            continue;
+        }
+
+        // Age limit: lists are in time order, so expired segments form the head
+        size_t expired = 0;
+        while (clock_valid && CONFIG_RETENTION_MAX_AGE_MS > 0 && expired < count &&
+               expired < MANIFEST_MAX_PENDING && list[expired].max_ts + CONFIG_RETENTION_MAX_AGE_MS < now_ms) {
+            expired++;
+        }
+        if (expired > 0) {
+            bool dropped = drop_segments(list, expired);
+            free(list);
+            free(oldest_list);
+            return dropped ? expired : 0;
+        }
+
+        if (oldest_list == NULL || list[0].min_ts < oldest_list[0].min_ts) {
+            free(oldest_list);
+            oldest_list = list;
+            oldest_count = count;
+        }
+
+        // Rollup: the first run of old raw segments (rollups sit in front of them)
+        if (clock_valid && CONFIG_ROLLUP_AGE_MS > 0) {
+            size_t first = 0;
+            while (first < count && (list[first].flags & SEGMENT_FLAG_ROLLUP)) {
+                first++;
+            }
+            size_t n = 0;
+            while (first + n < count && n < CONFIG_ROLLUP_SEGMENTS &&
+                   !(list[first + n].flags & SEGMENT_FLAG_ROLLUP) &&
+                   list[first + n].max_ts + CONFIG_ROLLUP_AGE_MS < now_ms) {
+                n++;
+            }
+            // Wait for a full run so every rollup saves the same number of segments.
+            // A rollup needs room for its output; if that fails the space rule below still runs.
+            if (n == CONFIG_ROLLUP_SEGMENTS && rollup_run(&list[first], n)) {
+                if (list != oldest_list) {
+                    free(list);
+                }
+                free(oldest_list);
+                return n - 1;
+            }
+        }
+        if (list != oldest_list) {
+            free(list);
+        }
+    }
+
+    // Space limit: drop the oldest data of any series, a run at a time to keep up with ingest
+    size_t reclaimed = 0;
+    if (oldest_list != NULL && get_flash_usage_percent() >= CONFIG_RETENTION_MAX_FLASH_PERCENT) {
+        size_t n = oldest_count < MANIFEST_MAX_PENDING ? oldest_count : MANIFEST_MAX_PENDING;
+        reclaimed = drop_segments(oldest_list, n) ? n : 0;
+    }
+    free(oldest_list);
+    return reclaimed;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+size_t compact_storage(uint64_t now_ms) {
+    size_t reclaimed = 0;
+    for (int unit = 0; unit < CONFIG_COMPACTION_MAX_UNITS; unit++) {
+        size_t r = compact_one(now_ms);
+        if (r == 0) {
+            break;
+        }
+        reclaimed += r;
+    }
+    if (reclaimed > 0) {
+        metrics_inc(METRIC_RECLAIMED, reclaimed);
+    }
+    return reclaimed;
+}
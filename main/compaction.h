@@ -0,0 +1,20 @@
+#ifndef COMPACTION_H
+#define COMPACTION_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stddef.h>
+#include <stdint.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Retention policy for flash segments, applied in whole-segment units so the
+ * node keeps ingesting while the edge is unreachable:
+ *   - segments older than CONFIG_RETENTION_MAX_AGE_MS are dropped;
+ *   - above CONFIG_RETENTION_MAX_FLASH_PERCENT NVS usage the oldest segment
+ *     of any series is dropped;
+ *   - runs of raw segments older than CONFIG_ROLLUP_AGE_MS are merged into
+ *     one rollup segment of per-group averages.
+ * Age rules are skipped while the clock is not set.
+ */
+/* One bounded pass (at most CONFIG_COMPACTION_MAX_UNITS replacements); returns segments reclaimed */
+size_t compact_storage(uint64_t now_ms);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // COMPACTION_H
@@ -8,7 +8,79 @@
 // DHT Sensor GPIO Pin
 #define CONFIG_DHT_GPIO_PIN GPIO_NUM_22 // Replace with your GPIO number
 
+// High-rate sampling mode (vibration / thermal transients on an analog input).
+// When enabled, the DHT task is replaced by one that samples the ADC channel
+// and commits the readings to the buffer in batches.
+#define CONFIG_HIGH_RATE_SAMPLING 0            // 1 = enable
+#define CONFIG_HIGH_RATE_SAMPLE_HZ 50          // 10..100 Hz, rounded to the FreeRTOS tick
+#define CONFIG_HIGH_RATE_BATCH_SIZE 10         // Samples per buffer_add_measurements() call
+#define CONFIG_HIGH_RATE_ADC_CHANNEL ADC_CHANNEL_6 // GPIO34 on ADC1
+#define CONFIG_HIGH_RATE_ADC_SCALE 0.1f        // value = raw * scale + offset
+#define CONFIG_HIGH_RATE_ADC_OFFSET 0.0f
+
+// Benchmark mode: on boot, run the storage/query benchmark and print a JSON
+// report instead of starting normal operation. Erases the "storage" namespace!
+#define CONFIG_RUN_BENCHMARK 0                 // 1 = enable
+#define CONFIG_BENCHMARK_DAYS 1                // Days of synthetic history to load
+#define CONFIG_BENCHMARK_INTERVAL_MS 20000     // Synthetic sample interval
+#define CONFIG_BENCHMARK_QUERIES 100           // Lookups/range queries per width
+#define CONFIG_BENCHMARK_SOAK_QUERIES 10000    // Mixed queries replayed to check heap fragmentation
+#define CONFIG_BENCHMARK_CONCURRENT_S 60       // Then ingest at CONFIG_HIGH_RATE_SAMPLE_HZ under queries (0 = skip)
+
+// Runtime metrics: JSON snapshot published to esp32/metrics on the device broker
+#define CONFIG_METRICS_PUBLISH_INTERVAL_MS 60000
+
+// Hot-path tracing per module (see trace.h): 0 = off, 1 = binary ring, 2 = ring + console
+#define CONFIG_TRACE_LEVEL_BUFFER 1
+#define CONFIG_TRACE_LEVEL_NVS 1
+#define CONFIG_TRACE_LEVEL_SEGMENT_LIST 1
+#define CONFIG_TRACE_LEVEL_QUERY 1
+#define CONFIG_TRACE_RING_SIZE 256             // Records (16 bytes each); power of two
+
+// Write-ahead journal for buffered samples: a reset loses at most one commit interval
+#define CONFIG_WAL_ENABLED 1                   // 1 = enable
+#define CONFIG_WAL_COMMIT_INTERVAL_MS 5000     // Group commit period
+#define CONFIG_WAL_GROUP_RECORDS 32            // Samples per chunk; a full group commits early
+#define CONFIG_WAL_MAX_CHUNKS 16               // Chunks awaiting a covering segment
+
+// Boot recovery: buffer warm-up stops once this much time is spent
+#ifndef CONFIG_BOOT_RECOVERY_BUDGET_MS        // host_test/ also builds a core that never warms up
+#define CONFIG_BOOT_RECOVERY_BUDGET_MS 300
+#endif
+#define CONFIG_INDEX_VALIDATE_BATCH 16         // List entries checked per flash monitoring pass
+
+// Retention: the compactor reclaims whole segments so ingest keeps going during edge outages
+#define CONFIG_RETENTION_MAX_AGE_MS (30ULL * 24 * 3600 * 1000)  // Drop older segments (0 = keep)
+#define CONFIG_RETENTION_MAX_FLASH_PERCENT 85  // Drop oldest segments above this flash usage
+#define CONFIG_ROLLUP_AGE_MS (24ULL * 3600 * 1000)  // Downsample raw segments older than this (0 = never)
+#define CONFIG_ROLLUP_SEGMENTS 4               // Raw segments merged per rollup (<= MANIFEST_MAX_PENDING)
+#define CONFIG_ROLLUP_FACTOR 4                 // Minimum samples averaged into one rollup point
+#define CONFIG_COMPACTION_INTERVAL_MS 10000
+#define CONFIG_COMPACTION_MAX_UNITS 8          // Segment replacements per compaction pass
+
+// Segment storage backend: 0 = one NVS blob per segment, 1 = circular log on a raw
+// data partition (needs the "tsdata" entry of partitions.csv and CONFIG_PARTITION_TABLE_CUSTOM).
+// Lists, manifest and WAL stay in NVS; the first boot after switching moves the segments over.
+#ifndef CONFIG_STORAGE_RAW_PARTITION          // host_test/ builds both backends
+#define CONFIG_STORAGE_RAW_PARTITION 0         // 1 = enable
+#endif
+#define CONFIG_RAW_PARTITION_LABEL "tsdata"
+
+// HTTP range endpoint (GET /range, see http_server.h), served alongside the MQTT query topic
+#define CONFIG_RANGE_HTTP_ENABLED 1            // 1 = enable
+#define CONFIG_RANGE_HTTP_PORT 80
+
+// Live queries ("subscribe" action, see subscription.h): defaults for clients that omit them
+#define CONFIG_SUBSCRIPTION_BATCH_RECORDS 10   // Points per pushed message
+#define CONFIG_SUBSCRIPTION_BATCH_MS 5000      // Longest a point waits for its batch
+#define CONFIG_SUBSCRIPTION_LEASE_MS 600000    // Expiry unless the client subscribes again
+#define CONFIG_SUBSCRIPTION_FLUSH_MS 250       // How often due batches are pushed
+
 // EDGE part
+// Fleet id: measurements go to esp32/<id>/temperature so the edge bridge can tag them
+// per device; empty keeps the single-device esp32/temperature topic. Letters, digits, '_'
+// and '-' only: the bridge ignores topics with any other id
+#define CONFIG_DEVICE_ID ""
 #define CONFIG_EDGE_MQTT_BROKER_URI "mqtt://192.X.X.X:1883" 
 #define CONFIG_EDGE_MQTT_USERNAME "edge_device"
 #define CONFIG_EDGE_MQTT_PASSWORD "pass101"
@@ -0,0 +1,248 @@
+#include "http_server.h"
+#include "query_handler.h"
+#include "buffer.h"
+#include "measurement.h"
+#include "metrics.h"
+#include "mem_pool.h"
+#include "config.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "HTTP_SERVER";
+
+#define HTTP_CHUNK_BYTES 1024
+#define HTTP_RECORD_MAX_BYTES 48   // Longest "[ts,value]," a JSON record can take
+#define HTTP_BIN_RECORD_BYTES 12
+
+static httpd_handle_t server = NULL;
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    httpd_req_t *req;
+    bool binary;
+    bool failed;     // Client went away; nothing more can be sent
+    size_t emitted;
+    bool rewrites;   // Sending samples rewritten behind the cursor, which do not move it
+    uint64_t last_ts;
+    size_t len;
+    char buf[HTTP_CHUNK_BYTES];
+} RangeStream;
+
+static bool flush_chunk(RangeStream *rs) {
+    if (rs->len == 0) {
+        return true;
+    }
+    if (httpd_resp_send_chunk(rs->req, rs->buf, rs->len) != ESP_OK) {
+        ESP_LOGW(TAG, "Client closed the range stream after %u samples", (unsigned)rs->emitted);
+        rs->failed = true;
+        return false;
+    }
+    rs->len = 0;
+    return true;
+}
+
+static bool append_text(RangeStream *rs, const char *text) {
+    size_t n = strlen(text);
+    if (rs->len + n > sizeof(rs->buf) && !flush_chunk(rs)) {
+        return false;
+    }
+    memcpy(&rs->buf[rs->len], text, n);
+    rs->len += n;
+    return true;
+}
+
+static bool emit_range_chunk(const Measurement *measurements, size_t count, void *ctx) {
+    RangeStream *rs = ctx;
+    for (size_t i = 0; i < count; i++) {
+        size_t need = rs->binary ? HTTP_BIN_RECORD_BYTES : HTTP_RECORD_MAX_BYTES;
+        if (rs->len + need > sizeof(rs->buf) && !flush_chunk(rs)) {
+            return false;
+        }
+        if (rs->binary) {
+            // The ESP32 is little-endian, so the in-memory layout is the wire layout
+            memcpy(&rs->buf[rs->len], &measurements[i].timestamp, sizeof(uint64_t));
+            memcpy(&rs->buf[rs->len + 8], &measurements[i].value, sizeof(float));
+            rs->len += HTTP_BIN_RECORD_BYTES;
+        } else if (isfinite(measurements[i].value)) {
+            rs->len += snprintf(&rs->buf[rs->len], sizeof(rs->buf) - rs->len, "%s[%" PRIu64 ",%.7g]",
+                                rs->emitted ? "," : "", measurements[i].timestamp, measurements[i].value);
+        } else {
+            // JSON has no NaN or Infinity; null, as in the MQTT responses
+            rs->len += snprintf(&rs->buf[rs->len], sizeof(rs->buf) - rs->len, "%s[%" PRIu64 ",null]",
+                                rs->emitted ? "," : "", measurements[i].timestamp);
+        }
+        if (!rs->rewrites) {
+            rs->last_ts = measurements[i].timestamp;
+        }
+        rs->emitted++;
+    }
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static bool query_param_u64(const char *query, const char *key, uint64_t *value) {
+    char text[24];
+    if (httpd_query_key_value(query, key, text, sizeof(text)) != ESP_OK || text[0] == '\0') {
+        return false;
+    }
+    char *end = NULL;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*end != '\0' || text[0] == '-') {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+static uint8_t query_param_series(const char *query) {
+    char text[24];
+    if (httpd_query_key_value(query, "series", text, sizeof(text)) != ESP_OK) {
+        return SERIES_TEMPERATURE; // Same default as get_data_range
+    }
+    char *end = NULL;
+    unsigned long id = strtoul(text, &end, 10);
+    if (text[0] != '\0' && *end == '\0') {
+        return id < SERIES_COUNT ? (uint8_t)id : SERIES_INVALID;
+    }
+    return series_from_name(text);
+}
+
+static esp_err_t range_get_handler(httpd_req_t *req) {
+    int64_t start_us = esp_timer_get_time();
+
+    char query[160];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "start and end are required");
+    }
+    // since=<cursor> makes start and end optional and only returns what followed the cursor
+    char cursor_text[QUERY_CURSOR_LEN + 1];
+    QueryCursor cursor = { 0 };
+    bool incremental = httpd_query_key_value(query, "since", cursor_text, sizeof(cursor_text)) == ESP_OK;
+    if (incremental && !query_cursor_parse(cursor_text, &cursor)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid cursor");
+    }
+    uint64_t start_timestamp = 0, end_timestamp = UINT64_MAX;
+    bool has_start = query_param_u64(query, "start", &start_timestamp);
+    bool has_end = query_param_u64(query, "end", &end_timestamp);
+    if ((!incremental && (!has_start || !has_end)) || end_timestamp < start_timestamp) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "start and end must be ms timestamps, start <= end");
+    }
+    uint8_t series_id = query_param_series(query);
+    if (series_id == SERIES_INVALID) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "unknown series");
+    }
+    char format[8] = "json";
+    httpd_query_key_value(query, "format", format, sizeof(format));
+    bool binary = strcmp(format, "bin") == 0;
+    if (!binary && strcmp(format, "json") != 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "format must be json or bin");
+    }
+
+    // The stream state and the scan's buffers live in this request's arena
+    mem_arena_begin();
+    RangeStream *rs = mem_scratch_alloc(sizeof(RangeStream));
+    if (!rs) {
+        ESP_LOGE(TAG, "Failed to allocate range stream");
+        mem_arena_end();
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+    }
+    rs->req = req;
+    rs->binary = binary;
+    rs->failed = false;
+    rs->emitted = 0;
+    rs->rewrites = false;
+    rs->last_ts = 0;
+    rs->len = 0;
+
+    httpd_resp_set_type(req, binary ? "application/octet-stream" : "application/json");
+    // The dashboard is served from elsewhere
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (!binary) {
+        char head[48];
+        snprintf(head, sizeof(head), "{\"series\":\"%s\",\"points\":[", series_name(series_id));
+        append_text(rs, head);
+    }
+
+    // A refresh first sends what was rewritten behind the cursor, then what followed it
+    QueryCursor next = { 0 };
+    buffer_ingest_position(series_id, &next.epoch, &next.seq);
+    bool resync = false;
+    int found = 0;
+    if (incremental) {
+        uint32_t seq_done = cursor.seq;
+        rs->rewrites = true;
+        found = query_rewrites_stream(series_id, &cursor, next.epoch, next.seq, start_timestamp, end_timestamp,
+                                      NULL, emit_range_chunk, rs, &seq_done);
+        rs->rewrites = false;
+        resync = found == QUERY_RESYNC;
+        if (!resync) {
+            rs->last_ts = cursor.last_ts;
+            if (cursor.last_ts >= start_timestamp) {
+                start_timestamp = cursor.last_ts < UINT64_MAX ? cursor.last_ts + 1 : UINT64_MAX;
+            }
+        }
+        if (found == -1) {
+            // Resumes at the rewrite that could not be read
+            next.seq = seq_done;
+            start_timestamp = UINT64_MAX;
+            end_timestamp = 0;
+        }
+    }
+    if (end_timestamp >= start_timestamp && !rs->failed) {
+        found = query_range_stream(series_id, start_timestamp, end_timestamp, NULL, emit_range_chunk, rs);
+    }
+
+    if (!rs->failed && !binary) {
+        // The cursor resumes after the last sample sent, even after a read error
+        next.last_ts = rs->last_ts;
+        char next_cursor[QUERY_CURSOR_LEN];
+        query_cursor_format(&next, next_cursor);
+        char tail[128];
+        snprintf(tail, sizeof(tail), "],\"count\":%u,\"cursor\":\"%s\"%s%s}", (unsigned)rs->emitted, next_cursor,
+                 resync ? ",\"resync\":true" : "", found == -1 ? ",\"error\":\"read failed\"" : "");
+        append_text(rs, tail);
+    }
+    esp_err_t err = ESP_FAIL;
+    if (!rs->failed && flush_chunk(rs)) {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    ESP_LOGI(TAG, "GET /range %s [%" PRIu64 ", %" PRIu64 "] -> %u samples (%s)", series_name(series_id),
+             start_timestamp, end_timestamp, (unsigned)rs->emitted, binary ? "bin" : "json");
+    mem_scratch_free(rs);
+    mem_arena_end();
+
+    metrics_inc(METRIC_QUERIES, 1);
+    metrics_observe(METRIC_HIST_QUERY_US, (uint32_t)(esp_timer_get_time() - start_us));
+    return err;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool http_server_start(void) {
+    if (server != NULL) {
+        return true;
+    }
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = CONFIG_RANGE_HTTP_PORT;
+    // Room for the query engine's chunk and segment buffers
+    config.stack_size = 6144;
+
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(err));
+        server = NULL;
+        return false;
+    }
+
+    const httpd_uri_t range_uri = {
+        .uri = "/range",
+        .method = HTTP_GET,
+        .handler = range_get_handler,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &range_uri);
+    ESP_LOGI(TAG, "Serving GET /range on port %d", config.server_port);
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * GET /range?start=<ms>&end=<ms>[&series=temperature|humidity|<id>][&format=json|bin]
+ * GET /range?since=<cursor>[&end=<ms>][&series=...][&format=json|bin]
+ *
+ * Runs the same range query as get_data_range over MQTT and streams the result
+ * with chunked transfer encoding, so the response never sits in RAM whole.
+ *   json: {"series":"temperature","points":[[ts,value],...],"count":N,"cursor":".."}
+ * A refresh lists samples rewritten behind its cursor first, then the new
+ * ones; "resync":true instead means the points are the window from its start.
+ *   bin:  12-byte little-endian records, u64 timestamp (ms) then f32 value
+ * A read error mid-stream ends a JSON body with an "error" member and cuts a
+ * binary body short. Binary bodies carry no cursor; a binary client resumes
+ * with start set to one past its last record's timestamp.
+ */
+bool http_server_start(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // HTTP_SERVER_H
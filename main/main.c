@@ -1,6 +1,7 @@
 // main.c
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
@@ -21,12 +22,26 @@
 
 #include "mqtt_client.h"
 #include "dht.h"
+#if CONFIG_HIGH_RATE_SAMPLING
+#include "esp_adc/adc_oneshot.h"
+#endif
 
 #include "buffer.h"
 #include "nvs_utils.h"
 #include "measurement.h"
 #include "mqtt_utils.h"
-#include "timestamp_list.h"
+#include "mqtt_topics.h"
+#include "offload.h"
+#include "segment_list.h"
+#include "benchmark.h"
+#include "read_cache.h"
+#include "wal.h"
+#include "recovery.h"
+#include "compaction.h"
+#include "http_server.h"
+#include "subscription.h"
+#include "metrics.h"
+#include "mem_pool.h"
 
 // New parts
 #include "query_handler.h"
@@ -71,8 +86,14 @@ void wifi_init_sta(void);
 void obtain_time(void);
 void mqtt_app_start(void);
 void measurement_collection_task(void *pvParameters);
+#if CONFIG_HIGH_RATE_SAMPLING
+void high_rate_collection_task(void *pvParameters);
+#endif
 void flash_monitoring_task(void *pvParameters);
-void send_flash_data_to_edge(void);
+void metrics_publish_task(void *pvParameters);
+void wal_commit_task(void *pvParameters);
+void subscription_task(void *pvParameters);
+void compaction_task(void *pvParameters);
 void time_sync_notification_cb(struct timeval *tv);
 void buffer_init(void);
 
@@ -86,28 +107,41 @@ static EventGroupHandle_t s_wifi_event_group;
 void edge_mqtt_event_handler(void *handler_args, esp_event_base_t event_base, int32_t event_id, void *event_data);
 void device_mqtt_event_handler(void *handler_args, esp_event_base_t event_base, int32_t event_id, void *event_data);
 
+// ─────────────────────────────────────────────────────────────────────────────
+// Wall-clock time in milliseconds since the epoch (SNTP keeps it in sync)
+static uint64_t current_timestamp_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+}
+
 // ─────────────────────────────────────────────────────────────────────────────
 // Measurement Collection Task
 void measurement_collection_task(void *pvParameters) {
     while (1) {
-        Measurement m;
-        m.timestamp = (uint32_t)time(NULL);
+        uint64_t timestamp = current_timestamp_ms();
 
         float humidity = 0.0f;
         float temperature = 0.0f;
 
         if (dht_read_float_data(SENSOR_TYPE, DHT_GPIO_PIN, &humidity, &temperature) == ESP_OK) {
-            m.temperature = temperature;
-            m.dirty_bit = DIRTY_BIT_BUFFER_ONLY;
+            // One reading yields one sample per series, sharing the timestamp
+            Measurement samples[SERIES_COUNT] = {
+                { .timestamp = timestamp, .value = temperature,
+                  .dirty_bit = DIRTY_BIT_BUFFER_ONLY, .series_id = SERIES_TEMPERATURE },
+                { .timestamp = timestamp, .value = humidity,
+                  .dirty_bit = DIRTY_BIT_BUFFER_ONLY, .series_id = SERIES_HUMIDITY },
+            };
 
             // Add to buffer
-            buffer_add_measurement(&m);
+            buffer_add_measurements(samples, SERIES_COUNT);
 
-            ESP_LOGI(TAG, "Measurement collected: Timestamp: %" PRIu32 ", Temperature: %.1f°C", m.timestamp, m.temperature);
+            ESP_LOGI(TAG, "Measurement collected: Timestamp: %" PRIu64 ", Temperature: %.1f°C, Humidity: %.1f%%",
+                     timestamp, temperature, humidity);
 
             // Check if buffer is at threshold
             if (buffer_is_threshold_full()) {
-                ESP_LOGI(TAG, "Buffer is %d%% full. Pushing half of the entries to flash.", BUFFER_THRESHOLD_PERCENT);
+                ESP_LOGI(TAG, "Buffer is %d%% unsaved. Pushing unsaved entries to flash.", BUFFER_THRESHOLD_PERCENT);
                 buffer_push_to_flash();
             }
         } else {
@@ -119,6 +153,50 @@ void measurement_collection_task(void *pvParameters) {
     }
 }
 
+// ─────────────────────────────────────────────────────────────────────────────
+// High-rate Collection Task
+#if CONFIG_HIGH_RATE_SAMPLING
+void high_rate_collection_task(void *pvParameters) {
+    adc_oneshot_unit_handle_t adc_handle;
+    adc_oneshot_unit_init_cfg_t unit_cfg = { .unit_id = ADC_UNIT_1 };
+    ESP_ERROR_CHECK(adc_oneshot_new_unit(&unit_cfg, &adc_handle));
+    adc_oneshot_chan_cfg_t chan_cfg = { .atten = ADC_ATTEN_DB_12, .bitwidth = ADC_BITWIDTH_DEFAULT };
+    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, CONFIG_HIGH_RATE_ADC_CHANNEL, &chan_cfg));
+
+    const TickType_t period = pdMS_TO_TICKS(1000 / CONFIG_HIGH_RATE_SAMPLE_HZ);
+    Measurement batch[CONFIG_HIGH_RATE_BATCH_SIZE];
+    size_t batch_count = 0;
+    TickType_t last_wake = xTaskGetTickCount();
+
+    ESP_LOGI(TAG, "High-rate sampling at %d Hz, batch size %d",
+             CONFIG_HIGH_RATE_SAMPLE_HZ, CONFIG_HIGH_RATE_BATCH_SIZE);
+    while (1) {
+        int raw = 0;
+        if (adc_oneshot_read(adc_handle, CONFIG_HIGH_RATE_ADC_CHANNEL, &raw) == ESP_OK) {
+            batch[batch_count++] = (Measurement){
+                .timestamp = current_timestamp_ms(),
+                .value = raw * CONFIG_HIGH_RATE_ADC_SCALE + CONFIG_HIGH_RATE_ADC_OFFSET,
+                .dirty_bit = DIRTY_BIT_BUFFER_ONLY,
+                .series_id = SERIES_TEMPERATURE,
+            };
+        }
+
+        // Samples stay local until the batch is full, then take the buffer lock once
+        if (batch_count == CONFIG_HIGH_RATE_BATCH_SIZE) {
+            buffer_add_measurements(batch, batch_count);
+            batch_count = 0;
+
+            if (buffer_is_threshold_full()) {
+                buffer_push_to_flash();
+            }
+        }
+
+        // Fixed-rate schedule: a slow flush is caught up rather than stretching the period
+        vTaskDelayUntil(&last_wake, period);
+    }
+}
+#endif
+
 // ─────────────────────────────────────────────────────────────────────────────
 // Flash Monitoring Task
 void flash_monitoring_task(void *pvParameters) {
@@ -128,74 +206,63 @@ void flash_monitoring_task(void *pvParameters) {
 
         if (flash_usage >= FLASH_USAGE_THRESHOLD_PERCENT) {
             ESP_LOGI(TAG, "Flash usage threshold reached (%u%%). Sending data to edge device.", FLASH_USAGE_THRESHOLD_PERCENT);
-            send_flash_data_to_edge();
+            offload_flash_to_edge(publish_to_edge);
         }
 
+        // Spread the index consistency check over the monitoring passes
+        validate_segment_lists_step(CONFIG_INDEX_VALIDATE_BATCH);
+
         // Check every minute (adjust as needed)
         vTaskDelay(pdMS_TO_TICKS(60000));
     }
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
-// send flash data to edge
-void send_flash_data_to_edge(void) {
-    ESP_LOGI(TAG, "Sending data from flash to edge device over MQTT");
-
-    size_t entries_to_send = 10; // Adjust as needed
-    uint32_t timestamps[entries_to_send];
-    size_t actual_entries = 0;
-
-    // Get the first 'entries_to_send' timestamps from the list
-    get_timestamps_from_list(entries_to_send, timestamps, &actual_entries);
-
-    if (actual_entries == 0) {
-        ESP_LOGI(TAG, "No entries to send");
-        return;
+// Compaction Task
+void compaction_task(void *pvParameters) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_COMPACTION_INTERVAL_MS));
+        compact_storage(current_timestamp_ms());
     }
+}
 
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        return;
+// ─────────────────────────────────────────────────────────────────────────────
+// Journal Group Commit Task
+void wal_commit_task(void *pvParameters) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_WAL_COMMIT_INTERVAL_MS));
+        wal_commit();
     }
+}
 
-    for (size_t i = 0; i < actual_entries; i++) {
-        char key[16];
-        snprintf(key, sizeof(key), "%" PRIu32, timestamps[i]);
+// ─────────────────────────────────────────────────────────────────────────────
+// Live Query Push Task
+void subscription_task(void *pvParameters) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SUBSCRIPTION_FLUSH_MS));
+        subscriptions_flush();
+    }
+}
 
-        // Retrieve the measurement
-        size_t required_size = sizeof(Measurement);
-        Measurement m;
-        err = nvs_get_blob(handle, key, &m, &required_size);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to get measurement for key %s: %s", key, esp_err_to_name(err));
-            continue;
-        }
+// ─────────────────────────────────────────────────────────────────────────────
+// Metrics Publishing Task
+void metrics_publish_task(void *pvParameters) {
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_METRICS_PUBLISH_INTERVAL_MS));
 
-        // Send the measurement to the edge device
-        publish_to_edge(&m);
+        // Outbox sizes stand in for queue depth: they grow while a broker is unreachable
+        metrics_set_gauge(METRIC_GAUGE_EDGE_OUTBOX, esp_mqtt_client_get_outbox_size(edge_mqtt_client));
+        metrics_set_gauge(METRIC_GAUGE_DEVICE_OUTBOX, esp_mqtt_client_get_outbox_size(device_mqtt_client));
 
-        // Update dirty_bit to DIRTY_BIT_SENT_TO_EDGE
-        m.dirty_bit = DIRTY_BIT_SENT_TO_EDGE;
-        err = nvs_set_blob(handle, key, &m, sizeof(Measurement));
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to update measurement for key %s: %s", key, esp_err_to_name(err));
+        char *payload = metrics_to_json();
+        if (payload == NULL) {
+            ESP_LOGE(TAG, "Failed to create metrics payload");
             continue;
         }
-
-        // Delete the entry from flash
-        err = nvs_erase_key(handle, key);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to erase key %s: %s", key, esp_err_to_name(err));
-        }
+        // QoS 0: a lost snapshot is superseded by the next one
+        esp_mqtt_client_publish(device_mqtt_client, METRICS_TOPIC, payload, 0, 0, 0);
+        cJSON_free(payload);
     }
-
-    nvs_commit(handle);
-    nvs_close(handle);
-
-    // Remove the timestamps from the list
-    remove_timestamps_from_list(actual_entries);
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
@@ -226,8 +293,14 @@ void device_mqtt_event_handler(void *handler_args, esp_event_base_t event_base,
             ESP_LOGI(TAG, "Subscribed to esp32/query");
             break;
         case MQTT_EVENT_DATA: {
-            char *topic_str = strndup(event->topic, event->topic_len);
-            char *data_str = strndup(event->data, event->data_len);
+            char *topic_str = mem_pool_strndup(event->topic, event->topic_len);
+            char *data_str = mem_pool_strndup(event->data, event->data_len);
+            if (topic_str == NULL || data_str == NULL) {
+                ESP_LOGE(TAG, "Failed to copy incoming message");
+                mem_pool_free(topic_str);
+                mem_pool_free(data_str);
+                break;
+            }
 
             ESP_LOGI(TAG, "Received message on topic: %s", topic_str);
 
@@ -236,8 +309,8 @@ void device_mqtt_event_handler(void *handler_args, esp_event_base_t event_base,
                 process_query_message(data_str);
             }
 
-            free(topic_str);
-            free(data_str);
+            mem_pool_free(topic_str);
+            mem_pool_free(data_str);
             break;
         }
         case MQTT_EVENT_DISCONNECTED:
@@ -398,6 +471,9 @@ void time_sync_notification_cb(struct timeval *tv) {
 
 // ─────────────────────────────────────────────────────────────────────────────
 void app_main(void) {
+    // Request pools and arenas; creates their lock, so it runs before any task starts
+    mem_pool_init();
+
     // Initialize NVS
     esp_err_t err = init_nvs();
     if (err != ESP_OK) {
@@ -414,6 +490,26 @@ void app_main(void) {
     // Initialize buffer
     buffer_init();
 
+    // Initialize read cache for flash-resident data
+    read_cache_init();
+
+#if CONFIG_RUN_BENCHMARK
+    // Benchmark needs no network; it leaves the node idle afterwards
+    benchmark_run(CONFIG_BENCHMARK_DAYS, CONFIG_BENCHMARK_INTERVAL_MS, CONFIG_BENCHMARK_QUERIES,
+                  CONFIG_BENCHMARK_SOAK_QUERIES);
+    if (CONFIG_BENCHMARK_CONCURRENT_S > 0) {
+        benchmark_concurrent(CONFIG_BENCHMARK_CONCURRENT_S, CONFIG_HIGH_RATE_SAMPLE_HZ, CONFIG_HIGH_RATE_BATCH_SIZE);
+    }
+    return;
+#endif
+
+    // Warm the buffer and replay the journal before anything reads or writes samples
+    RecoveryReport recovery;
+    storage_recover(&recovery);
+#if CONFIG_WAL_ENABLED
+    xTaskCreate(wal_commit_task, "wal_commit_task", 4096, NULL, 5, NULL);
+#endif
+
     // Initialize Wi-Fi
     wifi_init_sta();
 
@@ -423,15 +519,38 @@ void app_main(void) {
     // Synchronize time
     obtain_time();
 
+    // Query responses go out through the device broker
+    query_handler_set_response_sink(publish_to_device);
+    subscriptions_init(publish_to_device);
+
     // Initialize MQTT clients
     mqtt_app_start();       // Start the device MQTT client
     edge_mqtt_start();     // Start the edge MQTT client
 
+#if CONFIG_RANGE_HTTP_ENABLED
+    // Range queries over HTTP, without going through a broker
+    http_server_start();
+#endif
+
 
+#if CONFIG_HIGH_RATE_SAMPLING
+    // Start high-rate collection task (above normal priority to keep the sample clock steady)
+    xTaskCreate(high_rate_collection_task, "high_rate_collection_task", 4096, NULL, 6, NULL);
+#else
     // Start measurement collection task
     xTaskCreate(measurement_collection_task, "measurement_collection_task", 4096, NULL, 5, NULL);
+#endif
 
     // Start flash monitoring task
     xTaskCreate(flash_monitoring_task, "flash_monitoring_task", 4096, NULL, 5, NULL);
+
+    // Start compaction task (below the collectors: it only has to keep up with flash usage)
+    xTaskCreate(compaction_task, "compaction_task", 4096, NULL, 3, NULL);
+
+    // Start live query push task
+    xTaskCreate(subscription_task, "subscription_task", 4096, NULL, 4, NULL);
+
+    // Start metrics publishing task
+    xTaskCreate(metrics_publish_task, "metrics_publish_task", 4096, NULL, 4, NULL);
 }
 // ─────────────────────────────────────────────────────────────────────────────
\ No newline at end of file
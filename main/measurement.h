@@ -2,11 +2,19 @@
 #define MEASUREMENT_H
 // ─────────────────────────────────────────────────────────────────────────────
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 // ─────────────────────────────────────────────────────────────────────────────
+/*
+ * One sample of one series. The timestamp is milliseconds since the Unix
+ * epoch, so sampling faster than 1 Hz does not collide and it does not wrap
+ * in 2106.
+ */
 typedef struct __attribute__((packed)) {
-    uint32_t timestamp;   // 4 bytes    
-    float temperature;    // 4 bytes
+    uint64_t timestamp;   // 8 bytes
+    float value;          // 4 bytes
     uint8_t dirty_bit;    // 1 byte
+    uint8_t series_id;    // 1 byte
 } Measurement;
 // ─────────────────────────────────────────────────────────────────────────────
 // Dirty bit definitions
@@ -14,4 +22,52 @@ typedef struct __attribute__((packed)) {
 #define DIRTY_BIT_IN_FLASH 1
 #define DIRTY_BIT_SENT_TO_EDGE 2
 // ─────────────────────────────────────────────────────────────────────────────
+// Series identifiers (one per physical quantity logged by the node)
+#define SERIES_TEMPERATURE 0
+#define SERIES_HUMIDITY 1
+#define SERIES_COUNT 2
+#define SERIES_INVALID 0xFF
+// ─────────────────────────────────────────────────────────────────────────────
+static inline const char *series_name(uint8_t series_id) {
+    switch (series_id) {
+        case SERIES_TEMPERATURE: return "temperature";
+        case SERIES_HUMIDITY:    return "humidity";
+        default:                 return "unknown";
+    }
+}
+
+static inline uint8_t series_from_name(const char *name) {
+    for (uint8_t id = 0; id < SERIES_COUNT; id++) {
+        if (strcmp(name, series_name(id)) == 0) {
+            return id;
+        }
+    }
+    return SERIES_INVALID;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/* Threshold filter of get_data_where: lo < value < hi, each bound optional and possibly inclusive */
+typedef struct {
+    bool has_lo;
+    bool has_hi;
+    bool lo_inclusive;
+    bool hi_inclusive;
+    float lo;
+    float hi;
+} ValuePredicate;
+
+static inline bool value_predicate_match(const ValuePredicate *p, float value) {
+    if (p->has_lo && !(p->lo_inclusive ? value >= p->lo : value > p->lo)) {
+        return false;
+    }
+    return !p->has_hi || (p->hi_inclusive ? value <= p->hi : value < p->hi);
+}
+
+/* Zone map test: false only if no value in [min_value, max_value] can match */
+static inline bool value_predicate_may_match(const ValuePredicate *p, float min_value, float max_value) {
+    if (p->has_lo && !(p->lo_inclusive ? max_value >= p->lo : max_value > p->lo)) {
+        return false;
+    }
+    return !p->has_hi || (p->hi_inclusive ? min_value <= p->hi : min_value < p->hi);
+}
+// ─────────────────────────────────────────────────────────────────────────────
 #endif // MEASUREMENT_H
\ No newline at end of file
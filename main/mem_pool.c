@@ -0,0 +1,215 @@
+#include "mem_pool.h"
+#include "segment.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "MEM_POOL";
+// ─────────────────────────────────────────────────────────────────────────────
+#define MEM_ALIGN 8
+#define MEM_ALIGN_UP(n) (((n) + MEM_ALIGN - 1) & ~(size_t)(MEM_ALIGN - 1))
+#define SEGMENT_BLOCK_SIZE MEM_ALIGN_UP(sizeof(Segment))
+
+_Static_assert(MEM_POOL_SEGMENT_BLOCKS <= 32 && MEM_POOL_MESSAGE_BLOCKS <= 32, "free masks are 32 bits");
+_Static_assert(MEM_POOL_MESSAGE_BLOCK_SIZE % MEM_ALIGN == 0 && MEM_ARENA_SIZE % MEM_ALIGN == 0,
+               "blocks and arenas must keep 8-byte alignment");
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    uint8_t *blocks;
+    size_t block_size;
+    uint32_t block_count;
+    uint32_t free_mask;   // bit set => block free
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t fallbacks;
+} FixedPool;
+
+/*
+ * Bump allocator reset per request. Only the owning task allocates from it,
+ * so the lock is needed just to claim and release it.
+ */
+typedef struct {
+    uint8_t data[MEM_ARENA_SIZE];
+    size_t top;
+    size_t last;          // offset of the newest allocation
+    TaskHandle_t owner;   // NULL while free
+    uint32_t depth;
+} Arena;
+// ─────────────────────────────────────────────────────────────────────────────
+static uint8_t segment_blocks[MEM_POOL_SEGMENT_BLOCKS][SEGMENT_BLOCK_SIZE] __attribute__((aligned(MEM_ALIGN)));
+static uint8_t message_blocks[MEM_POOL_MESSAGE_BLOCKS][MEM_POOL_MESSAGE_BLOCK_SIZE] __attribute__((aligned(MEM_ALIGN)));
+
+static FixedPool pools[MEM_POOL_COUNT] = {
+    [MEM_POOL_SEGMENT] = { &segment_blocks[0][0], SEGMENT_BLOCK_SIZE, MEM_POOL_SEGMENT_BLOCKS },
+    [MEM_POOL_MESSAGE] = { &message_blocks[0][0], MEM_POOL_MESSAGE_BLOCK_SIZE, MEM_POOL_MESSAGE_BLOCKS },
+};
+static Arena arenas[MEM_ARENA_COUNT] __attribute__((aligned(MEM_ALIGN)));
+static uint32_t arena_peak = 0;
+static uint32_t arena_fallbacks = 0;
+static uint32_t arena_busy = 0;
+static SemaphoreHandle_t pool_mutex = NULL;
+// ─────────────────────────────────────────────────────────────────────────────
+void mem_pool_init(void) {
+    if (pool_mutex == NULL) {
+        pool_mutex = xSemaphoreCreateMutex();
+    }
+    for (int p = 0; p < MEM_POOL_COUNT; p++) {
+        pools[p].free_mask = pools[p].block_count == 32 ? UINT32_MAX : (1U << pools[p].block_count) - 1;
+        pools[p].in_use = 0;
+    }
+
+    ESP_LOGI(TAG, "Pools ready: %u segment and %u message blocks, %u x %u byte arenas",
+             MEM_POOL_SEGMENT_BLOCKS, MEM_POOL_MESSAGE_BLOCKS, MEM_ARENA_COUNT, MEM_ARENA_SIZE);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void *mem_pool_alloc(MemPoolId pool, size_t size) {
+    FixedPool *p = &pools[pool];
+    if (pool_mutex != NULL && size <= p->block_size) {
+        xSemaphoreTake(pool_mutex, portMAX_DELAY);
+        if (p->free_mask != 0) {
+            int block = __builtin_ctz(p->free_mask);
+            p->free_mask &= ~(1U << block);
+            if (++p->in_use > p->peak) {
+                p->peak = p->in_use;
+            }
+            xSemaphoreGive(pool_mutex);
+            return p->blocks + (size_t)block * p->block_size;
+        }
+        xSemaphoreGive(pool_mutex);
+    }
+    __atomic_fetch_add(&p->fallbacks, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void mem_pool_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    for (int i = 0; i < MEM_POOL_COUNT; i++) {
+        FixedPool *p = &pools[i];
+        uint8_t *u = ptr;
+        if (u >= p->blocks && u < p->blocks + p->block_count * p->block_size) {
+            int block = (int)((size_t)(u - p->blocks) / p->block_size);
+            xSemaphoreTake(pool_mutex, portMAX_DELAY);
+            p->free_mask |= 1U << block;
+            p->in_use--;
+            xSemaphoreGive(pool_mutex);
+            return;
+        }
+    }
+    free(ptr);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+char *mem_pool_strndup(const char *s, size_t len) {
+    char *copy = mem_pool_alloc(MEM_POOL_MESSAGE, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static Arena *current_arena(void) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < MEM_ARENA_COUNT; i++) {
+        // Only the owner ever stores its own handle, so a racy read cannot match falsely
+        if (__atomic_load_n(&arenas[i].owner, __ATOMIC_ACQUIRE) == self) {
+            return &arenas[i];
+        }
+    }
+    return NULL;
+}
+
+static bool in_arena(const Arena *arena, const void *ptr) {
+    const uint8_t *u = ptr;
+    return u >= arena->data && u < arena->data + MEM_ARENA_SIZE;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool mem_arena_begin(void) {
+    if (pool_mutex == NULL) {
+        return false;
+    }
+    Arena *arena = current_arena();
+    if (arena != NULL) {
+        arena->depth++;
+        return true;
+    }
+
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    for (int i = 0; i < MEM_ARENA_COUNT && arena == NULL; i++) {
+        if (arenas[i].owner == NULL) {
+            arena = &arenas[i];
+            arena->top = 0;
+            arena->last = 0;
+            arena->depth = 1;
+            __atomic_store_n(&arena->owner, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+        }
+    }
+    xSemaphoreGive(pool_mutex);
+
+    if (arena == NULL) {
+        // The request still runs, on the heap
+        __atomic_fetch_add(&arena_busy, 1, __ATOMIC_RELAXED);
+        ESP_LOGW(TAG, "All arenas in use");
+        return false;
+    }
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void mem_arena_end(void) {
+    Arena *arena = current_arena();
+    if (arena == NULL || --arena->depth > 0) {
+        return;
+    }
+    if (arena->top > __atomic_load_n(&arena_peak, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&arena_peak, (uint32_t)arena->top, __ATOMIC_RELAXED);
+    }
+    xSemaphoreTake(pool_mutex, portMAX_DELAY);
+    __atomic_store_n(&arena->owner, NULL, __ATOMIC_RELEASE);
+    xSemaphoreGive(pool_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void *mem_scratch_alloc(size_t size) {
+    Arena *arena = current_arena();
+    if (arena == NULL) {
+        return malloc(size);
+    }
+    size_t need = MEM_ALIGN_UP(size ? size : 1);
+    if (need <= MEM_ARENA_SIZE - arena->top) {
+        arena->last = arena->top;
+        arena->top += need;
+        return &arena->data[arena->last];
+    }
+    __atomic_fetch_add(&arena_fallbacks, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void mem_scratch_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    for (int i = 0; i < MEM_ARENA_COUNT; i++) {
+        Arena *arena = &arenas[i];
+        if (in_arena(arena, ptr)) {
+            // Stack-like release lets a short-lived buffer be reused within the request
+            if (arena->owner == xTaskGetCurrentTaskHandle() && ptr == &arena->data[arena->last]) {
+                arena->top = arena->last;
+            }
+            return;
+        }
+    }
+    free(ptr);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void mem_pool_get_stats(MemPoolStats *stats) {
+    for (int p = 0; p < MEM_POOL_COUNT; p++) {
+        stats->pool_peak[p] = __atomic_load_n(&pools[p].peak, __ATOMIC_RELAXED);
+        stats->pool_fallbacks[p] = __atomic_load_n(&pools[p].fallbacks, __ATOMIC_RELAXED);
+    }
+    stats->arena_peak = __atomic_load_n(&arena_peak, __ATOMIC_RELAXED);
+    stats->arena_fallbacks = __atomic_load_n(&arena_fallbacks, __ATOMIC_RELAXED);
+    stats->arena_busy = __atomic_load_n(&arena_busy, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,58 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Static allocators for request traffic, so queries never carve
+ * variable-sized blocks out of the heap:
+ *  - fixed-block pools for decoded segments and incoming MQTT strings;
+ *  - per-request arenas: a task claims one with mem_arena_begin() and
+ *    everything it takes with mem_scratch_alloc() is released at once by
+ *    mem_arena_end(). Builders that should use it call mem_scratch_alloc()
+ *    explicitly; cJSON stays on the heap.
+ * Both fall back to the heap when exhausted and count it in the stats.
+ */
+typedef enum {
+    MEM_POOL_SEGMENT,   // one decoded Segment
+    MEM_POOL_MESSAGE,   // an MQTT topic or payload, NUL terminated
+    MEM_POOL_COUNT
+} MemPoolId;
+
+#define MEM_POOL_SEGMENT_BLOCKS 3          // MQTT query, HTTP request, offload
+#define MEM_POOL_MESSAGE_BLOCKS 4          // topic + payload for each MQTT client
+#define MEM_POOL_MESSAGE_BLOCK_SIZE 512
+/* One arena per concurrent front end (MQTT queries, HTTP range requests) */
+#define MEM_ARENA_COUNT 2
+#define MEM_ARENA_SIZE 16384
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    uint32_t pool_peak[MEM_POOL_COUNT];      // most blocks in use at once
+    uint32_t pool_fallbacks[MEM_POOL_COUNT]; // allocations served by the heap instead
+    uint32_t arena_peak;                     // most bytes one request used
+    uint32_t arena_fallbacks;                // scratch allocations that spilled to the heap
+    uint32_t arena_busy;                     // requests that found every arena taken
+} MemPoolStats;
+// ─────────────────────────────────────────────────────────────────────────────
+/* Creates the lock; call before any task starts */
+void mem_pool_init(void);
+/* A block of `pool` if `size` fits and one is free, else heap memory */
+void *mem_pool_alloc(MemPoolId pool, size_t size);
+/* Releases memory from mem_pool_alloc() or mem_pool_strndup() */
+void mem_pool_free(void *ptr);
+char *mem_pool_strndup(const char *s, size_t len);
+// ─────────────────────────────────────────────────────────────────────────────
+/* Claims an arena for the calling task (nests); false if all are taken */
+bool mem_arena_begin(void);
+/* Releases everything allocated since the outermost mem_arena_begin() */
+void mem_arena_end(void);
+/* From the caller's arena if it holds one, else the heap */
+void *mem_scratch_alloc(size_t size);
+/* No-op for arena memory (the newest allocation is given back), free() otherwise */
+void mem_scratch_free(void *ptr);
+// ─────────────────────────────────────────────────────────────────────────────
+void mem_pool_get_stats(MemPoolStats *stats);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // MEM_POOL_H
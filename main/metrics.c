@@ -0,0 +1,137 @@
+#include "metrics.h"
+#include "read_cache.h"
+#include "mem_pool.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+#include <string.h>
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    uint32_t buckets[METRICS_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+} Histogram;
+// ─────────────────────────────────────────────────────────────────────────────
+static uint32_t counters[METRIC_COUNTER_COUNT];
+static uint32_t gauges[METRIC_GAUGE_COUNT];
+static Histogram histograms[METRIC_HIST_COUNT];
+
+static const char *counter_names[METRIC_COUNTER_COUNT] = {
+    "ingest", "flush", "flush_fail", "queries", "offloaded", "reclaimed", "late",
+    "late_dropped",
+};
+static const char *histogram_names[METRIC_HIST_COUNT] = {
+    "flush_us", "query_us",
+};
+static const char *gauge_names[METRIC_GAUGE_COUNT] = {
+    "q_edge", "q_dev", "boot_ms",
+};
+// ─────────────────────────────────────────────────────────────────────────────
+void metrics_inc(MetricCounter counter, uint32_t n) {
+    __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void metrics_set_gauge(MetricGauge gauge, uint32_t value) {
+    __atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void metrics_observe(MetricHistogram hist, uint32_t value_us) {
+    Histogram *h = &histograms[hist];
+
+    int bucket = 0;
+    uint32_t bound = METRICS_HIST_FIRST_BOUND_US;
+    while (bucket < METRICS_HIST_BUCKETS - 1 && value_us >= bound) {
+        bound <<= 1;
+        bucket++;
+    }
+    __atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+
+    uint32_t seen = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+    while (value_us > seen &&
+           !__atomic_compare_exchange_n(&h->max_us, &seen, value_us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Upper bound of the bucket holding the given quantile (per mille), capped at the observed max
+static uint32_t histogram_quantile(const uint32_t *buckets, uint32_t count, uint32_t max_us, uint32_t per_mille) {
+    uint32_t target = (uint32_t)(((uint64_t)count * per_mille + 999) / 1000);
+    uint32_t seen = 0;
+    uint32_t bound = METRICS_HIST_FIRST_BOUND_US;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++, bound <<= 1) {
+        seen += buckets[i];
+        if (seen >= target) {
+            break;
+        }
+    }
+    return bound < max_us ? bound : max_us;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+char *metrics_to_json(void) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "up_s", (double)(esp_timer_get_time() / 1000000));
+
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        cJSON_AddNumberToObject(json, counter_names[i], __atomic_load_n(&counters[i], __ATOMIC_RELAXED));
+    }
+
+    for (int i = 0; i < METRIC_HIST_COUNT; i++) {
+        // Copy first so the derived figures agree with each other
+        uint32_t buckets[METRICS_HIST_BUCKETS];
+        for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            buckets[b] = __atomic_load_n(&histograms[i].buckets[b], __ATOMIC_RELAXED);
+        }
+        uint32_t count = __atomic_load_n(&histograms[i].count, __ATOMIC_RELAXED);
+        uint32_t max_us = __atomic_load_n(&histograms[i].max_us, __ATOMIC_RELAXED);
+
+        cJSON *h = cJSON_AddObjectToObject(json, histogram_names[i]);
+        cJSON_AddNumberToObject(h, "n", count);
+        cJSON_AddNumberToObject(h, "max", max_us);
+        if (count) {
+            cJSON_AddNumberToObject(h, "p50", histogram_quantile(buckets, count, max_us, 500));
+            cJSON_AddNumberToObject(h, "p99", histogram_quantile(buckets, count, max_us, 990));
+        }
+        // Trailing empty buckets are dropped to keep the message short
+        int last = METRICS_HIST_BUCKETS - 1;
+        while (last >= 0 && buckets[last] == 0) {
+            last--;
+        }
+        cJSON *b = cJSON_AddArrayToObject(h, "b");
+        for (int k = 0; k <= last; k++) {
+            cJSON_AddItemToArray(b, cJSON_CreateNumber(buckets[k]));
+        }
+    }
+
+    ReadCacheStats cache;
+    memset(&cache, 0, sizeof(cache));
+    read_cache_get_stats(&cache);
+    uint32_t lookups = cache.hits + cache.misses;
+    cJSON_AddNumberToObject(json, "cache_hit", lookups ? (double)cache.hits / lookups : 0);
+
+    cJSON_AddNumberToObject(json, "heap_free", esp_get_free_heap_size());
+    cJSON_AddNumberToObject(json, "heap_min", esp_get_minimum_free_heap_size());
+    // Fragmentation: share of the free heap that the largest block cannot serve
+    size_t heap_8bit = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    cJSON_AddNumberToObject(json, "heap_blk", largest);
+    cJSON_AddNumberToObject(json, "heap_frag", heap_8bit ? 100 - (double)(largest * 100 / heap_8bit) : 0);
+
+    MemPoolStats pool;
+    mem_pool_get_stats(&pool);
+    cJSON *mem = cJSON_AddObjectToObject(json, "mem");
+    cJSON_AddNumberToObject(mem, "arena_peak", pool.arena_peak);
+    cJSON_AddNumberToObject(mem, "arena_spill", pool.arena_fallbacks);
+    cJSON_AddNumberToObject(mem, "arena_busy", pool.arena_busy);
+    cJSON_AddNumberToObject(mem, "seg_peak", pool.pool_peak[MEM_POOL_SEGMENT]);
+    cJSON_AddNumberToObject(mem, "seg_spill", pool.pool_fallbacks[MEM_POOL_SEGMENT]);
+    cJSON_AddNumberToObject(mem, "msg_peak", pool.pool_peak[MEM_POOL_MESSAGE]);
+    cJSON_AddNumberToObject(mem, "msg_spill", pool.pool_fallbacks[MEM_POOL_MESSAGE]);
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        cJSON_AddNumberToObject(json, gauge_names[i], __atomic_load_n(&gauges[i], __ATOMIC_RELAXED));
+    }
+
+    char *payload = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    return payload;
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef METRICS_H
+#define METRICS_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Runtime counters, gauges and latency histograms. Updates are single
+ * relaxed atomic operations, so they are safe from any task and never block
+ * the ingest or query paths.
+ */
+typedef enum {
+    METRIC_INGESTED,        // samples accepted into the buffer
+    METRIC_FLUSHES,         // segments written from the buffer
+    METRIC_FLUSH_FAILURES,
+    METRIC_QUERIES,         // query messages processed
+    METRIC_OFFLOADED,       // records handed to the edge
+    METRIC_RECLAIMED,       // segments freed by retention/compaction
+    METRIC_LATE,            // samples older than their series' flushed data
+    METRIC_LATE_DROPPED,    // late samples refused by a full stage
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    METRIC_HIST_FLUSH_US,
+    METRIC_HIST_QUERY_US,
+    METRIC_HIST_COUNT
+} MetricHistogram;
+
+typedef enum {
+    METRIC_GAUGE_EDGE_OUTBOX,   // bytes queued in the edge MQTT outbox
+    METRIC_GAUGE_DEVICE_OUTBOX, // bytes queued in the device MQTT outbox
+    METRIC_GAUGE_BOOT_MS,       // boot to storage-ready time
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+// ─────────────────────────────────────────────────────────────────────────────
+/* Power-of-two latency buckets: [0, 64us), [64us, 128us), ... , [64us << 14, inf) */
+#define METRICS_HIST_BUCKETS 16
+#define METRICS_HIST_FIRST_BOUND_US 64
+// ─────────────────────────────────────────────────────────────────────────────
+void metrics_inc(MetricCounter counter, uint32_t n);
+void metrics_observe(MetricHistogram hist, uint32_t value_us);
+void metrics_set_gauge(MetricGauge gauge, uint32_t value);
+/* Compact JSON snapshot of everything above plus cache and heap figures; release with cJSON_free() */
+char *metrics_to_json(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // METRICS_H
\ No newline at end of file
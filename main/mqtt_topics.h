@@ -6,6 +6,8 @@
 #define EDGE_REQUEST_TOPIC "edge/measurement/request"
 #define ESP32_RESPONSE_TOPIC "esp32/measurement/response"
 #define EDGE_PUBLISH_TOPIC "esp32/temperature"  // Topic to publish measurements to edge
+#define EDGE_DEVICE_PUBLISH_TOPIC_FMT "esp32/%s/temperature"  // Same, with CONFIG_DEVICE_ID set
 #define DEVICE_RESPONSE_TOPIC "esp32/response"  // Response topic for device broker
+#define METRICS_TOPIC "esp32/metrics"           // Periodic runtime metrics (device broker)
 // ─────────────────────────────────────────────────────────────────────────────
 #endif // MQTT_TOPICS_H
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "freertos/semphr.h"
 #include "cJSON.h"
 #include "nvs_utils.h" 
+#include "mem_pool.h"
 
 #include "config.h"
 #include "mqtt_topics.h"
@@ -24,19 +25,37 @@ bool edge_response_received = false;
 uint32_t expected_request_id = 0;
 
 // ─────────────────────────────────────────────────────────────────────────────
+static const char *edge_publish_topic(void) {
+    static char topic[64];
+    if (CONFIG_DEVICE_ID[0] == '\0') {
+        return EDGE_PUBLISH_TOPIC;
+    }
+    if (topic[0] == '\0') {
+        snprintf(topic, sizeof(topic), EDGE_DEVICE_PUBLISH_TOPIC_FMT, CONFIG_DEVICE_ID);
+    }
+    return topic;
+}
+
 // Publish Measurement to Edge Broker
-void publish_to_edge(Measurement *m) {
+bool publish_to_edge(Measurement *m) {
     char payload[128];
     snprintf(payload, sizeof(payload),
-             "{\"timestamp\":%" PRIu32 ",\"temperature\":%.1f}",
-             m->timestamp, m->temperature);
+             "{\"timestamp\":%" PRIu64 ",\"series\":\"%s\",\"value\":%.1f}",
+             m->timestamp, series_name(m->series_id), m->value);
 
-    int msg_id = esp_mqtt_client_publish(edge_mqtt_client, EDGE_PUBLISH_TOPIC, payload, 0, 1, 0);
+    int msg_id = esp_mqtt_client_publish(edge_mqtt_client, edge_publish_topic(), payload, 0, 1, 0);
     if (msg_id != -1) {
         ESP_LOGI(TAG, "Published measurement to edge MQTT broker, msg_id=%d", msg_id);
     } else {
         ESP_LOGE(TAG, "Failed to publish measurement to edge MQTT broker");
     }
+    return msg_id != -1;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Publish a raw payload to the device broker (used as the query response sink)
+int publish_to_device(const char *topic, const char *payload) {
+    return esp_mqtt_client_publish(device_mqtt_client, topic, payload, 0, 1, 0);
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
@@ -44,8 +63,8 @@ void publish_to_edge(Measurement *m) {
 void send_measurement_response(Measurement *m, const char *response_topic) {
     char payload[128];
     snprintf(payload, sizeof(payload),
-             "{\"timestamp\":%" PRIu32 ",\"temperature\":%.1f}",
-             m->timestamp, m->temperature);
+             "{\"timestamp\":%" PRIu64 ",\"series\":\"%s\",\"value\":%.1f}",
+             m->timestamp, series_name(m->series_id), m->value);
 
     int msg_id = esp_mqtt_client_publish(device_mqtt_client, response_topic, payload, 0, 1, 0);
     if (msg_id != -1) {
@@ -83,19 +102,29 @@ void process_edge_response(const char *data) {
         return;
     }
 
-    // Extract timestamp and temperature
+    // Extract timestamp, series and value (older bridges only send "temperature")
     cJSON *timestamp_json = cJSON_GetObjectItem(json, "timestamp");
-    cJSON *temperature_json = cJSON_GetObjectItem(json, "temperature");
+    cJSON *series_json = cJSON_GetObjectItem(json, "series");
+    cJSON *value_json = cJSON_GetObjectItem(json, "value");
+    if (value_json == NULL) {
+        value_json = cJSON_GetObjectItem(json, "temperature");
+    }
 
-    if (!cJSON_IsNumber(timestamp_json) || !cJSON_IsNumber(temperature_json)) {
+    uint8_t series_id = SERIES_TEMPERATURE;
+    if (cJSON_IsString(series_json)) {
+        series_id = series_from_name(series_json->valuestring);
+    }
+
+    if (!cJSON_IsNumber(timestamp_json) || !cJSON_IsNumber(value_json) || series_id == SERIES_INVALID) {
         ESP_LOGE(TAG, "Invalid data in edge response");
         cJSON_Delete(json);
         return;
     }
 
     // Populate the Measurement structure
-    edge_received_measurement.timestamp = (uint32_t)timestamp_json->valuedouble;
-    edge_received_measurement.temperature = (float)temperature_json->valuedouble;
+    edge_received_measurement.timestamp = (uint64_t)timestamp_json->valuedouble;
+    edge_received_measurement.value = (float)value_json->valuedouble;
+    edge_received_measurement.series_id = series_id;
 
     cJSON_Delete(json);
 
@@ -121,15 +150,21 @@ static void edge_mqtt_event_handler_cb(void *handler_args, esp_event_base_t base
             break;
 
         case MQTT_EVENT_DATA: {
-            char *topic = strndup(event->topic, event->topic_len);
-            char *data = strndup(event->data, event->data_len);
+            char *topic = mem_pool_strndup(event->topic, event->topic_len);
+            char *data = mem_pool_strndup(event->data, event->data_len);
+            if (topic == NULL || data == NULL) {
+                ESP_LOGE(TAG, "Failed to copy edge response");
+                mem_pool_free(topic);
+                mem_pool_free(data);
+                break;
+            }
 
             if (strcmp(topic, ESP32_RESPONSE_TOPIC) == 0) {
                 process_edge_response(data);
             }
 
-            free(topic);
-            free(data);
+            mem_pool_free(topic);
+            mem_pool_free(data);
             break;
         }
 
@@ -15,7 +15,8 @@ extern Measurement edge_received_measurement;
 extern bool edge_response_received;
 extern uint32_t expected_request_id;
 // ─────────────────────────────────────────────────────────────────────────────
-void publish_to_edge(Measurement *m);
+bool publish_to_edge(Measurement *m);
+int publish_to_device(const char *topic, const char *payload);
 void send_measurement_response(Measurement *m, const char *response_topic);
 // ─────────────────────────────────────────────────────────────────────────────
 // Function prototypes
@@ -3,19 +3,550 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include <inttypes.h>
+#include <string.h>
+#include <stdlib.h>
 
-#include "mqtt_utils.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
-#include "cJSON.h"
 #include "esp_timer.h"
-#include "esp_random.h"
-#include "esp_system.h"  // For esp_random()
-#include "mqtt_topics.h"
-#include "timestamp_list.h"  // [FIX] ensure we have TIMESTAMP_LIST_KEY
+#include "segment_list.h"
+#include "read_cache.h"
+#include "mem_pool.h"
+#include "raw_store.h"
+#include "config.h"
+#define TRACE_LEVEL CONFIG_TRACE_LEVEL_NVS
+#include "trace.h"
 // ─────────────────────────────────────────────────────────────────────────────
 static const char *TAG = "NVS_UTILS";
 // ─────────────────────────────────────────────────────────────────────────────
+/* Next id handed out by store_segment_in_flash(); resumed from the manifest at boot */
+static uint32_t next_segment_id = 1;
+static SemaphoreHandle_t segment_id_mutex = NULL;
+
+/*
+ * Small fixed-size record that lets boot recovery finish in bounded time.
+ * Segment ids are reserved in blocks, so a torn flush can only have left a
+ * blob inside the last block, and every erase sequence (offload, compaction,
+ * late merge) names the blobs it is about to drop in a slot of its own, so
+ * one finishing never clears another's record. Guarded by segment_id_mutex.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t count;                              // 0 = slot free
+    uint8_t reserved[3];
+    uint32_t ids[MANIFEST_MAX_PENDING];
+} PendingErase;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t backend;                            // CONFIG_STORAGE_RAW_PARTITION that wrote the segments
+    uint16_t reserved;
+    uint32_t id_limit;                          // no segment id at or above this was issued
+    PendingErase pending[MANIFEST_PENDING_SLOTS];
+} StorageManifest;
+
+#define MANIFEST_VERSION 3
+static StorageManifest manifest;
+/* Write accounting for the whole storage layer, guarded by wear_mutex */
+static FlashWearStats wear;
+static SemaphoreHandle_t wear_mutex = NULL;
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Segment commit protocol: the blob is written first and only becomes part of
+ * the store once its series' list references it. NVS replaces a single key
+ * atomically, so the list write (its newest chunk, or its header) is the
+ * commit point. Offload likewise drops list entries before erasing blobs.
+ * Without a manifest (first boot of this firmware) this full sweep erases
+ * blobs no list references and drops list entries whose blob is gone, then
+ * resumes segment ids past everything seen.
+ */
+#if !CONFIG_STORAGE_RAW_PARTITION
+static bool parse_segment_key(const char *key, uint32_t *segment_id)
+{
+    // "seg_%08x"; the list keys share the prefix but are not hex
+    char *end = NULL;
+    if (strncmp(key, "seg_", 4) != 0 || strlen(key) != 12) {
+        return false;
+    }
+    unsigned long id = strtoul(key + 4, &end, 16);
+    if (end == NULL || *end != '\0') {
+        return false;
+    }
+    *segment_id = (uint32_t)id;
+    return true;
+}
+#endif
+
+static bool segment_listed(SegmentInfo *const *lists, const size_t *counts, uint32_t segment_id,
+                           uint8_t *present[SERIES_COUNT])
+{
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        for (size_t i = 0; i < counts[s]; i++) {
+            if (lists[s][i].segment_id == segment_id) {
+                present[s][i] = 1;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Every segment id in the store; false if the list may be incomplete
+static bool collect_stored_segments(uint32_t **ids, size_t *count)
+{
+    *ids = NULL;
+    *count = 0;
+#if CONFIG_STORAGE_RAW_PARTITION
+    size_t n = raw_store_segment_ids(NULL, 0);
+    *ids = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (*ids == NULL) {
+        return false;
+    }
+    *count = raw_store_segment_ids(*ids, n);
+    return true;
+#else
+    size_t cap = 0;
+    nvs_iterator_t it = NULL;
+    esp_err_t res = nvs_entry_find(NVS_DEFAULT_PART_NAME, "storage", NVS_TYPE_BLOB, &it);
+    while (res == ESP_OK) {
+        nvs_entry_info_t info;
+        uint32_t segment_id;
+        nvs_entry_info(it, &info);
+        if (parse_segment_key(info.key, &segment_id)) {
+            if (*count == cap) {
+                cap = cap ? cap * 2 : 8;
+                uint32_t *grown = realloc(*ids, cap * sizeof(uint32_t));
+                if (grown == NULL) {
+                    res = ESP_ERR_NO_MEM;
+                    break;
+                }
+                *ids = grown;
+            }
+            (*ids)[(*count)++] = segment_id;
+        }
+        res = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    // Without a complete scan a missing blob cannot be told from an unvisited one
+    return res == ESP_ERR_NVS_NOT_FOUND;
+#endif
+}
+
+static void recover_segments(void)
+{
+    SegmentInfo *lists[SERIES_COUNT] = { 0 };
+    size_t counts[SERIES_COUNT] = { 0 };
+    uint8_t *present[SERIES_COUNT] = { 0 };
+    uint32_t max_id = 0;
+    bool lists_read = true;
+
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        lists_read &= load_segment_list_checked(s, &lists[s], &counts[s]) != SEGMENT_LIST_ERROR;
+        present[s] = calloc(counts[s] ? counts[s] : 1, 1);
+        for (size_t i = 0; i < counts[s]; i++) {
+            if (lists[s][i].segment_id > max_id) {
+                max_id = lists[s][i].segment_id;
+            }
+        }
+    }
+
+    // Collect unreferenced blobs first; the store must not change under the iterator
+    size_t stored_count = 0;
+    uint32_t *stored = NULL;
+    // An unreadable list would make every blob it names look orphaned
+    bool scan_complete = collect_stored_segments(&stored, &stored_count) && lists_read;
+    if (!lists_read) {
+        ESP_LOGE(TAG, "Segment lists unreadable; erasing nothing");
+    }
+    size_t orphan_count = 0;
+    uint32_t *orphans = stored;
+    for (size_t i = 0; i < stored_count; i++) {
+        if (stored[i] > max_id) {
+            max_id = stored[i];
+        }
+        if (!segment_listed(lists, counts, stored[i], present) && lists_read) {
+            orphans[orphan_count++] = stored[i];
+        }
+    }
+
+    for (size_t i = 0; i < orphan_count; i++) {
+        erase_segment_from_flash(orphans[i]);
+    }
+    if (orphan_count > 0) {
+        ESP_LOGW(TAG, "Erased %u uncommitted segments", (unsigned)orphan_count);
+    }
+    free(orphans);
+
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        size_t kept = 0;
+        for (size_t i = 0; i < counts[s]; i++) {
+            if (present[s][i]) {
+                lists[s][kept++] = lists[s][i];
+            }
+        }
+        if (scan_complete && kept < counts[s]) {
+            ESP_LOGW(TAG, "Dropped %u %s list entries without a segment",
+                     (unsigned)(counts[s] - kept), series_name(s));
+            store_segment_list(s, lists[s], kept);
+        }
+        free(lists[s]);
+        free(present[s]);
+    }
+    next_segment_id = max_id + 1;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Caller holds segment_id_mutex (or is init_nvs)
+static bool save_manifest(void)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = storage_set_blob(handle, MANIFEST_KEY, &manifest, sizeof(manifest));
+        if (err == ESP_OK) {
+            err = storage_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write manifest: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+static bool load_manifest(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open("storage", NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t sz = sizeof(manifest);
+    esp_err_t err = nvs_get_blob(handle, MANIFEST_KEY, &manifest, &sz);
+    nvs_close(handle);
+    if (err != ESP_OK || sz != sizeof(manifest) || manifest.version != MANIFEST_VERSION) {
+        return false;
+    }
+    for (size_t slot = 0; slot < MANIFEST_PENDING_SLOTS; slot++) {
+        if (manifest.pending[slot].count > MANIFEST_MAX_PENDING) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool segment_exists_in_flash(uint32_t segment_id)
+{
+#if CONFIG_STORAGE_RAW_PARTITION
+    return raw_store_exists(segment_id);
+#else
+    nvs_handle_t handle;
+    if (nvs_open("storage", NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    char key[SEGMENT_KEY_SIZE];
+    format_segment_key(segment_id, key, sizeof(key));
+    size_t sz = 0;
+    esp_err_t err = nvs_get_blob(handle, key, NULL, &sz);
+    nvs_close(handle);
+    return err == ESP_OK;
+#endif
+}
+
+// Bounded counterpart of recover_segments(): only the last id block and the
+// blobs named by interrupted erase sequences can be orphans
+static void resume_from_manifest(void)
+{
+    SegmentInfo *lists[SERIES_COUNT] = { 0 };
+    size_t counts[SERIES_COUNT] = { 0 };
+    uint32_t max_listed = 0;
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        lists[s] = load_segment_list(s, &counts[s]);
+        // Rollups take new ids but sit at the front, so the newest id can be anywhere
+        for (size_t i = 0; i < counts[s]; i++) {
+            if (lists[s][i].segment_id > max_listed) {
+                max_listed = lists[s][i].segment_id;
+            }
+        }
+    }
+
+    unsigned erased = 0;
+    for (size_t slot = 0; slot < MANIFEST_PENDING_SLOTS; slot++) {
+        const PendingErase *pe = &manifest.pending[slot];
+        for (uint8_t p = 0; p < pe->count; p++) {
+            // Still listed means the reset came before the list update committed
+            bool listed = false;
+            for (uint8_t s = 0; s < SERIES_COUNT && !listed; s++) {
+                for (size_t i = 0; i < counts[s] && !listed; i++) {
+                    listed = (lists[s][i].segment_id == pe->ids[p]);
+                }
+            }
+            if (!listed && segment_exists_in_flash(pe->ids[p])) {
+                erase_segment_from_flash(pe->ids[p]);
+                erased++;
+            }
+        }
+    }
+
+    uint32_t first = manifest.id_limit > SEGMENT_ID_RESERVE ? manifest.id_limit - SEGMENT_ID_RESERVE : 1;
+    if (first <= max_listed) {
+        first = max_listed + 1;
+    }
+    for (uint32_t id = first; id < manifest.id_limit; id++) {
+        if (segment_exists_in_flash(id)) {
+            erase_segment_from_flash(id);
+            erased++;
+        }
+    }
+    if (erased > 0) {
+        ESP_LOGW(TAG, "Erased %u uncommitted segments", erased);
+    }
+
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        free(lists[s]);
+    }
+    next_segment_id = manifest.id_limit > max_listed ? manifest.id_limit : max_listed + 1;
+}
+#if CONFIG_STORAGE_RAW_PARTITION
+// Log erases only live in RAM, so the lists decide what survived a reset
+static void retain_listed_segments(void)
+{
+    size_t total = 0;
+    SegmentInfo *lists[SERIES_COUNT] = { 0 };
+    size_t counts[SERIES_COUNT] = { 0 };
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        lists[s] = load_segment_list(s, &counts[s]);
+        total += counts[s];
+    }
+    uint32_t *ids = malloc((total ? total : 1) * sizeof(uint32_t));
+    if (ids != NULL) {
+        size_t n = 0;
+        for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+            for (size_t i = 0; i < counts[s]; i++) {
+                ids[n++] = lists[s][i].segment_id;
+            }
+        }
+        raw_store_retain(ids, n);
+        free(ids);
+    }
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        free(lists[s]);
+    }
+}
+#endif
+// ─────────────────────────────────────────────────────────────────────────────
+int begin_segment_erase(const uint32_t *segment_ids, size_t count)
+{
+    if (count == 0 || count > MANIFEST_MAX_PENDING) {
+        return -1;
+    }
+    xSemaphoreTake(segment_id_mutex, portMAX_DELAY);
+    int slot = -1;
+    for (size_t i = 0; i < MANIFEST_PENDING_SLOTS && slot < 0; i++) {
+        if (manifest.pending[i].count == 0) {
+            slot = (int)i;
+        }
+    }
+    if (slot < 0) {
+        ESP_LOGW(TAG, "All %d pending erase slots in use", MANIFEST_PENDING_SLOTS);
+    } else {
+        PendingErase *pe = &manifest.pending[slot];
+        memcpy(pe->ids, segment_ids, count * sizeof(uint32_t));
+        pe->count = (uint8_t)count;
+        if (!save_manifest()) {
+            pe->count = 0;
+            slot = -1;
+        }
+    }
+    xSemaphoreGive(segment_id_mutex);
+    return slot;
+}
+
+void end_segment_erase(int slot)
+{
+    if (slot < 0 || slot >= MANIFEST_PENDING_SLOTS) {
+        return;
+    }
+    xSemaphoreTake(segment_id_mutex, portMAX_DELAY);
+    manifest.pending[slot].count = 0;
+    save_manifest();
+    xSemaphoreGive(segment_id_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Before segments, every temperature sample was its own 9-byte blob keyed by
+ * its timestamp ("<ts>", 32-bit seconds) and listed in "timestamp_list". Pack
+ * any such records into segments once so nothing logged by older firmware is
+ * lost.
+ */
+#define LEGACY_LIST_KEY "timestamp_list"
+
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp;
+    float value;
+    uint8_t dirty_bit;
+} LegacyMeasurement;
+
+static void migrate_legacy_records(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open("storage", NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+
+    size_t list_size = 0;
+    if (nvs_get_blob(handle, LEGACY_LIST_KEY, NULL, &list_size) != ESP_OK || list_size == 0) {
+        nvs_close(handle);
+        return;
+    }
+
+    uint32_t *timestamps = malloc(list_size);
+    Segment *seg = calloc(1, sizeof(Segment));
+    if (!timestamps || !seg || nvs_get_blob(handle, LEGACY_LIST_KEY, timestamps, &list_size) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read legacy list %s", LEGACY_LIST_KEY);
+        free(timestamps);
+        free(seg);
+        nvs_close(handle);
+        return;
+    }
+
+    size_t total = list_size / sizeof(uint32_t);
+    size_t migrated = 0;
+    size_t seg_start = 0;
+    bool ok = true;
+    char key[SEGMENT_KEY_SIZE];
+    seg->info.series_id = SERIES_TEMPERATURE;
+    for (size_t i = 0; i < total; i++) {
+        snprintf(key, sizeof(key), "%" PRIu32, timestamps[i]);
+
+        LegacyMeasurement m;
+        size_t sz = sizeof(m);
+        if (nvs_get_blob(handle, key, &m, &sz) == ESP_OK) {
+            seg->timestamps[seg->info.count] = (uint64_t)m.timestamp * 1000;
+            seg->values[seg->info.count] = m.value;
+            seg->info.count++;
+        }
+
+        if (seg->info.count < SEGMENT_MAX_RECORDS && i < total - 1) {
+            continue;
+        }
+        if (seg->info.count > 0 && !store_segment_in_flash(seg)) {
+            ok = false;
+            break;
+        }
+        // Old records are only dropped once their segment is safely stored
+        for (size_t j = seg_start; j <= i; j++) {
+            snprintf(key, sizeof(key), "%" PRIu32, timestamps[j]);
+            storage_erase_key(handle, key);
+        }
+        migrated += seg->info.count;
+        seg_start = i + 1;
+        memset(seg, 0, sizeof(*seg));
+        seg->info.series_id = SERIES_TEMPERATURE;
+    }
+
+    if (ok) {
+        storage_erase_key(handle, LEGACY_LIST_KEY);
+    } else {
+        ESP_LOGE(TAG, "Legacy migration stopped early, will retry on next boot");
+    }
+    storage_commit(handle);
+    nvs_close(handle);
+    ESP_LOGW(TAG, "Migrated %u legacy records into segments", (unsigned)migrated);
+    free(timestamps);
+    free(seg);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Segments written under the other CONFIG_STORAGE_RAW_PARTITION setting. Lists
+ * name them either way, so switching backends moves every listed blob the
+ * new backend lacks instead of letting recovery drop its list entry.
+ */
+static bool other_backend_open(void)
+{
+#if CONFIG_STORAGE_RAW_PARTITION
+    return true;    // NVS is mounted already
+#else
+    return raw_store_init();
+#endif
+}
+
+static bool other_backend_read(uint32_t segment_id, uint8_t *blob, size_t *blob_size)
+{
+#if CONFIG_STORAGE_RAW_PARTITION
+    nvs_handle_t handle;
+    if (nvs_open("storage", NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    char key[SEGMENT_KEY_SIZE];
+    format_segment_key(segment_id, key, sizeof(key));
+    esp_err_t err = nvs_get_blob(handle, key, blob, blob_size);
+    nvs_close(handle);
+    return err == ESP_OK;
+#else
+    return raw_store_exists(segment_id) && raw_store_read(segment_id, blob, blob_size);
+#endif
+}
+
+static void other_backend_erase(uint32_t segment_id)
+{
+#if CONFIG_STORAGE_RAW_PARTITION
+    nvs_handle_t handle;
+    if (nvs_open("storage", NVS_READWRITE, &handle) == ESP_OK) {
+        char key[SEGMENT_KEY_SIZE];
+        format_segment_key(segment_id, key, sizeof(key));
+        if (storage_erase_key(handle, key) == ESP_OK) {
+            storage_commit(handle);
+        }
+        nvs_close(handle);
+    }
+#else
+    raw_store_erase(segment_id);
+#endif
+}
+
+static bool put_segment_blob(uint32_t segment_id, const uint8_t *blob, size_t blob_size);
+
+// `required`: the manifest says the segments are there, so not reaching them is fatal
+static bool migrate_segment_backend(bool required)
+{
+    if (!other_backend_open()) {
+        if (required) {
+            ESP_LOGE(TAG, "Segments were stored on the %s backend, which cannot be mounted",
+                     CONFIG_STORAGE_RAW_PARTITION ? "NVS" : "raw partition");
+        }
+        return !required;
+    }
+    uint8_t *blob = malloc(SEGMENT_MAX_ENCODED_SIZE);
+    if (blob == NULL) {
+        return false;
+    }
+    bool ok = true;
+    unsigned moved = 0;
+    for (uint8_t s = 0; s < SERIES_COUNT && ok; s++) {
+        size_t count = 0;
+        SegmentInfo *list = load_segment_list(s, &count);
+        for (size_t i = 0; i < count && ok; i++) {
+            size_t blob_size = SEGMENT_MAX_ENCODED_SIZE;
+            uint32_t id = list[i].segment_id;
+            // Already moved by an interrupted run, or on neither backend (recovery drops it)
+            if (segment_exists_in_flash(id) || !other_backend_read(id, blob, &blob_size)) {
+                continue;
+            }
+            ok = put_segment_blob(id, blob, blob_size);
+            if (ok) {
+                other_backend_erase(id);
+                moved++;
+            }
+        }
+        free(list);
+    }
+    free(blob);
+    if (moved > 0 || !ok) {
+        ESP_LOGW(TAG, "Moved %u segments to the %s backend%s", moved,
+                 CONFIG_STORAGE_RAW_PARTITION ? "raw partition" : "NVS", ok ? "" : " before running out of space");
+    }
+    return ok;
+}
+// ─────────────────────────────────────────────────────────────────────────────
 esp_err_t init_nvs(void)
 {
     esp_err_t err = nvs_flash_init();
@@ -26,14 +557,147 @@ esp_err_t init_nvs(void)
         ESP_ERROR_CHECK(nvs_flash_erase());
         err = nvs_flash_init();
     }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (segment_id_mutex == NULL) {
+        segment_id_mutex = xSemaphoreCreateMutex();
+    }
+    if (wear_mutex == NULL) {
+        wear_mutex = xSemaphoreCreateMutex();
+        reset_flash_wear_stats();
+    }
+    segment_list_init();
+#if CONFIG_STORAGE_RAW_PARTITION
+    if (!raw_store_init()) {
+        return ESP_ERR_NOT_FOUND;
+    }
+#endif
+    bool have_manifest = load_manifest();
+    // Without a manifest the backend is unknown, so listed blobs are looked for on both
+    if ((!have_manifest || manifest.backend != CONFIG_STORAGE_RAW_PARTITION) &&
+        !migrate_segment_backend(have_manifest)) {
+        ESP_LOGE(TAG, "Refusing to mount storage: listed segments could not be moved to this backend");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (have_manifest) {
+        resume_from_manifest();
+    } else {
+        // One O(keys) sweep; every later boot is bounded by the manifest
+        recover_segments();
+    }
+#if CONFIG_STORAGE_RAW_PARTITION
+    retain_listed_segments();
+#endif
+    manifest.version = MANIFEST_VERSION;
+    manifest.backend = CONFIG_STORAGE_RAW_PARTITION;
+    memset(manifest.pending, 0, sizeof(manifest.pending));
+    manifest.id_limit = next_segment_id + SEGMENT_ID_RESERVE;
+    save_manifest();
+    migrate_legacy_records();
+    return ESP_OK;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void account_blob_write(size_t length, uint32_t entries) {
+    if (wear_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(wear_mutex, portMAX_DELAY);
+    wear.blob_writes++;
+    wear.bytes_written += length;
+    wear.entries_written += entries;
+    xSemaphoreGive(wear_mutex);
+}
+
+esp_err_t storage_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    esp_err_t err = nvs_set_blob(handle, key, value, length);
+    if (err == ESP_OK) {
+        // Blob data entries plus the item header and blob index entries
+        account_blob_write(length, 2 + (length + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE);
+    }
+    return err;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t storage_erase_key(nvs_handle_t handle, const char *key) {
+    esp_err_t err = nvs_erase_key(handle, key);
+    if (err == ESP_OK && wear_mutex != NULL) {
+        xSemaphoreTake(wear_mutex, portMAX_DELAY);
+        wear.erases++;
+        xSemaphoreGive(wear_mutex);
+    }
+    return err;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+esp_err_t storage_commit(nvs_handle_t handle) {
+    esp_err_t err = nvs_commit(handle);
+    if (wear_mutex != NULL) {
+        xSemaphoreTake(wear_mutex, portMAX_DELAY);
+        wear.commits++;
+        xSemaphoreGive(wear_mutex);
+    }
     return err;
 }
 // ─────────────────────────────────────────────────────────────────────────────
-bool store_measurement_in_flash(Measurement *m) {
-    if (!m) {
-        ESP_LOGE(TAG, "Measurement is NULL");
+void get_flash_wear_stats(FlashWearStats *stats) {
+    if (wear_mutex == NULL) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(wear_mutex, portMAX_DELAY);
+    *stats = wear;
+    xSemaphoreGive(wear_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void reset_flash_wear_stats(void) {
+    if (wear_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(wear_mutex, portMAX_DELAY);
+    memset(&wear, 0, sizeof(wear));
+    wear.since_us = (uint64_t)esp_timer_get_time();
+    xSemaphoreGive(wear_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+float flash_write_amplification(const FlashWearStats *stats) {
+    if (stats->logical_bytes == 0) {
+        return 0.0f;
+    }
+    return (float)((double)stats->entries_written * NVS_ENTRY_SIZE / (double)stats->logical_bytes);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+float flash_projected_lifetime_days(const FlashWearStats *stats) {
+    nvs_stats_t st;
+    uint64_t elapsed_us = (uint64_t)esp_timer_get_time() - stats->since_us;
+    if (stats->entries_written == 0 || elapsed_us == 0 || nvs_get_stats("nvs", &st) != ESP_OK) {
+        return 0.0f;
+    }
+    // Entry writes are spread over every page of the partition before a page is erased again
+    double entries_per_day = (double)stats->entries_written * 86400e6 / (double)elapsed_us;
+    double total_entries = (double)st.total_entries;
+#if CONFIG_STORAGE_RAW_PARTITION
+    // The segment log wears its own partition, counted here in entry-sized units
+    total_entries += (double)raw_store_capacity() / NVS_ENTRY_SIZE;
+#endif
+    return (float)(total_entries * FLASH_ENDURANCE_CYCLES / entries_per_day);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void format_segment_key(uint32_t segment_id, char *key, size_t key_len) {
+    snprintf(key, key_len, "seg_%08" PRIx32, segment_id);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Segment blob I/O for the backend picked by CONFIG_STORAGE_RAW_PARTITION:
+ * one NVS key per segment, or a record in the raw partition log.
+ */
+static bool put_segment_blob(uint32_t segment_id, const uint8_t *blob, size_t blob_size) {
+#if CONFIG_STORAGE_RAW_PARTITION
+    if (!raw_store_write(segment_id, blob, blob_size)) {
         return false;
     }
+    account_blob_write(blob_size, (raw_store_record_size(blob_size) + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE);
+    return true;
+#else
     nvs_handle_t handle;
     esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
     if (err != ESP_OK) {
@@ -41,44 +705,35 @@ bool store_measurement_in_flash(Measurement *m) {
         return false;
     }
 
-    char key[16]; // [FIX] unify key size
-    snprintf(key, sizeof(key), "%" PRIu32, m->timestamp);
+    char key[SEGMENT_KEY_SIZE];
+    format_segment_key(segment_id, key, sizeof(key));
 
-    // see if entry already exists
-    size_t sz = 0;
-    err = nvs_get_blob(handle, key, NULL, &sz);
-    if (err == ESP_OK) {
-        // entry already exists
-        nvs_close(handle);
-        return true;
-    }
-
-    err = nvs_set_blob(handle, key, m, sizeof(Measurement));
+    err = storage_set_blob(handle, key, blob, blob_size);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to set blob in NVS: %s", esp_err_to_name(err));
         nvs_close(handle);
         return false;
     }
 
-    err = nvs_commit(handle);
+    err = storage_commit(handle);
     nvs_close(handle);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
         return false;
     }
-
-    ESP_LOGI(TAG, "Stored measurement timestamp=%" PRIu32 " in flash key=%s", m->timestamp, key);
     return true;
+#endif
 }
 
-// ─────────────────────────────────────────────────────────────────────────────
-bool find_measurement_in_flash(uint32_t timestamp, Measurement *result) {
-    if (!result) {
-        ESP_LOGE(TAG, "Result pointer is NULL");
+static bool get_segment_blob(uint32_t segment_id, uint8_t *blob, size_t *blob_size) {
+#if CONFIG_STORAGE_RAW_PARTITION
+    if (!raw_store_read(segment_id, blob, blob_size)) {
+        ESP_LOGE(TAG, "Failed get segment %" PRIu32 " from the raw partition", segment_id);
         return false;
     }
-
+    return true;
+#else
     nvs_handle_t handle;
     esp_err_t err = nvs_open("storage", NVS_READONLY, &handle);
     if (err != ESP_OK) {
@@ -86,20 +741,343 @@ bool find_measurement_in_flash(uint32_t timestamp, Measurement *result) {
         return false;
     }
 
-    char key[16]; // [FIX]
-    snprintf(key, sizeof(key), "%" PRIu32, timestamp);
+    char key[SEGMENT_KEY_SIZE];
+    format_segment_key(segment_id, key, sizeof(key));
+
+    err = nvs_get_blob(handle, key, blob, blob_size);
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed get segment for key=%s: %s", key, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+#endif
+}
 
-    size_t sz = sizeof(Measurement);
-    err = nvs_get_blob(handle, key, result, &sz);
+static bool erase_segment_blob(uint32_t segment_id) {
+#if CONFIG_STORAGE_RAW_PARTITION
+    // Only the index forgets it; the sector is reused once nothing in it is live
+    if (raw_store_erase(segment_id) && wear_mutex != NULL) {
+        xSemaphoreTake(wear_mutex, portMAX_DELAY);
+        wear.erases++;
+        xSemaphoreGive(wear_mutex);
+    }
+    return true;
+#else
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS handle: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    char key[SEGMENT_KEY_SIZE];
+    format_segment_key(segment_id, key, sizeof(key));
+
+    err = storage_erase_key(handle, key);
+    if (err == ESP_OK) {
+        err = storage_commit(handle);
+    }
     nvs_close(handle);
 
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed get blob for key=%s: %s", key, esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to erase key %s: %s", key, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+#endif
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Writes the encoded segment; caller fills seg->info.segment_id
+static bool write_segment_blob(const Segment *seg) {
+    size_t blob_size = segment_encoded_size(seg);
+    uint8_t *blob = malloc(blob_size);
+    if (!blob) {
+        ESP_LOGE(TAG, "Malloc fail for segment blob (%u bytes)", (unsigned)blob_size);
+        return false;
+    }
+    if (segment_encode(seg, blob, blob_size) == 0) {
+        free(blob);
+        return false;
+    }
+
+    bool ok = put_segment_blob(seg->info.segment_id, blob, blob_size);
+    free(blob);
+    if (!ok) {
+        return false;
+    }
+    TRACE(TRACE_SEGMENT_STORE, seg->info.segment_id, blob_size);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Gives the segment the next id and its zone map and writes the blob; it is not listed yet
+static bool write_new_segment(Segment *seg) {
+    if (!seg || seg->info.count == 0 || seg->info.count > SEGMENT_MAX_RECORDS) {
+        ESP_LOGE(TAG, "Invalid segment");
+        return false;
+    }
+
+    xSemaphoreTake(segment_id_mutex, portMAX_DELAY);
+    if (next_segment_id >= manifest.id_limit) {
+        // Reserve the next block before any blob carries an id from it
+        manifest.id_limit = next_segment_id + SEGMENT_ID_RESERVE;
+        if (!save_manifest()) {
+            manifest.id_limit = next_segment_id;
+            xSemaphoreGive(segment_id_mutex);
+            return false;
+        }
+    }
+    seg->info.segment_id = next_segment_id++;
+    xSemaphoreGive(segment_id_mutex);
+
+    segment_compute_bounds(seg);
+    return write_segment_blob(seg);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool store_segment_in_flash(Segment *seg) {
+    if (!write_new_segment(seg)) {
+        return false;
+    }
+    xSemaphoreTake(wear_mutex, portMAX_DELAY);
+    wear.logical_records += seg->info.count;
+    wear.logical_bytes += (uint64_t)seg->info.count * (sizeof(uint64_t) + sizeof(float));
+    xSemaphoreGive(wear_mutex);
+
+    if (!append_segment_to_list(&seg->info)) {
+        // Without an index entry the segment is unreachable; drop it
+        erase_segment_from_flash(seg->info.segment_id);
+        return false;
+    }
+
+    TRACE_LOG("Stored %s segment %" PRIu32 " (%u records, ts %" PRIu64 "..%" PRIu64 ") in flash",
+             series_name(seg->info.series_id), seg->info.segment_id, seg->info.count,
+             seg->info.min_ts, seg->info.max_ts);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool replace_segments_in_flash(uint8_t series_id, const uint32_t *old_ids, size_t count,
+                               Segment *replacements, size_t replacement_count) {
+    if (count == 0 || count > MANIFEST_MAX_PENDING) {
+        return false;
+    }
+    if (replacement_count == 0) {
+        // Pure drops erase first: a reset in between only leaves list entries without
+        // blobs for validate_segment_lists_step(), and nothing has to be written before
+        // space is freed, so this still works on a full partition
+        for (size_t i = 0; i < count; i++) {
+            erase_segment_from_flash(old_ids[i]);
+        }
+        return replace_segments_in_list(series_id, old_ids, count, NULL, 0);
+    }
+
+    // Same order as a flush followed by an offload: new blobs, pending erase, list, old blobs
+    SegmentInfo infos[SEGMENT_REPLACE_MAX];
+    size_t written = 0;
+    while (written < replacement_count && written < SEGMENT_REPLACE_MAX && write_new_segment(&replacements[written])) {
+        infos[written] = replacements[written].info;
+        written++;
+    }
+    bool ok = written == replacement_count;
+    int slot = ok ? begin_segment_erase(old_ids, count) : -1;
+    if (slot < 0) {
+        ok = false;
+    } else if (!replace_segments_in_list(series_id, old_ids, count, infos, replacement_count)) {
+        // The old entries are still listed, so the pending record protects nothing
+        end_segment_erase(slot);
+        ok = false;
+    }
+    if (!ok) {
+        for (size_t i = 0; i < written; i++) {
+            erase_segment_from_flash(replacements[i].info.segment_id);
+        }
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        erase_segment_from_flash(old_ids[i]);
+    }
+    end_segment_erase(slot);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/* Records of one segment with late samples merged in, before it is split back into segments */
+typedef struct {
+    uint64_t timestamps[2 * SEGMENT_MAX_RECORDS];
+    float values[2 * SEGMENT_MAX_RECORDS];
+    bool sent[2 * SEGMENT_MAX_RECORDS];
+    size_t count;
+} MergedRun;
+
+// Rewrites the listed segment `info` with up to SEGMENT_MAX_RECORDS sorted late samples merged in
+static bool merge_into_segment(const SegmentInfo *info, const uint64_t *timestamps, const float *values, size_t n) {
+    Segment *seg = mem_pool_alloc(MEM_POOL_SEGMENT, sizeof(Segment));
+    MergedRun *run = malloc(sizeof(MergedRun));
+    Segment *pieces = calloc(2, sizeof(Segment));
+    bool ok = seg && run && pieces && load_segment_from_flash(info->segment_id, seg);
+    if (!ok) {
+        ESP_LOGE(TAG, "Cannot merge late samples into segment %" PRIu32, info->segment_id);
+        mem_pool_free(seg);
+        free(run);
+        free(pieces);
+        return false;
+    }
+
+    // A late sample replaces a stored one with the same timestamp, so back-fill is idempotent
+    size_t r = 0, k = 0;
+    run->count = 0;
+    while (r < seg->info.count || k < n) {
+        size_t at = run->count++;
+        if (k == n || (r < seg->info.count && seg->timestamps[r] < timestamps[k])) {
+            run->timestamps[at] = seg->timestamps[r];
+            run->values[at] = seg->values[r];
+            run->sent[at] = segment_is_sent(seg, r);
+            r++;
+        } else {
+            if (r < seg->info.count && seg->timestamps[r] == timestamps[k]) {
+                r++;
+            }
+            run->timestamps[at] = timestamps[k];
+            run->values[at] = values[k];
+            run->sent[at] = false;
+            k++;
+        }
+    }
+
+    // Split evenly when the result no longer fits one segment
+    size_t piece_count = (run->count + SEGMENT_MAX_RECORDS - 1) / SEGMENT_MAX_RECORDS;
+    size_t per_piece = (run->count + piece_count - 1) / piece_count;
+    for (size_t i = 0; i < run->count; i++) {
+        Segment *piece = &pieces[i / per_piece];
+        int idx = piece->info.count++;
+        piece->timestamps[idx] = run->timestamps[i];
+        piece->values[idx] = run->values[i];
+        if (run->sent[i]) {
+            segment_mark_sent(piece, idx);
+        }
+    }
+    for (size_t p = 0; p < piece_count; p++) {
+        pieces[p].info.series_id = info->series_id;
+        pieces[p].info.flags = info->flags;
+    }
+
+    uint32_t old_id = info->segment_id;
+    ok = replace_segments_in_flash(info->series_id, &old_id, 1, pieces, piece_count);
+    if (ok) {
+        TRACE_LOG("Merged %u late samples into %s segment %" PRIu32 " (%u segments now)", (unsigned)n,
+                 series_name(info->series_id), info->segment_id, (unsigned)piece_count);
+    }
+    mem_pool_free(seg);
+    free(run);
+    free(pieces);
+    return ok;
+}
+
+bool merge_late_measurements(uint8_t series_id, const uint64_t *timestamps, const float *values, size_t count) {
+    size_t done = 0;
+    size_t merged = 0;  // the rest went through store_segment_in_flash(), which counts its own
+    while (done < count) {
+        size_t total = 0;
+        SegmentInfo *list = NULL;
+        SegmentListStatus status = load_segment_list_checked(series_id, &list, &total);
+        if (status == SEGMENT_LIST_ERROR) {
+            // Not knowing the list, any segment written now could duplicate a stored one
+            ESP_LOGE(TAG, "Cannot read the %s segment list; late samples stay staged", series_name(series_id));
+            return false;
+        }
+        if (status == SEGMENT_LIST_EMPTY) {
+            // Everything they belong between has been offloaded; they start the list afresh
+            Segment *seg = mem_pool_alloc(MEM_POOL_SEGMENT, sizeof(Segment));
+            if (seg == NULL) {
+                return false;
+            }
+            memset(seg, 0, sizeof(*seg));
+            seg->info.series_id = series_id;
+            for (; done < count && seg->info.count < SEGMENT_MAX_RECORDS; done++) {
+                seg->timestamps[seg->info.count] = timestamps[done];
+                seg->values[seg->info.count++] = values[done];
+            }
+            bool ok = store_segment_in_flash(seg);
+            mem_pool_free(seg);
+            if (!ok) {
+                return false;
+            }
+            continue;
+        }
+
+        // The first segment ending at or after the sample takes it (the newest if none does),
+        // together with the following samples up to that segment's end
+        size_t lo = 0, hi = total;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (list[mid].max_ts < timestamps[done]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        size_t target = lo < total ? lo : total - 1;
+        uint64_t limit = target + 1 < total ? list[target].max_ts : UINT64_MAX;
+        SegmentInfo info = list[target];
+        free(list);
+
+        size_t end = done;
+        while (end < count && end - done < SEGMENT_MAX_RECORDS && timestamps[end] <= limit) {
+            end++;
+        }
+        if (!merge_into_segment(&info, &timestamps[done], &values[done], end - done)) {
+            return false;
+        }
+        merged += end - done;
+        done = end;
+    }
+
+    xSemaphoreTake(wear_mutex, portMAX_DELAY);
+    wear.logical_records += merged;
+    wear.logical_bytes += (uint64_t)merged * (sizeof(uint64_t) + sizeof(float));
+    xSemaphoreGive(wear_mutex);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool load_segment_from_flash(uint32_t segment_id, Segment *seg) {
+    if (!seg) {
+        ESP_LOGE(TAG, "Segment pointer is NULL");
+        return false;
+    }
+
+    uint8_t blob[SEGMENT_MAX_ENCODED_SIZE];
+    size_t sz = sizeof(blob);
+    if (!get_segment_blob(segment_id, blob, &sz)) {
+        return false;
+    }
+    TRACE(TRACE_SEGMENT_LOAD, segment_id, sz);
+    return segment_decode(blob, sz, seg);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool update_segment_in_flash(const Segment *seg) {
+    if (!seg) {
+        return false;
+    }
+    read_cache_invalidate(seg->info.segment_id);
+    return write_segment_blob(seg);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool erase_segment_from_flash(uint32_t segment_id) {
+    bool ok = erase_segment_blob(segment_id);
+    read_cache_invalidate(segment_id);
+    if (!ok) {
         return false;
     }
-    ESP_LOGI(TAG, "Found measurement timestamp=%" PRIu32 " in flash (key=%s)", timestamp, key);
+    TRACE(TRACE_SEGMENT_ERASE, segment_id, 0);
     return true;
 }
+// ─────────────────────────────────────────────────────────────────────────────
+bool find_measurement_in_flash(uint8_t series_id, uint64_t timestamp, Measurement *result) {
+    if (!result) {
+        ESP_LOGE(TAG, "Result pointer is NULL");
+        return false;
+    }
+    return get_measurements_from_flash(series_id, timestamp, timestamp, result, 1) == 1;
+}
 
 // ─────────────────────────────────────────────────────────────────────────────
 void clear_flash_storage(void) {
@@ -116,12 +1094,22 @@ void clear_flash_storage(void) {
     } else {
         ESP_LOGI(TAG, "Flash storage cleared.");
     }
+#if CONFIG_STORAGE_RAW_PARTITION
+    raw_store_format();
+#endif
+    read_cache_clear();
 
-    err = nvs_commit(handle);
+    err = storage_commit(handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed commit after erase: %s", esp_err_to_name(err));
     }
     nvs_close(handle);
+
+    // Keep the id reservation so the next boot stays on the bounded path
+    xSemaphoreTake(segment_id_mutex, portMAX_DELAY);
+    memset(manifest.pending, 0, sizeof(manifest.pending));
+    save_manifest();
+    xSemaphoreGive(segment_id_mutex);
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
@@ -135,92 +1123,107 @@ uint32_t get_flash_usage_percent(void) {
     if (st.total_entries == 0) {
         return 0;
     }
-    return (st.used_entries * 100U) / st.total_entries;
-}
-
-// ─────────────────────────────────────────────────────────────────────────────
-bool retrieve_measurement_from_flash(uint32_t timestamp, Measurement *m) {
-    if (!m) {
-        ESP_LOGE(TAG, "Measurement pointer is NULL");
-        return false;
+    uint32_t percent = (st.used_entries * 100U) / st.total_entries;
+#if CONFIG_STORAGE_RAW_PARTITION
+    // Segments live in the log; lists, manifest and WAL still fill NVS
+    uint32_t log_percent = raw_store_usage_percent();
+    if (log_percent > percent) {
+        percent = log_percent;
     }
-
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS handle: %s", esp_err_to_name(err));
-        return false;
-    }
-
-    char key[16];
-    snprintf(key, sizeof(key), "%" PRIu32, timestamp);
-
-    size_t sz = sizeof(Measurement);
-    err = nvs_get_blob(handle, key, m, &sz);
-    nvs_close(handle);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed get measurement for key=%s: %s", key, esp_err_to_name(err));
-        return false;
-    }
-    ESP_LOGI(TAG, "Retrieved measurement timestamp=%" PRIu32 " from flash key=%s", timestamp, key);
-    return true;
+#endif
+    return percent;
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
 // -------------- Edge retrieve logic truncated for brevity... --------------
 
-// Range retrieval from flash
-int get_measurements_from_flash(uint32_t start_timestamp, uint32_t end_timestamp,
-                                Measurement *measurements, size_t max_measurements)
+// Range retrieval from flash, handed to `visit` one segment at a time
+int scan_measurements_in_flash(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                               const ValuePredicate *where, flash_range_visitor_t visit, void *ctx)
 {
-    nvs_handle_t handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed nvs_open: %s", esp_err_to_name(err));
-        return -1;
-    }
-
-    // We assume TIMESTAMP_LIST_KEY is defined in "timestamp_list.h"
-    size_t list_size = 0;
-    err = nvs_get_blob(handle, TIMESTAMP_LIST_KEY, NULL, &list_size);
-    if (err != ESP_OK || list_size == 0) {
-        ESP_LOGE(TAG, "Failed to get timestamp list or empty. err=%s", esp_err_to_name(err));
-        nvs_close(handle);
-        return -1;
-    }
-
-    size_t total_entries = list_size / sizeof(uint32_t);
-    uint32_t *timestamp_list = malloc(list_size);
-    if (!timestamp_list) {
-        ESP_LOGE(TAG, "Malloc fail for timestamp_list");
-        nvs_close(handle);
-        return -1;
+    size_t total_segments = 0;
+    SegmentInfo *segment_list = load_segment_list_scratch(series_id, &total_segments);
+    if (!segment_list) {
+        // Nothing persisted for this series yet
+        return 0;
     }
 
-    err = nvs_get_blob(handle, TIMESTAMP_LIST_KEY, timestamp_list, &list_size);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed get blob for TS list: %s", esp_err_to_name(err));
-        free(timestamp_list);
-        nvs_close(handle);
+    Segment *seg = mem_pool_alloc(MEM_POOL_SEGMENT, sizeof(Segment));
+    Measurement *matches = mem_scratch_alloc(sizeof(Measurement) * SEGMENT_MAX_RECORDS);
+    if (!seg || !matches) {
+        ESP_LOGE(TAG, "Malloc fail for segment");
+        mem_pool_free(seg);
+        mem_scratch_free(matches);
+        mem_scratch_free(segment_list);
         return -1;
     }
-    nvs_close(handle);
 
     int count = 0;
-    for (size_t i = 0; i < total_entries && (int)count < (int)max_measurements; i++) {
-        uint32_t ts = timestamp_list[i];
-        if (ts >= start_timestamp && ts <= end_timestamp) {
-            Measurement tmp;
-            if (retrieve_measurement_from_flash(ts, &tmp)) {
-                measurements[count++] = tmp;
-            } else {
-                ESP_LOGW(TAG, "Could not retrieve flash item for TS=%" PRIu32, ts);
+    size_t pruned = 0;
+    for (size_t i = 0; i < total_segments; i++) {
+        const SegmentInfo *info = &segment_list[i];
+        // Skip segments whose time bounds cannot overlap the range, without reading them
+        if (info->max_ts < start_timestamp || info->min_ts > end_timestamp) {
+            continue;
+        }
+        // Likewise for value bounds that cannot satisfy the predicate
+        if (where && !value_predicate_may_match(where, zone_bound_value(info->min_value),
+                                                zone_bound_value(info->max_value))) {
+            pruned++;
+            continue;
+        }
+
+        if (!read_cache_lookup(info->segment_id, seg)) {
+            if (!load_segment_from_flash(info->segment_id, seg)) {
+                ESP_LOGW(TAG, "Could not retrieve flash segment %" PRIu32, info->segment_id);
+                continue;
             }
+            read_cache_insert(seg);
+        }
+
+        int found = segment_get_range_where(seg, start_timestamp, end_timestamp, where, matches, SEGMENT_MAX_RECORDS);
+        if (found == 0) {
+            continue;
+        }
+        count += found;
+        if (!visit(matches, (size_t)found, ctx)) {
+            break;
         }
     }
-    ESP_LOGI(TAG, "Found %d measurements in flash range [%"PRIu32", %"PRIu32"]", count, start_timestamp, end_timestamp);
+    TRACE(TRACE_FLASH_RANGE, series_id, count);
+    TRACE_LOG("Found %d %s measurements in flash range [%"PRIu64", %"PRIu64"] (%u segments pruned by value)",
+             count, series_name(series_id), start_timestamp, end_timestamp, (unsigned)pruned);
 
-    free(timestamp_list);
+    mem_scratch_free(matches);
+    mem_pool_free(seg);
+    mem_scratch_free(segment_list);
     return count;
+}
+
+typedef struct {
+    Measurement *out;
+    size_t max;
+    size_t count;
+} FlashCollect;
+
+static bool collect_flash_range(const Measurement *measurements, size_t count, void *ctx) {
+    FlashCollect *collect = ctx;
+    size_t room = collect->max - collect->count;
+    size_t n = count < room ? count : room;
+    memcpy(&collect->out[collect->count], measurements, n * sizeof(Measurement));
+    collect->count += n;
+    return collect->count < collect->max;
+}
+
+int get_measurements_from_flash(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                                Measurement *measurements, size_t max_measurements)
+{
+    if (max_measurements == 0) {
+        return 0;
+    }
+    FlashCollect collect = { measurements, max_measurements, 0 };
+    if (scan_measurements_in_flash(series_id, start_timestamp, end_timestamp, NULL, collect_flash_range, &collect) < 0) {
+        return -1;
+    }
+    return (int)collect.count;
 }
\ No newline at end of file
@@ -3,17 +3,98 @@
 // ─────────────────────────────────────────────────────────────────────────────
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
+#include "nvs.h"
 #include "measurement.h"
+#include "segment.h"
+// ─────────────────────────────────────────────────────────────────────────────
+#define SEGMENT_KEY_SIZE 16
+#define MANIFEST_KEY "manifest"
+/* Segment ids reserved per manifest write; bounds the boot-time orphan probe */
+#define SEGMENT_ID_RESERVE 64
+/* Most segments one erase sequence may drop (see offload.c) */
+#define MANIFEST_MAX_PENDING 8
+/* Erase sequences that may be in flight at once: offload, compaction, late merge, one spare */
+#define MANIFEST_PENDING_SLOTS 4
+/* Rated erase cycles per flash sector, used for the lifetime projection */
+#define FLASH_ENDURANCE_CYCLES 100000
+/* NVS stores data in 32-byte entries, 126 per 4 KB page */
+#define NVS_ENTRY_SIZE 32
 // ─────────────────────────────────────────────────────────────────────────────
 esp_err_t init_nvs(void);
-bool store_measurement_in_flash(Measurement *m);
-bool find_measurement_in_flash(uint32_t timestamp, Measurement *result);
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Every NVS write in the storage layer goes through these wrappers so the
+ * physical cost of logging can be compared with the logical data rate.
+ */
+typedef struct {
+    uint32_t logical_records;   // measurements handed to flash
+    uint64_t logical_bytes;     // their timestamp + value payload
+    uint32_t blob_writes;       // nvs_set_blob calls
+    uint64_t bytes_written;     // blob bytes passed to NVS
+    uint32_t entries_written;   // 32-byte NVS entries consumed, incl. headers
+    uint32_t erases;            // keys erased
+    uint32_t commits;
+    uint64_t since_us;          // accounting window start (esp_timer time)
+} FlashWearStats;
+
+esp_err_t storage_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t storage_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t storage_commit(nvs_handle_t handle);
+void get_flash_wear_stats(FlashWearStats *stats);
+void reset_flash_wear_stats(void);
+/* Physical bytes (whole NVS entries) written per logical payload byte; 0 if nothing logged */
+float flash_write_amplification(const FlashWearStats *stats);
+/* Days until the partition's sectors reach FLASH_ENDURANCE_CYCLES at the observed rate */
+float flash_projected_lifetime_days(const FlashWearStats *stats);
+void format_segment_key(uint32_t segment_id, char *key, size_t key_len);
+// ─────────────────────────────────────────────────────────────────────────────
+/* Assigns seg->info.segment_id, writes the segment and appends it to its series' list */
+bool store_segment_in_flash(Segment *seg);
+bool load_segment_from_flash(uint32_t segment_id, Segment *seg);
+/* Rewrites an existing segment in place (e.g. after updating its sent bitmap) */
+bool update_segment_in_flash(const Segment *seg);
+bool erase_segment_from_flash(uint32_t segment_id);
+/*
+ * Swaps a contiguous run of a series' listed segments for `replacements`
+ * (stored under new ids, at most SEGMENT_REPLACE_MAX) or, if there are
+ * none, drops them. Crash-safe like flush and offload.
+ */
+#define SEGMENT_REPLACE_MAX 4
+bool replace_segments_in_flash(uint8_t series_id, const uint32_t *old_ids, size_t count,
+                               Segment *replacements, size_t replacement_count);
+/*
+ * Folds sorted samples older than the series' newest segment into the listed
+ * segments covering their time, splitting any that overflow, so lists stay
+ * sorted and non-overlapping. A stored timestamp is overwritten, which makes
+ * a retry after a failure harmless.
+ */
+bool merge_late_measurements(uint8_t series_id, const uint64_t *timestamps, const float *values, size_t count);
+bool segment_exists_in_flash(uint32_t segment_id);
+/*
+ * An erase sequence records the blobs it is about to drop before updating the
+ * list and clears the record once they are erased, so boot recovery never has
+ * to scan for orphans. Returns the manifest slot to pass to end_segment_erase(),
+ * or -1 if the record could not be written.
+ */
+int begin_segment_erase(const uint32_t *segment_ids, size_t count);
+void end_segment_erase(int slot);
+// ─────────────────────────────────────────────────────────────────────────────
+bool find_measurement_in_flash(uint8_t series_id, uint64_t timestamp, Measurement *result);
 void clear_flash_storage(void);
 uint32_t get_flash_usage_percent(void);
-bool retrieve_measurement_from_flash(uint32_t timestamp, Measurement *m);
-bool retrieve_measurement_from_edge(uint32_t timestamp, Measurement *m); // Declaration only
+bool retrieve_measurement_from_edge(uint8_t series_id, uint64_t timestamp, Measurement *m); // Declaration only
 // ─────────────────────────────────────────────────────────────────────────────
-int get_measurements_from_flash(uint32_t start_timestamp, uint32_t end_timestamp, Measurement *measurements, size_t max_measurements);
+/* Receives the matches of one segment at a time; returning false ends the scan */
+typedef bool (*flash_range_visitor_t)(const Measurement *measurements, size_t count, void *ctx);
+/*
+ * Visits the series' stored samples in [start, end] that satisfy `where` (NULL
+ * for all) in list order; returns how many matched, or -1
+ */
+int scan_measurements_in_flash(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                               const ValuePredicate *where, flash_range_visitor_t visit, void *ctx);
+int get_measurements_from_flash(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                                Measurement *measurements, size_t max_measurements);
 // ─────────────────────────────────────────────────────────────────────────────
-#endif // NVS_UTILS_H
+#endif // NVS_UTILS_H
\ No newline at end of file
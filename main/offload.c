@@ -0,0 +1,103 @@
+#include "offload.h"
+#include "nvs_utils.h"
+#include "segment_list.h"
+#include "metrics.h"
+#include "mem_pool.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "OFFLOAD";
+// ─────────────────────────────────────────────────────────────────────────────
+// send the oldest flash segments of one series to edge
+static void offload_series_to_edge(uint8_t series_id, offload_publish_fn publish) {
+    size_t segments_to_send = 4; // Adjust as needed (at most MANIFEST_MAX_PENDING)
+    SegmentInfo segments[segments_to_send];
+    size_t actual_segments = 0;
+
+    // Get the first 'segments_to_send' segments from the list
+    get_segments_from_list(series_id, segments_to_send, segments, &actual_segments);
+
+    if (actual_segments == 0) {
+        ESP_LOGI(TAG, "No %s entries to send", series_name(series_id));
+        return;
+    }
+
+    Segment *seg = mem_pool_alloc(MEM_POOL_SEGMENT, sizeof(Segment));
+    if (!seg) {
+        ESP_LOGE(TAG, "Failed to allocate segment");
+        return;
+    }
+
+    size_t fully_sent = 0;
+    for (size_t i = 0; i < actual_segments; i++) {
+        if (!load_segment_from_flash(segments[i].segment_id, seg)) {
+            ESP_LOGE(TAG, "Failed to load segment %" PRIu32, segments[i].segment_id);
+            break;
+        }
+
+        // Send each unsent record to the edge device and mark it in the sent bitmap
+        bool all_sent = true;
+        for (int r = 0; r < seg->info.count; r++) {
+            if (segment_is_sent(seg, r)) {
+                continue;
+            }
+            Measurement m = { .timestamp = seg->timestamps[r], .value = seg->values[r],
+                              .dirty_bit = DIRTY_BIT_IN_FLASH, .series_id = series_id };
+            if (publish(&m)) {
+                segment_mark_sent(seg, r);
+                metrics_inc(METRIC_OFFLOADED, 1);
+            } else {
+                all_sent = false;
+            }
+        }
+
+        if (!all_sent) {
+            // Persist partial progress so a retry does not resend records, unless a merge or
+            // rollup replaced the segment meanwhile: rewriting its id would bring back an erased blob
+            if (!update_listed_segment(series_id, seg)) {
+                ESP_LOGW(TAG, "%s segment %" PRIu32 " changed under offload; progress not kept",
+                         series_name(series_id), seg->info.segment_id);
+            }
+            break;
+        }
+
+        fully_sent++;
+    }
+    mem_pool_free(seg);
+
+    if (fully_sent == 0) {
+        return;
+    }
+
+    // Drop the sent segments from the list first, by id: compaction or a late merge may
+    // have replaced them since they were read, and then they are left alone. The manifest
+    // names the blobs so a reset before they are erased is cleaned up at boot
+    uint32_t ids[MANIFEST_MAX_PENDING];
+    for (size_t i = 0; i < fully_sent; i++) {
+        ids[i] = segments[i].segment_id;
+    }
+    int slot = begin_segment_erase(ids, fully_sent);
+    if (slot < 0) {
+        ESP_LOGE(TAG, "Failed to record pending erase; keeping sent %s segments", series_name(series_id));
+        return;
+    }
+    if (replace_segments_in_list(series_id, ids, fully_sent, NULL, 0)) {
+        for (size_t i = 0; i < fully_sent; i++) {
+            erase_segment_from_flash(ids[i]);
+        }
+    } else {
+        ESP_LOGW(TAG, "Sent %s segments changed under offload; keeping them", series_name(series_id));
+    }
+    end_segment_erase(slot);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// send flash data to edge
+void offload_flash_to_edge(offload_publish_fn publish) {
+    ESP_LOGI(TAG, "Sending data from flash to edge device");
+
+    for (uint8_t series_id = 0; series_id < SERIES_COUNT; series_id++) {
+        offload_series_to_edge(series_id, publish);
+    }
+}
\ No newline at end of file
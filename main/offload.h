@@ -1,13 +1,17 @@
-#ifndef TIMESTAMP_LIST_H
-#define TIMESTAMP_LIST_H
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
 // ─────────────────────────────────────────────────────────────────────────────
-#include <stdint.h>
-#include <stddef.h>
+#include <stdbool.h>
+#include "measurement.h"
 // ─────────────────────────────────────────────────────────────────────────────
-#define TIMESTAMP_LIST_KEY "timestamp_list"
+/* Sends one record upstream; returns false if it could not be handed to the transport */
+typedef bool (*offload_publish_fn)(Measurement *m);
 // ─────────────────────────────────────────────────────────────────────────────
-void append_timestamp_to_list(uint32_t timestamp);
-void remove_timestamps_from_list(size_t count);
-void get_timestamps_from_list(size_t count, uint32_t *timestamps, size_t *out_count);
+/*
+ * Sends the oldest stored segments of every series through `publish`.
+ * Fully sent segments are erased; a partly sent one keeps its sent bitmap
+ * so the next run resumes where this one stopped.
+ */
+void offload_flash_to_edge(offload_publish_fn publish);
 // ─────────────────────────────────────────────────────────────────────────────
-#endif // TIMESTAMP_LIST_H
\ No newline at end of file
+#endif // OFFLOAD_H
\ No newline at end of file
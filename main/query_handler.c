@@ -1,86 +1,564 @@
 #include "query_handler.h"
-#include "mqtt_utils.h"
 #include "buffer.h"
 #include "nvs_utils.h"
+#include "read_cache.h"
+#include "metrics.h"
+#include "subscription.h"
+#include "mem_pool.h"
+#include "config.h"
+#define TRACE_LEVEL CONFIG_TRACE_LEVEL_QUERY
+#include "trace.h"
+#include "esp_timer.h"
 #include "cJSON.h"
 #include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
 #include <inttypes.h>
 // ─────────────────────────────────────────────────────────────────────────────
 static const char *TAG = "QUERY_HANDLER";
 // ─────────────────────────────────────────────────────────────────────────────
 #define MAX_MEASUREMENTS 50  // Arbitrary max array size for single query
-// You can define this if your measurement interval is exactly 20 seconds:
-#define MEASUREMENT_INTERVAL_SEC 20
 
 
+// ─────────────────────────────────────────────────────────────────────────────
+// Responses are handed to the transport registered by the application
+static query_response_sink_t response_sink = NULL;
+
+void query_handler_set_response_sink(query_response_sink_t sink) {
+    response_sink = sink;
+}
+
+static int publish_response(const char *topic, const char *payload) {
+    if (response_sink == NULL) {
+        ESP_LOGE(TAG, "No response sink registered, dropping response for %s", topic);
+        return -1;
+    }
+    return response_sink(topic, payload);
+}
+
 // ─────────────────────────────────────────────────────────────────────────────
 // Function to send an error response for a single timestamp
-void send_error_response(uint32_t timestamp, const char *response_topic) {
+void send_error_response(uint64_t timestamp, const char *response_topic) {
     char payload[128];
     snprintf(payload, sizeof(payload),
-             "{\"error\":\"Measurement not found\",\"timestamp\":%" PRIu32 "}", 
+             "{\"error\":\"Measurement not found\",\"timestamp\":%" PRIu64 "}", 
              timestamp);
 
-    int msg_id = esp_mqtt_client_publish(device_mqtt_client, response_topic, payload, 0, 1, 0);
+    int msg_id = publish_response(response_topic, payload);
     if (msg_id != -1) {
-        ESP_LOGI(TAG, "Published error response for timestamp %"PRIu32" to device broker, msg_id=%d", timestamp, msg_id);
+        ESP_LOGI(TAG, "Published error response for timestamp %"PRIu64" to device broker, msg_id=%d", timestamp, msg_id);
     } else {
-        ESP_LOGE(TAG, "Failed to publish error response for timestamp %"PRIu32, timestamp);
+        ESP_LOGE(TAG, "Failed to publish error response for timestamp %"PRIu64, timestamp);
     }
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
 // Function to send an error response for a timestamp range
-void send_error_response_range(uint32_t start_timestamp, uint32_t end_timestamp, const char *response_topic) {
+void send_error_response_range(uint64_t start_timestamp, uint64_t end_timestamp, const char *response_topic) {
     char payload[256];
     snprintf(payload, sizeof(payload),
-             "{\"error\":\"Measurements not found in the range\",\"start_timestamp\":%" PRIu32 ",\"end_timestamp\":%" PRIu32 "}",
+             "{\"error\":\"Measurements not found in the range\",\"start_timestamp\":%" PRIu64 ",\"end_timestamp\":%" PRIu64 "}",
              start_timestamp, end_timestamp);
 
-    int msg_id = esp_mqtt_client_publish(device_mqtt_client, response_topic, payload, 0, 1, 0);
+    int msg_id = publish_response(response_topic, payload);
     if (msg_id != -1) {
-        ESP_LOGI(TAG, "Published error response to device broker, msg_id=%d for range [%"PRIu32",%"PRIu32"]",
+        ESP_LOGI(TAG, "Published error response to device broker, msg_id=%d for range [%"PRIu64",%"PRIu64"]",
                  msg_id, start_timestamp, end_timestamp);
     } else {
-        ESP_LOGE(TAG, "Failed to publish error response for range [%"PRIu32",%"PRIu32"]", start_timestamp, end_timestamp);
+        ESP_LOGE(TAG, "Failed to publish error response for range [%"PRIu64",%"PRIu64"]", start_timestamp, end_timestamp);
     }
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
-// Helper to send an array of measurements
-void send_measurements_response(Measurement *measurements, int count, const char *response_topic) {
-    cJSON *json_array = cJSON_CreateArray();
-    for (int i = 0; i < count; i++) {
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "timestamp",   measurements[i].timestamp);
-        cJSON_AddNumberToObject(item, "temperature", measurements[i].temperature);
-        // Optionally add the dirty_bit if you want debugging info
-        cJSON_AddNumberToObject(item, "dirty_bit",   measurements[i].dirty_bit);
+// Cursors are opaque to clients: the last timestamp returned, then the boot epoch and ingest
+// sequence they were issued at, in hex
+void query_cursor_format(const QueryCursor *cursor, char out[QUERY_CURSOR_LEN]) {
+    snprintf(out, QUERY_CURSOR_LEN, "%016" PRIx64 "%08" PRIx32 "%08" PRIx32,
+             cursor->last_ts, cursor->epoch, cursor->seq);
+}
 
-        cJSON_AddItemToArray(json_array, item);
+static bool parse_hex(const char *text, size_t len, uint64_t *value) {
+    *value = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        int digit = c >= '0' && c <= '9' ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return false;
+        }
+        *value = (*value << 4) | (uint64_t)digit;
     }
+    return true;
+}
 
-    char *payload = cJSON_PrintUnformatted(json_array);
-    cJSON_Delete(json_array);
+bool query_cursor_parse(const char *text, QueryCursor *cursor) {
+    size_t len = text != NULL ? strlen(text) : 0;
+    uint64_t last_ts = 0, epoch = 0, seq = 0;
+    // A timestamp-only cursor from an older firmware is still accepted; it always resyncs
+    if (len == 16 && parse_hex(text, 16, &last_ts)) {
+        *cursor = (QueryCursor){ .last_ts = last_ts };
+        return true;
+    }
+    if (len != QUERY_CURSOR_LEN - 1 || !parse_hex(text, 16, &last_ts) || !parse_hex(text + 16, 8, &epoch)
+        || !parse_hex(text + 24, 8, &seq)) {
+        return false;
+    }
+    *cursor = (QueryCursor){ .last_ts = last_ts, .epoch = (uint32_t)epoch, .seq = (uint32_t)seq };
+    return true;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * The measurement response is the one payload that grows with the results,
+ * so it is written as text straight into the request's arena rather than
+ * built as a cJSON tree.
+ */
+#define RESPONSE_HEAD_BYTES 160
+#define RESPONSE_POINT_BYTES 52   // "<u64>," + "<%1.17g>," + "<dirty bit>,"
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} ResponseText;
+
+static void response_append(ResponseText *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void response_append(ResponseText *out, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(&out->buf[out->len], out->cap - out->len, fmt, args);
+    va_end(args);
+    out->len = n < 0 ? out->cap : out->len + (size_t)n;
+}
 
+// Numbers as cJSON prints them: the shortest of 15 or 17 significant digits that reads back exactly
+static void response_append_number(ResponseText *out, const char *sep, double d) {
+    if (isnan(d) || isinf(d)) {
+        response_append(out, "%snull", sep);
+        return;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%1.15g", d);
+    if (strtod(text, NULL) != d) {
+        snprintf(text, sizeof(text), "%1.17g", d);
+    }
+    response_append(out, "%s%s", sep, text);
+}
+
+// Helper to format measurements of one series, column-wise to avoid repeating keys per point:
+// {"series":"temperature","timestamps":[...],"values":[...],"dirty_bits":[...],"cursor":"..","more":true}
+// "more" means the page was full; passing "cursor" back as since_cursor fetches the rest.
+// "resync" means the cursor could not be followed and this is the window from its start.
+// Returns NUL-terminated text from mem_scratch_alloc(), or NULL.
+static char *format_measurements(uint8_t series_id, const Measurement *measurements, int count,
+                                 const QueryCursor *cursor, bool more, bool resync) {
+    ResponseText out = { .cap = RESPONSE_HEAD_BYTES + (size_t)count * RESPONSE_POINT_BYTES };
+    out.buf = mem_scratch_alloc(out.cap);
+    if (out.buf == NULL) {
+        return NULL;
+    }
+    response_append(&out, "{\"series\":\"%s\",\"timestamps\":[", series_name(series_id));
+    for (int i = 0; i < count; i++) {
+        response_append(&out, "%s%" PRIu64, i ? "," : "", measurements[i].timestamp);
+    }
+    response_append(&out, "],\"values\":[");
+    for (int i = 0; i < count; i++) {
+        response_append_number(&out, i ? "," : "", measurements[i].value);
+    }
+    response_append(&out, "],\"dirty_bits\":[");
+    for (int i = 0; i < count; i++) {
+        response_append(&out, "%s%u", i ? "," : "", (unsigned)measurements[i].dirty_bit);
+    }
+    char cursor_text[QUERY_CURSOR_LEN];
+    query_cursor_format(cursor, cursor_text);
+    response_append(&out, "],\"cursor\":\"%s\"%s%s}", cursor_text, more ? ",\"more\":true" : "",
+                    resync ? ",\"resync\":true" : "");
+    if (out.len >= out.cap) {
+        mem_scratch_free(out.buf);
+        return NULL;
+    }
+    return out.buf;
+}
+
+void send_measurements_response(uint8_t series_id, Measurement *measurements, int count,
+                                const QueryCursor *cursor, bool more, bool resync, const char *response_topic) {
+    // Built in the request's arena and gone with it
+    char *payload = format_measurements(series_id, measurements, count, cursor, more, resync);
     if (payload == NULL) {
         ESP_LOGE(TAG, "Failed to create JSON payload for measurement array");
         return;
     }
 
-    int msg_id = esp_mqtt_client_publish(device_mqtt_client, response_topic, payload, 0, 1, 0);
+    int msg_id = publish_response(response_topic, payload);
     if (msg_id != -1) {
-        ESP_LOGI(TAG, "Published %d measurements to device broker, msg_id=%d", count, msg_id);
+        TRACE_LOG("Published %d measurements to device broker, msg_id=%d", count, msg_id);
     } else {
         ESP_LOGE(TAG, "Failed to publish measurements to device broker");
     }
 
-    free(payload);
+    mem_scratch_free(payload);
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
-void process_query_message(const char *message) {
-    ESP_LOGI(TAG, "Processing query message: %s", message);
+// Reports flash write accounting since boot:
+// {"logical_records":..,"bytes_written":..,"write_amplification":..,"projected_lifetime_days":..}
+void send_flash_stats_response(const char *response_topic) {
+    FlashWearStats st;
+    get_flash_wear_stats(&st);
+
+    cJSON *json_response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json_response, "logical_records", st.logical_records);
+    cJSON_AddNumberToObject(json_response, "logical_bytes", (double)st.logical_bytes);
+    cJSON_AddNumberToObject(json_response, "blob_writes", st.blob_writes);
+    cJSON_AddNumberToObject(json_response, "bytes_written", (double)st.bytes_written);
+    cJSON_AddNumberToObject(json_response, "entries_written", st.entries_written);
+    cJSON_AddNumberToObject(json_response, "erases", st.erases);
+    cJSON_AddNumberToObject(json_response, "commits", st.commits);
+    cJSON_AddNumberToObject(json_response, "entries_per_record",
+                            st.logical_records ? (double)st.entries_written / st.logical_records : 0);
+    cJSON_AddNumberToObject(json_response, "write_amplification", flash_write_amplification(&st));
+    cJSON_AddNumberToObject(json_response, "projected_lifetime_days", flash_projected_lifetime_days(&st));
+    cJSON_AddNumberToObject(json_response, "flash_usage_percent", get_flash_usage_percent());
+
+    char *payload = cJSON_PrintUnformatted(json_response);
+    cJSON_Delete(json_response);
+    if (payload == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON payload for flash stats");
+        return;
+    }
+
+    if (publish_response(response_topic, payload) == -1) {
+        ESP_LOGE(TAG, "Failed to publish flash stats");
+    }
+    cJSON_free(payload);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Runtime metrics snapshot, same format as the periodic esp32/metrics message
+void send_stats_response(const char *response_topic) {
+    char *payload = metrics_to_json();
+    if (payload == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON payload for stats");
+        return;
+    }
+
+    if (publish_response(response_topic, payload) == -1) {
+        ESP_LOGE(TAG, "Failed to publish stats");
+    }
+    cJSON_free(payload);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Dumps the binary trace ring (see trace.h for the record layout)
+void send_trace_response(const char *response_topic) {
+    char *payload = trace_to_json();
+    if (payload == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON payload for trace");
+        return;
+    }
+
+    if (publish_response(response_topic, payload) == -1) {
+        ESP_LOGE(TAG, "Failed to publish trace");
+    }
+    cJSON_free(payload);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Series by name or id; missing means temperature, for older clients
+static uint8_t parse_series(const cJSON *series) {
+    if (cJSON_IsString(series)) {
+        return series_from_name(series->valuestring);
+    }
+    if (cJSON_IsNumber(series)) {
+        return (series->valuedouble >= 0 && series->valuedouble < SERIES_COUNT)
+                   ? (uint8_t)series->valuedouble : SERIES_INVALID;
+    }
+    return SERIES_TEMPERATURE;
+}
+
+static uint32_t json_u32(const cJSON *json, const char *key, uint32_t fallback) {
+    const cJSON *item = cJSON_GetObjectItem(json, key);
+    return (cJSON_IsNumber(item) && item->valuedouble >= 0 && item->valuedouble <= UINT32_MAX)
+               ? (uint32_t)item->valuedouble : fallback;
+}
+
+// Converting a negative, non-finite or too large double to uint64_t is undefined, so those are refused
+static bool json_timestamp(const cJSON *item, uint64_t *timestamp) {
+    double d = item->valuedouble;
+    if (!isfinite(d) || d < 0 || d >= 18446744073709551616.0) {  // 2^64
+        return false;
+    }
+    *timestamp = (uint64_t)d;
+    return true;
+}
+
+// {"gt":30} / {"gte":..,"lt":..}: at least one bound, lower and upper at most once each
+static bool parse_predicate(const cJSON *where, ValuePredicate *predicate) {
+    memset(predicate, 0, sizeof(*predicate));
+    if (!cJSON_IsObject(where)) {
+        return false;
+    }
+    static const struct { const char *key; bool lower; bool inclusive; } bounds[] = {
+        { "gt", true, false }, { "gte", true, true }, { "lt", false, false }, { "lte", false, true },
+    };
+    for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+        const cJSON *item = cJSON_GetObjectItem(where, bounds[i].key);
+        if (item == NULL) {
+            continue;
+        }
+        bool *has = bounds[i].lower ? &predicate->has_lo : &predicate->has_hi;
+        if (!cJSON_IsNumber(item) || *has) {
+            return false;
+        }
+        *has = true;
+        if (bounds[i].lower) {
+            predicate->lo = (float)item->valuedouble;
+            predicate->lo_inclusive = bounds[i].inclusive;
+        } else {
+            predicate->hi = (float)item->valuedouble;
+            predicate->hi_inclusive = bounds[i].inclusive;
+        }
+    }
+    return predicate->has_lo || predicate->has_hi;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Registers a live query and acknowledges it on the response topic:
+// {"action":"subscribe","subscription":1,"series":"temperature","lease_ms":..}
+static void handle_subscribe(const cJSON *json, const char *resp_topic) {
+    SubscriptionFilter filter = {0};
+    filter.series_id = parse_series(cJSON_GetObjectItem(json, "series"));
+    if (filter.series_id == SERIES_INVALID) {
+        ESP_LOGE(TAG, "Unknown 'series' in subscribe message");
+        return;
+    }
+    filter.batch_records = json_u32(json, "batch_records", CONFIG_SUBSCRIPTION_BATCH_RECORDS);
+    filter.batch_ms = json_u32(json, "batch_ms", CONFIG_SUBSCRIPTION_BATCH_MS);
+    filter.bucket_ms = json_u32(json, "bucket_ms", 0);
+    filter.lease_ms = json_u32(json, "lease_ms", CONFIG_SUBSCRIPTION_LEASE_MS);
+    const cJSON *min_value = cJSON_GetObjectItem(json, "min_value");
+    const cJSON *max_value = cJSON_GetObjectItem(json, "max_value");
+    if (cJSON_IsNumber(min_value)) {
+        filter.has_min_value = true;
+        filter.min_value = (float)min_value->valuedouble;
+    }
+    if (cJSON_IsNumber(max_value)) {
+        filter.has_max_value = true;
+        filter.max_value = (float)max_value->valuedouble;
+    }
+
+    char payload[160];
+    int id = subscription_add(resp_topic, &filter);
+    if (id < 0) {
+        snprintf(payload, sizeof(payload), "{\"error\":\"No free subscription slot\"}");
+    } else {
+        snprintf(payload, sizeof(payload),
+                 "{\"action\":\"subscribe\",\"subscription\":%d,\"series\":\"%s\",\"lease_ms\":%" PRIu32 "}",
+                 id, series_name(filter.series_id), filter.lease_ms);
+    }
+    if (publish_response(resp_topic, payload) == -1) {
+        ESP_LOGE(TAG, "Failed to publish subscribe acknowledgement");
+    }
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Range engine shared by the MQTT and HTTP front ends
+typedef struct {
+    query_emit_fn emit;
+    void *ctx;
+    bool stopped;
+    const ValuePredicate *where;
+    const Measurement *late;   // staged late samples of the flash part, sorted
+    size_t late_count;
+    size_t late_next;
+    Measurement *merged;       // a flash chunk with late samples woven in
+    int late_added;            // late samples emitted, less the flash ones they replaced
+} StreamState;
+
+// Appends the next staged late sample to the merge buffer if it passes the filter
+static void take_late(StreamState *state, size_t *n) {
+    const Measurement *m = &state->late[state->late_next++];
+    if (state->where == NULL || value_predicate_match(state->where, m->value)) {
+        state->merged[(*n)++] = *m;
+        state->late_added++;
+    }
+}
+
+static bool emit_flash_chunk(const Measurement *measurements, size_t count, void *ctx) {
+    StreamState *state = ctx;
+    if (state->late_next < state->late_count) {
+        // A staged sample overrides a stored one with the same timestamp, as its merge will
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            while (state->late_next < state->late_count
+                   && state->late[state->late_next].timestamp < measurements[i].timestamp) {
+                take_late(state, &n);
+            }
+            if (state->late_next < state->late_count
+                && state->late[state->late_next].timestamp == measurements[i].timestamp) {
+                state->late_added--;
+                take_late(state, &n);
+            } else {
+                state->merged[n++] = measurements[i];
+            }
+        }
+        measurements = state->merged;
+        count = n;
+    }
+    if (!state->emit(measurements, count, state->ctx)) {
+        state->stopped = true;
+    }
+    return !state->stopped;
+}
+
+int query_range_stream(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                       const ValuePredicate *where, query_emit_fn emit, void *ctx) {
+    if (series_id >= SERIES_COUNT || end_timestamp < start_timestamp) {
+        return -1;
+    }
+    StreamState state = { .emit = emit, .ctx = ctx, .where = where };
+    int total = 0;
+
+    // Everything from the buffer's earliest entry onward is served by the buffer
+    // (flushed entries stay buffered too), so flash only covers what came before it.
+    uint64_t buffer_earliest_ts = 0, buffer_latest_ts = 0;
+    bool buffered = buffer_get_time_bounds(series_id, &buffer_earliest_ts, &buffer_latest_ts);
+    if (!buffered || buffer_earliest_ts > start_timestamp) {
+        uint64_t flash_end = end_timestamp;
+        if (buffered && buffer_earliest_ts <= flash_end) {
+            flash_end = buffer_earliest_ts - 1;
+        }
+        // Late samples not merged yet are woven into the flash results in timestamp order;
+        // they are filtered there, since one may replace a stored value the filter passes
+        Measurement late[BUFFER_LATE_HELD];
+        state.late = late;
+        state.late_count = (size_t)get_late_measurements(series_id, start_timestamp, flash_end, NULL,
+                                                         late, BUFFER_LATE_HELD);
+        if (state.late_count > 0) {
+            state.merged = mem_scratch_alloc((SEGMENT_MAX_RECORDS + BUFFER_LATE_HELD) * sizeof(Measurement));
+            if (state.merged == NULL) {
+                return -1;
+            }
+        }
+        int found_in_flash = scan_measurements_in_flash(series_id, start_timestamp, flash_end, where,
+                                                        emit_flash_chunk, &state);
+        if (found_in_flash >= 0 && !state.stopped && state.late_next < state.late_count) {
+            size_t n = 0;
+            while (state.late_next < state.late_count) {
+                take_late(&state, &n);
+            }
+            state.stopped = n > 0 && !emit(state.merged, n, ctx);
+        }
+        mem_scratch_free(state.merged);
+        if (found_in_flash < 0) {
+            ESP_LOGE(TAG, "Error reading from flash, aborting query");
+            return -1;
+        }
+        found_in_flash += state.late_added;
+        if (TRACE_LEVEL >= TRACE_LEVEL_VERBOSE && found_in_flash > 0) {
+            ReadCacheStats cache_stats;
+            read_cache_get_stats(&cache_stats);
+            TRACE_LOG("Found %d from flash (read cache hits=%" PRIu32 ", misses=%" PRIu32 ")",
+                     found_in_flash, cache_stats.hits, cache_stats.misses);
+        }
+        total += found_in_flash;
+    }
+
+    // The ring is copied out a chunk at a time so the buffer mutex is never held
+    // while a front end is sending; timestamps increase along the ring.
+    Measurement chunk[QUERY_STREAM_CHUNK];
+    uint64_t from = start_timestamp;
+    while (buffered && !state.stopped && from <= end_timestamp) {
+        int found = get_measurements_from_buffer_where(series_id, from, end_timestamp, where,
+                                                       chunk, QUERY_STREAM_CHUNK);
+        if (found <= 0) {
+            break;
+        }
+        total += found;
+        if (!emit(chunk, (size_t)found, ctx)) {
+            break;
+        }
+        if (found < QUERY_STREAM_CHUNK || chunk[found - 1].timestamp == UINT64_MAX) {
+            break;
+        }
+        from = chunk[found - 1].timestamp + 1;
+    }
+
+    TRACE(TRACE_QUERY, series_id, total);
+    TRACE_LOG("Retrieved %d %s measurements in [%"PRIu64", %"PRIu64"] (buffer+flash)",
+             total, series_name(series_id), start_timestamp, end_timestamp);
+    return total;
+}
+
+typedef struct {
+    Measurement *out;
+    size_t max;
+    size_t count;
+} RangeCollect;
+
+static bool collect_range(const Measurement *measurements, size_t count, void *ctx) {
+    RangeCollect *collect = ctx;
+    size_t room = collect->max - collect->count;
+    size_t n = count < room ? count : room;
+    memcpy(&collect->out[collect->count], measurements, n * sizeof(Measurement));
+    collect->count += n;
+    return collect->count < collect->max;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+static bool take_one(const Measurement *measurements, size_t count, void *ctx) {
+    *(Measurement *)ctx = measurements[count - 1];
+    return true;
+}
+
+int query_rewrites_stream(uint8_t series_id, const QueryCursor *cursor, uint32_t epoch, uint32_t up_to_seq,
+                          uint64_t start_timestamp, uint64_t end_timestamp, const ValuePredicate *where,
+                          query_emit_fn emit, void *ctx, uint32_t *seq_done) {
+    *seq_done = cursor->seq;
+    if (cursor->epoch != epoch) {
+        return QUERY_RESYNC;
+    }
+    uint64_t timestamps[BUFFER_REWRITE_LOG];
+    uint32_t seqs[BUFFER_REWRITE_LOG];
+    int n = buffer_get_rewrites(series_id, cursor->seq, up_to_seq, timestamps, seqs, BUFFER_REWRITE_LOG);
+    if (n < 0) {
+        return QUERY_RESYNC;
+    }
+    int emitted = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t ts = timestamps[i];
+        bool again = false;
+        for (int j = i + 1; j < n && !again; j++) {
+            again = timestamps[j] == ts;
+        }
+        // Newer timestamps are still ahead of the cursor, and a repeat is read once, at its last rewrite
+        if (again || ts > cursor->last_ts || ts < start_timestamp || ts > end_timestamp) {
+            *seq_done = seqs[i];
+            continue;
+        }
+        Measurement m;
+        int found = query_range_stream(series_id, ts, ts, where, take_one, &m);
+        if (found < 0) {
+            return -1;
+        }
+        *seq_done = seqs[i];
+        if (found > 0) {
+            emitted++;
+            if (!emit(&m, 1, ctx)) {
+                break;
+            }
+        }
+    }
+    return emitted;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+static void handle_query_message(const char *message) {
+    TRACE_LOG("Processing query message: %s", message);
     cJSON *json = cJSON_Parse(message);
     if (json == NULL) {
         ESP_LOGE(TAG, "Failed to parse query message");
@@ -94,32 +572,70 @@ void process_query_message(const char *message) {
         return;
     }
 
-    if (strcmp(action->valuestring, "get_data_range") == 0) {
+    const cJSON *response_topic = cJSON_GetObjectItem(json, "response_topic");
+    const char *resp_topic = "esp32/response"; // Default response topic
+    if (cJSON_IsString(response_topic)) {
+        resp_topic = response_topic->valuestring;
+    }
+
+    bool where_query = strcmp(action->valuestring, "get_data_where") == 0;
+    if (strcmp(action->valuestring, "get_data_range") == 0 || where_query) {
         const cJSON *start_ts = cJSON_GetObjectItem(json, "start_timestamp");
         const cJSON *end_ts   = cJSON_GetObjectItem(json,   "end_timestamp");
-        const cJSON *response_topic = cJSON_GetObjectItem(json, "response_topic");
+        const cJSON *series = cJSON_GetObjectItem(json, "series");
+        const cJSON *since_cursor = cJSON_GetObjectItem(json, "since_cursor");
+
+        uint8_t series_id = parse_series(series);
+        if (series_id == SERIES_INVALID) {
+            ESP_LOGE(TAG, "Unknown 'series' in query message");
+            cJSON_Delete(json);
+            return;
+        }
 
-        const char *resp_topic = "esp32/response"; // Default response topic
-        if (cJSON_IsString(response_topic)) {
-            resp_topic = response_topic->valuestring;
+        // get_data_where: the range is optional, the value predicate is not
+        ValuePredicate predicate;
+        if (where_query && !parse_predicate(cJSON_GetObjectItem(json, "where"), &predicate)) {
+            ESP_LOGW(TAG, "Missing or invalid 'where' in query");
+            if (publish_response(resp_topic, "{\"error\":\"Invalid predicate\"}") == -1) {
+                ESP_LOGE(TAG, "Failed to publish predicate error");
+            }
+            cJSON_Delete(json);
+            return;
+        }
+        const ValuePredicate *where = where_query ? &predicate : NULL;
+
+        // A cursor replaces start_timestamp (a later one still applies) and makes the end optional
+        QueryCursor cursor = { 0 };
+        bool incremental = since_cursor != NULL;
+        if (incremental && !(cJSON_IsString(since_cursor) && query_cursor_parse(since_cursor->valuestring, &cursor))) {
+            ESP_LOGW(TAG, "Invalid 'since_cursor' in query");
+            if (publish_response(resp_topic, "{\"error\":\"Invalid cursor\"}") == -1) {
+                ESP_LOGE(TAG, "Failed to publish cursor error");
+            }
+            cJSON_Delete(json);
+            return;
         }
 
-        if (cJSON_IsNumber(start_ts) && cJSON_IsNumber(end_ts)) {
-            uint32_t start_timestamp = (uint32_t)start_ts->valuedouble;
-            uint32_t end_timestamp   = (uint32_t)end_ts->valuedouble;
-            if (end_timestamp < start_timestamp) {
+        bool open_range = incremental || where_query;
+        if ((cJSON_IsNumber(start_ts) || open_range) && (cJSON_IsNumber(end_ts) || open_range)) {
+            uint64_t start_timestamp = 0;
+            uint64_t end_timestamp   = UINT64_MAX;
+            if ((cJSON_IsNumber(start_ts) && !json_timestamp(start_ts, &start_timestamp))
+                || (cJSON_IsNumber(end_ts) && !json_timestamp(end_ts, &end_timestamp))) {
+                ESP_LOGW(TAG, "Invalid range: timestamp is not a millisecond count");
+                send_error_response_range(start_timestamp, end_timestamp, resp_topic);
+                cJSON_Delete(json);
+                return;
+            }
+            if (end_timestamp < start_timestamp && !open_range) {
                 ESP_LOGW(TAG, "Invalid range: end < start");
                 send_error_response_range(start_timestamp, end_timestamp, resp_topic);
                 cJSON_Delete(json);
                 return;
             }
 
-            // Estimate how many we expect in that range, given 20s interval
-            uint32_t dt = end_timestamp - start_timestamp;
-            uint32_t expectedCount = (dt / MEASUREMENT_INTERVAL_SEC) + 1;
-
             size_t max_measurements = BUFFER_CAPACITY_MACRO * 3; // or some bigger number
-            Measurement *measurements = malloc(sizeof(Measurement) * max_measurements);
+            Measurement *measurements = mem_scratch_alloc(sizeof(Measurement) * max_measurements);
             if (!measurements) {
                 ESP_LOGE(TAG, "Failed to allocate memory for measurements (size=%u)",
                          (unsigned)(sizeof(Measurement) * max_measurements));
@@ -127,89 +643,89 @@ void process_query_message(const char *message) {
                 return;
             }
 
-            ESP_LOGI(TAG, "Handling range query: [%"PRIu32", %"PRIu32"], expectedCount=%"PRIu32,
-                     start_timestamp, end_timestamp, expectedCount);
-
-            /*--------------------------------------------------------
-             * 1) Check buffer coverage
-             *-------------------------------------------------------*/
-            // If the entire range is within buffer_earliest_ts..buffer_latest_ts
-            // and expectedCount isn't huge, we might skip flash entirely.
-            bool entireRangeInBuffer = false;
-            if (start_timestamp >= buffer_earliest_ts && end_timestamp <= buffer_latest_ts) {
-                entireRangeInBuffer = true;
-            }
-
-            int found_in_buffer = get_measurements_from_buffer(start_timestamp, end_timestamp,
-                                                               measurements, max_measurements);
-
-            ESP_LOGI(TAG, "get_measurements_from_buffer found=%d", found_in_buffer);
-
-            if (entireRangeInBuffer && (uint32_t)found_in_buffer == expectedCount) {
-                ESP_LOGI(TAG, "All %d data points are already in buffer. Skipping flash.", found_in_buffer);
-                send_measurements_response(measurements, found_in_buffer, resp_topic);
-                free(measurements);
-                cJSON_Delete(json);
-                return;
-            }
-
-            /*--------------------------------------------------------
-             * 2) If partial or none in buffer => also check flash
-             *-------------------------------------------------------*/
-            int total_found = found_in_buffer; 
-            if ((uint32_t)found_in_buffer < expectedCount) {
-                // Attempt to get the remainder from flash
-                // We'll store them into measurements array after the existing ones
-                ESP_LOGI(TAG, "Measurements not fully in buffer => checking flash");
-                int found_in_flash = get_measurements_from_flash(start_timestamp, end_timestamp,
-                                                                 &measurements[found_in_buffer],
-                                                                 max_measurements - found_in_buffer);
-                if (found_in_flash < 0) {
-                    // Error reading flash
-                    ESP_LOGE(TAG, "Error reading from flash, aborting query");
-                    free(measurements);
+            TRACE_LOG("Handling %s %s query: [%"PRIu64", %"PRIu64"]", series_name(series_id),
+                     action->valuestring, start_timestamp, end_timestamp);
+
+            // Every answer carries a cursor at the ingest position from before it was read
+            QueryCursor next = { 0 };
+            buffer_ingest_position(series_id, &next.epoch, &next.seq);
+            RangeCollect collect = { measurements, max_measurements, 0 };
+
+            // A refresh first returns what was rewritten behind the cursor, then what followed it
+            bool resync = false;
+            if (incremental) {
+                uint32_t seq_done = cursor.seq;
+                int rewritten = query_rewrites_stream(series_id, &cursor, next.epoch, next.seq, start_timestamp,
+                                                      end_timestamp, where, collect_range, &collect, &seq_done);
+                if (rewritten == -1) {
+                    mem_scratch_free(measurements);
                     cJSON_Delete(json);
                     return;
                 }
-                if (found_in_flash > 0) {
-                    ESP_LOGI(TAG, "Found %d from flash", found_in_flash);
+                resync = rewritten == QUERY_RESYNC;
+                if (!resync && collect.count == max_measurements) {
+                    // The rest of the rewrites come with the next page
+                    next.last_ts = cursor.last_ts;
+                    next.seq = seq_done;
+                    send_measurements_response(series_id, measurements, (int)collect.count, &next, true, false,
+                                               resp_topic);
+                    mem_scratch_free(measurements);
+                    cJSON_Delete(json);
+                    return;
+                }
+                if (!resync && cursor.last_ts >= start_timestamp) {
+                    start_timestamp = cursor.last_ts < UINT64_MAX ? cursor.last_ts + 1 : UINT64_MAX;
                 }
-                total_found += found_in_flash;
+            }
+            size_t rewritten = collect.count;
+
+            // Flash results are admitted into the read cache by the scan; the write
+            // buffer is never touched by query traffic. A cursor past the buffer's
+            // earliest sample never reaches flash at all.
+            if (end_timestamp >= start_timestamp
+                && query_range_stream(series_id, start_timestamp, end_timestamp, where, collect_range, &collect) < 0) {
+                mem_scratch_free(measurements);
+                cJSON_Delete(json);
+                return;
             }
 
-            ESP_LOGI(TAG, "Retrieved %d measurements total (buffer+flash).", total_found);
-
-            if (total_found == 0) {
+            // No match is a valid answer to a predicate or a refresh, not a missing range
+            if (collect.count == 0 && !open_range) {
                 // Data not available locally, or truly none found
                 ESP_LOGI(TAG, "Data not available locally. Retrieving from edge device or error...");
                 // For now, just send an error
                 send_error_response_range(start_timestamp, end_timestamp, resp_topic);
-                free(measurements);
+                mem_scratch_free(measurements);
                 cJSON_Delete(json);
                 return;
             }
 
-            /*--------------------------------------------------------
-             * 3) Optionally bring some or all from flash => buffer
-             *-------------------------------------------------------*/
-            if (total_found <= (int)(BUFFER_CAPACITY_MACRO * 0.8)) {
-                // Bring them all to the buffer, for caching
-                for (int i = found_in_buffer; i < total_found; i++) {
-                    buffer_add_measurement(&measurements[i]);
-                }
-            } else {
-                ESP_LOGI(TAG, "Data too large to bring fully into buffer => skipping buffer load");
+            // With nothing new in order, a refresh keeps the client's last timestamp
+            if (collect.count > rewritten) {
+                next.last_ts = measurements[collect.count - 1].timestamp;
+            } else if (incremental && !resync) {
+                next.last_ts = cursor.last_ts;
             }
-
-            /*--------------------------------------------------------
-             * 4) Finally respond
-             *-------------------------------------------------------*/
-            send_measurements_response(measurements, total_found, resp_topic);
-            free(measurements);
+            send_measurements_response(series_id, measurements, (int)collect.count, &next,
+                                       collect.count == max_measurements, resync, resp_topic);
+            mem_scratch_free(measurements);
 
         } else {
             ESP_LOGE(TAG, "Invalid or missing 'start_timestamp' or 'end_timestamp' in query");
         }
+    } else if (strcmp(action->valuestring, "subscribe") == 0) {
+        handle_subscribe(json, resp_topic);
+    } else if (strcmp(action->valuestring, "unsubscribe") == 0) {
+        const cJSON *id = cJSON_GetObjectItem(json, "subscription");
+        if (!cJSON_IsNumber(id) || !subscription_remove((int)id->valuedouble)) {
+            ESP_LOGW(TAG, "No such subscription to remove");
+        }
+    } else if (strcmp(action->valuestring, "get_flash_stats") == 0) {
+        send_flash_stats_response(resp_topic);
+    } else if (strcmp(action->valuestring, "get_stats") == 0) {
+        send_stats_response(resp_topic);
+    } else if (strcmp(action->valuestring, "get_trace") == 0) {
+        send_trace_response(resp_topic);
     } else {
         ESP_LOGE(TAG, "Invalid action in query message: %s", action->valuestring);
     }
@@ -218,4 +734,13 @@ void process_query_message(const char *message) {
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
-
+void process_query_message(const char *message) {
+    int64_t start_us = esp_timer_get_time();
+    // Results and the response come from one arena, dropped as a whole; the parse tree is cJSON's
+    mem_arena_begin();
+    handle_query_message(message);
+    mem_arena_end();
+    metrics_inc(METRIC_QUERIES, 1);
+    metrics_observe(METRIC_HIST_QUERY_US, (uint32_t)(esp_timer_get_time() - start_us));
+}
+// ─────────────────────────────────────────────────────────────────────────────
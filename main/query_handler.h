@@ -3,13 +3,60 @@
 // ─────────────────────────────────────────────────────────────────────────────
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "measurement.h"
 // ─────────────────────────────────────────────────────────────────────────────
+/* Delivers a response payload on `topic`; returns the transport's message id, or -1 on failure */
+typedef int (*query_response_sink_t)(const char *topic, const char *payload);
+/* Receives range results in time order, one segment or buffer chunk at a time; returning false stops the query */
+typedef bool (*query_emit_fn)(const Measurement *measurements, size_t count, void *ctx);
+#define QUERY_STREAM_CHUNK 32
+// ─────────────────────────────────────────────────────────────────────────────
+void query_handler_set_response_sink(query_response_sink_t sink);
 void process_query_message(const char *message);
+/*
+ * Range responses carry a cursor; a query with since_cursor returns only what
+ * was ingested after it, so a refresh costs the new data rather than the window.
+ * Besides the last timestamp returned, a cursor holds the ingest sequence it
+ * was issued at, so samples that arrived later but landed at or before that
+ * timestamp (see buffer_get_rewrites) are returned too. One from another boot,
+ * or older than the rewrite log reaches, is answered with a full resync.
+ */
+typedef struct {
+    uint64_t last_ts;
+    uint32_t epoch;     // 0: no ingest position (a cursor from before sequences)
+    uint32_t seq;
+} QueryCursor;
+#define QUERY_CURSOR_LEN 33
+#define QUERY_RESYNC (-2)
+void query_cursor_format(const QueryCursor *cursor, char out[QUERY_CURSOR_LEN]);
+bool query_cursor_parse(const char *text, QueryCursor *cursor);
+/*
+ * Emits, one sample per call, the current value of every timestamp in
+ * [start, end] and at or before cursor->last_ts rewritten after the cursor,
+ * up to ingest sequence `up_to_seq` of boot `epoch`. Returns how many were
+ * emitted, QUERY_RESYNC, or -1 on a read error. `seq_done` is where a cursor
+ * resumes; an emit returning false has still taken its sample.
+ */
+int query_rewrites_stream(uint8_t series_id, const QueryCursor *cursor, uint32_t epoch, uint32_t up_to_seq,
+                          uint64_t start_timestamp, uint64_t end_timestamp, const ValuePredicate *where,
+                          query_emit_fn emit, void *ctx, uint32_t *seq_done);
+/*
+ * Runs a get_data_range (or, with `where`, get_data_where) query for any front
+ * end: stored samples older than the buffer come from flash, the rest from the
+ * buffer. Segments and the ring are skipped by their zone maps. Returns how many samples
+ * were found (including any after `emit` stopped), or -1 on a bad range or read error.
+ */
+int query_range_stream(uint8_t series_id, uint64_t start_timestamp, uint64_t end_timestamp,
+                       const ValuePredicate *where, query_emit_fn emit, void *ctx);
 // ─────────────────────────────────────────────────────────────────────────────
-//static int unify_and_respond(uint32_t start_timestamp, uint32_t end_timestamp, const char *resp_topic);
+//static int unify_and_respond(uint64_t start_timestamp, uint64_t end_timestamp, const char *resp_topic);
 // ─────────────────────────────────────────────────────────────────────────────
-void send_measurements_response(Measurement *measurements, int count, const char *response_topic);
-void send_error_response_range(uint32_t start_timestamp, uint32_t end_timestamp, const char *response_topic);
+void send_measurements_response(uint8_t series_id, Measurement *measurements, int count,
+                                const QueryCursor *cursor, bool more, bool resync, const char *response_topic);
+void send_error_response_range(uint64_t start_timestamp, uint64_t end_timestamp, const char *response_topic);
+void send_flash_stats_response(const char *response_topic);
+void send_stats_response(const char *response_topic);
+void send_trace_response(const char *response_topic);
 // ─────────────────────────────────────────────────────────────────────────────
 #endif // QUERY_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,488 @@
+#include "raw_store.h"
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#ifdef RAW_STORE_HOST_FILE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#endif
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "RAW_STORE";
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Every 4 KB sector starts with a header carrying a sequence number and
+ * holds records appended back to back; a record never crosses a sector.
+ * Rewriting a segment appends a new version and erasing one only drops it
+ * from the RAM index, so the only flash erases are whole sectors, once the
+ * head wraps onto a sector the tail has left. Retention drops the oldest
+ * data first, which is also what sits in the oldest sectors.
+ *
+ * A reset can only tear the record being appended, so at boot only the
+ * newest sector's payloads are checked; a tear is closed off by programming
+ * its magic to RECORD_CLOSED, which stops every later scan of that sector.
+ */
+#define SECTOR_MAGIC 0x31445354   // "TSD1"
+#define RECORD_MAGIC 0x5247
+#define RECORD_CLOSED 0x0000
+#define RECORD_ALIGN 4
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t seq;               // 0 and 0xFFFFFFFF are never issued
+} SectorHeader;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t length;            // blob bytes after the header
+    uint32_t segment_id;
+    uint32_t crc;               // over segment_id and the blob
+} RecordHeader;
+
+#define MAX_BLOB_SIZE (RAW_SECTOR_SIZE - sizeof(SectorHeader) - sizeof(RecordHeader))
+
+/* Where the current version of a segment lives; 8 bytes per stored segment */
+typedef struct {
+    uint32_t segment_id;
+    uint32_t addr;              // record header offset in the partition
+} IndexEntry;
+
+static SemaphoreHandle_t raw_mutex = NULL;
+static IndexEntry *entries;     // sorted by segment_id
+static size_t entry_count, entry_cap;
+static uint32_t sector_count;
+static uint32_t *sector_seq;    // 0 = not part of the log
+static uint16_t *sector_live;   // current versions stored in each sector
+static uint32_t tail, head;     // oldest and newest sector of the log
+static uint32_t head_offset;    // next free byte in the head sector
+static bool log_empty = true;
+static uint32_t next_seq = 1;
+// ─────────────────────────────────────────────────────────────────────────────
+#ifdef RAW_STORE_HOST_FILE
+#ifndef RAW_STORE_HOST_SIZE
+#define RAW_STORE_HOST_SIZE (256 * 1024)
+#endif
+static uint8_t *flash_map;
+static uint32_t flash_size;
+
+static bool flash_open(void) {
+    if (flash_map != NULL) {
+        return true;
+    }
+    struct stat st;
+    int fd = open(RAW_STORE_HOST_FILE, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size < RAW_STORE_HOST_SIZE && ftruncate(fd, RAW_STORE_HOST_SIZE) != 0)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, RAW_STORE_HOST_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    flash_map = map;
+    flash_size = RAW_STORE_HOST_SIZE;
+    if (st.st_size < RAW_STORE_HOST_SIZE) {
+        // New flash reads as erased
+        memset(flash_map + st.st_size, 0xFF, RAW_STORE_HOST_SIZE - st.st_size);
+    }
+    return true;
+}
+
+static bool flash_read(uint32_t addr, void *dst, size_t len) {
+    memcpy(dst, flash_map + addr, len);
+    return true;
+}
+
+// Like NOR flash, programming can only clear bits
+static bool flash_write(uint32_t addr, const void *src, size_t len) {
+    const uint8_t *p = src;
+    for (size_t i = 0; i < len; i++) {
+        flash_map[addr + i] &= p[i];
+    }
+    return true;
+}
+
+static bool flash_erase_sector(uint32_t sector) {
+    memset(flash_map + (size_t)sector * RAW_SECTOR_SIZE, 0xFF, RAW_SECTOR_SIZE);
+    return true;
+}
+
+static uint32_t record_crc(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = data;
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+#else
+static const esp_partition_t *partition;
+static uint32_t flash_size;
+
+static bool flash_open(void) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         CONFIG_RAW_PARTITION_LABEL);
+    if (partition == NULL) {
+        return false;
+    }
+    flash_size = partition->size;
+    return true;
+}
+
+static bool flash_read(uint32_t addr, void *dst, size_t len) {
+    return esp_partition_read(partition, addr, dst, len) == ESP_OK;
+}
+
+static bool flash_write(uint32_t addr, const void *src, size_t len) {
+    return esp_partition_write(partition, addr, src, len) == ESP_OK;
+}
+
+static bool flash_erase_sector(uint32_t sector) {
+    return esp_partition_erase_range(partition, sector * RAW_SECTOR_SIZE, RAW_SECTOR_SIZE) == ESP_OK;
+}
+
+static uint32_t record_crc(uint32_t crc, const void *data, size_t len) {
+    return esp_rom_crc32_le(crc, data, len);
+}
+#endif
+// ─────────────────────────────────────────────────────────────────────────────
+size_t raw_store_record_size(size_t length) {
+    return (sizeof(RecordHeader) + length + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+static uint32_t blob_crc(uint32_t segment_id, const uint8_t *blob, size_t length) {
+    return record_crc(record_crc(0, &segment_id, sizeof(segment_id)), blob, length);
+}
+
+// First entry with an id >= segment_id
+static size_t index_find(uint32_t segment_id) {
+    size_t lo = 0, hi = entry_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].segment_id < segment_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool index_contains(size_t i, uint32_t segment_id) {
+    return i < entry_count && entries[i].segment_id == segment_id;
+}
+
+// Points the segment at a newly appended record, superseding any older version
+static bool index_put(uint32_t segment_id, uint32_t addr) {
+    size_t i = index_find(segment_id);
+    if (index_contains(i, segment_id)) {
+        sector_live[entries[i].addr / RAW_SECTOR_SIZE]--;
+    } else {
+        if (entry_count == entry_cap) {
+            size_t cap = entry_cap ? entry_cap * 2 : 64;
+            IndexEntry *grown = realloc(entries, cap * sizeof(IndexEntry));
+            if (grown == NULL) {
+                ESP_LOGE(TAG, "Malloc fail for segment index (%u entries)", (unsigned)cap);
+                return false;
+            }
+            entries = grown;
+            entry_cap = cap;
+        }
+        memmove(&entries[i + 1], &entries[i], (entry_count - i) * sizeof(IndexEntry));
+        entry_count++;
+    }
+    entries[i].segment_id = segment_id;
+    entries[i].addr = addr;
+    sector_live[addr / RAW_SECTOR_SIZE]++;
+    return true;
+}
+
+// Drops whole sectors from the tail once nothing in them is current. Caller holds the mutex.
+static void reclaim_tail(void) {
+    while (!log_empty && tail != head && sector_live[tail] == 0) {
+        sector_seq[tail] = 0;
+        tail = (tail + 1) % sector_count;
+    }
+}
+
+// Marks the rest of the head sector unusable after a failed or torn record
+static void close_head(uint32_t offset) {
+    uint16_t closed = RECORD_CLOSED;
+    flash_write(head * RAW_SECTOR_SIZE + offset, &closed, sizeof(closed));
+    head_offset = RAW_SECTOR_SIZE;
+}
+
+// Finds room for `size` bytes, opening the next sector if the head is full. Caller holds the mutex.
+static bool reserve(size_t size, uint32_t *addr) {
+    if (log_empty || head_offset + size > RAW_SECTOR_SIZE) {
+        reclaim_tail();
+        uint32_t next = log_empty ? head : (head + 1) % sector_count;
+        if (!log_empty && next == tail) {
+            return false;
+        }
+        SectorHeader hdr = { SECTOR_MAGIC, next_seq };
+        if (!flash_erase_sector(next) || !flash_write(next * RAW_SECTOR_SIZE, &hdr, sizeof(hdr))) {
+            ESP_LOGE(TAG, "Failed to open sector %" PRIu32, next);
+            return false;
+        }
+        next_seq++;
+        sector_seq[next] = hdr.seq;
+        sector_live[next] = 0;
+        if (log_empty) {
+            tail = next;
+            log_empty = false;
+        }
+        head = next;
+        head_offset = sizeof(SectorHeader);
+    }
+    *addr = head * RAW_SECTOR_SIZE + head_offset;
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Indexes one sector's records in write order and returns where the next one
+ * would go (RAW_SECTOR_SIZE once the sector is closed). `buf` is only used
+ * for the newest sector, whose payloads are checked.
+ */
+static uint32_t scan_sector(uint32_t sector, uint8_t *buf) {
+    uint32_t base = sector * RAW_SECTOR_SIZE;
+    uint32_t offset = sizeof(SectorHeader);
+    while (offset + sizeof(RecordHeader) <= RAW_SECTOR_SIZE) {
+        RecordHeader hdr;
+        if (!flash_read(base + offset, &hdr, sizeof(hdr))) {
+            return RAW_SECTOR_SIZE;
+        }
+        if (hdr.magic == 0xFFFF && hdr.length == 0xFFFF && hdr.segment_id == UINT32_MAX &&
+            hdr.crc == UINT32_MAX) {
+            return offset;
+        }
+        bool valid = hdr.magic == RECORD_MAGIC && hdr.length > 0 && hdr.length <= MAX_BLOB_SIZE &&
+                     offset + raw_store_record_size(hdr.length) <= RAW_SECTOR_SIZE;
+        if (valid && buf != NULL) {
+            valid = flash_read(base + offset + sizeof(hdr), buf, hdr.length) &&
+                    blob_crc(hdr.segment_id, buf, hdr.length) == hdr.crc;
+        }
+        if (!valid) {
+            if (buf != NULL && hdr.magic != RECORD_CLOSED) {
+                ESP_LOGW(TAG, "Closing torn record in sector %" PRIu32 " at %" PRIu32, sector, offset);
+                head = sector;
+                close_head(offset);
+            }
+            return RAW_SECTOR_SIZE;
+        }
+        index_put(hdr.segment_id, base + offset);
+        offset += raw_store_record_size(hdr.length);
+    }
+    return RAW_SECTOR_SIZE;
+}
+
+static int compare_sector_seq(const void *a, const void *b) {
+    uint32_t sa = sector_seq[*(const uint32_t *)a];
+    uint32_t sb = sector_seq[*(const uint32_t *)b];
+    return (sa > sb) - (sa < sb);
+}
+
+bool raw_store_init(void) {
+    if (raw_mutex == NULL) {
+        raw_mutex = xSemaphoreCreateMutex();
+    }
+    if (!flash_open()) {
+        ESP_LOGE(TAG, "Partition \"%s\" not found", CONFIG_RAW_PARTITION_LABEL);
+        return false;
+    }
+    sector_count = flash_size / RAW_SECTOR_SIZE;
+    free(sector_seq);
+    free(sector_live);
+    sector_seq = calloc(sector_count, sizeof(uint32_t));
+    sector_live = calloc(sector_count, sizeof(uint16_t));
+    uint32_t *order = malloc(sector_count * sizeof(uint32_t));
+    uint8_t *buf = malloc(MAX_BLOB_SIZE);
+    if (sector_seq == NULL || sector_live == NULL || order == NULL || buf == NULL || sector_count < 2) {
+        ESP_LOGE(TAG, "Cannot mount %" PRIu32 " sectors", sector_count);
+        free(order);
+        free(buf);
+        return false;
+    }
+
+    entry_count = 0;
+    log_empty = true;
+    head = tail = 0;
+    next_seq = 1;
+    size_t used = 0;
+    for (uint32_t s = 0; s < sector_count; s++) {
+        SectorHeader hdr;
+        if (flash_read(s * RAW_SECTOR_SIZE, &hdr, sizeof(hdr)) && hdr.magic == SECTOR_MAGIC &&
+            hdr.seq != 0 && hdr.seq != UINT32_MAX) {
+            sector_seq[s] = hdr.seq;
+            order[used++] = s;
+        }
+    }
+    // Replaying in sequence order leaves every segment at its newest version
+    qsort(order, used, sizeof(uint32_t), compare_sector_seq);
+    for (size_t k = 0; k < used; k++) {
+        bool newest = (k + 1 == used);
+        uint32_t end = scan_sector(order[k], newest ? buf : NULL);
+        if (newest) {
+            tail = order[0];
+            head = order[k];
+            head_offset = end;
+            log_empty = false;
+            next_seq = sector_seq[head] + 1;
+        }
+    }
+    free(order);
+    free(buf);
+    ESP_LOGI(TAG, "Mounted \"%s\": %u segments in %u of %" PRIu32 " sectors", CONFIG_RAW_PARTITION_LABEL,
+             (unsigned)entry_count, (unsigned)used, sector_count);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool raw_store_write(uint32_t segment_id, const uint8_t *blob, size_t length) {
+    if (length == 0 || length > MAX_BLOB_SIZE) {
+        ESP_LOGE(TAG, "Invalid blob size %u for segment %" PRIu32, (unsigned)length, segment_id);
+        return false;
+    }
+    RecordHeader hdr = { RECORD_MAGIC, (uint16_t)length, segment_id, blob_crc(segment_id, blob, length) };
+
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    uint32_t addr;
+    bool ok = reserve(raw_store_record_size(length), &addr);
+    if (!ok) {
+        ESP_LOGE(TAG, "Log full, cannot store segment %" PRIu32, segment_id);
+    } else if (!flash_write(addr, &hdr, sizeof(hdr)) || !flash_write(addr + sizeof(hdr), blob, length)) {
+        ESP_LOGE(TAG, "Failed to write segment %" PRIu32, segment_id);
+        close_head(addr % RAW_SECTOR_SIZE);
+        ok = false;
+    } else {
+        head_offset += raw_store_record_size(length);
+        ok = index_put(segment_id, addr);
+    }
+    xSemaphoreGive(raw_mutex);
+    return ok;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool raw_store_read(uint32_t segment_id, uint8_t *blob, size_t *length) {
+    RecordHeader hdr;
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    size_t i = index_find(segment_id);
+    bool ok = index_contains(i, segment_id) &&
+              flash_read(entries[i].addr, &hdr, sizeof(hdr)) &&
+              hdr.magic == RECORD_MAGIC && hdr.segment_id == segment_id && hdr.length <= *length &&
+              flash_read(entries[i].addr + sizeof(hdr), blob, hdr.length);
+    xSemaphoreGive(raw_mutex);
+    if (!ok) {
+        return false;
+    }
+    if (blob_crc(segment_id, blob, hdr.length) != hdr.crc) {
+        ESP_LOGE(TAG, "CRC mismatch in segment %" PRIu32, segment_id);
+        return false;
+    }
+    *length = hdr.length;
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool raw_store_exists(uint32_t segment_id) {
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    bool found = index_contains(index_find(segment_id), segment_id);
+    xSemaphoreGive(raw_mutex);
+    return found;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool raw_store_erase(uint32_t segment_id) {
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    size_t i = index_find(segment_id);
+    bool found = index_contains(i, segment_id);
+    if (found) {
+        sector_live[entries[i].addr / RAW_SECTOR_SIZE]--;
+        memmove(&entries[i], &entries[i + 1], (entry_count - i - 1) * sizeof(IndexEntry));
+        entry_count--;
+        reclaim_tail();
+    }
+    xSemaphoreGive(raw_mutex);
+    return found;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static int compare_ids(const void *a, const void *b) {
+    uint32_t ia = *(const uint32_t *)a;
+    uint32_t ib = *(const uint32_t *)b;
+    return (ia > ib) - (ia < ib);
+}
+
+void raw_store_retain(uint32_t *segment_ids, size_t count) {
+    qsort(segment_ids, count, sizeof(uint32_t), compare_ids);
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    size_t kept = 0;
+    for (size_t i = 0; i < entry_count; i++) {
+        if (bsearch(&entries[i].segment_id, segment_ids, count, sizeof(uint32_t), compare_ids)) {
+            entries[kept++] = entries[i];
+        } else {
+            sector_live[entries[i].addr / RAW_SECTOR_SIZE]--;
+        }
+    }
+    size_t dropped = entry_count - kept;
+    entry_count = kept;
+    reclaim_tail();
+    xSemaphoreGive(raw_mutex);
+    if (dropped > 0) {
+        ESP_LOGW(TAG, "Dropped %u unlisted segments", (unsigned)dropped);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+size_t raw_store_segment_ids(uint32_t *segment_ids, size_t max) {
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    size_t n = entry_count;
+    for (size_t i = 0; i < n && i < max; i++) {
+        segment_ids[i] = entries[i].segment_id;
+    }
+    xSemaphoreGive(raw_mutex);
+    return n;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void raw_store_format(void) {
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    // Sectors the tail has left still hold valid headers, so check every one
+    for (uint32_t s = 0; s < sector_count; s++) {
+        SectorHeader hdr;
+        if (flash_read(s * RAW_SECTOR_SIZE, &hdr, sizeof(hdr)) &&
+            (hdr.magic != UINT32_MAX || hdr.seq != UINT32_MAX)) {
+            flash_erase_sector(s);
+        }
+        sector_seq[s] = 0;
+        sector_live[s] = 0;
+    }
+    entry_count = 0;
+    log_empty = true;
+    head = tail = 0;
+    xSemaphoreGive(raw_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+uint32_t raw_store_usage_percent(void) {
+    if (raw_mutex == NULL || sector_count == 0) {
+        return 0;
+    }
+    xSemaphoreTake(raw_mutex, portMAX_DELAY);
+    reclaim_tail();
+    uint32_t used = log_empty ? 0 : (head + sector_count - tail) % sector_count + 1;
+    xSemaphoreGive(raw_mutex);
+    return used * 100U / sector_count;
+}
+
+uint32_t raw_store_capacity(void) {
+    return sector_count * RAW_SECTOR_SIZE;
+}
@@ -0,0 +1,40 @@
+#ifndef RAW_STORE_H
+#define RAW_STORE_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Segment blobs in a circular log on a raw data partition (the "tsdata"
+ * entry of partitions.csv), used by nvs_utils.c instead of NVS blobs when
+ * CONFIG_STORAGE_RAW_PARTITION is set. Lists, the manifest and the WAL stay
+ * in NVS. Building with RAW_STORE_HOST_FILE="path" swaps the partition for
+ * a memory-mapped file so the backend can be exercised on a host.
+ */
+#define RAW_SECTOR_SIZE 4096
+// ─────────────────────────────────────────────────────────────────────────────
+/* Mounts the partition and rebuilds the segment index from the record headers */
+bool raw_store_init(void);
+/* Appends `blob` as the current version of the segment */
+bool raw_store_write(uint32_t segment_id, const uint8_t *blob, size_t length);
+/* `*length` is the buffer size on entry and the blob size on return */
+bool raw_store_read(uint32_t segment_id, uint8_t *blob, size_t *length);
+bool raw_store_exists(uint32_t segment_id);
+/* Forgets the segment; its sector is erased once nothing in it is live */
+bool raw_store_erase(uint32_t segment_id);
+/*
+ * Forgets every segment not in `segment_ids` (sorted in place). Erases are
+ * not journalled, so boot recovery calls this with the listed ids.
+ */
+void raw_store_retain(uint32_t *segment_ids, size_t count);
+/* Copies up to `max` stored ids into `segment_ids`; returns how many are stored */
+size_t raw_store_segment_ids(uint32_t *segment_ids, size_t max);
+void raw_store_format(void);
+/* Sectors between the log tail and head, dead records included */
+uint32_t raw_store_usage_percent(void);
+uint32_t raw_store_capacity(void);
+/* Flash bytes a blob of `length` occupies, record header and padding included */
+size_t raw_store_record_size(size_t length);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // RAW_STORE_H
@@ -0,0 +1,174 @@
+#include "read_cache.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "READ_CACHE";
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Read-only cache of segments decoded from flash. It is kept completely apart
+ * from the write buffer: entries here are always clean copies of what is
+ * already persisted, so evicting them never costs a flash write.
+ * Replacement uses the CLOCK (second chance) algorithm.
+ *
+ * Admission is TinyLFU-style: once the cache is full, a segment only replaces
+ * a resident entry on its second access within the doorkeeper window, so a
+ * single wide scan cannot flush the working set of repeated dashboard queries.
+ */
+typedef struct {
+    Segment seg;
+    bool valid;
+    bool referenced;
+} ReadCacheEntry;
+// ─────────────────────────────────────────────────────────────────────────────
+static ReadCacheEntry cache[READ_CACHE_CAPACITY];
+static int clock_hand = 0;
+static ReadCacheStats stats;
+static SemaphoreHandle_t cache_mutex = NULL;
+// ─────────────────────────────────────────────────────────────────────────────
+/* Doorkeeper bloom filter (two hash functions) */
+static uint8_t doorkeeper[READ_CACHE_DOORKEEPER_BITS / 8];
+static uint32_t doorkeeper_attempts = 0;
+// ─────────────────────────────────────────────────────────────────────────────
+void read_cache_init(void) {
+    if (cache_mutex == NULL) {
+        cache_mutex = xSemaphoreCreateMutex();
+    }
+    memset(cache, 0, sizeof(cache));
+    memset(&stats, 0, sizeof(stats));
+    memset(doorkeeper, 0, sizeof(doorkeeper));
+    doorkeeper_attempts = 0;
+    clock_hand = 0;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Returns the slot index holding `segment_id`, or -1. Caller holds the mutex.
+static int find_slot(uint32_t segment_id) {
+    for (int i = 0; i < READ_CACHE_CAPACITY; i++) {
+        if (cache[i].valid && cache[i].seg.info.segment_id == segment_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Returns a free slot index, or -1 if the cache is full. Caller holds the mutex.
+static int find_free_slot(void) {
+    for (int i = 0; i < READ_CACHE_CAPACITY; i++) {
+        if (!cache[i].valid) {
+            return i;
+        }
+    }
+    return -1;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Records an access in the doorkeeper; returns true if it was already present.
+static bool doorkeeper_check_and_set(uint32_t segment_id) {
+    if (++doorkeeper_attempts >= READ_CACHE_DOORKEEPER_RESET) {
+        // Periodic reset ages out stale history
+        memset(doorkeeper, 0, sizeof(doorkeeper));
+        doorkeeper_attempts = 0;
+    }
+
+    uint32_t key = segment_id;
+    uint32_t h1 = key * 2654435761u;
+    uint32_t h2 = (key ^ (key >> 16)) * 2246822519u;
+    uint32_t b1 = (h1 >> 7) % READ_CACHE_DOORKEEPER_BITS;
+    uint32_t b2 = (h2 >> 7) % READ_CACHE_DOORKEEPER_BITS;
+
+    bool seen = (doorkeeper[b1 / 8] & (1u << (b1 % 8))) &&
+                (doorkeeper[b2 / 8] & (1u << (b2 % 8)));
+    doorkeeper[b1 / 8] |= (uint8_t)(1u << (b1 % 8));
+    doorkeeper[b2 / 8] |= (uint8_t)(1u << (b2 % 8));
+    return seen;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool read_cache_lookup(uint32_t segment_id, Segment *result) {
+    if (cache_mutex == NULL || result == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int slot = find_slot(segment_id);
+    if (slot >= 0) {
+        cache[slot].referenced = true;
+        *result = cache[slot].seg;
+        stats.hits++;
+    } else {
+        stats.misses++;
+    }
+    xSemaphoreGive(cache_mutex);
+    return slot >= 0;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void read_cache_insert(const Segment *seg) {
+    if (cache_mutex == NULL || seg == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int slot = find_slot(seg->info.segment_id);
+    if (slot < 0) {
+        slot = find_free_slot();
+    }
+    if (slot < 0) {
+        // Full: only admit segments that were already requested recently
+        if (!doorkeeper_check_and_set(seg->info.segment_id)) {
+            stats.rejected++;
+            xSemaphoreGive(cache_mutex);
+            return;
+        }
+
+        // Advance the hand, giving referenced entries a second chance
+        while (cache[clock_hand].valid && cache[clock_hand].referenced) {
+            cache[clock_hand].referenced = false;
+            clock_hand = (clock_hand + 1) % READ_CACHE_CAPACITY;
+        }
+        slot = clock_hand;
+        clock_hand = (clock_hand + 1) % READ_CACHE_CAPACITY;
+        if (cache[slot].valid) {
+            stats.evictions++;
+        }
+    }
+    cache[slot].seg = *seg;
+    cache[slot].valid = true;
+    cache[slot].referenced = false;
+    xSemaphoreGive(cache_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void read_cache_invalidate(uint32_t segment_id) {
+    if (cache_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    int slot = find_slot(segment_id);
+    if (slot >= 0) {
+        cache[slot].valid = false;
+        cache[slot].referenced = false;
+    }
+    xSemaphoreGive(cache_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void read_cache_clear(void) {
+    if (cache_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    memset(cache, 0, sizeof(cache));
+    clock_hand = 0;
+    xSemaphoreGive(cache_mutex);
+    ESP_LOGI(TAG, "Read cache cleared");
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void read_cache_get_stats(ReadCacheStats *out) {
+    if (cache_mutex == NULL || out == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(cache_mutex);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stdbool.h>
+#include "segment.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/* Number of decoded flash segments kept in RAM for repeated queries */
+#define READ_CACHE_CAPACITY 8
+/* Doorkeeper size in bits; a segment must be seen twice before it may evict */
+#define READ_CACHE_DOORKEEPER_BITS 512
+/* Forget doorkeeper history after this many admission attempts */
+#define READ_CACHE_DOORKEEPER_RESET 1024
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t rejected;    // insertions refused by the admission policy
+} ReadCacheStats;
+// ─────────────────────────────────────────────────────────────────────────────
+void read_cache_init(void);
+bool read_cache_lookup(uint32_t segment_id, Segment *result);
+void read_cache_insert(const Segment *seg);
+void read_cache_invalidate(uint32_t segment_id);
+void read_cache_clear(void);
+void read_cache_get_stats(ReadCacheStats *stats);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // READ_CACHE_H
\ No newline at end of file
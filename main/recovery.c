@@ -0,0 +1,53 @@
+#include "recovery.h"
+#include "config.h"
+#include "buffer.h"
+#include "metrics.h"
+#include "wal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "RECOVERY";
+// ─────────────────────────────────────────────────────────────────────────────
+void storage_recover(RecoveryReport *report) {
+    memset(report, 0, sizeof(*report));
+    int64_t start_us = esp_timer_get_time();
+    int64_t budget_us = (int64_t)CONFIG_BOOT_RECOVERY_BUDGET_MS * 1000;
+
+    // Not budgeted: a series that does not know what it flushed would store old samples
+    // (journal replay, back-fill) again as overlapping segments instead of merging them
+    uint32_t newest[SERIES_COUNT];
+    bool stored[SERIES_COUNT];
+    for (uint8_t series_id = 0; series_id < SERIES_COUNT; series_id++) {
+        stored[series_id] = buffer_seed_flushed_ts(series_id, &newest[series_id]);
+    }
+
+    // Warm-up is an optimization, so it is the part that gives way to the budget
+    for (uint8_t series_id = 0; series_id < SERIES_COUNT; series_id++) {
+        if (!stored[series_id]) {
+            continue;
+        }
+        if (esp_timer_get_time() - start_us >= budget_us) {
+            report->over_budget = true;
+            ESP_LOGW(TAG, "Recovery budget spent; %s ring starts cold", series_name(series_id));
+            continue;
+        }
+        report->warmed += buffer_warm_from_flash(series_id, newest[series_id]);
+    }
+
+#if CONFIG_WAL_ENABLED
+    // The journal is always replayed in full; it holds about CONFIG_WAL_MAX_CHUNKS chunks
+    wal_init();
+    report->replayed = wal_recover();
+#endif
+
+    int64_t now_us = esp_timer_get_time();
+    report->recovery_ms = (uint32_t)((now_us - start_us) / 1000);
+    report->ready_ms = (uint32_t)(now_us / 1000);
+    metrics_set_gauge(METRIC_GAUGE_BOOT_MS, report->ready_ms);
+
+    ESP_LOGI(TAG, "Storage ready %" PRIu32 " ms after boot (recovery %" PRIu32 " ms, %" PRIu32
+             " warmed, %" PRIu32 " replayed)", report->ready_ms, report->recovery_ms,
+             report->warmed, report->replayed);
+}
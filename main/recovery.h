@@ -0,0 +1,25 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+#include <stdint.h>
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    uint32_t ready_ms;      // time since boot when storage became ready
+    uint32_t recovery_ms;   // spent in storage_recover() itself
+    uint32_t warmed;        // samples loaded into the buffer from segments
+    uint32_t replayed;      // samples replayed from the journal
+    bool over_budget;       // warm-up was cut short by CONFIG_BOOT_RECOVERY_BUDGET_MS
+} RecoveryReport;
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Startup stage run after init_nvs() (which resumes the manifest) and
+ * buffer_init(). Seeds what every series already flushed, warms each ring
+ * from its newest segment while the budget allows, replays the journal, and
+ * reports boot-to-ready time. Deeper index checks are left to
+ * validate_segment_lists_step() so the cost does not grow with the amount of
+ * stored history.
+ */
+void storage_recover(RecoveryReport *report);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // RECOVERY_H
@@ -0,0 +1,253 @@
+#include "segment.h"
+#include "esp_log.h"
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "SEGMENT";
+// ─────────────────────────────────────────────────────────────────────────────
+/* Zigzag maps small signed deltas to small unsigned values: 0,-1,1,-2 -> 0,1,2,3 */
+static inline uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static size_t varint_size(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static uint8_t *varint_write(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// Returns the byte after the varint, or NULL if it runs past `end` or is malformed
+static const uint8_t *varint_read(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        result |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+size_t segment_encoded_size(const Segment *seg) {
+    uint16_t count = seg->info.count;
+    size_t size = sizeof(SegmentHeader) + count * sizeof(float) + (count + 7) / 8;
+    for (int i = 1; i < count; i++) {
+        size += varint_size(zigzag_encode((int64_t)(seg->timestamps[i] - seg->timestamps[i - 1])));
+    }
+    return size;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+size_t segment_encode(const Segment *seg, uint8_t *out, size_t out_len) {
+    uint16_t count = seg->info.count;
+    if (count == 0 || count > SEGMENT_MAX_RECORDS) {
+        ESP_LOGE(TAG, "Cannot encode segment (count=%u)", count);
+        return 0;
+    }
+    size_t needed = segment_encoded_size(seg);
+    if (out_len < needed) {
+        ESP_LOGE(TAG, "Cannot encode segment (needed=%u, out_len=%u)", (unsigned)needed, (unsigned)out_len);
+        return 0;
+    }
+
+    SegmentHeader header = {
+        .version = SEGMENT_FORMAT_VERSION,
+        .series_id = seg->info.series_id,
+        .count = count,
+        .segment_id = seg->info.segment_id,
+        .base_ts = seg->timestamps[0],
+    };
+
+    uint8_t *p = out;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    for (int i = 1; i < count; i++) {
+        p = varint_write(p, zigzag_encode((int64_t)(seg->timestamps[i] - seg->timestamps[i - 1])));
+    }
+    memcpy(p, seg->values, count * sizeof(float));
+    p += count * sizeof(float);
+    memcpy(p, seg->sent, (count + 7) / 8);
+
+    return needed;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool segment_decode(const uint8_t *in, size_t in_len, Segment *seg) {
+    SegmentHeader header;
+    if (in_len < sizeof(header)) {
+        ESP_LOGE(TAG, "Segment blob too short (%u bytes)", (unsigned)in_len);
+        return false;
+    }
+    memcpy(&header, in, sizeof(header));
+
+    if (header.version != SEGMENT_FORMAT_VERSION || header.count == 0 ||
+        header.count > SEGMENT_MAX_RECORDS) {
+        ESP_LOGE(TAG, "Invalid segment header (version=%u, count=%u, len=%u)",
+                 header.version, header.count, (unsigned)in_len);
+        return false;
+    }
+
+    memset(seg, 0, sizeof(*seg));
+    const uint8_t *p = in + sizeof(header);
+    const uint8_t *end = in + in_len;
+    seg->timestamps[0] = header.base_ts;
+    for (int i = 1; i < header.count; i++) {
+        uint64_t delta;
+        p = varint_read(p, end, &delta);
+        if (p == NULL) {
+            ESP_LOGE(TAG, "Truncated timestamp column in segment %" PRIu32, header.segment_id);
+            return false;
+        }
+        seg->timestamps[i] = seg->timestamps[i - 1] + (uint64_t)zigzag_decode(delta);
+    }
+
+    size_t tail = header.count * sizeof(float) + (header.count + 7) / 8;
+    if ((size_t)(end - p) < tail) {
+        ESP_LOGE(TAG, "Truncated segment %" PRIu32 " (len=%u)", header.segment_id, (unsigned)in_len);
+        return false;
+    }
+    memcpy(seg->values, p, header.count * sizeof(float));
+    p += header.count * sizeof(float);
+    memcpy(seg->sent, p, (header.count + 7) / 8);
+
+    seg->info.segment_id = header.segment_id;
+    seg->info.series_id  = header.series_id;
+    seg->info.count      = header.count;
+    segment_compute_bounds(seg);
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void segment_compute_bounds(Segment *seg) {
+    SegmentInfo *info = &seg->info;
+    info->min_ts = info->max_ts = seg->timestamps[0];
+    float min_value = seg->values[0], max_value = seg->values[0];
+    bool has_nan = isnan(seg->values[0]);
+    for (int i = 1; i < info->count; i++) {
+        if (seg->timestamps[i] < info->min_ts) {
+            info->min_ts = seg->timestamps[i];
+        }
+        if (seg->timestamps[i] > info->max_ts) {
+            info->max_ts = seg->timestamps[i];
+        }
+        has_nan |= isnan(seg->values[i]);
+        if (seg->values[i] < min_value || isnan(min_value)) {
+            min_value = seg->values[i];
+        }
+        if (seg->values[i] > max_value || isnan(max_value)) {
+            max_value = seg->values[i];
+        }
+    }
+    // A NaN sample keeps the segment from ever being pruned
+    info->min_value = has_nan ? ZONE_BOUND_NEG_INF : zone_bound_floor(min_value);
+    info->max_value = has_nan ? ZONE_BOUND_POS_INF : zone_bound_ceil(max_value);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// float -> half, rounding toward zero; the directed versions step one ulp outward if needed
+static uint16_t half_truncate(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (isinf(value)) {
+        return sign | 0x7C00;
+    }
+    if (exponent >= 31) {
+        return sign | 0x7BFF;                   // largest finite half
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        return sign | (uint16_t)((mantissa | 0x800000) >> (14 - exponent));
+    }
+    return sign | (uint16_t)(exponent << 10) | (uint16_t)(mantissa >> 13);
+}
+
+float zone_bound_value(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    int exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    float magnitude;
+    if (exponent == 31) {
+        magnitude = mantissa ? NAN : INFINITY;
+    } else if (exponent == 0) {
+        magnitude = ldexpf((float)mantissa, -24);
+    } else {
+        magnitude = ldexpf((float)(mantissa | 0x400), exponent - 25);
+    }
+    uint32_t bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    bits |= sign;
+    memcpy(&magnitude, &bits, sizeof(bits));
+    return magnitude;
+}
+
+uint16_t zone_bound_floor(float value) {
+    if (isnan(value)) {
+        return ZONE_BOUND_NEG_INF;
+    }
+    uint16_t half = half_truncate(value);
+    if (zone_bound_value(half) > value) {
+        // Truncation moved a negative value up: one step further from zero
+        half = (half == 0x0000) ? 0x8001 : (uint16_t)(half + 1);
+    }
+    return half;
+}
+
+uint16_t zone_bound_ceil(float value) {
+    if (isnan(value)) {
+        return ZONE_BOUND_POS_INF;
+    }
+    uint16_t half = half_truncate(value);
+    if (zone_bound_value(half) < value) {
+        // Truncation moved a positive value down: one step further from zero
+        half = (half == 0x8000) ? 0x0001 : (uint16_t)(half + 1);
+    }
+    return half;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int segment_get_range(const Segment *seg, uint64_t start_timestamp, uint64_t end_timestamp,
+                      Measurement *out, size_t max_out) {
+    return segment_get_range_where(seg, start_timestamp, end_timestamp, NULL, out, max_out);
+}
+
+int segment_get_range_where(const Segment *seg, uint64_t start_timestamp, uint64_t end_timestamp,
+                            const ValuePredicate *where, Measurement *out, size_t max_out) {
+    int count = 0;
+    // Only the timestamp column is touched until a record matches
+    for (int i = 0; i < seg->info.count; i++) {
+        uint64_t ts = seg->timestamps[i];
+        if (ts < start_timestamp || ts > end_timestamp) {
+            continue;
+        }
+        if (where && !value_predicate_match(where, seg->values[i])) {
+            continue;
+        }
+        if (count >= (int)max_out) {
+            break;
+        }
+        out[count].timestamp = ts;
+        out[count].value     = seg->values[i];
+        out[count].series_id = seg->info.series_id;
+        out[count].dirty_bit = segment_is_sent(seg, i) ? DIRTY_BIT_SENT_TO_EDGE : DIRTY_BIT_IN_FLASH;
+        count++;
+    }
+    return count;
+}
\ No newline at end of file
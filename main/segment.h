@@ -0,0 +1,94 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include "measurement.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * A segment is the unit written to flash: a run of consecutive samples of a
+ * single series, stored column-wise so a range scan only has to look at the
+ * timestamp column.
+ *
+ * Timestamps are 64-bit epoch milliseconds. On flash only the first one is
+ * stored in full (in the header); every following one is the zigzag varint
+ * of its delta to the previous record, so a steady 1 Hz series costs 2 bytes
+ * per timestamp and out-of-order samples still encode.
+ *
+ * Encoded layout (little endian):
+ *   SegmentHeader | varint deltas[count - 1] | float values[count] | uint8_t sent[(count + 7) / 8]
+ */
+#define SEGMENT_FORMAT_VERSION 2
+#define SEGMENT_MAX_RECORDS 32
+#define SEGMENT_BITMAP_BYTES ((SEGMENT_MAX_RECORDS + 7) / 8)
+#define SEGMENT_MAX_VARINT_BYTES 10
+#define SEGMENT_MAX_ENCODED_SIZE \
+    (sizeof(SegmentHeader) + (SEGMENT_MAX_RECORDS - 1) * SEGMENT_MAX_VARINT_BYTES + \
+     SEGMENT_MAX_RECORDS * sizeof(float) + SEGMENT_BITMAP_BYTES)
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t series_id;
+    uint16_t count;
+    uint32_t segment_id;
+    uint64_t base_ts;     // timestamp of the first record
+} SegmentHeader;
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Index entry describing one stored segment (kept in the per-series segment
+ * list). The time and value bounds are its zone map: queries skip segments
+ * that cannot match without reading them. The value bounds are IEEE half
+ * floats rounded outward, so they never exclude a stored value and only add
+ * 4 bytes to an entry the list rewrites on every flush.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t segment_id;
+    uint64_t min_ts;
+    uint64_t max_ts;
+    uint16_t count;
+    uint8_t series_id;
+    uint8_t flags;        // SEGMENT_FLAG_*; only kept in the list entry
+    uint16_t min_value;   // half float, rounded down
+    uint16_t max_value;   // half float, rounded up
+} SegmentInfo;
+
+#define SEGMENT_FLAG_ROLLUP 0x01  // downsampled by the compactor
+// ─────────────────────────────────────────────────────────────────────────────
+/* Decoded segment in RAM */
+typedef struct {
+    SegmentInfo info;
+    uint64_t timestamps[SEGMENT_MAX_RECORDS];
+    float values[SEGMENT_MAX_RECORDS];
+    uint8_t sent[SEGMENT_BITMAP_BYTES];   // bit set => record already sent to edge
+} Segment;
+// ─────────────────────────────────────────────────────────────────────────────
+/* Fills in the time and value bounds of `seg->info` from its records */
+void segment_compute_bounds(Segment *seg);
+/* Half-float zone bounds: the nearest half <= / >= value (NaN widens to -inf / +inf) */
+uint16_t zone_bound_floor(float value);
+uint16_t zone_bound_ceil(float value);
+float zone_bound_value(uint16_t half);
+#define ZONE_BOUND_NEG_INF 0xFC00
+#define ZONE_BOUND_POS_INF 0x7C00
+size_t segment_encoded_size(const Segment *seg);
+size_t segment_encode(const Segment *seg, uint8_t *out, size_t out_len);
+bool segment_decode(const uint8_t *in, size_t in_len, Segment *seg);
+// ─────────────────────────────────────────────────────────────────────────────
+static inline bool segment_is_sent(const Segment *seg, int i) {
+    return (seg->sent[i / 8] >> (i % 8)) & 1u;
+}
+
+static inline void segment_mark_sent(Segment *seg, int i) {
+    seg->sent[i / 8] |= (uint8_t)(1u << (i % 8));
+}
+// ─────────────────────────────────────────────────────────────────────────────
+/* Copy records of `seg` with timestamps in [start, end] into `out`; returns the number copied */
+int segment_get_range(const Segment *seg, uint64_t start_timestamp, uint64_t end_timestamp,
+                      Measurement *out, size_t max_out);
+/* Same, keeping only values that satisfy `where` (NULL matches everything) */
+int segment_get_range_where(const Segment *seg, uint64_t start_timestamp, uint64_t end_timestamp,
+                            const ValuePredicate *where, Measurement *out, size_t max_out);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // SEGMENT_H
\ No newline at end of file
@@ -0,0 +1,517 @@
+#include "segment_list.h"
+#include "nvs_utils.h"
+#include "nvs_flash.h"
+#include "esp_log.h"
+#include "mem_pool.h"
+#define TRACE_LEVEL CONFIG_TRACE_LEVEL_SEGMENT_LIST
+#include "trace.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "SEGMENT_LIST";
+#define NAMESPACE "storage"
+
+/* Serializes read-modify-write of the list blobs (ingest appends, offload removes) */
+static SemaphoreHandle_t list_mutex = NULL;
+
+/*
+ * A list is stored in chunks of up to SEGMENT_LIST_CHUNK entries, so an append
+ * rewrites only the newest chunk instead of the whole list. The header names
+ * the live chunks in order; a chunk id is never reused while listed, so any
+ * change spanning chunks writes them under fresh ids and commits by rewriting
+ * the header. The chunks it replaced are named in that same header as stale
+ * and erased after it commits (again at init if a reset came in between).
+ *
+ * Chunk 0 is keyed like the single list blob of earlier firmware, and a
+ * missing header means just that chunk, so those lists load unchanged.
+ */
+typedef struct {
+    uint32_t next_id;   // Lowest chunk id never written
+    uint16_t count;     // Live chunks, oldest first
+    uint16_t stale;     // Replaced chunks, erased once this header is committed
+    uint32_t ids[];     // `count` live ids, then `stale` ids
+} ListHeader;
+
+typedef struct {
+    ListHeader *header;
+    size_t *starts;     // Index of each live chunk's first entry in `entries`
+    SegmentInfo *entries;
+    size_t total;
+} ListView;
+
+static void chunk_key(uint8_t series_id, uint32_t chunk_id, char *key, size_t key_len) {
+    if (chunk_id == 0) {
+        segment_list_key(series_id, key, key_len);
+    } else {
+        snprintf(key, key_len, "%s%u.%" PRIx32, SEGMENT_LIST_KEY, (unsigned)series_id, chunk_id);
+    }
+}
+
+static void header_key(uint8_t series_id, char *key, size_t key_len) {
+    snprintf(key, key_len, "%s%u", SEGMENT_LIST_HEADER_KEY, (unsigned)series_id);
+}
+
+static size_t header_size(uint16_t count, uint16_t stale) {
+    return sizeof(ListHeader) + ((size_t)count + stale) * sizeof(uint32_t);
+}
+
+// Heap copy of the series' header (caller frees); NULL on a read error
+static ListHeader *read_header(nvs_handle_t handle, uint8_t series_id) {
+    char key[SEGMENT_LIST_KEY_SIZE];
+    header_key(series_id, key, sizeof(key));
+    size_t size = 0;
+    esp_err_t err = nvs_get_blob(handle, key, NULL, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ListHeader *header = malloc(header_size(1, 0));
+        if (header != NULL) {
+            *header = (ListHeader){ .next_id = 1, .count = 1 };
+            header->ids[0] = 0;
+        }
+        return header;
+    }
+    ListHeader *header = err == ESP_OK && size >= sizeof(ListHeader) ? malloc(size) : NULL;
+    if (header != NULL && (nvs_get_blob(handle, key, header, &size) != ESP_OK
+                           || size != header_size(header->count, header->stale))) {
+        free(header);
+        header = NULL;
+    }
+    if (header == NULL) {
+        ESP_LOGE(TAG, "Failed to read segment list header %s", key);
+    }
+    return header;
+}
+
+// Entries in the chunk; a missing chunk is empty. -1 on a read error.
+static int chunk_entries(nvs_handle_t handle, uint8_t series_id, uint32_t chunk_id) {
+    char key[SEGMENT_LIST_KEY_SIZE];
+    chunk_key(series_id, chunk_id, key, sizeof(key));
+    size_t size = 0;
+    esp_err_t err = nvs_get_blob(handle, key, NULL, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return 0;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error getting segment list chunk %s: %s", key, esp_err_to_name(err));
+        return -1;
+    }
+    return (int)(size / sizeof(SegmentInfo));
+}
+
+static bool read_chunk(nvs_handle_t handle, uint8_t series_id, uint32_t chunk_id, SegmentInfo *out, size_t count) {
+    char key[SEGMENT_LIST_KEY_SIZE];
+    chunk_key(series_id, chunk_id, key, sizeof(key));
+    size_t size = count * sizeof(SegmentInfo);
+    esp_err_t err = count ? nvs_get_blob(handle, key, out, &size) : ESP_OK;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error getting segment list chunk %s: %s", key, esp_err_to_name(err));
+    }
+    return err == ESP_OK;
+}
+
+static esp_err_t write_chunk(nvs_handle_t handle, uint8_t series_id, uint32_t chunk_id,
+                             const SegmentInfo *entries, size_t count) {
+    char key[SEGMENT_LIST_KEY_SIZE];
+    chunk_key(series_id, chunk_id, key, sizeof(key));
+    return storage_set_blob(handle, key, entries, count * sizeof(SegmentInfo));
+}
+
+static esp_err_t write_header(nvs_handle_t handle, uint8_t series_id, const ListHeader *header) {
+    char key[SEGMENT_LIST_KEY_SIZE];
+    header_key(series_id, key, sizeof(key));
+    return storage_set_blob(handle, key, header, header_size(header->count, header->stale));
+}
+
+static void erase_stale_chunks(nvs_handle_t handle, uint8_t series_id, const ListHeader *header) {
+    for (uint16_t i = 0; i < header->stale; i++) {
+        char key[SEGMENT_LIST_KEY_SIZE];
+        chunk_key(series_id, header->ids[header->count + i], key, sizeof(key));
+        esp_err_t err = storage_erase_key(handle, key);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Failed to erase stale list chunk %s: %s", key, esp_err_to_name(err));
+        }
+    }
+    if (header->stale > 0) {
+        storage_commit(handle);
+    }
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Reads the header and every live chunk; entries come from `alloc`, the rest from the heap
+static bool read_view(nvs_handle_t handle, uint8_t series_id, ListView *view, void *(*alloc)(size_t)) {
+    memset(view, 0, sizeof(*view));
+    view->header = read_header(handle, series_id);
+    if (view->header == NULL) {
+        return false;
+    }
+    const ListHeader *header = view->header;
+    view->starts = malloc(((size_t)header->count + 1) * sizeof(size_t));
+    if (view->starts == NULL) {
+        return false;
+    }
+    for (uint16_t i = 0; i < header->count; i++) {
+        int n = chunk_entries(handle, series_id, header->ids[i]);
+        if (n < 0) {
+            return false;
+        }
+        view->starts[i] = view->total;
+        view->total += (size_t)n;
+    }
+    view->starts[header->count] = view->total;
+    if (view->total == 0) {
+        return true;
+    }
+    view->entries = alloc(view->total * sizeof(SegmentInfo));
+    if (view->entries == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for segment list");
+        return false;
+    }
+    for (uint16_t i = 0; i < header->count; i++) {
+        if (!read_chunk(handle, series_id, header->ids[i], &view->entries[view->starts[i]],
+                        view->starts[i + 1] - view->starts[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void release_view(ListView *view, void (*release)(void *)) {
+    free(view->header);
+    free(view->starts);
+    if (view->entries != NULL) {
+        release(view->entries);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+/*
+ * Replaces live chunks [first, last) with `entries` in new chunks, committed
+ * by one header write; `first == last` inserts there. Caller holds the mutex.
+ */
+static bool rewrite_chunks_locked(nvs_handle_t handle, uint8_t series_id, const ListHeader *header,
+                                  uint16_t first, uint16_t last, const SegmentInfo *entries, size_t count) {
+    size_t added = (count + SEGMENT_LIST_CHUNK - 1) / SEGMENT_LIST_CHUNK;
+    uint16_t removed = last - first;
+    size_t live = header->count - removed + added;
+    if (live > UINT16_MAX) {
+        return false;
+    }
+    ListHeader *updated = malloc(header_size((uint16_t)live, removed));
+    if (updated == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for segment list header");
+        return false;
+    }
+    updated->next_id = header->next_id;
+    updated->count = (uint16_t)live;
+    updated->stale = removed;
+    memcpy(updated->ids, header->ids, first * sizeof(uint32_t));
+
+    esp_err_t err = ESP_OK;
+    for (size_t k = 0; k < added && err == ESP_OK; k++) {
+        size_t offset = k * SEGMENT_LIST_CHUNK;
+        size_t n = count - offset < SEGMENT_LIST_CHUNK ? count - offset : SEGMENT_LIST_CHUNK;
+        updated->ids[first + k] = updated->next_id++;
+        err = write_chunk(handle, series_id, updated->ids[first + k], &entries[offset], n);
+    }
+    memcpy(&updated->ids[first + added], &header->ids[last], (header->count - last) * sizeof(uint32_t));
+    memcpy(&updated->ids[live], &header->ids[first], removed * sizeof(uint32_t));
+    // Chunks written above are not listed until the header is; a reset before leaves them to be overwritten
+    if (err == ESP_OK) {
+        err = write_header(handle, series_id, updated);
+    }
+    if (err == ESP_OK) {
+        err = storage_commit(handle);
+    }
+    if (err == ESP_OK) {
+        erase_stale_chunks(handle, series_id, updated);
+    } else {
+        ESP_LOGE(TAG, "Error rewriting segment list chunks of series %u: %s",
+                 (unsigned)series_id, esp_err_to_name(err));
+    }
+    free(updated);
+    return err == ESP_OK;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+void segment_list_init(void) {
+    if (list_mutex == NULL) {
+        list_mutex = xSemaphoreCreateMutex();
+    }
+    // Finishes a change that reset before erasing the chunks it replaced
+    nvs_handle_t handle;
+    if (nvs_open(NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    for (uint8_t series_id = 0; series_id < SERIES_COUNT; series_id++) {
+        ListHeader *header = read_header(handle, series_id);
+        if (header != NULL && header->stale > 0) {
+            erase_stale_chunks(handle, series_id, header);
+            header->stale = 0;
+            if (write_header(handle, series_id, header) == ESP_OK) {
+                storage_commit(handle);
+            }
+        }
+        free(header);
+    }
+    nvs_close(handle);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+void segment_list_key(uint8_t series_id, char *key, size_t key_len) {
+    snprintf(key, key_len, "%s%u", SEGMENT_LIST_KEY, (unsigned)series_id);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+static bool append_segment_locked(const SegmentInfo *info) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    ListHeader *header = read_header(handle, info->series_id);
+    int tail_count = header == NULL ? -1 : header->count == 0 ? SEGMENT_LIST_CHUNK
+                   : chunk_entries(handle, info->series_id, header->ids[header->count - 1]);
+    bool ok = false;
+    if (tail_count >= SEGMENT_LIST_CHUNK) {
+        // The newest chunk is full: the entry starts a new one
+        ok = rewrite_chunks_locked(handle, info->series_id, header, header->count, header->count, info, 1);
+    } else if (tail_count >= 0) {
+        // Only the newest chunk is rewritten, so the cost does not grow with the list
+        uint32_t tail = header->ids[header->count - 1];
+        SegmentInfo chunk[SEGMENT_LIST_CHUNK];
+        if (read_chunk(handle, info->series_id, tail, chunk, (size_t)tail_count)) {
+            chunk[tail_count] = *info;
+            err = write_chunk(handle, info->series_id, tail, chunk, (size_t)tail_count + 1);
+            if (err == ESP_OK) {
+                err = storage_commit(handle);
+            }
+            ok = err == ESP_OK;
+            if (!ok) {
+                ESP_LOGE(TAG, "Error setting segment list chunk: %s", esp_err_to_name(err));
+            }
+        }
+    }
+    if (ok) {
+        TRACE(TRACE_LIST_APPEND, info->series_id, info->segment_id);
+        TRACE_LOG("Appended segment %" PRIu32 " to FIFO list of series %u", info->segment_id, info->series_id);
+    }
+    free(header);
+    nvs_close(handle);
+    return ok;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+// Caller holds the mutex
+static bool store_list_locked(uint8_t series_id, const SegmentInfo *segments, size_t count) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return false;
+    }
+    ListHeader *header = read_header(handle, series_id);
+    bool ok = header != NULL && rewrite_chunks_locked(handle, series_id, header, 0, header->count, segments, count);
+    free(header);
+    nvs_close(handle);
+    return ok;
+}
+
+bool store_segment_list(uint8_t series_id, const SegmentInfo *segments, size_t count) {
+    xSemaphoreTake(list_mutex, portMAX_DELAY);
+    bool ok = store_list_locked(series_id, segments, count);
+    xSemaphoreGive(list_mutex);
+    return ok;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+bool replace_segments_in_list(uint8_t series_id, const uint32_t *old_ids, size_t count,
+                              const SegmentInfo *replacements, size_t replacement_count) {
+    xSemaphoreTake(list_mutex, portMAX_DELAY);
+    nvs_handle_t handle;
+    if (nvs_open(NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        xSemaphoreGive(list_mutex);
+        return false;
+    }
+    ListView view;
+    bool ok = read_view(handle, series_id, &view, malloc);
+    size_t total = view.total;
+    SegmentInfo *segment_list = view.entries;
+
+    // The run must still be listed, contiguous and in order
+    size_t first = 0;
+    while (ok && first < total && segment_list[first].segment_id != old_ids[0]) {
+        first++;
+    }
+    bool found = ok && count > 0 && (first + count <= total);
+    for (size_t k = 0; found && k < count; k++) {
+        found = (segment_list[first + k].segment_id == old_ids[k]);
+    }
+
+    ok = false;
+    if (found) {
+        // Only the chunks holding the run are rewritten, with what they keep around it
+        uint16_t a = 0, b = 0;
+        while (view.starts[a + 1] <= first) {
+            a++;
+        }
+        b = a;
+        while (view.starts[b + 1] < first + count) {
+            b++;
+        }
+        size_t before = first - view.starts[a];
+        size_t after = view.starts[b + 1] - (first + count);
+        size_t n = before + replacement_count + after;
+        SegmentInfo *merged = malloc((n ? n : 1) * sizeof(SegmentInfo));
+        if (merged) {
+            memcpy(merged, &segment_list[view.starts[a]], before * sizeof(SegmentInfo));
+            if (replacement_count > 0) {
+                memcpy(&merged[before], replacements, replacement_count * sizeof(SegmentInfo));
+            }
+            memcpy(&merged[before + replacement_count], &segment_list[first + count], after * sizeof(SegmentInfo));
+            if (a == b && n > 0 && n <= SEGMENT_LIST_CHUNK) {
+                // Within one chunk the chunk write itself is the commit point
+                esp_err_t err = write_chunk(handle, series_id, view.header->ids[a], merged, n);
+                ok = err == ESP_OK && storage_commit(handle) == ESP_OK;
+            } else {
+                ok = rewrite_chunks_locked(handle, series_id, view.header, a, b + 1, merged, n);
+            }
+            free(merged);
+        }
+        if (ok && replacement_count == 0) {
+            TRACE(TRACE_LIST_REMOVE, series_id, count);
+        }
+    } else if (view.header != NULL && view.entries != NULL) {
+        ESP_LOGW(TAG, "Segment run starting at %" PRIu32 " no longer listed", old_ids[0]);
+    }
+    release_view(&view, free);
+    nvs_close(handle);
+    xSemaphoreGive(list_mutex);
+    return ok;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+bool update_listed_segment(uint8_t series_id, const Segment *seg) {
+    xSemaphoreTake(list_mutex, portMAX_DELAY);
+    size_t count = 0;
+    SegmentInfo *segment_list = load_segment_list(series_id, &count);
+    bool listed = false;
+    for (size_t i = 0; i < count && !listed; i++) {
+        listed = segment_list[i].segment_id == seg->info.segment_id;
+    }
+    free(segment_list);
+    // Replacing takes this lock before erasing the old blobs; a pure drop erases them first
+    bool ok = listed && segment_exists_in_flash(seg->info.segment_id) && update_segment_in_flash(seg);
+    xSemaphoreGive(list_mutex);
+    return ok;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+/* Cursor of the background index check */
+static uint8_t validate_series;
+static size_t validate_index;
+
+void validate_segment_lists_step(size_t budget) {
+    xSemaphoreTake(list_mutex, portMAX_DELAY);
+    size_t count = 0;
+    SegmentInfo *segment_list = load_segment_list(validate_series, &count);
+
+    size_t end = validate_index + budget < count ? validate_index + budget : count;
+    size_t kept = validate_index;
+    size_t dropped = 0;
+    for (size_t i = validate_index; i < count; i++) {
+        // Blobs are written before and erased after their entry, so a missing one is damage
+        if (i < end && !segment_exists_in_flash(segment_list[i].segment_id)) {
+            dropped++;
+            continue;
+        }
+        segment_list[kept++] = segment_list[i];
+    }
+    if (dropped > 0) {
+        ESP_LOGW(TAG, "Dropping %u %s list entries without a segment",
+                 (unsigned)dropped, series_name(validate_series));
+        store_list_locked(validate_series, segment_list, kept);
+    }
+    free(segment_list);
+
+    if (end >= count) {
+        validate_series = (validate_series + 1) % SERIES_COUNT;
+        validate_index = 0;
+    } else {
+        validate_index = end - dropped;
+    }
+    xSemaphoreGive(list_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool append_segment_to_list(const SegmentInfo *info) {
+    xSemaphoreTake(list_mutex, portMAX_DELAY);
+    bool ok = append_segment_locked(info);
+    xSemaphoreGive(list_mutex);
+    return ok;
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+static SegmentInfo *read_segment_list(uint8_t series_id, size_t *out_count, SegmentListStatus *status,
+                                      void *(*alloc)(size_t), void (*release)(void *)) {
+    *out_count = 0;
+    *status = SEGMENT_LIST_ERROR;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return NULL;
+    }
+    ListView view;
+    bool ok = read_view(handle, series_id, &view, alloc);
+    nvs_close(handle);
+
+    SegmentInfo *segment_list = NULL;
+    if (ok) {
+        *status = view.total > 0 ? SEGMENT_LIST_OK : SEGMENT_LIST_EMPTY;
+        segment_list = view.entries;
+        *out_count = view.total;
+        view.entries = NULL;
+    }
+    release_view(&view, release);
+    return segment_list;
+}
+
+SegmentInfo *load_segment_list(uint8_t series_id, size_t *out_count) {
+    SegmentListStatus status;
+    return read_segment_list(series_id, out_count, &status, malloc, free);
+}
+
+SegmentListStatus load_segment_list_checked(uint8_t series_id, SegmentInfo **list, size_t *out_count) {
+    SegmentListStatus status;
+    *list = read_segment_list(series_id, out_count, &status, malloc, free);
+    return status;
+}
+
+SegmentInfo *load_segment_list_scratch(uint8_t series_id, size_t *out_count) {
+    SegmentListStatus status;
+    return read_segment_list(series_id, out_count, &status, mem_scratch_alloc, mem_scratch_free);
+}
+
+// ─────────────────────────────────────────────────────────────────────────────
+void get_segments_from_list(uint8_t series_id, size_t count, SegmentInfo *segments, size_t *out_count) {
+    size_t total_entries = 0;
+    SegmentInfo *segment_list = load_segment_list(series_id, &total_entries);
+    if (segment_list == NULL) {
+        *out_count = 0;
+        return;
+    }
+
+    if (count > total_entries) {
+        count = total_entries;
+    }
+
+    memcpy(segments, segment_list, count * sizeof(SegmentInfo));
+    *out_count = count;
+    TRACE_LOG("Retrieved %" PRIu32 " segments from FIFO list of series %u", (uint32_t)*out_count, series_id);
+
+    free(segment_list);
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef SEGMENT_LIST_H
+#define SEGMENT_LIST_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "segment.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/* Each series keeps a FIFO list of its stored segments, oldest first, in chunks */
+#define SEGMENT_LIST_KEY "seg_idx"          // chunks: "seg_idx<series>[.<chunk id>]"
+#define SEGMENT_LIST_HEADER_KEY "seg_hdr"   // live chunk ids in order
+#define SEGMENT_LIST_KEY_SIZE 16
+#define SEGMENT_LIST_CHUNK 8
+// ─────────────────────────────────────────────────────────────────────────────
+/* Creates the mutex and erases chunks a reset left behind; NVS must be up */
+void segment_list_init(void);
+void segment_list_key(uint8_t series_id, char *key, size_t key_len);
+// ─────────────────────────────────────────────────────────────────────────────
+bool append_segment_to_list(const SegmentInfo *info);
+void get_segments_from_list(uint8_t series_id, size_t count, SegmentInfo *segments, size_t *out_count);
+/* Replaces the whole list, committed by one header write (empties it when count is 0) */
+bool store_segment_list(uint8_t series_id, const SegmentInfo *segments, size_t count);
+/* Replaces the listed run `old_ids` with `replacements` (none removes it); false if the run changed */
+bool replace_segments_in_list(uint8_t series_id, const uint32_t *old_ids, size_t count,
+                              const SegmentInfo *replacements, size_t replacement_count);
+/* Rewrites a stored segment (its sent bitmap) only while the series still lists it; false if not */
+bool update_listed_segment(uint8_t series_id, const Segment *seg);
+/* Checks the next `budget` list entries for a stored blob and drops the ones without */
+void validate_segment_lists_step(size_t budget);
+/* Loads the whole list into a malloc'd array (caller frees); NULL if empty or on error */
+SegmentInfo *load_segment_list(uint8_t series_id, size_t *out_count);
+typedef enum {
+    SEGMENT_LIST_OK,
+    SEGMENT_LIST_EMPTY,
+    SEGMENT_LIST_ERROR,
+} SegmentListStatus;
+/* Same, for callers that must not take a failed read for an empty list */
+SegmentListStatus load_segment_list_checked(uint8_t series_id, SegmentInfo **list, size_t *out_count);
+/* Same, from the caller's request arena (see mem_pool.h); release with mem_scratch_free() */
+SegmentInfo *load_segment_list_scratch(uint8_t series_id, size_t *out_count);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // SEGMENT_LIST_H
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "subscription.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "SUBSCRIPTION";
+// ─────────────────────────────────────────────────────────────────────────────
+typedef struct {
+    bool active;
+    int id;
+    char topic[SUBSCRIPTION_TOPIC_MAX];
+    SubscriptionFilter filter;
+    int64_t expires_us;
+
+    // Pending points, published as one message
+    uint32_t pending;
+    uint64_t timestamps[SUBSCRIPTION_BATCH_MAX];
+    float values[SUBSCRIPTION_BATCH_MAX];
+    uint16_t counts[SUBSCRIPTION_BATCH_MAX];
+    int64_t first_pending_us;
+    uint32_t dropped;
+
+    // Open aggregation bucket
+    uint64_t bucket_start;
+    double bucket_sum;
+    uint16_t bucket_count;
+} Subscription;
+
+static Subscription subscriptions[SUBSCRIPTION_MAX];
+static SemaphoreHandle_t subscription_mutex = NULL;
+static query_response_sink_t subscription_sink = NULL;
+static uint32_t active_count = 0;
+static int next_id = 1;
+// ─────────────────────────────────────────────────────────────────────────────
+void subscriptions_init(query_response_sink_t sink) {
+    if (subscription_mutex == NULL) {
+        subscription_mutex = xSemaphoreCreateMutex();
+    }
+    subscription_sink = sink;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+int subscription_add(const char *response_topic, const SubscriptionFilter *filter) {
+    if (subscription_mutex == NULL || strlen(response_topic) >= SUBSCRIPTION_TOPIC_MAX) {
+        return -1;
+    }
+    xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+    Subscription *slot = NULL;
+    for (int i = 0; i < SUBSCRIPTION_MAX; i++) {
+        Subscription *s = &subscriptions[i];
+        if (s->active && s->filter.series_id == filter->series_id && strcmp(s->topic, response_topic) == 0) {
+            slot = s;   // Renewal: keep the id and whatever is pending
+            break;
+        }
+        if (!s->active && slot == NULL) {
+            slot = s;
+        }
+    }
+    if (slot == NULL) {
+        xSemaphoreGive(subscription_mutex);
+        return -1;
+    }
+    if (!slot->active) {
+        memset(slot, 0, sizeof(*slot));
+        slot->active = true;
+        slot->id = next_id++;
+        strcpy(slot->topic, response_topic);
+        __atomic_add_fetch(&active_count, 1, __ATOMIC_RELAXED);
+    } else if (slot->filter.bucket_ms != filter->bucket_ms) {
+        slot->bucket_count = 0;
+    }
+    slot->filter = *filter;
+    if (slot->filter.batch_records == 0 || slot->filter.batch_records > SUBSCRIPTION_BATCH_MAX) {
+        slot->filter.batch_records = SUBSCRIPTION_BATCH_MAX;
+    }
+    slot->expires_us = esp_timer_get_time() + (int64_t)filter->lease_ms * 1000;
+    int id = slot->id;
+    xSemaphoreGive(subscription_mutex);
+
+    ESP_LOGI(TAG, "Subscription %d: %s -> %s (batch %" PRIu32 "/%" PRIu32 " ms, bucket %" PRIu32 " ms)",
+             id, series_name(filter->series_id), response_topic, slot->filter.batch_records,
+             filter->batch_ms, filter->bucket_ms);
+    return id;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool subscription_remove(int subscription_id) {
+    if (subscription_mutex == NULL) {
+        return false;
+    }
+    bool removed = false;
+    xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+    for (int i = 0; i < SUBSCRIPTION_MAX; i++) {
+        if (subscriptions[i].active && subscriptions[i].id == subscription_id) {
+            subscriptions[i].active = false;
+            __atomic_sub_fetch(&active_count, 1, __ATOMIC_RELAXED);
+            removed = true;
+            break;
+        }
+    }
+    xSemaphoreGive(subscription_mutex);
+    return removed;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Caller holds the mutex
+static void append_point(Subscription *s, uint64_t timestamp, float value, uint16_t count) {
+    if (s->pending == SUBSCRIPTION_BATCH_MAX) {
+        s->dropped++;
+        return;
+    }
+    if (s->pending == 0) {
+        s->first_pending_us = esp_timer_get_time();
+    }
+    s->timestamps[s->pending] = timestamp;
+    s->values[s->pending] = value;
+    s->counts[s->pending] = count;
+    s->pending++;
+}
+
+void subscriptions_on_ingest(const Measurement *batch, size_t n) {
+    if (__atomic_load_n(&active_count, __ATOMIC_RELAXED) == 0 || subscription_mutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+    for (int i = 0; i < SUBSCRIPTION_MAX; i++) {
+        Subscription *s = &subscriptions[i];
+        if (!s->active) {
+            continue;
+        }
+        const SubscriptionFilter *f = &s->filter;
+        for (size_t k = 0; k < n; k++) {
+            const Measurement *m = &batch[k];
+            if (m->series_id != f->series_id
+                || (f->has_min_value && m->value < f->min_value)
+                || (f->has_max_value && m->value > f->max_value)) {
+                continue;
+            }
+            if (f->bucket_ms == 0) {
+                append_point(s, m->timestamp, m->value, 1);
+                continue;
+            }
+            uint64_t bucket_start = m->timestamp - m->timestamp % f->bucket_ms;
+            if (s->bucket_count > 0 && bucket_start != s->bucket_start) {
+                append_point(s, s->bucket_start, (float)(s->bucket_sum / s->bucket_count), s->bucket_count);
+                s->bucket_count = 0;
+            }
+            if (s->bucket_count == 0) {
+                s->bucket_start = bucket_start;
+                s->bucket_sum = 0;
+            }
+            s->bucket_sum += m->value;
+            if (s->bucket_count < UINT16_MAX) {
+                s->bucket_count++;
+            }
+        }
+    }
+    xSemaphoreGive(subscription_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void publish_batch(int id, uint8_t series_id, const char *topic, uint32_t bucket_ms,
+                          const uint64_t *timestamps, const float *values, const uint16_t *counts,
+                          uint32_t pending, uint32_t dropped) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "subscription", id);
+    cJSON_AddStringToObject(json, "series", series_name(series_id));
+    cJSON *ts_array = cJSON_AddArrayToObject(json, "timestamps");
+    cJSON *value_array = cJSON_AddArrayToObject(json, "values");
+    cJSON *count_array = bucket_ms ? cJSON_AddArrayToObject(json, "counts") : NULL;
+    for (uint32_t i = 0; i < pending; i++) {
+        cJSON_AddItemToArray(ts_array, cJSON_CreateNumber(timestamps[i]));
+        cJSON_AddItemToArray(value_array, cJSON_CreateNumber(values[i]));
+        if (count_array) {
+            cJSON_AddItemToArray(count_array, cJSON_CreateNumber(counts[i]));
+        }
+    }
+    if (bucket_ms) {
+        cJSON_AddNumberToObject(json, "bucket_ms", bucket_ms);
+    }
+    if (dropped) {
+        cJSON_AddNumberToObject(json, "dropped", dropped);
+    }
+    char *payload = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (payload == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON payload for subscription %d", id);
+        return;
+    }
+    if (subscription_sink == NULL || subscription_sink(topic, payload) == -1) {
+        ESP_LOGW(TAG, "Failed to publish %" PRIu32 " points for subscription %d", pending, id);
+    }
+    cJSON_free(payload);
+}
+
+void subscriptions_flush(void) {
+    if (subscription_mutex == NULL || __atomic_load_n(&active_count, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    // One batch is copied out at a time so the ingest path never waits on the broker
+    static uint64_t timestamps[SUBSCRIPTION_BATCH_MAX];
+    static float values[SUBSCRIPTION_BATCH_MAX];
+    static uint16_t counts[SUBSCRIPTION_BATCH_MAX];
+    char topic[SUBSCRIPTION_TOPIC_MAX];
+
+    for (int i = 0; i < SUBSCRIPTION_MAX; i++) {
+        xSemaphoreTake(subscription_mutex, portMAX_DELAY);
+        Subscription *s = &subscriptions[i];
+        if (!s->active) {
+            xSemaphoreGive(subscription_mutex);
+            continue;
+        }
+        int64_t now_us = esp_timer_get_time();
+        bool expired = now_us >= s->expires_us;
+        bool due = s->pending > 0 && (expired || s->pending >= s->filter.batch_records
+                                      || now_us - s->first_pending_us >= (int64_t)s->filter.batch_ms * 1000);
+        int id = s->id;
+        uint8_t series_id = s->filter.series_id;
+        uint32_t bucket_ms = s->filter.bucket_ms;
+        uint32_t pending = 0, dropped = 0;
+        if (due) {
+            pending = s->pending;
+            dropped = s->dropped;
+            memcpy(timestamps, s->timestamps, pending * sizeof(uint64_t));
+            memcpy(values, s->values, pending * sizeof(float));
+            memcpy(counts, s->counts, pending * sizeof(uint16_t));
+            s->pending = 0;
+            s->dropped = 0;
+        }
+        if (expired) {
+            s->active = false;
+            __atomic_sub_fetch(&active_count, 1, __ATOMIC_RELAXED);
+        }
+        strcpy(topic, s->topic);
+        xSemaphoreGive(subscription_mutex);
+
+        if (due) {
+            publish_batch(id, series_id, topic, bucket_ms, timestamps, values, counts, pending, dropped);
+        }
+        if (expired) {
+            ESP_LOGI(TAG, "Subscription %d expired", id);
+            char payload[64];
+            snprintf(payload, sizeof(payload), "{\"subscription\":%d,\"expired\":true}", id);
+            if (subscription_sink) {
+                subscription_sink(topic, payload);
+            }
+        }
+    }
+}
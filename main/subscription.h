@@ -0,0 +1,46 @@
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "measurement.h"
+#include "query_handler.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Live queries registered with the "subscribe" action. Newly ingested samples
+ * that pass a subscription's filter are batched in RAM and pushed to its
+ * response topic by subscriptions_flush(), so dashboards stop polling
+ * get_data_range:
+ *   {"subscription":1,"series":"temperature","timestamps":[...],"values":[...]}
+ * With bucket_ms set, each point is the mean of one bucket (stamped with the
+ * bucket start) and a "counts" array is added; a bucket is published once a
+ * later sample closes it. "dropped" reports samples lost to a full batch.
+ * Subscriptions expire after lease_ms unless renewed by subscribing again.
+ */
+#define SUBSCRIPTION_MAX 4
+#define SUBSCRIPTION_BATCH_MAX 32
+#define SUBSCRIPTION_TOPIC_MAX 64
+
+typedef struct {
+    uint8_t series_id;
+    uint32_t batch_records;   // Publish once this many points are pending (1..SUBSCRIPTION_BATCH_MAX)
+    uint32_t batch_ms;        // ...or once the oldest pending point is this old
+    uint32_t bucket_ms;       // 0 = raw samples
+    uint32_t lease_ms;
+    bool has_min_value;
+    bool has_max_value;
+    float min_value;
+    float max_value;
+} SubscriptionFilter;
+// ─────────────────────────────────────────────────────────────────────────────
+void subscriptions_init(query_response_sink_t sink);
+/* Registers or renews (same topic and series) a subscription; returns its id, or -1 if the table is full */
+int subscription_add(const char *response_topic, const SubscriptionFilter *filter);
+bool subscription_remove(int subscription_id);
+/* Ingest hook; cheap when nobody is subscribed */
+void subscriptions_on_ingest(const Measurement *batch, size_t n);
+/* Publishes due batches and drops expired subscriptions; called periodically */
+void subscriptions_flush(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // SUBSCRIPTION_H
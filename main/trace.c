@@ -0,0 +1,56 @@
+#include "trace.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include <stdlib.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static TraceRecord ring[CONFIG_TRACE_RING_SIZE];
+static uint32_t ring_head;  // total records ever written
+// ─────────────────────────────────────────────────────────────────────────────
+void trace_record(TraceEvent event, uint32_t a, uint32_t b) {
+    // Claim a slot without a lock; a reader racing a writer may see one torn
+    // record, which is acceptable for a diagnostic log
+    uint32_t slot = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED) % CONFIG_TRACE_RING_SIZE;
+    TraceRecord *r = &ring[slot];
+    r->time_us = (uint32_t)esp_timer_get_time();
+    r->event = event;
+    r->a = a;
+    r->b = b;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+size_t trace_snapshot(TraceRecord *out, size_t max) {
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    size_t available = head < CONFIG_TRACE_RING_SIZE ? head : CONFIG_TRACE_RING_SIZE;
+    size_t n = available < max ? available : max;
+
+    // Newest n records, oldest first
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ring[(head - n + i) % CONFIG_TRACE_RING_SIZE];
+    }
+    return n;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+char *trace_to_json(void) {
+    TraceRecord *records = malloc(sizeof(TraceRecord) * CONFIG_TRACE_RING_SIZE);
+    if (records == NULL) {
+        return NULL;
+    }
+    size_t n = trace_snapshot(records, CONFIG_TRACE_RING_SIZE);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "n", __atomic_load_n(&ring_head, __ATOMIC_RELAXED));
+    cJSON *list = cJSON_AddArrayToObject(json, "t");
+    for (size_t i = 0; i < n; i++) {
+        cJSON *rec = cJSON_CreateArray();
+        cJSON_AddItemToArray(rec, cJSON_CreateNumber(records[i].time_us));
+        cJSON_AddItemToArray(rec, cJSON_CreateNumber(records[i].event));
+        cJSON_AddItemToArray(rec, cJSON_CreateNumber(records[i].a));
+        cJSON_AddItemToArray(rec, cJSON_CreateNumber(records[i].b));
+        cJSON_AddItemToArray(list, rec);
+    }
+    free(records);
+
+    char *payload = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    return payload;
+}
+// ─────────────────────────────────────────────────────────────────────────────
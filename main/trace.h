@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "esp_log.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Hot-path tracing. Each module sets TRACE_LEVEL to its CONFIG_TRACE_LEVEL_*
+ * value before including this header:
+ *   TRACE_LEVEL_OFF     - TRACE()/TRACE_LOG() compile to nothing
+ *   TRACE_LEVEL_RING    - TRACE() stores a 16-byte record in the binary ring
+ *   TRACE_LEVEL_VERBOSE - additionally prints TRACE_LOG() text on the console
+ * The level is a constant, so disabled calls leave no formatting or argument
+ * evaluation in the binary.
+ */
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_RING 1
+#define TRACE_LEVEL_VERBOSE 2
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_OFF
+#endif
+
+typedef enum {
+    TRACE_INGEST = 1,       // a = series, b = timestamp (low 32 bits)
+    TRACE_INGEST_BATCH,     // a = accepted, b = requested
+    TRACE_EVICT,            // a = series, b = timestamp (low 32 bits)
+    TRACE_FLUSH,            // a = series, b = segment id
+    TRACE_BUFFER_LOOKUP,    // a = series, b = matches
+    TRACE_SEGMENT_STORE,    // a = segment id, b = blob bytes
+    TRACE_SEGMENT_LOAD,     // a = segment id, b = blob bytes
+    TRACE_SEGMENT_ERASE,    // a = segment id
+    TRACE_FLASH_RANGE,      // a = series, b = matches
+    TRACE_LIST_APPEND,      // a = series, b = segment id
+    TRACE_LIST_REMOVE,      // a = series, b = removed
+    TRACE_QUERY,            // a = series, b = results
+} TraceEvent;
+
+typedef struct {
+    uint32_t time_us;   // esp_timer time, wraps every ~71 minutes
+    uint32_t event;
+    uint32_t a;
+    uint32_t b;
+} TraceRecord;
+// ─────────────────────────────────────────────────────────────────────────────
+void trace_record(TraceEvent event, uint32_t a, uint32_t b);
+/* Oldest-first copy of up to max records; returns the number copied */
+size_t trace_snapshot(TraceRecord *out, size_t max);
+/* JSON {"n":total,"t":[[time_us,event,a,b],...]} of the ring contents; release with cJSON_free() */
+char *trace_to_json(void);
+// ─────────────────────────────────────────────────────────────────────────────
+#define TRACE(event, a, b) do { \
+        if (TRACE_LEVEL >= TRACE_LEVEL_RING) trace_record((event), (uint32_t)(a), (uint32_t)(b)); \
+    } while (0)
+
+#define TRACE_LOG(...) do { \
+        if (TRACE_LEVEL >= TRACE_LEVEL_VERBOSE) ESP_LOGI(TAG, __VA_ARGS__); \
+    } while (0)
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // TRACE_H
@@ -0,0 +1,376 @@
+#include "wal.h"
+#include "config.h"
+#include "buffer.h"
+#include "nvs_utils.h"
+#include "segment_list.h"
+#include "nvs_flash.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+// ─────────────────────────────────────────────────────────────────────────────
+static const char *TAG = "WAL";
+#define NAMESPACE "storage"
+// ─────────────────────────────────────────────────────────────────────────────
+/* A chunk on flash, described by the newest sample it holds per series (0 = none) */
+typedef struct {
+    uint32_t seq;
+    uint64_t max_ts[SERIES_COUNT];
+    uint8_t late_mask;   // series with late samples not yet merged into segments
+} WalChunk;
+
+/* Journaled dirty_bit of a late sample: replayed even though it is older than the checkpoint */
+#define WAL_RECORD_LATE 0x80
+
+static SemaphoreHandle_t wal_mutex = NULL;
+static Measurement pending[CONFIG_WAL_GROUP_RECORDS];
+static size_t pending_count;
+static WalChunk chunks[CONFIG_WAL_MAX_CHUNKS];  // oldest first
+static size_t chunk_count;
+static uint32_t next_seq = 1;
+static uint64_t persisted_ts[SERIES_COUNT];
+static bool replaying;
+// ─────────────────────────────────────────────────────────────────────────────
+static void wal_key(uint32_t seq, char *key, size_t key_len) {
+    snprintf(key, key_len, WAL_KEY_PREFIX "%08" PRIx32, seq);
+}
+
+// False if the chunk is still on flash; the caller keeps tracking it and retries later
+static bool erase_chunk(uint32_t seq) {
+    char key[16];
+    wal_key(seq, key, sizeof(key));
+
+    nvs_handle_t handle;
+    if (nvs_open(NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = storage_erase_key(handle, key);
+    if (err == ESP_OK) {
+        err = storage_commit(handle);
+    }
+    nvs_close(handle);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Failed to erase journal chunk %s: %s", key, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+static bool chunk_covered(const WalChunk *c) {
+    if (c->late_mask != 0) {
+        return false;
+    }
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        if (c->max_ts[s] > persisted_ts[s]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Erases every chunk whose samples are all in segments. Caller holds the mutex.
+static void retire_chunks_locked(void) {
+    size_t kept = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        if (!chunk_covered(&chunks[i]) || !erase_chunk(chunks[i].seq)) {
+            chunks[kept++] = chunks[i];
+        }
+    }
+    chunk_count = kept;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void wal_init(void) {
+    if (wal_mutex == NULL) {
+        wal_mutex = xSemaphoreCreateMutex();
+    }
+    pending_count = 0;
+    chunk_count = 0;
+    next_seq = 1;
+
+    // Nothing at or before the last stored segment needs the journal
+    for (uint8_t s = 0; s < SERIES_COUNT; s++) {
+        size_t count = 0;
+        SegmentInfo *list = load_segment_list(s, &count);
+        persisted_ts[s] = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (list[i].max_ts > persisted_ts[s]) {
+                persisted_ts[s] = list[i].max_ts;
+            }
+        }
+        free(list);
+    }
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static int compare_chunks(const void *a, const void *b) {
+    uint32_t x = ((const WalChunk *)a)->seq, y = ((const WalChunk *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+static bool load_chunk(nvs_handle_t handle, const char *key, WalChunkHeader *hdr, Measurement **records) {
+    size_t size = 0;
+    if (nvs_get_blob(handle, key, NULL, &size) != ESP_OK || size < sizeof(WalChunkHeader)) {
+        return false;
+    }
+    uint8_t *blob = malloc(size);
+    if (blob == NULL || nvs_get_blob(handle, key, blob, &size) != ESP_OK) {
+        free(blob);
+        return false;
+    }
+    memcpy(hdr, blob, sizeof(*hdr));
+    if (hdr->version != WAL_CHUNK_VERSION ||
+        size != sizeof(*hdr) + (size_t)hdr->count * sizeof(Measurement)) {
+        free(blob);
+        return false;
+    }
+    *records = malloc(hdr->count * sizeof(Measurement) + 1);
+    if (*records == NULL) {
+        free(blob);
+        return false;
+    }
+    memcpy(*records, blob + sizeof(*hdr), hdr->count * sizeof(Measurement));
+    free(blob);
+    return true;
+}
+
+size_t wal_recover(void) {
+    // Find every chunk key first; NVS must not change under the iterator. Chunks left
+    // behind by failed erases can outnumber CONFIG_WAL_MAX_CHUNKS, so the table grows.
+    WalChunk *found = NULL;
+    size_t seq_count = 0, found_cap = 0;
+    nvs_iterator_t it = NULL;
+    esp_err_t res = nvs_entry_find(NVS_DEFAULT_PART_NAME, NAMESPACE, NVS_TYPE_BLOB, &it);
+    while (res == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        if (strncmp(info.key, WAL_KEY_PREFIX, strlen(WAL_KEY_PREFIX)) == 0) {
+            if (seq_count == found_cap) {
+                size_t cap = found_cap ? found_cap * 2 : CONFIG_WAL_MAX_CHUNKS;
+                WalChunk *grown = realloc(found, cap * sizeof(WalChunk));
+                if (grown == NULL) {
+                    ESP_LOGE(TAG, "Malloc fail listing journal chunks; replaying the first %u",
+                             (unsigned)seq_count);
+                    break;
+                }
+                found = grown;
+                found_cap = cap;
+            }
+            found[seq_count++].seq = (uint32_t)strtoul(info.key + strlen(WAL_KEY_PREFIX), NULL, 16);
+        }
+        res = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    if (seq_count == 0) {
+        free(found);
+        return 0;
+    }
+    qsort(found, seq_count, sizeof(WalChunk), compare_chunks);
+
+    nvs_handle_t handle;
+    if (nvs_open(NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS for recovery");
+        free(found);
+        return 0;
+    }
+
+    // Replay oldest first without journaling again: the chunks stay on flash
+    // and are retired by the checkpoints of the segments they end up in
+    size_t replayed = 0;
+    replaying = true;
+    for (size_t i = 0; i < seq_count; i++) {
+        char key[16];
+        WalChunkHeader hdr;
+        Measurement *records = NULL;
+        wal_key(found[i].seq, key, sizeof(key));
+        memset(found[i].max_ts, 0, sizeof(found[i].max_ts));
+        found[i].late_mask = 0;
+
+        if (!load_chunk(handle, key, &hdr, &records)) {
+            ESP_LOGW(TAG, "Skipping unreadable journal chunk %s", key);
+            continue;
+        }
+        for (uint16_t r = 0; r < hdr.count; r++) {
+            Measurement *m = &records[r];
+            bool late = m->dirty_bit == WAL_RECORD_LATE;
+            if (m->series_id >= SERIES_COUNT || (m->timestamp <= persisted_ts[m->series_id] && !late)) {
+                continue;
+            }
+            if (late) {
+                // Merging again is harmless if it already happened: stored timestamps are overwritten
+                found[i].late_mask |= 1u << m->series_id;
+            }
+            if (m->timestamp > found[i].max_ts[m->series_id]) {
+                found[i].max_ts[m->series_id] = m->timestamp;
+            }
+            m->dirty_bit = DIRTY_BIT_BUFFER_ONLY;
+            buffer_restore_measurements(m, 1);
+            replayed++;
+        }
+        free(records);
+    }
+    replaying = false;
+    nvs_close(handle);
+
+    xSemaphoreTake(wal_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < seq_count; i++) {
+        if (chunk_count < CONFIG_WAL_MAX_CHUNKS) {
+            chunks[chunk_count++] = found[i];
+        } else if (!erase_chunk(found[i].seq)) {
+            // Its samples are in the buffer now; if it survives, the next boot replays it again
+            ESP_LOGW(TAG, "Journal chunk %" PRIu32 " left untracked", found[i].seq);
+        }
+        if (found[i].seq >= next_seq) {
+            next_seq = found[i].seq + 1;
+        }
+    }
+    retire_chunks_locked();
+    xSemaphoreGive(wal_mutex);
+    free(found);
+
+    ESP_LOGW(TAG, "Recovered %u samples from %u journal chunks", (unsigned)replayed, (unsigned)seq_count);
+    return replayed;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+// Writes the pending group as the next chunk. Caller holds the mutex.
+static bool commit_locked(void) {
+    if (pending_count == 0) {
+        return true;
+    }
+
+    WalChunk chunk = { .seq = next_seq };
+    for (size_t i = 0; i < pending_count; i++) {
+        uint8_t s = pending[i].series_id;
+        if (pending[i].timestamp > chunk.max_ts[s]) {
+            chunk.max_ts[s] = pending[i].timestamp;
+        }
+        if (pending[i].dirty_bit == WAL_RECORD_LATE) {
+            chunk.late_mask |= 1u << s;
+        }
+    }
+
+    size_t blob_size = sizeof(WalChunkHeader) + pending_count * sizeof(Measurement);
+    uint8_t *blob = malloc(blob_size);
+    if (blob == NULL) {
+        ESP_LOGE(TAG, "Malloc fail for journal chunk (%u bytes)", (unsigned)blob_size);
+        return false;
+    }
+    WalChunkHeader hdr = { .version = WAL_CHUNK_VERSION, .count = (uint16_t)pending_count, .seq = chunk.seq };
+    memcpy(blob, &hdr, sizeof(hdr));
+    memcpy(blob + sizeof(hdr), pending, pending_count * sizeof(Measurement));
+
+    char key[16];
+    wal_key(chunk.seq, key, sizeof(key));
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = storage_set_blob(handle, key, blob, blob_size);
+        if (err == ESP_OK) {
+            err = storage_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    free(blob);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write journal chunk %s: %s", key, esp_err_to_name(err));
+        return false;
+    }
+
+    if (chunk_count == CONFIG_WAL_MAX_CHUNKS) {
+        // Segments are not keeping up (flash errors); give up the oldest chunk. If even
+        // that cannot be erased it stays on flash and the next boot still finds it.
+        ESP_LOGW(TAG, "Journal full; dropping chunk %" PRIu32, chunks[0].seq);
+        erase_chunk(chunks[0].seq);
+        memmove(&chunks[0], &chunks[1], (chunk_count - 1) * sizeof(WalChunk));
+        chunk_count--;
+    }
+    chunks[chunk_count++] = chunk;
+    next_seq++;
+    pending_count = 0;
+    return true;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+static void append_record(const Measurement *m, uint8_t marker) {
+    if (wal_mutex == NULL || replaying) {
+        return;
+    }
+
+    xSemaphoreTake(wal_mutex, portMAX_DELAY);
+    pending[pending_count] = *m;
+    pending[pending_count++].dirty_bit = marker;
+    if (pending_count == CONFIG_WAL_GROUP_RECORDS) {
+        commit_locked();
+        // On a write error keep the newest samples and retry at the next commit
+        if (pending_count == CONFIG_WAL_GROUP_RECORDS) {
+            memmove(&pending[0], &pending[1], (pending_count - 1) * sizeof(Measurement));
+            pending_count--;
+        }
+    }
+    xSemaphoreGive(wal_mutex);
+}
+
+void wal_append(const Measurement *m) {
+    append_record(m, DIRTY_BIT_BUFFER_ONLY);
+}
+
+void wal_append_late(const Measurement *m) {
+    append_record(m, WAL_RECORD_LATE);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+bool wal_commit(void) {
+    if (wal_mutex == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(wal_mutex, portMAX_DELAY);
+    bool ok = commit_locked();
+    xSemaphoreGive(wal_mutex);
+    return ok;
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void wal_checkpoint(uint8_t series_id, uint64_t persisted) {
+    if (wal_mutex == NULL || series_id >= SERIES_COUNT) {
+        return;
+    }
+
+    xSemaphoreTake(wal_mutex, portMAX_DELAY);
+    if (persisted > persisted_ts[series_id]) {
+        persisted_ts[series_id] = persisted;
+    }
+
+    // Samples already in a segment need not be journaled at all; late ones are older but are not in one yet
+    size_t kept = 0;
+    for (size_t i = 0; i < pending_count; i++) {
+        if (pending[i].series_id != series_id || pending[i].timestamp > persisted_ts[series_id]
+            || pending[i].dirty_bit == WAL_RECORD_LATE) {
+            pending[kept++] = pending[i];
+        }
+    }
+    pending_count = kept;
+
+    retire_chunks_locked();
+    xSemaphoreGive(wal_mutex);
+}
+// ─────────────────────────────────────────────────────────────────────────────
+void wal_checkpoint_late(uint8_t series_id) {
+    if (wal_mutex == NULL || series_id >= SERIES_COUNT) {
+        return;
+    }
+
+    xSemaphoreTake(wal_mutex, portMAX_DELAY);
+    size_t kept = 0;
+    for (size_t i = 0; i < pending_count; i++) {
+        if (pending[i].series_id != series_id || pending[i].dirty_bit != WAL_RECORD_LATE) {
+            pending[kept++] = pending[i];
+        }
+    }
+    pending_count = kept;
+    for (size_t i = 0; i < chunk_count; i++) {
+        chunks[i].late_mask &= (uint8_t)~(1u << series_id);
+    }
+
+    retire_chunks_locked();
+    xSemaphoreGive(wal_mutex);
+}
@@ -0,0 +1,39 @@
+#ifndef WAL_H
+#define WAL_H
+// ─────────────────────────────────────────────────────────────────────────────
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "measurement.h"
+// ─────────────────────────────────────────────────────────────────────────────
+/*
+ * Write-ahead journal for samples that only live in the RAM ring. New samples
+ * collect in a RAM group and are written as one append-only chunk blob
+ * ("wal_<seq>") per group commit, so a reset loses at most one commit window.
+ * A chunk is erased once every sample in it is covered by a stored segment.
+ */
+#define WAL_KEY_PREFIX "wal_"
+#define WAL_CHUNK_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t count;
+    uint32_t seq;
+} WalChunkHeader;   // followed by `count` Measurement records
+// ─────────────────────────────────────────────────────────────────────────────
+void wal_init(void);
+/* Re-adds journaled samples newer than each series' last segment to the buffer; returns how many */
+size_t wal_recover(void);
+/* Queues a buffer-only sample for the next group commit; commits at once if the group is full */
+void wal_append(const Measurement *m);
+/* Writes the pending group as one chunk; returns false on a write error */
+bool wal_commit(void);
+/* Journals a sample older than the series' checkpoint, held until wal_checkpoint_late() */
+void wal_append_late(const Measurement *m);
+/* Everything of the series up to persisted_ts is in a segment now; retires covered chunks */
+void wal_checkpoint(uint8_t series_id, uint64_t persisted_ts);
+/* Every late sample journaled for the series so far has been merged into its segments */
+void wal_checkpoint_late(uint8_t series_id);
+// ─────────────────────────────────────────────────────────────────────────────
+#endif // WAL_H
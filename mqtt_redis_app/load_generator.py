@@ -0,0 +1,150 @@
+
+import argparse
+import json
+import random
+import threading
+import time
+import paho.mqtt.client as mqtt
+
+
+# Simulates a fleet of devices publishing on esp32/<device>/temperature, like
+# firmware built with CONFIG_DEVICE_ID, and reports the sustained publish rate.
+# With --influxdb-url it also counts what the bridge actually stored.
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Fleet load generator for the edge bridge")
+    parser.add_argument('--broker', default='localhost')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--username', default='edge_device')
+    parser.add_argument('--password', default='pass101')
+    parser.add_argument('--devices', type=int, default=200, help="simulated devices")
+    parser.add_argument('--rate', type=float, default=1.0, help="points per second per device")
+    parser.add_argument('--duration', type=float, default=60, help="seconds to publish")
+    parser.add_argument('--connections', type=int, default=20,
+                        help="MQTT connections the devices are spread over")
+    parser.add_argument('--qos', type=int, default=1, choices=(0, 1))
+    parser.add_argument('--run-id', default=f"load{int(time.time())}",
+                        help="device id prefix, so a run's points can be counted")
+    parser.add_argument('--influxdb-url', default=None)
+    parser.add_argument('--influxdb-token', default='my-token')
+    parser.add_argument('--influxdb-org', default='my-org')
+    parser.add_argument('--influxdb-bucket', default='my-bucket')
+    parser.add_argument('--settle', type=float, default=10,
+                        help="seconds to let the bridge drain before counting")
+    return parser.parse_args()
+
+
+class Connection:
+    def __init__(self, args, index, devices):
+        self.args = args
+        self.devices = devices
+        self.sent = 0
+        self.acked = 0
+        self.lock = threading.Lock()
+        self.client = mqtt.Client(client_id=f"{args.run_id}-{index}", protocol=mqtt.MQTTv311)
+        self.client.username_pw_set(args.username, args.password)
+        self.client.on_publish = self.on_publish
+        # Keep up with bursts instead of queueing unboundedly in paho
+        self.client.max_inflight_messages_set(1000)
+        self.client.connect(args.broker, args.port, 60)
+        self.client.loop_start()
+
+    def on_publish(self, client, userdata, mid):
+        with self.lock:
+            self.acked += 1
+
+    def run(self, start, stop):
+        # Every device publishes `rate` points per second, spread evenly over the connection
+        interval = 1.0 / (self.args.rate * len(self.devices))
+        next_at = start + random.random() * interval
+        last_ts = {}
+        i = 0
+        while next_at < stop:
+            delay = next_at - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            device = self.devices[i % len(self.devices)]
+            # Distinct per device, so every point is stored and counted
+            timestamp = max(int(time.time() * 1000), last_ts.get(device, 0) + 1)
+            last_ts[device] = timestamp
+            payload = json.dumps({
+                'timestamp': timestamp,
+                'series': 'temperature',
+                'value': round(20 + 5 * random.random(), 1),
+            })
+            self.client.publish(f"esp32/{device}/temperature", payload, qos=self.args.qos)
+            with self.lock:
+                self.sent += 1
+            i += 1
+            next_at += interval
+
+    def close(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+def count_stored(args, start_ns, stop_ns):
+    from influxdb_client import InfluxDBClient
+    client = InfluxDBClient(url=args.influxdb_url, token=args.influxdb_token, org=args.influxdb_org)
+    query = f'''
+        from(bucket: "{args.influxdb_bucket}")
+        |> range(start: time(v: {start_ns}), stop: time(v: {stop_ns}))
+        |> filter(fn: (r) => r["_measurement"] == "temperature_esp")
+        |> filter(fn: (r) => r["device"] =~ /^{args.run_id}-/)
+        |> group()
+        |> count()
+        '''
+    total = 0
+    for table in client.query_api().query(query):
+        for record in table.records:
+            total += record.get_value()
+    client.close()
+    return total
+
+
+def main():
+    args = parse_args()
+    devices = [f"{args.run_id}-{d:04d}" for d in range(args.devices)]
+    connections = [Connection(args, c, devices[c::args.connections])
+                   for c in range(min(args.connections, args.devices))]
+
+    wall_start_ns = time.time_ns()
+    start = time.monotonic() + 1
+    stop = start + args.duration
+    threads = [threading.Thread(target=conn.run, args=(start, stop), daemon=True) for conn in connections]
+    for thread in threads:
+        thread.start()
+
+    last_sent = 0
+    while any(thread.is_alive() for thread in threads):
+        time.sleep(1)
+        sent = sum(conn.sent for conn in connections)
+        acked = sum(conn.acked for conn in connections)
+        print(f"sent {sent} ({sent - last_sent}/s), acked {acked}")
+        last_sent = sent
+    elapsed = time.monotonic() - start
+    time.sleep(2)
+    for conn in connections:
+        conn.close()
+
+    sent = sum(conn.sent for conn in connections)
+    acked = sum(conn.acked for conn in connections)
+    report = {
+        'devices': args.devices,
+        'connections': len(connections),
+        'target_points_per_sec': args.devices * args.rate,
+        'sent': sent,
+        'acked': acked,
+        'published_points_per_sec': round(sent / elapsed, 1),
+    }
+    if args.influxdb_url:
+        print(f"Waiting {args.settle} s for the bridge to drain...")
+        time.sleep(args.settle)
+        stored = count_stored(args, wall_start_ns, time.time_ns() + 60 * 10**9)
+        report['stored'] = stored
+        report['stored_points_per_sec'] = round(stored / elapsed, 1)
+    print("LOAD " + json.dumps(report))
+
+
+if __name__ == "__main__":
+    main()
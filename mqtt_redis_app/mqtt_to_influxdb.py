@@ -1,26 +1,64 @@
 
 import os
+import multiprocessing
+import socket
 import paho.mqtt.client as mqtt
 import json
+import queue
+import re
+import threading
+import time
+import urllib3
+from collections import OrderedDict
 from influxdb_client import InfluxDBClient, Point, WritePrecision
 from influxdb_client.client.write_api import SYNCHRONOUS
+from influxdb_client.rest import ApiException
 from datetime import datetime, timezone
 
 
 
-def main():
+def main(worker=0):
     # Load settings from environment variables
     MQTT_BROKER = os.getenv('MQTT_BROKER', 'localhost')
     MQTT_PORT = int(os.getenv('MQTT_PORT', 1883))
     MQTT_PUBLISH_TOPIC = 'esp32/temperature'  # Remains the same
     MQTT_REQUEST_TOPIC = 'edge/measurement/request'  # Updated to match ESP32
     MQTT_RESPONSE_TOPIC = 'esp32/measurement/response'  # Updated to match ESP32
+    # Fleet topics carry the device id as the second level; the legacy topics
+    # above are stored under LEGACY_DEVICE
+    DEVICE_PUBLISH_TOPIC = 'esp32/+/temperature'
+    DEVICE_REQUEST_TOPIC = 'edge/+/measurement/request'
+    DEVICE_RESPONSE_TOPIC = 'esp32/{device}/measurement/response'
+    LEGACY_DEVICE = os.getenv('LEGACY_DEVICE_ID', 'esp32')
+    # Device ids end up in tags and Flux filters, so only plain names are accepted
+    DEVICE_ID_PATTERN = re.compile(r'^[A-Za-z0-9_-]+$')
+    # Workers in the same group share the subscriptions (MQTT v5 $share); empty disables
+    SHARED_GROUP = os.getenv('MQTT_SHARED_GROUP', 'bridge')
+    VERBOSE = os.getenv('BRIDGE_VERBOSE', '1') == '1'
+    KNOWN_SERIES = ('temperature', 'humidity')  # Must match series_name() in the firmware
 
     INFLUXDB_URL = os.getenv('INFLUXDB_URL', 'http://influxdb:8086')
     INFLUXDB_TOKEN = os.getenv('INFLUXDB_TOKEN', 'my-token')
     INFLUXDB_ORG = os.getenv('INFLUXDB_ORG', 'my-org')
     INFLUXDB_BUCKET = os.getenv('INFLUXDB_BUCKET', 'my-bucket')
 
+    # Points are written by a separate thread in batches so a slow InfluxDB
+    # never stalls the MQTT network loop
+    BATCH_SIZE = int(os.getenv('INFLUXDB_BATCH_SIZE', 500))
+    FLUSH_INTERVAL = int(os.getenv('INFLUXDB_FLUSH_INTERVAL_MS', 1000)) / 1000
+    QUEUE_SIZE = int(os.getenv('INFLUXDB_QUEUE_SIZE', 20000))
+    # How long on_message may block on a full queue before the point is dropped;
+    # blocking stops paho reading, which pushes back on the broker
+    BACKPRESSURE_TIMEOUT = float(os.getenv('INFLUXDB_BACKPRESSURE_TIMEOUT_S', 10))
+    DEDUP_WINDOW = int(os.getenv('DEDUP_WINDOW', 8192))
+    RETRY_DELAY_MAX = 30
+
+    # Range requests: one Flux query per window, answered in pages
+    RANGE_PAGE_SIZE = int(os.getenv('RANGE_PAGE_SIZE', 200))
+    RANGE_MAX_POINTS = int(os.getenv('RANGE_MAX_POINTS', 20000))
+    RANGE_CACHE_ENTRIES = int(os.getenv('RANGE_CACHE_ENTRIES', 16))
+    RANGE_CACHE_TTL = float(os.getenv('RANGE_CACHE_TTL_S', 60))
+
     # Initialize InfluxDB client
     try:
         influxdb_client = InfluxDBClient(
@@ -30,26 +68,117 @@ def main():
     except Exception as e:
         print(f"Failed to connect to InfluxDB: {e}")
 
-    # Track last stored timestamp and temperature to avoid duplicates
-    last_timestamp = None
-    last_temperature = None
+    # Recently queued (device, series, timestamp) -> value, oldest first; offload retries
+    # and several devices replaying the same data arrive as exact repeats
+    recent_points = OrderedDict()
+    point_queue = queue.Queue(maxsize=QUEUE_SIZE)
+    dropped_points = 0
+
+    def is_duplicate(device, series, timestamp, value):
+        key = (device, series, timestamp)
+        if recent_points.get(key) == value:
+            recent_points.move_to_end(key)
+            return True
+        recent_points[key] = value
+        recent_points.move_to_end(key)
+        if len(recent_points) > DEDUP_WINDOW:
+            recent_points.popitem(last=False)
+        return False
+
+    # Batches InfluxDB refused as invalid; only the writer thread touches it
+    rejected_points = 0
+
+    def is_transient(error):
+        # A 4xx other than 429 (bad point, auth, missing bucket) fails the same way
+        # every time; only an overloaded server or the connection is worth waiting for
+        if isinstance(error, ApiException):
+            return error.status is None or error.status == 429 or error.status >= 500
+        return isinstance(error, (OSError, urllib3.exceptions.HTTPError))
+
+    def write_batch(batch):
+        # Retries transient failures until InfluxDB takes the batch; meanwhile the
+        # queue fills and on_message starts blocking
+        nonlocal rejected_points
+        delay = 1
+        while True:
+            try:
+                write_api.write(bucket=INFLUXDB_BUCKET, org=INFLUXDB_ORG, record=batch)
+                print(f"Stored {len(batch)} points in InfluxDB")
+                return
+            except Exception as e:
+                if not is_transient(e):
+                    rejected_points += len(batch)
+                    print(f"InfluxDB rejected {len(batch)} points, skipping them "
+                          f"({rejected_points} rejected so far): {e}")
+                    return
+                print(f"Error writing {len(batch)} points to InfluxDB: {e}; retrying in {delay} s")
+                time.sleep(delay)
+                delay = min(delay * 2, RETRY_DELAY_MAX)
+
+    def writer_loop():
+        batch = []
+        deadline = None
+        while True:
+            timeout = None if deadline is None else max(0, deadline - time.monotonic())
+            try:
+                point = point_queue.get(timeout=timeout)
+            except queue.Empty:
+                point = None
+            if point is not None:
+                if not batch:
+                    deadline = time.monotonic() + FLUSH_INTERVAL
+                batch.append(point)
+            if batch and (len(batch) >= BATCH_SIZE or time.monotonic() >= deadline):
+                write_batch(batch)
+                batch = []
+                deadline = None
+
+    threading.Thread(target=writer_loop, name="influx-writer", daemon=True).start()
+
+    # (device, series, start, end) -> (fetched_at, [(timestamp, value), ...]), oldest
+    # first; device None spans every device. Only touched from the MQTT thread, and
+    # per worker, so points taken by another worker only age out via the TTL.
+    range_cache = OrderedDict()
+
+    def cached_range(device, series, start, end):
+        now = time.monotonic()
+        for key in list(range_cache):
+            fetched_at, rows = range_cache[key]
+            if now - fetched_at > RANGE_CACHE_TTL:
+                del range_cache[key]
+            elif key[:2] == (device, series) and key[2] <= start and end <= key[3]:
+                range_cache.move_to_end(key)
+                return [row for row in rows if start <= row[0] <= end]
+        return None
+
+    def cache_range(device, series, start, end, rows):
+        range_cache[(device, series, start, end)] = (time.monotonic(), rows)
+        if len(range_cache) > RANGE_CACHE_ENTRIES:
+            range_cache.popitem(last=False)
+
+    def invalidate_ranges(device, series, timestamp):
+        for key in [k for k in range_cache
+                    if k[0] in (device, None) and k[1] == series and k[2] <= timestamp <= k[3]]:
+            del range_cache[key]
 
     # MQTT on_connect and on_message handlers
-    def on_connect(client, userdata, flags, rc):
+    def subscription(topic):
+        return f"$share/{SHARED_GROUP}/{topic}" if SHARED_GROUP else topic
+
+    def on_connect(client, userdata, flags, rc, properties=None):
         if rc == 0:
             print("Connected to MQTT Broker!")
-            client.unsubscribe(MQTT_PUBLISH_TOPIC)
-            client.subscribe(MQTT_PUBLISH_TOPIC)
-            client.subscribe(MQTT_REQUEST_TOPIC)
-            print(f"Subscribed to topics: {MQTT_PUBLISH_TOPIC}, {MQTT_REQUEST_TOPIC}")
+            topics = [MQTT_PUBLISH_TOPIC, DEVICE_PUBLISH_TOPIC, MQTT_REQUEST_TOPIC, DEVICE_REQUEST_TOPIC]
+            client.subscribe([(subscription(topic), 1) for topic in topics])
+            print(f"Subscribed to topics: {', '.join(subscription(topic) for topic in topics)}")
         else:
             print(f"Failed to connect, return code {rc}")
 
     def on_message(client, userdata, msg):
-        nonlocal last_timestamp, last_temperature
-        print(f"Received message on topic {msg.topic}")
         payload = msg.payload.decode('utf-8')
-        print(f"Payload: {payload}")
+        if VERBOSE:
+            print(f"Received message on topic {msg.topic}")
+            print(f"Payload: {payload}")
         if not payload:
             print("Empty payload received; ignoring.")
             return
@@ -57,10 +186,19 @@ def main():
             # Parse message payload as JSON
             data = json.loads(payload)
 
+            device = msg.topic.split('/')[1]
             if msg.topic == MQTT_PUBLISH_TOPIC:
-                handle_incoming_measurement(data)
+                handle_incoming_measurement(LEGACY_DEVICE, data)
             elif msg.topic == MQTT_REQUEST_TOPIC:
-                handle_measurement_request(client, data)
+                handle_measurement_request(client, None, MQTT_RESPONSE_TOPIC, data)
+            elif (mqtt.topic_matches_sub(DEVICE_PUBLISH_TOPIC, msg.topic) or
+                  mqtt.topic_matches_sub(DEVICE_REQUEST_TOPIC, msg.topic)) and \
+                    not DEVICE_ID_PATTERN.match(device):
+                print(f"Invalid device id in topic {msg.topic}; ignoring.")
+            elif mqtt.topic_matches_sub(DEVICE_PUBLISH_TOPIC, msg.topic):
+                handle_incoming_measurement(device, data)
+            elif mqtt.topic_matches_sub(DEVICE_REQUEST_TOPIC, msg.topic):
+                handle_measurement_request(client, device, DEVICE_RESPONSE_TOPIC.format(device=device), data)
             else:
                 print(f"Unknown topic: {msg.topic}")
 
@@ -69,60 +207,66 @@ def main():
         except Exception as e:
             print(f"Error processing message: {e}")
 
-    def handle_incoming_measurement(data):
-        nonlocal last_timestamp, last_temperature
-        # Retrieve timestamp and temperature values from the message
+    def handle_incoming_measurement(device, data):
+        nonlocal dropped_points
+        # Retrieve timestamp (epoch milliseconds), series and value from the message.
+        # Older firmware only sends a "temperature" field.
         timestamp = data.get('timestamp')
-        temperature = data.get('temperature')
+        series = data.get('series', 'temperature')
+        value = data.get('value', data.get('temperature'))
 
-        # Convert temperature to float
-        if temperature is not None:
-            temperature = float(temperature)
+        # Convert value to float
+        if value is not None:
+            value = float(value)
         else:
-            print("Temperature value is missing; ignoring message.")
+            print("Value is missing; ignoring message.")
             return
 
-        # Proceed only if timestamp is present and data is unique
-        if timestamp and (timestamp != last_timestamp or temperature != last_temperature):
-            try:
-                # Create a point and write to InfluxDB
-                point = Point("temperature_esp") \
-                    .field("temperature", temperature) \
-                    .time(timestamp, WritePrecision.S)
-
-                write_api.write(bucket=INFLUXDB_BUCKET,
-                                org=INFLUXDB_ORG, record=point)
-                print(
-                    f"Data stored in InfluxDB: {{'timestamp': {timestamp}, 'temperature': {temperature}}}")
-
-                # Update last stored values to avoid duplicates
-                last_timestamp = timestamp
-                last_temperature = temperature
-            except Exception as e:
-                print(f"Error writing to InfluxDB: {e}")
-        else:
-            print("Duplicate or invalid data received; not storing in InfluxDB.")
+        if not timestamp:
+            print("Timestamp is missing; ignoring message.")
+            return
+        if is_duplicate(device, series, timestamp, value):
+            if VERBOSE:
+                print("Duplicate data received; not storing in InfluxDB.")
+            return
+        invalidate_ranges(device, series, int(timestamp))
+
+        # Each series is its own field; devices are told apart by tag
+        point = Point("temperature_esp") \
+            .tag("device", device) \
+            .field(series, value) \
+            .time(int(timestamp), WritePrecision.MS)
+        try:
+            point_queue.put(point, timeout=BACKPRESSURE_TIMEOUT)
+        except queue.Full:
+            dropped_points += 1
+            # Let a later retry of the same sample through
+            recent_points.pop((device, series, timestamp), None)
+            print(f"Write queue full; dropped point ({dropped_points} dropped so far)")
 
-    def handle_measurement_request(client, data):
+    # `device` is None for the legacy request topic, which is answered across devices
+    def handle_measurement_request(client, device, response_topic, data):
         print(f"Processing measurement request from ESP32: {data}")
         action = data.get('action')
         timestamp = data.get('timestamp')
         request_id = data.get('request_id')
-        print(f"Action: {action}, Timestamp: {timestamp}, Request ID: {request_id}")
+        series = data.get('series', 'temperature')
+        print(f"Action: {action}, Timestamp: {timestamp}, Series: {series}, Request ID: {request_id}")
 
-        if action == 'get_measurement' and timestamp and request_id:
+        if action == 'get_measurement' and timestamp and request_id and series in KNOWN_SERIES:
             # Query InfluxDB for the measurement
-            measurement = query_measurement_from_influxdb(timestamp)
+            measurement = query_measurement_from_influxdb(timestamp, series, device)
             if measurement:
                 # Prepare response payload
                 print(f"Measurement found: {measurement}")
                 response = {
                     'request_id': request_id,
                     'timestamp': measurement['timestamp'],
-                    'temperature': measurement['temperature']
+                    'series': series,
+                    'value': measurement['value']
                 }
                 # Publish the response to ESP32
-                client.publish(MQTT_RESPONSE_TOPIC, json.dumps(response))
+                client.publish(response_topic, json.dumps(response))
                 print(f"Sent measurement response: {response}")
             else:
                 # Measurement not found, send an error response
@@ -132,27 +276,79 @@ def main():
                     'error': 'Measurement not found',
                     'timestamp': timestamp
                 }
-                client.publish(MQTT_RESPONSE_TOPIC, json.dumps(error_response))
+                client.publish(response_topic, json.dumps(error_response))
                 print(f"Measurement not found for timestamp {timestamp}")
+        elif action == 'get_measurement_range' and request_id and series in KNOWN_SERIES:
+            handle_range_request(client, device, response_topic, data, request_id, series)
         else:
             print("Invalid request received; ignoring.")
 
-    def query_measurement_from_influxdb(timestamp):
+    def handle_range_request(client, device, response_topic, data, request_id, series):
         try:
-            timestamp = int(timestamp)
-            start_time = timestamp - 10  # 10 seconds before
-            end_time = timestamp + 10    # 10 seconds after
+            start = int(data['start_timestamp'])
+            end = int(data['end_timestamp'])
+            page_size = max(1, min(int(data.get('page_size', RANGE_PAGE_SIZE)), RANGE_PAGE_SIZE))
+        except (KeyError, TypeError, ValueError):
+            start = end = None
+        if start is None or start > end:
+            client.publish(response_topic, json.dumps(
+                {'request_id': request_id, 'error': 'Invalid range'}))
+            return
+
+        rows = cached_range(device, series, start, end)
+        if rows is None:
+            rows = query_range_from_influxdb(start, end, series, device)
+            if rows is None:
+                client.publish(response_topic, json.dumps(
+                    {'request_id': request_id, 'error': 'Query failed'}))
+                return
+            cache_range(device, series, start, end, rows)
+        else:
+            print(f"Range {start}..{end} of {series} served from cache")
+
+        truncated = len(rows) > RANGE_MAX_POINTS
+        rows = rows[:RANGE_MAX_POINTS]
+        pages = max(1, (len(rows) + page_size - 1) // page_size)
+        for page in range(pages):
+            chunk = rows[page * page_size:(page + 1) * page_size]
+            response = {
+                'request_id': request_id,
+                'series': series,
+                'page': page,
+                'pages': pages,
+                'timestamps': [row[0] for row in chunk],
+                'values': [row[1] for row in chunk]
+            }
+            if truncated and page == pages - 1:
+                response['truncated'] = True
+            client.publish(response_topic, json.dumps(response))
+        print(f"Sent {len(rows)} measurements of {series} in {pages} pages for request {request_id}")
+
+    def device_filter(device):
+        if not device:
+            return ''
+        # Never interpolate anything else into the query; callers turn this into an error reply
+        if not DEVICE_ID_PATTERN.match(device):
+            raise ValueError(f"invalid device id {device!r}")
+        return f'|> filter(fn: (r) => r["device"] == "{device}")'
+
+    def query_measurement_from_influxdb(timestamp, series='temperature', device=None):
+        try:
+            timestamp = int(timestamp)       # epoch milliseconds
+            start_time = timestamp - 10000  # 10 seconds before
+            end_time = timestamp + 10000    # 10 seconds after
 
             # Convert to RFC3339 format
-            start_time_rfc3339 = datetime.fromtimestamp(start_time, tz=timezone.utc).isoformat()
-            end_time_rfc3339 = datetime.fromtimestamp(end_time, tz=timezone.utc).isoformat()
-            timestamp_rfc3339 = datetime.fromtimestamp(timestamp, tz=timezone.utc).isoformat()
+            start_time_rfc3339 = datetime.fromtimestamp(start_time / 1000, tz=timezone.utc).isoformat()
+            end_time_rfc3339 = datetime.fromtimestamp(end_time / 1000, tz=timezone.utc).isoformat()
+            timestamp_rfc3339 = datetime.fromtimestamp(timestamp / 1000, tz=timezone.utc).isoformat()
 
             query = f'''
                 from(bucket: "{INFLUXDB_BUCKET}")
                 |> range(start: time(v: "{start_time_rfc3339}"), stop: time(v: "{end_time_rfc3339}"))
                 |> filter(fn: (r) => r["_measurement"] == "temperature_esp")
-                |> filter(fn: (r) => r["_field"] == "temperature")
+                |> filter(fn: (r) => r["_field"] == "{series}")
+                {device_filter(device)}
                 |> filter(fn: (r) => r._time == time(v: "{timestamp_rfc3339}"))
                 '''
             print(f"Executing InfluxDB query: {query}")
@@ -160,11 +356,11 @@ def main():
             tables = query_api.query(query)
             for table in tables:
                 for record in table.records:
-                    record_timestamp = int(record.get_time().timestamp())
+                    record_timestamp = round(record.get_time().timestamp() * 1000)
                     if record_timestamp == timestamp:
                         return {
                             'timestamp': record_timestamp,
-                            'temperature': record.get_value()
+                            'value': record.get_value()
                         }
             return None
         except Exception as e:
@@ -172,10 +368,40 @@ def main():
             return None
 
 
+    def query_range_from_influxdb(start, end, series='temperature', device=None):
+        try:
+            start_rfc3339 = datetime.fromtimestamp(start / 1000, tz=timezone.utc).isoformat()
+            # range() excludes stop; end is inclusive
+            stop_rfc3339 = datetime.fromtimestamp((end + 1) / 1000, tz=timezone.utc).isoformat()
+
+            query = f'''
+                from(bucket: "{INFLUXDB_BUCKET}")
+                |> range(start: time(v: "{start_rfc3339}"), stop: time(v: "{stop_rfc3339}"))
+                |> filter(fn: (r) => r["_measurement"] == "temperature_esp")
+                |> filter(fn: (r) => r["_field"] == "{series}")
+                {device_filter(device)}
+                |> group()
+                |> keep(columns: ["_time", "_value"])
+                |> sort(columns: ["_time"])
+                |> limit(n: {RANGE_MAX_POINTS + 1})
+                '''
+            print(f"Executing InfluxDB range query: {query}")
+
+            rows = []
+            for table in query_api.query(query):
+                for record in table.records:
+                    rows.append((round(record.get_time().timestamp() * 1000), record.get_value()))
+            rows.sort(key=lambda row: row[0])
+            return rows
+        except Exception as e:
+            print(f"Error querying InfluxDB: {e}")
+            return None
+
 
     # MQTT client setup with error handling
-    mqtt_client = mqtt.Client(client_id="", clean_session=True,
-                              userdata=None, protocol=mqtt.MQTTv311)
+    # Shared subscriptions need MQTT v5 and a distinct client id per worker
+    mqtt_client = mqtt.Client(client_id=f"bridge-{socket.gethostname()}-{worker}",
+                              userdata=None, protocol=mqtt.MQTTv5)
     mqtt_client.username_pw_set("edge_device", "pass101")
     mqtt_client.on_connect = on_connect
     mqtt_client.on_message = on_message
@@ -188,8 +414,23 @@ def main():
     mqtt_client.loop_forever()
 
 
-if __name__ == "__main__":
+def run_worker(worker):
     try:
-        main()
+        main(worker)
     except Exception as e:
         print(f"Application crashed with exception: {e}")
+
+
+if __name__ == "__main__":
+    # Each worker is a separate process with its own MQTT connection and writer;
+    # the broker load-balances the shared subscriptions between them
+    workers = int(os.getenv('BRIDGE_WORKERS', 1))
+    if workers > 1:
+        processes = [multiprocessing.Process(target=run_worker, args=(i,), name=f"bridge-{i}")
+                     for i in range(workers)]
+        for process in processes:
+            process.start()
+        for process in processes:
+            process.join()
+    else:
+        run_worker(0)
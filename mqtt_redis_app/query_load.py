@@ -0,0 +1,240 @@
+
+import argparse
+import json
+import random
+import subprocess
+import threading
+import time
+
+
+# Replays a mix of point, short-range and long-range get_data_range queries
+# against a node's esp32/query topic and reports throughput and end-to-end
+# latency per query type. Every query names its own response_topic under
+# loadtest/<run>/, which is how responses are matched to requests, so it works
+# against any firmware that answers esp32/query: a device through its broker,
+# or with --host-core the host build of the firmware core (host_test/host_node),
+# which is driven over its stdin/stdout instead of MQTT.
+
+QUERY_TOPIC = 'esp32/query'
+SERIES = ('temperature', 'humidity')
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Query load and latency harness")
+    parser.add_argument('--broker', default='localhost', help="the node's device broker")
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--username', default=None)
+    parser.add_argument('--password', default=None)
+    parser.add_argument('--host-core', default=None, metavar='HOST_NODE',
+                        help="run this host_node binary and query it instead of a broker")
+    parser.add_argument('--duration', type=float, default=60, help="seconds to send queries")
+    parser.add_argument('--concurrency', type=int, default=1,
+                        help="queries in flight (closed loop); the firmware answers one at a time")
+    parser.add_argument('--rate', type=float, default=0,
+                        help="fixed queries per second (open loop) instead of --concurrency")
+    parser.add_argument('--timeout', type=float, default=10, help="seconds before a query counts as lost")
+    parser.add_argument('--mix', default='point=6,short=3,long=1',
+                        help="relative weights of point, short (1 min) and long (1 h) ranges")
+    parser.add_argument('--short-ms', type=int, default=60 * 1000)
+    parser.add_argument('--long-ms', type=int, default=3600 * 1000)
+    parser.add_argument('--window-hours', type=float, default=24,
+                        help="queries fall within the last this many hours")
+    parser.add_argument('--interval-ms', type=int, default=20000,
+                        help="sample interval, used to aim point queries at real samples")
+    return parser.parse_args()
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return None
+    index = min(len(sorted_values) - 1, int(round(p / 100 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+class MqttTransport:
+    def __init__(self, args, run_id, on_message):
+        import paho.mqtt.client as mqtt    # not needed for --host-core
+        self.client = mqtt.Client(client_id=run_id, protocol=mqtt.MQTTv311)
+        if args.username:
+            self.client.username_pw_set(args.username, args.password)
+        self.client.on_message = lambda client, userdata, msg: on_message(msg.topic, msg.payload)
+        self.client.connect(args.broker, args.port, 60)
+        self.client.subscribe(f"loadtest/{run_id}/#", qos=0)
+        self.client.loop_start()
+        time.sleep(0.5)
+
+    def publish(self, topic, payload):
+        self.client.publish(topic, payload, qos=0)
+
+    def close(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+class HostCoreTransport:
+    """host_node in a child process: one "<topic>\\t<payload>" line per message each way."""
+
+    def __init__(self, args, on_message):
+        # The node holds the same window of samples the queries aim at
+        self.process = subprocess.Popen(
+            [args.host_core, '--hours', str(args.window_hours), '--interval-ms', str(args.interval_ms)],
+            stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True, bufsize=1)
+        if self.process.stdout.readline().strip() != 'ready':
+            raise RuntimeError(f"{args.host_core} did not start")
+        self.lock = threading.Lock()
+        self.on_message = on_message
+        self.reader = threading.Thread(target=self.read_loop, daemon=True)
+        self.reader.start()
+
+    def read_loop(self):
+        for line in self.process.stdout:
+            topic, _, payload = line.rstrip('\n').partition('\t')
+            self.on_message(topic, payload.encode())
+
+    def publish(self, topic, payload):
+        with self.lock:
+            self.process.stdin.write(f"{topic}\t{payload}\n")
+            self.process.stdin.flush()
+
+    def close(self):
+        self.process.stdin.close()
+        self.process.wait()
+        self.reader.join()
+
+
+class Harness:
+    def __init__(self, args):
+        self.args = args
+        self.run_id = f"q{int(time.time())}"
+        self.lock = threading.Condition()
+        self.pending = {}              # response topic -> (kind, sent_at)
+        self.latencies = {}            # kind -> [ms]
+        self.sent = {}
+        self.not_found = {}            # kind -> error answers (no data in range)
+        self.last_answer = 0
+        self.points = 0
+        self.next_id = 0
+        kinds = dict(item.split('=') for item in args.mix.split(','))
+        self.kinds = list(kinds)
+        self.weights = [float(kinds[k]) for k in self.kinds]
+
+        if args.host_core:
+            self.transport = HostCoreTransport(args, self.on_message)
+        else:
+            self.transport = MqttTransport(args, self.run_id, self.on_message)
+
+    def make_query(self, kind):
+        now = int(time.time() * 1000)
+        window = int(self.args.window_hours * 3600 * 1000)
+        span = {'point': 0, 'short': self.args.short_ms, 'long': self.args.long_ms}[kind]
+        start = now - random.randint(span, max(span, window))
+        if kind == 'point':
+            start -= start % self.args.interval_ms
+        return {
+            'action': 'get_data_range',
+            'series': random.choice(SERIES),
+            'start_timestamp': start,
+            'end_timestamp': start + span,
+        }
+
+    def send_one(self):
+        kind = random.choices(self.kinds, self.weights)[0]
+        query = self.make_query(kind)
+        with self.lock:
+            self.next_id += 1
+            topic = f"loadtest/{self.run_id}/{self.next_id}"
+            self.pending[topic] = (kind, time.monotonic())
+            self.sent[kind] = self.sent.get(kind, 0) + 1
+        query['response_topic'] = topic
+        self.transport.publish(QUERY_TOPIC, json.dumps(query))
+
+    def on_message(self, topic, payload):
+        received = time.monotonic()
+        with self.lock:
+            entry = self.pending.pop(topic, None)
+            if entry is None:
+                return
+            kind, sent_at = entry
+            self.last_answer = received
+            self.latencies.setdefault(kind, []).append((received - sent_at) * 1000)
+            try:
+                data = json.loads(payload)
+                if 'error' in data:
+                    self.not_found[kind] = self.not_found.get(kind, 0) + 1
+                else:
+                    self.points += len(data.get('timestamps', []))
+            except ValueError:
+                self.not_found[kind] = self.not_found.get(kind, 0) + 1
+            self.lock.notify_all()
+
+    def expire(self):
+        # Caller holds the lock
+        now = time.monotonic()
+        for topic in [t for t, (_, sent_at) in self.pending.items() if now - sent_at > self.args.timeout]:
+            del self.pending[topic]
+
+    def run(self):
+        stop = time.monotonic() + self.args.duration
+        start = time.monotonic()
+        if self.args.rate > 0:
+            next_at = start
+            while next_at < stop:
+                delay = next_at - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+                self.send_one()
+                next_at += 1.0 / self.args.rate
+                with self.lock:
+                    self.expire()
+        else:
+            while time.monotonic() < stop:
+                with self.lock:
+                    self.expire()
+                    while len(self.pending) >= self.args.concurrency and time.monotonic() < stop:
+                        self.lock.wait(0.1)
+                        self.expire()
+                if time.monotonic() < stop:
+                    self.send_one()
+        # Give stragglers their full timeout; throughput counts until the last answer
+        deadline = time.monotonic() + self.args.timeout
+        with self.lock:
+            while self.pending and time.monotonic() < deadline:
+                self.lock.wait(0.1)
+            elapsed = max(stop, self.last_answer) - start
+        self.transport.close()
+        return elapsed
+
+    def report(self, elapsed):
+        answered = sum(len(v) for v in self.latencies.values())
+        report = {
+            'duration_s': round(elapsed, 1),
+            'sent': sum(self.sent.values()),
+            'answered': answered,
+            'lost': sum(self.sent.values()) - answered,
+            'queries_per_sec': round(answered / elapsed, 1),
+            'points_returned': self.points,
+            'types': {},
+        }
+        for kind in self.kinds:
+            values = sorted(self.latencies.get(kind, []))
+            report['types'][kind] = {
+                'sent': self.sent.get(kind, 0),
+                'answered': len(values),
+                'not_found': self.not_found.get(kind, 0),
+                'p50_ms': round(percentile(values, 50), 1) if values else None,
+                'p90_ms': round(percentile(values, 90), 1) if values else None,
+                'p99_ms': round(percentile(values, 99), 1) if values else None,
+                'max_ms': round(values[-1], 1) if values else None,
+            }
+        print("QUERY_LOAD " + json.dumps(report))
+
+
+def main():
+    args = parse_args()
+    harness = Harness(args)
+    elapsed = harness.run()
+    harness.report(elapsed)
+
+
+if __name__ == "__main__":
+    main()
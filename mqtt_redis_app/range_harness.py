@@ -0,0 +1,172 @@
+import argparse
+import json
+import sys
+import threading
+import time
+import paho.mqtt.client as mqtt
+from influxdb_client import InfluxDBClient, Point, WritePrecision
+from influxdb_client.client.write_api import SYNCHRONOUS
+
+
+# Checks the bridge's get_measurement_range handling against the compose stack
+# (mosquitto, influxdb and one bridge worker): pages, the window cache, and
+# cache invalidation when a point lands inside a cached window. Exits non-zero
+# if any check fails.
+#
+# The cache is per worker, so run it against a single worker
+# (BRIDGE_WORKERS=1, one app container). Every run uses its own device id,
+# so earlier runs and other traffic do not affect it.
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Range request checks against a running bridge")
+    parser.add_argument('--broker', default='localhost')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--username', default='edge_device')
+    parser.add_argument('--password', default='pass101')
+    parser.add_argument('--influxdb-url', default='http://localhost:8086')
+    parser.add_argument('--influxdb-token', default='my-token')
+    parser.add_argument('--influxdb-org', default='my-org')
+    parser.add_argument('--influxdb-bucket', default='my-bucket')
+    parser.add_argument('--points', type=int, default=450, help="points seeded into the window")
+    parser.add_argument('--page-size', type=int, default=100)
+    parser.add_argument('--timeout', type=float, default=10, help="seconds to wait for an answer")
+    parser.add_argument('--settle', type=float, default=3,
+                        help="seconds for the bridge to write a published point (> INFLUXDB_FLUSH_INTERVAL_MS)")
+    parser.add_argument('--device', default=f"harness{int(time.time())}")
+    return parser.parse_args()
+
+
+class Bridge:
+    """Sends range requests for one device and collects the pages of each answer."""
+
+    def __init__(self, args):
+        self.args = args
+        self.request_topic = f"edge/{args.device}/measurement/request"
+        self.response_topic = f"esp32/{args.device}/measurement/response"
+        self.next_id = 1
+        self.pages = {}
+        self.cond = threading.Condition()
+        self.client = mqtt.Client(client_id=f"{args.device}-harness", protocol=mqtt.MQTTv311)
+        self.client.username_pw_set(args.username, args.password)
+        self.client.on_message = self.on_message
+        self.client.connect(args.broker, args.port, 60)
+        self.client.subscribe(self.response_topic, qos=1)
+        self.client.loop_start()
+
+    def on_message(self, client, userdata, msg):
+        response = json.loads(msg.payload.decode('utf-8'))
+        with self.cond:
+            self.pages.setdefault(response.get('request_id'), []).append(response)
+            self.cond.notify_all()
+
+    def request_range(self, start, end, page_size):
+        """Returns every page of the answer, in arrival order, or None on timeout"""
+        request_id = self.next_id
+        self.next_id += 1
+        self.client.publish(self.request_topic, json.dumps({
+            'action': 'get_measurement_range',
+            'request_id': request_id,
+            'series': 'temperature',
+            'start_timestamp': start,
+            'end_timestamp': end,
+            'page_size': page_size,
+        }), qos=1)
+
+        def complete():
+            pages = self.pages.get(request_id, [])
+            return pages and ('error' in pages[0] or len(pages) >= pages[0]['pages'])
+
+        with self.cond:
+            if not self.cond.wait_for(complete, timeout=self.args.timeout):
+                return None
+            return self.pages.pop(request_id)
+
+    def publish_point(self, timestamp, value):
+        # Goes through the bridge's ingest path, which invalidates cached windows
+        self.client.publish(f"esp32/{self.args.device}/temperature", json.dumps({
+            'timestamp': timestamp, 'series': 'temperature', 'value': value}), qos=1)
+
+    def close(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+class Checks:
+    def __init__(self):
+        self.failed = 0
+
+    def expect(self, name, ok, detail=""):
+        print(f"{'PASS' if ok else 'FAIL'} {name}{': ' + detail if detail and not ok else ''}")
+        self.failed += 0 if ok else 1
+
+
+def timestamps_of(pages):
+    return [ts for page in sorted(pages, key=lambda p: p['page']) for ts in page['timestamps']]
+
+
+def main():
+    args = parse_args()
+    checks = Checks()
+    influx = InfluxDBClient(url=args.influxdb_url, token=args.influxdb_token, org=args.influxdb_org)
+    write_api = influx.write_api(write_options=SYNCHRONOUS)
+
+    def write_direct(timestamps):
+        # Straight into InfluxDB, so the bridge does not see these points
+        points = [Point("temperature_esp").tag("device", args.device).field("temperature", float(i))
+                  .time(ts, WritePrecision.MS) for i, ts in enumerate(timestamps)]
+        write_api.write(bucket=args.influxdb_bucket, org=args.influxdb_org, record=points)
+
+    # One point a second, ending an hour ago
+    start = (int(time.time()) - 3600 - args.points) * 1000
+    seeded = [start + i * 1000 for i in range(args.points)]
+    end = seeded[-1]
+    write_direct(seeded)
+    bridge = Bridge(args)
+
+    # Paging: every point once, in order, split into full pages that echo the request id
+    pages = bridge.request_range(start, end, args.page_size)
+    checks.expect("range answered", pages is not None, "no answer")
+    if pages is not None:
+        expected_pages = (args.points + args.page_size - 1) // args.page_size
+        checks.expect("page count", len(pages) == expected_pages and
+                      all(p['pages'] == expected_pages for p in pages),
+                      f"{len(pages)} pages, expected {expected_pages}")
+        checks.expect("page numbers", sorted(p['page'] for p in pages) == list(range(len(pages))))
+        checks.expect("page sizes", all(len(p['timestamps']) == len(p['values']) <= args.page_size
+                                        for p in pages))
+        checks.expect("all points in order", timestamps_of(pages) == seeded,
+                      f"{len(timestamps_of(pages))} points returned")
+
+    # Caching: a point written behind the bridge's back stays invisible to a window inside
+    # the cached one, since that is answered without querying InfluxDB
+    hidden = start + 500
+    write_direct([hidden])
+    inner_end = seeded[-10]
+    pages = bridge.request_range(start, inner_end, args.page_size)
+    got = timestamps_of(pages) if pages else []
+    checks.expect("sub-window served from cache", pages is not None and hidden not in got and
+                  got == [ts for ts in seeded if ts <= inner_end], "InfluxDB was queried again")
+
+    # Invalidation: a point published through the bridge inside the window drops it from
+    # the cache, so the next request goes to InfluxDB and sees both new points
+    published = start + 1500
+    bridge.publish_point(published, 99.0)
+    time.sleep(args.settle)
+    pages = bridge.request_range(start, end, args.page_size)
+    got = timestamps_of(pages) if pages else []
+    checks.expect("new points visible", published in got and hidden in got,
+                  f"published {'in' if published in got else 'missing'}, "
+                  f"direct write {'in' if hidden in got else 'missing'}")
+
+    # Errors still carry the request id
+    pages = bridge.request_range(end, start, args.page_size)
+    checks.expect("reversed range rejected", pages is not None and pages[0].get('error') == 'Invalid range')
+
+    bridge.close()
+    influx.close()
+    print(f"{checks.failed} checks failed" if checks.failed else "All checks passed")
+    sys.exit(1 if checks.failed else 0)
+
+
+if __name__ == "__main__":
+    main()